@@ -58,6 +58,12 @@ typedef struct FNA3D_Buffer FNA3D_Buffer;
 typedef struct FNA3D_Renderbuffer FNA3D_Renderbuffer;
 typedef struct FNA3D_Effect FNA3D_Effect;
 typedef struct FNA3D_Query FNA3D_Query;
+typedef struct FNA3D_Readback FNA3D_Readback;
+typedef struct FNA3D_BlendStateObject FNA3D_BlendStateObject;
+typedef struct FNA3D_DepthStencilStateObject FNA3D_DepthStencilStateObject;
+typedef struct FNA3D_RasterizerStateObject FNA3D_RasterizerStateObject;
+typedef struct FNA3D_SamplerStateObject FNA3D_SamplerStateObject;
+typedef struct FNA3D_VertexDeclarationObject FNA3D_VertexDeclarationObject;
 
 /* Enumerations, should match XNA 4.0 */
 
@@ -451,6 +457,19 @@ typedef struct FNA3D_RenderTargetBinding
 	FNA3D_Renderbuffer *colorBuffer;
 } FNA3D_RenderTargetBinding;
 
+/* Not part of XNA! This layout matches both DrawElementsIndirectCommand and
+ * VkDrawIndexedIndirectCommand, so an array of these can be uploaded to a
+ * buffer as-is and used with FNA3D_MultiDrawIndexedPrimitivesIndirect.
+ */
+typedef struct FNA3D_DrawIndexedArgs
+{
+	uint32_t indexCount;
+	uint32_t instanceCount;
+	uint32_t startIndex;
+	int32_t baseVertex;
+	uint32_t baseInstance; /* Must be 0! */
+} FNA3D_DrawIndexedArgs;
+
 /* Version API */
 
 #define FNA3D_ABI_VERSION	 0
@@ -485,6 +504,25 @@ FNA3DAPI void FNA3D_HookLogFunctions(
 	FNA3D_LogFunc error
 );
 
+/* Reroutes FNA3D's logging for a single device, overriding the hooks from
+ * FNA3D_HookLogFunctions. Drivers log from many places that never see the
+ * device, so messages are matched to it through the thread it's used from:
+ * call this from the thread that owns the device. Messages logged while the
+ * device is being created still go to the process-wide hooks. Pass NULL for a
+ * function to fall back to the process-wide hook.
+ *
+ * device:	The device whose messages should be rerouted.
+ * info:	Basic logs that might be useful to have stored for support.
+ * warn:	Something went wrong, but it's really just annoying, not fatal.
+ * error:	You better have this stored somewhere because it's crashing now!
+ */
+FNA3DAPI void FNA3D_HookDeviceLogFunctions(
+	FNA3D_Device *device,
+	FNA3D_LogFunc info,
+	FNA3D_LogFunc warn,
+	FNA3D_LogFunc error
+);
+
 /* Init/Quit */
 
 /* Selects the most suitable graphics rendering backend for the system, then
@@ -516,7 +554,39 @@ FNA3DAPI FNA3D_Device* FNA3D_CreateDevice(
 	uint8_t debugMode
 );
 
-/* Destroys a rendering context previously returned by FNA3D_CreateDevice. */
+/* Creates a rendering context that has no window to present to. Everything is
+ * drawn to the faux backbuffer, which can be read with FNA3D_ReadBackbuffer or
+ * FNA3D_RequestReadback. SwapBuffers only ends the frame.
+ *
+ * You do not need to call FNA3D_PrepareWindowAttributes first. The
+ * deviceWindowHandle in presentationParameters is ignored. The
+ * FNA3D_FORCE_DRIVER hint is still respected.
+ *
+ * Headless devices share no driver selection state, so several threads may
+ * each create and use their own device at the same time. Currently only the
+ * OpenGL and Vulkan drivers support this. Devices of different drivers never
+ * wait on each other, but MojoShader keeps one current shader context per
+ * backend, so devices of the same driver still take turns compiling shaders
+ * and building pipelines. D3D11 and Metal support one device per process.
+ *
+ * OpenGL uses an EGL context with no surface (or a 1x1 pbuffer) when libEGL is
+ * available, and a hidden window otherwise. Either way SDL's video subsystem
+ * must be initialized; the "offscreen" and "dummy" video drivers are fine.
+ *
+ * presentationParameters:	The initial device/backbuffer settings.
+ * debugMode:			Enable debugging and backend validation features
+ *				at the cost of reduced overall performance.
+ *
+ * Returns a device ready for use, or NULL if no driver supports headless mode.
+ */
+FNA3DAPI FNA3D_Device* FNA3D_CreateHeadlessDevice(
+	FNA3D_PresentationParameters *presentationParameters,
+	uint8_t debugMode
+);
+
+/* Destroys a rendering context previously returned by FNA3D_CreateDevice or
+ * FNA3D_CreateHeadlessDevice.
+ */
 FNA3DAPI void FNA3D_DestroyDevice(FNA3D_Device *device);
 
 /* Begin/End Frame */
@@ -614,6 +684,53 @@ FNA3DAPI void FNA3D_DrawInstancedPrimitives(
 	FNA3D_IndexElementSize indexElementSize
 );
 
+/* Draws several ranges of the same vertex/index buffers in one call. All of
+ * the draws share the current render state, so this is meant for batches of
+ * same-state draws (tiles, terrain chunks, etc.) that would otherwise each
+ * need their own FNA3D_DrawIndexedPrimitives call.
+ *
+ * Note that baseVertex is passed per-draw here, so the vertex buffer bindings
+ * should be applied with a baseVertex of 0.
+ *
+ * primitiveType:	The primitive topology of the vertex data.
+ * drawArgs:		An array of draw ranges, in index counts.
+ * drawCount:		The number of elements in the drawArgs array.
+ * indices:		The index buffer to bind for these draw calls.
+ * indexElementSize:	The size of the index type for this index buffer.
+ */
+FNA3DAPI void FNA3D_MultiDrawIndexedPrimitives(
+	FNA3D_Device *device,
+	FNA3D_PrimitiveType primitiveType,
+	FNA3D_DrawIndexedArgs *drawArgs,
+	int32_t drawCount,
+	FNA3D_Buffer *indices,
+	FNA3D_IndexElementSize indexElementSize
+);
+
+/* Same as FNA3D_MultiDrawIndexedPrimitives, but the draw ranges are read from
+ * a vertex buffer created with FNA3D_GenVertexBuffer, so they can be written
+ * ahead of time (or reused across frames) without resubmitting them.
+ *
+ * Renderers without native indirect draws will read the buffer back and loop,
+ * which stalls, so check FNA3D_SupportsIndirectDraws before relying on this!
+ *
+ * primitiveType:	The primitive topology of the vertex data.
+ * drawBuffer:		The buffer containing tightly packed FNA3D_DrawIndexedArgs.
+ * offsetInBytes:	The starting offset of the first draw in drawBuffer.
+ * drawCount:		The number of FNA3D_DrawIndexedArgs to read.
+ * indices:		The index buffer to bind for these draw calls.
+ * indexElementSize:	The size of the index type for this index buffer.
+ */
+FNA3DAPI void FNA3D_MultiDrawIndexedPrimitivesIndirect(
+	FNA3D_Device *device,
+	FNA3D_PrimitiveType primitiveType,
+	FNA3D_Buffer *drawBuffer,
+	int32_t offsetInBytes,
+	int32_t drawCount,
+	FNA3D_Buffer *indices,
+	FNA3D_IndexElementSize indexElementSize
+);
+
 /* Draws data from vertex buffers.
  * primitiveType:	The primitive topology of the vertex data.
  * vertexStart:		The starting offset to read from the vertex buffer.
@@ -796,6 +913,116 @@ FNA3DAPI void FNA3D_VerifyVertexSampler(
 	FNA3D_SamplerState *sampler
 );
 
+/* State Objects */
+
+/* The functions above take the full state structs on every call, which means
+ * the renderer has to hash and look up its own state objects each time. If
+ * your states are known ahead of time (as XNA's BlendState and friends are,
+ * once bound), you can bake them into state objects instead. The hash and the
+ * renderer's state are resolved once, so binding becomes a pointer compare.
+ *
+ * State objects belong to the device that created them and must be destroyed
+ * before that device is.
+ */
+
+/* Bakes a blend state for use with FNA3D_SetBlendStateObject.
+ *
+ * blendState:	The parameters to use for color blending.
+ *
+ * Returns a state object to be destroyed with FNA3D_DestroyBlendState.
+ */
+FNA3DAPI FNA3D_BlendStateObject* FNA3D_CreateBlendState(
+	FNA3D_Device *device,
+	FNA3D_BlendState *blendState
+);
+
+/* Bakes a depth/stencil state for use with FNA3D_SetDepthStencilStateObject.
+ *
+ * depthStencilState:	The parameters to use for depth/stencil work.
+ *
+ * Returns a state object to be destroyed with FNA3D_DestroyDepthStencilState.
+ */
+FNA3DAPI FNA3D_DepthStencilStateObject* FNA3D_CreateDepthStencilState(
+	FNA3D_Device *device,
+	FNA3D_DepthStencilState *depthStencilState
+);
+
+/* Bakes a rasterizer state for use with FNA3D_ApplyRasterizerStateObject.
+ *
+ * rasterizerState:	The parameters to use for rasterization work.
+ *
+ * Returns a state object to be destroyed with FNA3D_DestroyRasterizerState.
+ */
+FNA3DAPI FNA3D_RasterizerStateObject* FNA3D_CreateRasterizerState(
+	FNA3D_Device *device,
+	FNA3D_RasterizerState *rasterizerState
+);
+
+/* Bakes a sampler state for use with FNA3D_VerifySamplerObject.
+ *
+ * samplerState:	The parameters to use for texture sampling.
+ *
+ * Returns a state object to be destroyed with FNA3D_DestroySamplerState.
+ */
+FNA3DAPI FNA3D_SamplerStateObject* FNA3D_CreateSamplerState(
+	FNA3D_Device *device,
+	FNA3D_SamplerState *samplerState
+);
+
+/* Frees state objects created by the functions above. These must not be bound
+ * by any future draw calls, but it's fine to destroy them mid-frame.
+ */
+FNA3DAPI void FNA3D_DestroyBlendState(
+	FNA3D_Device *device,
+	FNA3D_BlendStateObject *blendState
+);
+FNA3DAPI void FNA3D_DestroyDepthStencilState(
+	FNA3D_Device *device,
+	FNA3D_DepthStencilStateObject *depthStencilState
+);
+FNA3DAPI void FNA3D_DestroyRasterizerState(
+	FNA3D_Device *device,
+	FNA3D_RasterizerStateObject *rasterizerState
+);
+FNA3DAPI void FNA3D_DestroySamplerState(
+	FNA3D_Device *device,
+	FNA3D_SamplerStateObject *samplerState
+);
+
+/* Same as FNA3D_SetBlendState, but with a pre-baked state object. */
+FNA3DAPI void FNA3D_SetBlendStateObject(
+	FNA3D_Device *device,
+	FNA3D_BlendStateObject *blendState
+);
+
+/* Same as FNA3D_SetDepthStencilState, but with a pre-baked state object. */
+FNA3DAPI void FNA3D_SetDepthStencilStateObject(
+	FNA3D_Device *device,
+	FNA3D_DepthStencilStateObject *depthStencilState
+);
+
+/* Same as FNA3D_ApplyRasterizerState, but with a pre-baked state object. */
+FNA3DAPI void FNA3D_ApplyRasterizerStateObject(
+	FNA3D_Device *device,
+	FNA3D_RasterizerStateObject *rasterizerState
+);
+
+/* Same as FNA3D_VerifySampler, but with a pre-baked state object. */
+FNA3DAPI void FNA3D_VerifySamplerObject(
+	FNA3D_Device *device,
+	int32_t index,
+	FNA3D_Texture *texture,
+	FNA3D_SamplerStateObject *sampler
+);
+
+/* Same as FNA3D_VerifyVertexSampler, but with a pre-baked state object. */
+FNA3DAPI void FNA3D_VerifyVertexSamplerObject(
+	FNA3D_Device *device,
+	int32_t index,
+	FNA3D_Texture *texture,
+	FNA3D_SamplerStateObject *sampler
+);
+
 /* Vertex State */
 
 /* Updates the vertex attribute state to read from a set of vertex buffers. This
@@ -838,6 +1065,73 @@ FNA3DAPI void FNA3D_ApplyVertexDeclaration(
 	int32_t vertexOffset
 );
 
+/* Interned Vertex Declarations */
+
+/* FNA3D_ApplyVertexBufferBindings has to rehash every element of every
+ * declaration each time it is called. Declarations never change once created,
+ * so they can be interned instead: the elements are copied and hashed once,
+ * and identical declarations share one object.
+ *
+ * Declarations belong to the device that created them and must be destroyed
+ * before that device is.
+ */
+
+/* Interns a vertex declaration for use with
+ * FNA3D_ApplyVertexBufferBindingObjects.
+ *
+ * vertexDeclaration:	The vertex layout to intern. The elements are copied, so
+ *			the array may be freed after this call.
+ *
+ * Returns a declaration to be released with FNA3D_DestroyVertexDeclaration.
+ * Each call must be matched with its own Destroy call, even if an identical
+ * declaration was returned.
+ */
+FNA3DAPI FNA3D_VertexDeclarationObject* FNA3D_CreateVertexDeclaration(
+	FNA3D_Device *device,
+	FNA3D_VertexDeclaration *vertexDeclaration
+);
+
+/* Releases a declaration created with FNA3D_CreateVertexDeclaration.
+ *
+ * vertexDeclaration:	The declaration to release.
+ */
+FNA3DAPI void FNA3D_DestroyVertexDeclaration(
+	FNA3D_Device *device,
+	FNA3D_VertexDeclarationObject *vertexDeclaration
+);
+
+/* Gets the ID of an interned declaration. IDs are never reused for the
+ * lifetime of the device, making them useful as sort keys.
+ *
+ * vertexDeclaration:	The declaration to query.
+ *
+ * Returns a 64-bit ID, never 0.
+ */
+FNA3DAPI uint64_t FNA3D_GetVertexDeclarationID(
+	FNA3D_Device *device,
+	FNA3D_VertexDeclarationObject *vertexDeclaration
+);
+
+/* Same as FNA3D_ApplyVertexBufferBindings, but the attribute data for each
+ * binding comes from an interned declaration, so nothing is rehashed.
+ *
+ * bindings:		The vertex buffers to bind. The vertexDeclaration of
+ *			each binding is ignored, the interned layout is used.
+ * declarations:	The interned layout of each binding.
+ * numBindings:		The number of elements in the bindings and
+ *			declarations arrays.
+ * bindingsUpdated:	See FNA3D_ApplyVertexBufferBindings.
+ * baseVertex:		See FNA3D_ApplyVertexBufferBindings.
+ */
+FNA3DAPI void FNA3D_ApplyVertexBufferBindingObjects(
+	FNA3D_Device *device,
+	FNA3D_VertexBufferBinding *bindings,
+	FNA3D_VertexDeclarationObject **declarations,
+	int32_t numBindings,
+	uint8_t bindingsUpdated,
+	int32_t baseVertex
+);
+
 /* Render Targets */
 
 /* Sets the color/depth/stencil buffers to write future draw calls to.
@@ -1106,6 +1400,22 @@ FNA3DAPI void FNA3D_SetTextureDataYUV(
 	int32_t dataLength
 );
 
+/* Regenerates every mipmap level of a texture from its first level, using the
+ * GPU. Upload level 0 with SetTextureData, then call this instead of building
+ * the rest of the mip chain on the CPU.
+ *
+ * The texture must have been created with a levelCount greater than 1, and
+ * must use an uncompressed, color-renderable format. If the device can't
+ * blit the format, the levels are left as they are and a warning is logged;
+ * build the chain on the CPU (FNA3D_Image_GenerateMipChain) in that case.
+ *
+ * texture:	The texture whose mipmap levels will be regenerated.
+ */
+FNA3DAPI void FNA3D_GenerateMipmaps(
+	FNA3D_Device *device,
+	FNA3D_Texture *texture
+);
+
 /* Pulls image data from a 2D texture into client memory. Like any GetData,
  * this is generally asking for a massive CPU/GPU sync point, don't call this
  * unless there's absolutely no other way to use the image data!
@@ -1402,6 +1712,11 @@ typedef struct MOJOSHADER_effectStateChanges MOJOSHADER_effectStateChanges;
 #endif /* _INCL_MOJOSHADER_H_ */
 
 /* Parses and compiles a Direct3D 9 Effects Framework binary.
+ *
+ * The OpenGL driver normally links each shader program on the first draw that
+ * uses it. Set the FNA3D_OPENGL_PRELINK_EFFECTS hint to "1" before creating the
+ * device to link every pass of every technique here instead, moving those
+ * hitches into load time.
  *
  * effectCode:		The D3D9 Effect binary blob.
  * effectCodeLength:	The size (in bytes) of the blob.
@@ -1544,6 +1859,242 @@ FNA3DAPI int32_t FNA3D_QueryPixelCount(
 	FNA3D_Query *query
 );
 
+/* Readbacks */
+
+/* Starts copying image data into renderer memory without waiting for the GPU
+ * to catch up, unlike ReadBackbuffer or GetTextureData2D. Poll the result a
+ * frame or two later to get the data without stalling the pipeline.
+ *
+ * texture:	The texture object being read, or NULL for the backbuffer.
+ * format:	The pixel format of the texture data, ignored for the backbuffer.
+ * x:		The x offset of the subregion being read.
+ * y:		The y offset of the subregion being read.
+ * w:		The width of the subregion being read.
+ * h:		The height of the subregion being read.
+ * level:	The mipmap level being read, ignored for the backbuffer.
+ * dataLength:	The size of the image data in bytes.
+ *
+ * Returns an FNA3D_Readback object, or NULL if the request failed.
+ */
+FNA3DAPI FNA3D_Readback* FNA3D_RequestReadback(
+	FNA3D_Device *device,
+	FNA3D_Texture *texture,
+	FNA3D_SurfaceFormat format,
+	int32_t x,
+	int32_t y,
+	int32_t w,
+	int32_t h,
+	int32_t level,
+	int32_t dataLength
+);
+
+/* Call this until the function returns 1 to get the data for a readback. Once
+ * this returns 1, the readback object is released and must not be used again.
+ *
+ * readback:	The FNA3D_Readback to sync with.
+ * data:	The pointer being filled with the image data, may be NULL to
+ *		release the readback without copying anything.
+ *
+ * Returns 1 when complete, 0 when still in execution.
+ */
+FNA3DAPI uint8_t FNA3D_PollReadback(
+	FNA3D_Device *device,
+	FNA3D_Readback *readback,
+	void* data
+);
+
+/* Frame Capture */
+
+/* Receives a captured frame on the capture thread. This is where slow work
+ * like FNA3D_Image_SavePNG/SaveJPG and file I/O should happen.
+ *
+ * userdata:	The pointer passed to FNA3D_BeginCapture.
+ * frame:	The number of SwapBuffers calls made since capturing began.
+ * width:	The width of the frame, in pixels.
+ * height:	The height of the frame, in pixels.
+ * data:	The RGBA8 pixels, top row first. Only valid during the call!
+ */
+typedef void (FNA3DCALL * FNA3D_CaptureFunc)(
+	void* userdata,
+	uint64_t frame,
+	int32_t width,
+	int32_t height,
+	uint8_t *data
+);
+
+/* Captures the backbuffer every N frames from now on. Each capture is an
+ * asynchronous readback requested at SwapBuffers time, which is handed to a
+ * worker thread once the GPU is done with it, so the render thread never
+ * waits on the readback or the callback. If the callback falls behind,
+ * frames are dropped rather than stalling the game.
+ *
+ * callback:		Called on the capture thread for every captured frame.
+ * userdata:		User pointer passed back to the callback.
+ * everyNFrames:	The capture interval; 1 captures every frame.
+ */
+FNA3DAPI void FNA3D_BeginCapture(
+	FNA3D_Device *device,
+	FNA3D_CaptureFunc callback,
+	void* userdata,
+	int32_t everyNFrames
+);
+
+/* Stops capturing frames. Frames already given to the capture thread are
+ * delivered before this returns; readbacks still on the GPU are discarded.
+ * The callback will not be called after this returns.
+ */
+FNA3DAPI void FNA3D_EndCapture(FNA3D_Device *device);
+
+/* Command Streams */
+
+/* A command stream is a packed sequence of the structs below, each starting
+ * with its FNA3D_StreamCommandType and each starting on an 8-byte boundary
+ * (pad the end of a command up to the next multiple of 8). Pointers inside the
+ * stream are used directly, so they must stay valid just as they would for
+ * the matching FNA3D function.
+ */
+typedef enum FNA3D_StreamCommandType
+{
+	FNA3D_STREAMCOMMAND_CLEAR,			/* FNA3D_StreamClear */
+	FNA3D_STREAMCOMMAND_DRAWINDEXEDPRIMITIVES,	/* FNA3D_StreamDrawIndexed */
+	FNA3D_STREAMCOMMAND_DRAWINSTANCEDPRIMITIVES,	/* FNA3D_StreamDrawIndexed */
+	FNA3D_STREAMCOMMAND_DRAWPRIMITIVES,		/* FNA3D_StreamDraw */
+	FNA3D_STREAMCOMMAND_SETVIEWPORT,		/* FNA3D_StreamSetViewport */
+	FNA3D_STREAMCOMMAND_SETSCISSORRECT,		/* FNA3D_StreamSetScissorRect */
+	FNA3D_STREAMCOMMAND_SETBLENDFACTOR,		/* FNA3D_StreamSetBlendFactor */
+	FNA3D_STREAMCOMMAND_SETMULTISAMPLEMASK,		/* FNA3D_StreamSetValue */
+	FNA3D_STREAMCOMMAND_SETREFERENCESTENCIL,	/* FNA3D_StreamSetValue */
+	FNA3D_STREAMCOMMAND_SETBLENDSTATE,		/* FNA3D_StreamSetBlendState */
+	FNA3D_STREAMCOMMAND_SETDEPTHSTENCILSTATE,	/* FNA3D_StreamSetDepthStencilState */
+	FNA3D_STREAMCOMMAND_APPLYRASTERIZERSTATE,	/* FNA3D_StreamApplyRasterizerState */
+	FNA3D_STREAMCOMMAND_VERIFYSAMPLER,		/* FNA3D_StreamVerifySampler */
+	FNA3D_STREAMCOMMAND_VERIFYVERTEXSAMPLER,	/* FNA3D_StreamVerifySampler */
+	FNA3D_STREAMCOMMAND_APPLYVERTEXBUFFERBINDINGS,	/* FNA3D_StreamApplyVertexBufferBindings */
+	FNA3D_STREAMCOMMAND_SETRENDERTARGETS,		/* FNA3D_StreamSetRenderTargets */
+	FNA3D_STREAMCOMMAND_APPLYEFFECT		/* FNA3D_StreamApplyEffect */
+} FNA3D_StreamCommandType;
+
+typedef struct FNA3D_StreamClear
+{
+	FNA3D_StreamCommandType type;
+	FNA3D_ClearOptions options;
+	FNA3D_Vec4 color;
+	float depth;
+	int32_t stencil;
+} FNA3D_StreamClear;
+
+typedef struct FNA3D_StreamDrawIndexed
+{
+	FNA3D_StreamCommandType type;
+	FNA3D_PrimitiveType primitiveType;
+	int32_t baseVertex;
+	int32_t minVertexIndex;
+	int32_t numVertices;
+	int32_t startIndex;
+	int32_t primitiveCount;
+	int32_t instanceCount; /* Ignored by DRAWINDEXEDPRIMITIVES */
+	FNA3D_IndexElementSize indexElementSize;
+	FNA3D_Buffer *indices;
+} FNA3D_StreamDrawIndexed;
+
+typedef struct FNA3D_StreamDraw
+{
+	FNA3D_StreamCommandType type;
+	FNA3D_PrimitiveType primitiveType;
+	int32_t vertexStart;
+	int32_t primitiveCount;
+} FNA3D_StreamDraw;
+
+typedef struct FNA3D_StreamSetViewport
+{
+	FNA3D_StreamCommandType type;
+	FNA3D_Viewport viewport;
+} FNA3D_StreamSetViewport;
+
+typedef struct FNA3D_StreamSetScissorRect
+{
+	FNA3D_StreamCommandType type;
+	FNA3D_Rect scissor;
+} FNA3D_StreamSetScissorRect;
+
+typedef struct FNA3D_StreamSetBlendFactor
+{
+	FNA3D_StreamCommandType type;
+	FNA3D_Color blendFactor;
+} FNA3D_StreamSetBlendFactor;
+
+typedef struct FNA3D_StreamSetValue
+{
+	FNA3D_StreamCommandType type;
+	int32_t value;
+} FNA3D_StreamSetValue;
+
+typedef struct FNA3D_StreamSetBlendState
+{
+	FNA3D_StreamCommandType type;
+	FNA3D_BlendState blendState;
+} FNA3D_StreamSetBlendState;
+
+typedef struct FNA3D_StreamSetDepthStencilState
+{
+	FNA3D_StreamCommandType type;
+	FNA3D_DepthStencilState depthStencilState;
+} FNA3D_StreamSetDepthStencilState;
+
+typedef struct FNA3D_StreamApplyRasterizerState
+{
+	FNA3D_StreamCommandType type;
+	FNA3D_RasterizerState rasterizerState;
+} FNA3D_StreamApplyRasterizerState;
+
+typedef struct FNA3D_StreamVerifySampler
+{
+	FNA3D_StreamCommandType type;
+	int32_t index;
+	FNA3D_Texture *texture;
+	FNA3D_SamplerState sampler;
+} FNA3D_StreamVerifySampler;
+
+typedef struct FNA3D_StreamApplyVertexBufferBindings
+{
+	FNA3D_StreamCommandType type;
+	int32_t numBindings;
+	int32_t baseVertex;
+	uint8_t bindingsUpdated;
+	FNA3D_VertexBufferBinding *bindings;
+} FNA3D_StreamApplyVertexBufferBindings;
+
+typedef struct FNA3D_StreamSetRenderTargets
+{
+	FNA3D_StreamCommandType type;
+	int32_t numRenderTargets;
+	FNA3D_DepthFormat depthFormat;
+	FNA3D_RenderTargetBinding *renderTargets;
+	FNA3D_Renderbuffer *depthStencilBuffer;
+} FNA3D_StreamSetRenderTargets;
+
+typedef struct FNA3D_StreamApplyEffect
+{
+	FNA3D_StreamCommandType type;
+	uint32_t pass;
+	FNA3D_Effect *effect;
+	MOJOSHADER_effectStateChanges *stateChanges;
+} FNA3D_StreamApplyEffect;
+
+/* Runs a packed stream of state changes and draws in a single call, exactly as
+ * if each command's FNA3D function had been called in order. This lets managed
+ * callers batch a frame's worth of calls into one transition. If a malformed
+ * command is found, an error is logged and the rest of the stream is skipped.
+ *
+ * buffer:	The command stream, which must be 8-byte aligned.
+ * length:	The size of the command stream, in bytes.
+ */
+FNA3DAPI void FNA3D_ExecuteCommandStream(
+	FNA3D_Device *device,
+	uint8_t *buffer,
+	int32_t length
+);
+
 /* Feature Queries */
 
 /* Returns 1 if the renderer natively supports DXT1 texture data. */
@@ -1558,6 +2109,11 @@ FNA3DAPI uint8_t FNA3D_SupportsHardwareInstancing(FNA3D_Device *device);
 /* Returns 1 if the renderer natively supports asynchronous buffer writing. */
 FNA3DAPI uint8_t FNA3D_SupportsNoOverwrite(FNA3D_Device *device);
 
+/* Returns 1 if FNA3D_MultiDrawIndexedPrimitivesIndirect runs on the GPU,
+ * rather than reading the draw buffer back to loop over it.
+ */
+FNA3DAPI uint8_t FNA3D_SupportsIndirectDraws(FNA3D_Device *device);
+
 /* Returns the number of sampler slots supported by the renderer. */
 FNA3DAPI void FNA3D_GetMaxTextureSlots(
 	FNA3D_Device *device,
@@ -1578,6 +2134,48 @@ FNA3DAPI int32_t FNA3D_GetMaxMultiSampleCount(
 	int32_t multiSampleCount
 );
 
+/* Redundant State Filter */
+
+/* Renderers that reapply their full state before every draw can have FNA3D
+ * drop exact repeats before they ever reach the driver. This is off by
+ * default; set the FNA3D_FILTER_REDUNDANT_STATE hint to "1" before creating
+ * the device to turn it on.
+ *
+ * The filter covers blend, depth/stencil, rasterizer and sampler state, as
+ * well as the viewport and scissor rectangle, for both the struct and the
+ * state object entry points.
+ */
+
+typedef struct FNA3D_StateFilterStatistics
+{
+	/* Calls that were made, and how many of those were dropped */
+	uint64_t blendStateCalls;
+	uint64_t blendStateFiltered;
+	uint64_t depthStencilStateCalls;
+	uint64_t depthStencilStateFiltered;
+	uint64_t rasterizerStateCalls;
+	uint64_t rasterizerStateFiltered;
+	uint64_t samplerCalls;
+	uint64_t samplerFiltered;
+	uint64_t viewportCalls;
+	uint64_t viewportFiltered;
+	uint64_t scissorRectCalls;
+	uint64_t scissorRectFiltered;
+} FNA3D_StateFilterStatistics;
+
+/* Gets the redundant state filter's counters. They accumulate from device
+ * creation, so subtract two samples to get per-frame numbers.
+ *
+ * statistics:	Filled with the counters. Everything is 0 if the filter is
+ *		disabled.
+ *
+ * Returns 1 if the filter is enabled for this device, 0 otherwise.
+ */
+FNA3DAPI uint8_t FNA3D_GetStateFilterStatistics(
+	FNA3D_Device *device,
+	FNA3D_StateFilterStatistics *statistics
+);
+
 /* Debugging */
 
 /* Sets an arbitrary string constant to be stored in a rendering API trace,
@@ -54,11 +54,38 @@ typedef void (FNA3DCALL * FNA3D_Image_SkipFunc)(
 );
 typedef int32_t (FNA3DCALL * FNA3D_Image_EOFFunc)(void* context);
 
+/* Reads the dimensions of PNG/JPG/GIF data without decoding it.
+ *
+ * readFunc:	Callback used to pull data from the stream.
+ * skipFunc:	Callback used to seek around a stream.
+ * eofFunc:	Callback used to check that we've reached the end of a stream.
+ * context:	User pointer passed back to the above callbacks.
+ * w:		Filled with the width FNA3D_Image_LoadInto will produce.
+ * h:		Filled with the height FNA3D_Image_LoadInto will produce.
+ * forceW:	Forced width of the image (-1 to ignore).
+ * forceH:	Forced height of the image (-1 to ignore).
+ * zoom:	When forcing dimensions, enable this to crop instead of stretch.
+ *
+ * Returns 1 on success, 0 if the data could not be recognized. This consumes
+ * part of the stream, so rewind it before calling FNA3D_Image_LoadInto!
+ */
+FNA3DAPI uint8_t FNA3D_Image_Info(
+	FNA3D_Image_ReadFunc readFunc,
+	FNA3D_Image_SkipFunc skipFunc,
+	FNA3D_Image_EOFFunc eofFunc,
+	void* context,
+	int32_t *w,
+	int32_t *h,
+	int32_t forceW,
+	int32_t forceH,
+	uint8_t zoom
+);
+
 /* Decodes PNG/JPG/GIF data into raw RGBA8 texture data.
  *
  * readFunc:	Callback used to pull data from the stream.
  * skipFunc:	Callback used to seek around a stream.
- * eofFunc:	Callback used to check that we're reached the end of a stream.
+ * eofFunc:	Callback used to check that we've reached the end of a stream.
  * context:	User pointer passed back to the above callbacks.
  * w:		Filled with the width of the image.
  * h:		Filled with the height of the image.
@@ -67,7 +94,8 @@ typedef int32_t (FNA3DCALL * FNA3D_Image_EOFFunc)(void* context);
  * forceH:	Forced height of the returned image (-1 to ignore).
  * zoom:	When forcing dimensions, enable this to crop instead of stretch.
  *
- * Returns a block of memory suitable for use with FNA3D_SetTextureData2D.
+ * Returns a block of memory suitable for use with FNA3D_SetTextureData2D,
+ * or NULL if decoding failed.
  * Be sure to free the memory with FNA3D_Image_Free after use!
  */
 FNA3DAPI uint8_t* FNA3D_Image_Load(
@@ -83,12 +111,208 @@ FNA3DAPI uint8_t* FNA3D_Image_Load(
 	uint8_t zoom
 );
 
+/* Decodes PNG/JPG/GIF data into caller-provided RGBA8 memory, such as a
+ * mapped staging buffer. Size dst using FNA3D_Image_Info.
+ *
+ * readFunc:	Callback used to pull data from the stream.
+ * skipFunc:	Callback used to seek around a stream.
+ * eofFunc:	Callback used to check that we've reached the end of a stream.
+ * context:	User pointer passed back to the above callbacks.
+ * w:		Filled with the width of the image.
+ * h:		Filled with the height of the image.
+ * forceW:	Forced width of the image (-1 to ignore).
+ * forceH:	Forced height of the image (-1 to ignore).
+ * zoom:	When forcing dimensions, enable this to crop instead of stretch.
+ * premultiply:	Multiply the color channels by alpha.
+ * dst:		The memory to write the RGBA8 image data to.
+ * dstPitch:	The size (in bytes) of each row in dst.
+ * dstLength:	The size (in bytes) of dst.
+ *
+ * Returns 1 on success, 0 if decoding failed or the image does not fit in dst.
+ */
+FNA3DAPI uint8_t FNA3D_Image_LoadInto(
+	FNA3D_Image_ReadFunc readFunc,
+	FNA3D_Image_SkipFunc skipFunc,
+	FNA3D_Image_EOFFunc eofFunc,
+	void* context,
+	int32_t *w,
+	int32_t *h,
+	int32_t forceW,
+	int32_t forceH,
+	uint8_t zoom,
+	uint8_t premultiply,
+	uint8_t *dst,
+	int32_t dstPitch,
+	int32_t dstLength
+);
+
+typedef struct FNA3D_Image_LoadRequest
+{
+	/* Filled in by the caller, see FNA3D_Image_Load */
+	FNA3D_Image_ReadFunc readFunc;
+	FNA3D_Image_SkipFunc skipFunc;
+	FNA3D_Image_EOFFunc eofFunc;
+	void* context;
+	int32_t forceW;
+	int32_t forceH;
+	uint8_t zoom;
+
+	/* Filled in by FNA3D_Image_LoadBatch, pixels is NULL on failure */
+	uint8_t *pixels;
+	int32_t w;
+	int32_t h;
+	int32_t len;
+} FNA3D_Image_LoadRequest;
+
+typedef void (FNA3DCALL * FNA3D_Image_LoadCallback)(
+	void* userdata,
+	FNA3D_Image_LoadRequest *request
+);
+
+/* Decodes many PNG/JPG/GIF streams in parallel, blocking until all of them
+ * are done. Each request's callbacks are only ever called from one thread at
+ * a time, but that thread may not be the calling thread.
+ *
+ * requests:	The streams to decode. Results are written back to each entry.
+ * count:	The number of requests.
+ * threadCount:	The number of threads to decode with, including the calling
+ *		thread (0 to use the CPU count).
+ * callback:	Optional, called from the decoding thread as each image is
+ *		finished, in no particular order.
+ * userdata:	User pointer passed back to the callback.
+ *
+ * Each returned pixels block must be freed with FNA3D_Image_Free after use!
+ */
+FNA3DAPI void FNA3D_Image_LoadBatch(
+	FNA3D_Image_LoadRequest *requests,
+	int32_t count,
+	int32_t threadCount,
+	FNA3D_Image_LoadCallback callback,
+	void* userdata
+);
+
 /* Frees memory returned by FNA3D_Image_Load. (Do NOT free the memory yourself!)
  *
- * mem: A pointer previously returned by FNA3D_Image_Load.
+ * mem: A pointer previously returned by FNA3D_Image_Load or LoadBatch.
  */
 FNA3DAPI void FNA3D_Image_Free(uint8_t *mem);
 
+/* Image Mipmap API */
+
+typedef enum FNA3D_Image_Filter
+{
+	FNA3D_IMAGE_FILTER_BOX,
+	FNA3D_IMAGE_FILTER_BILINEAR,
+	FNA3D_IMAGE_FILTER_LANCZOS
+} FNA3D_Image_Filter;
+
+/* Fills in the mip levels that follow RGBA8 image data, each level being
+ * filtered from the one before it. Channels are filtered independently, so
+ * premultiplied alpha gives the best results.
+ *
+ * data:	The image data. Level 0 must already be filled in, the other
+ *		levels follow it tightly packed.
+ * dataLength:	The size (in bytes) of data.
+ * w:		The width of level 0.
+ * h:		The height of level 0.
+ * levelCount:	The number of levels wanted, including level 0 (0 for all).
+ * filter:	The filter used to downsample each level.
+ *
+ * Returns the number of levels in data, including level 0.
+ */
+FNA3DAPI int32_t FNA3D_Image_GenerateMipChain(
+	uint8_t *data,
+	int32_t dataLength,
+	int32_t w,
+	int32_t h,
+	int32_t levelCount,
+	FNA3D_Image_Filter filter
+);
+
+/* Image Container API */
+
+#define FNA3D_IMAGE_MAX_LEVELS 16
+
+typedef struct FNA3D_Image_Level
+{
+	uint8_t *data;		/* Points into the container data */
+	int32_t dataLength;
+	int32_t width;
+	int32_t height;
+} FNA3D_Image_Level;
+
+typedef struct FNA3D_Image_Texture
+{
+	int32_t format;		/* FNA3D_SurfaceFormat */
+	int32_t width;
+	int32_t height;
+	int32_t levelCount;
+	int32_t faceCount;	/* 6 for cube maps, in FNA3D_CubeMapFace order */
+	FNA3D_Image_Level levels[6][FNA3D_IMAGE_MAX_LEVELS];
+} FNA3D_Image_Texture;
+
+/* Parses a DDS file, pointing each level at its texel data in place.
+ * DXT1/3/5 (including DX10 BC1/2/3), Color, ColorBgraEXT, Bgr565, Bgra5551,
+ * Bgra4444 and Alpha8 2D textures and cube maps are supported.
+ *
+ * data:	The whole file, for example a memory mapped one.
+ * dataLength:	The size (in bytes) of data.
+ * texture:	Filled with the texture description and level views.
+ *
+ * Returns 1 on success, 0 if the file is invalid or unsupported. The level
+ * data can be passed straight to FNA3D_SetTextureData2D/Cube, and stays
+ * valid for as long as data does. Nothing is allocated. Textures larger than
+ * 16384 in either dimension are rejected, and levels below 1x1 are dropped.
+ */
+FNA3DAPI uint8_t FNA3D_Image_LoadDDS(
+	uint8_t *data,
+	int32_t dataLength,
+	FNA3D_Image_Texture *texture
+);
+
+/* Parses a KTX 1.1 file, pointing each level at its texel data in place.
+ * The same formats as FNA3D_Image_LoadDDS are supported. Only little endian
+ * files with tightly packed rows can be used without a copy, so anything
+ * else is rejected.
+ *
+ * data:	The whole file, for example a memory mapped one.
+ * dataLength:	The size (in bytes) of data.
+ * texture:	Filled with the texture description and level views.
+ *
+ * Returns 1 on success, 0 if the file is invalid or unsupported.
+ */
+FNA3DAPI uint8_t FNA3D_Image_LoadKTX(
+	uint8_t *data,
+	int32_t dataLength,
+	FNA3D_Image_Texture *texture
+);
+
+/* Image Compression API */
+
+/* Compresses RGBA8 image data into DXT1 or DXT5 blocks, for example the
+ * output of FNA3D_Image_Load. Only use this if FNA3D_SupportsDXT1 or
+ * FNA3D_SupportsS3TC (respectively) says the device can sample the result.
+ * DXT1 keeps 1-bit alpha, with texels below 50% alpha becoming transparent.
+ *
+ * data:	The raw RGBA8 image data.
+ * w:		The width of the image data.
+ * h:		The height of the image data.
+ * format:	FNA3D_SURFACEFORMAT_DXT1 or FNA3D_SURFACEFORMAT_DXT5.
+ * dst:		Filled with the compressed blocks, which must be at least
+ *		((w + 3) / 4) * ((h + 3) / 4) * 8 bytes for DXT1, 16 for DXT5.
+ * dstLength:	The size (in bytes) of dst.
+ *
+ * Returns 1 on success, 0 if the format is unsupported or dst is too small.
+ */
+FNA3DAPI uint8_t FNA3D_Image_CompressDXT(
+	uint8_t *data,
+	int32_t w,
+	int32_t h,
+	int32_t format,
+	uint8_t *dst,
+	int32_t dstLength
+);
+
 /* Image Write API */
 
 typedef void (FNA3DCALL * FNA3D_Image_WriteFunc)(
@@ -82,36 +82,82 @@ FNA3D_LogFunc FNA3D_LogInfoFunc = FNA3D_Default_LogInfo;
 FNA3D_LogFunc FNA3D_LogWarnFunc = FNA3D_Default_LogWarn;
 FNA3D_LogFunc FNA3D_LogErrorFunc = FNA3D_Default_LogError;
 
+/* Per-device overrides. Drivers log from places that never see a device
+ * pointer, so each thread remembers the device it has hooked.
+ */
+static SDL_SpinLock logDeviceLock = 0;
+static SDL_TLSID logDevice = 0;
+
+static inline FNA3D_Device* FNA3D_INTERNAL_GetLogDevice(void)
+{
+	SDL_TLSID id;
+	SDL_AtomicLock(&logDeviceLock);
+	id = logDevice;
+	SDL_AtomicUnlock(&logDeviceLock);
+	if (id == 0)
+	{
+		return NULL;
+	}
+	return (FNA3D_Device*) SDL_TLSGet(id);
+}
+
 #define MAX_MESSAGE_SIZE 1024
 
 void FNA3D_LogInfo(const char *fmt, ...)
 {
 	char msg[MAX_MESSAGE_SIZE];
+	FNA3D_Device *device;
 	va_list ap;
 	va_start(ap, fmt);
 	SDL_vsnprintf(msg, sizeof(msg), fmt, ap);
 	va_end(ap);
-	FNA3D_LogInfoFunc(msg);
+	device = FNA3D_INTERNAL_GetLogDevice();
+	if (device != NULL && device->logInfo != NULL)
+	{
+		device->logInfo(msg);
+	}
+	else
+	{
+		FNA3D_LogInfoFunc(msg);
+	}
 }
 
 void FNA3D_LogWarn(const char *fmt, ...)
 {
 	char msg[MAX_MESSAGE_SIZE];
+	FNA3D_Device *device;
 	va_list ap;
 	va_start(ap, fmt);
 	SDL_vsnprintf(msg, sizeof(msg), fmt, ap);
 	va_end(ap);
-	FNA3D_LogWarnFunc(msg);
+	device = FNA3D_INTERNAL_GetLogDevice();
+	if (device != NULL && device->logWarn != NULL)
+	{
+		device->logWarn(msg);
+	}
+	else
+	{
+		FNA3D_LogWarnFunc(msg);
+	}
 }
 
 void FNA3D_LogError(const char *fmt, ...)
 {
 	char msg[MAX_MESSAGE_SIZE];
+	FNA3D_Device *device;
 	va_list ap;
 	va_start(ap, fmt);
 	SDL_vsnprintf(msg, sizeof(msg), fmt, ap);
 	va_end(ap);
-	FNA3D_LogErrorFunc(msg);
+	device = FNA3D_INTERNAL_GetLogDevice();
+	if (device != NULL && device->logError != NULL)
+	{
+		device->logError(msg);
+	}
+	else
+	{
+		FNA3D_LogErrorFunc(msg);
+	}
 }
 
 #undef MAX_MESSAGE_SIZE
@@ -126,6 +172,55 @@ void FNA3D_HookLogFunctions(
 	FNA3D_LogErrorFunc = error;
 }
 
+void FNA3D_HookDeviceLogFunctions(
+	FNA3D_Device *device,
+	FNA3D_LogFunc info,
+	FNA3D_LogFunc warn,
+	FNA3D_LogFunc error
+) {
+	if (device == NULL)
+	{
+		return;
+	}
+
+	SDL_AtomicLock(&logDeviceLock);
+	if (logDevice == 0)
+	{
+		logDevice = SDL_TLSCreate();
+	}
+	SDL_AtomicUnlock(&logDeviceLock);
+
+	device->logInfo = info;
+	device->logWarn = warn;
+	device->logError = error;
+	SDL_TLSSet(logDevice, device, NULL);
+}
+
+/* MojoShader Backend Locks */
+
+static SDL_SpinLock shaderBackendGuard = 0;
+static SDL_mutex *shaderBackendLocks[FNA3D_SHADERBACKEND_COUNT];
+
+void FNA3D_LockShaderBackend(FNA3D_ShaderBackend backend)
+{
+	/* Created on first use and kept for the life of the process, so a
+	 * device being destroyed can never pull the lock out from under
+	 * another device's thread.
+	 */
+	SDL_AtomicLock(&shaderBackendGuard);
+	if (shaderBackendLocks[backend] == NULL)
+	{
+		shaderBackendLocks[backend] = SDL_CreateMutex();
+	}
+	SDL_AtomicUnlock(&shaderBackendGuard);
+	SDL_LockMutex(shaderBackendLocks[backend]);
+}
+
+void FNA3D_UnlockShaderBackend(FNA3D_ShaderBackend backend)
+{
+	SDL_UnlockMutex(shaderBackendLocks[backend]);
+}
+
 /* Version API */
 
 uint32_t FNA3D_LinkedVersion(void)
@@ -178,32 +273,766 @@ FNA3DAPI void FNA3D_GetDrawableSize(void* window, int32_t *x, int32_t *y)
 	drivers[selectedDriver]->GetDrawableSize(window, x, y);
 }
 
+/* Frame Capture Internals */
+
+#define MAX_CAPTURE_PENDING	4 /* Readbacks in flight on the GPU */
+#define MAX_CAPTURE_QUEUED	8 /* Frames waiting on the capture thread */
+
+typedef struct FNA3D_Capture FNA3D_Capture;
+typedef struct FNA3D_CaptureFrame FNA3D_CaptureFrame;
+
+struct FNA3D_CaptureFrame
+{
+	FNA3D_Readback *readback;
+	uint64_t frame;
+	int32_t width;
+	int32_t height;
+	uint8_t *data;
+	int32_t dataSize;
+	uint8_t discard; /* Left over from a capture that has ended */
+	FNA3D_CaptureFrame *next; /* linked list */
+};
+
+struct FNA3D_Capture
+{
+	/* Render thread only */
+	uint8_t active;
+	int32_t everyNFrames;
+	uint64_t frameCount;
+	FNA3D_CaptureFrame *pending[MAX_CAPTURE_PENDING]; /* Oldest first */
+	int32_t pendingCount;
+
+	/* Only changed while the capture thread isn't running */
+	FNA3D_CaptureFunc callback;
+	void* userdata;
+	SDL_Thread *thread;
+
+	/* Protected by lock */
+	SDL_mutex *lock;
+	SDL_cond *cond;
+	FNA3D_CaptureFrame *queue;
+	int32_t queueCount;
+	FNA3D_CaptureFrame *freeFrames;
+	uint8_t quit;
+};
+
+static int FNA3D_INTERNAL_CaptureThread(void* data)
+{
+	FNA3D_Capture *capture = (FNA3D_Capture*) data;
+	FNA3D_CaptureFrame *frame;
+
+	SDL_LockMutex(capture->lock);
+	while (1)
+	{
+		while (capture->queue == NULL && !capture->quit)
+		{
+			SDL_CondWait(capture->cond, capture->lock);
+		}
+		if (capture->queue == NULL)
+		{
+			/* Told to quit and nothing left to deliver */
+			break;
+		}
+		frame = capture->queue;
+		capture->queue = frame->next;
+		capture->queueCount -= 1;
+		SDL_UnlockMutex(capture->lock);
+
+		capture->callback(
+			capture->userdata,
+			frame->frame,
+			frame->width,
+			frame->height,
+			frame->data
+		);
+
+		SDL_LockMutex(capture->lock);
+		frame->next = capture->freeFrames;
+		capture->freeFrames = frame;
+	}
+	SDL_UnlockMutex(capture->lock);
+	return 0;
+}
+
+static FNA3D_CaptureFrame* FNA3D_INTERNAL_GetCaptureFrame(
+	FNA3D_Capture *capture,
+	int32_t dataSize
+) {
+	FNA3D_CaptureFrame *frame;
+
+	SDL_LockMutex(capture->lock);
+	frame = capture->freeFrames;
+	if (frame != NULL)
+	{
+		capture->freeFrames = frame->next;
+	}
+	SDL_UnlockMutex(capture->lock);
+
+	if (frame == NULL)
+	{
+		frame = (FNA3D_CaptureFrame*) SDL_malloc(
+			sizeof(FNA3D_CaptureFrame)
+		);
+		SDL_zerop(frame);
+	}
+	if (frame->dataSize < dataSize)
+	{
+		SDL_free(frame->data);
+		frame->data = (uint8_t*) SDL_malloc(dataSize);
+		frame->dataSize = dataSize;
+	}
+	frame->readback = NULL;
+	frame->discard = 0;
+	frame->next = NULL;
+	return frame;
+}
+
+static void FNA3D_INTERNAL_ReleaseCaptureFrame(
+	FNA3D_Capture *capture,
+	FNA3D_CaptureFrame *frame
+) {
+	SDL_LockMutex(capture->lock);
+	frame->next = capture->freeFrames;
+	capture->freeFrames = frame;
+	SDL_UnlockMutex(capture->lock);
+}
+
+static void FNA3D_INTERNAL_DestroyCapture(FNA3D_Capture *capture)
+{
+	FNA3D_CaptureFrame *frame, *next;
+	int32_t i;
+
+	/* The thread is gone by now, readbacks die with the renderer */
+	for (i = 0; i < capture->pendingCount; i += 1)
+	{
+		FNA3D_INTERNAL_ReleaseCaptureFrame(capture, capture->pending[i]);
+	}
+	#define FREE_FRAMES(list) \
+		frame = list; \
+		while (frame != NULL) \
+		{ \
+			next = frame->next; \
+			SDL_free(frame->data); \
+			SDL_free(frame); \
+			frame = next; \
+		}
+	FREE_FRAMES(capture->queue)
+	FREE_FRAMES(capture->freeFrames)
+	#undef FREE_FRAMES
+
+	SDL_DestroyCond(capture->cond);
+	SDL_DestroyMutex(capture->lock);
+	SDL_free(capture);
+}
+
+static void FNA3D_INTERNAL_UpdateCapture(FNA3D_Device *device)
+{
+	FNA3D_Capture *capture = device->capture;
+	FNA3D_CaptureFrame *frame, *curr;
+	int32_t i, w, h;
+
+	/* Hand finished readbacks to the capture thread, in order */
+	while (capture->pendingCount > 0)
+	{
+		frame = capture->pending[0];
+		if (!device->PollReadback(
+			device->driverData,
+			frame->readback,
+			frame->discard ? NULL : frame->data
+		)) {
+			break;
+		}
+
+		capture->pendingCount -= 1;
+		for (i = 0; i < capture->pendingCount; i += 1)
+		{
+			capture->pending[i] = capture->pending[i + 1];
+		}
+
+		if (frame->discard)
+		{
+			FNA3D_INTERNAL_ReleaseCaptureFrame(capture, frame);
+			continue;
+		}
+
+		SDL_LockMutex(capture->lock);
+		if (capture->queueCount < MAX_CAPTURE_QUEUED)
+		{
+			LinkedList_Add(capture->queue, frame, curr);
+			capture->queueCount += 1;
+			SDL_CondSignal(capture->cond);
+		}
+		else
+		{
+			/* The callback can't keep up, drop the frame */
+			frame->next = capture->freeFrames;
+			capture->freeFrames = frame;
+		}
+		SDL_UnlockMutex(capture->lock);
+	}
+
+	if (!capture->active)
+	{
+		/* Ended, just waiting on the GPU to give back the readbacks */
+		if (capture->pendingCount == 0)
+		{
+			FNA3D_INTERNAL_DestroyCapture(capture);
+			device->capture = NULL;
+		}
+		return;
+	}
+
+	if (	(capture->frameCount % capture->everyNFrames) == 0 &&
+		capture->pendingCount < MAX_CAPTURE_PENDING	)
+	{
+		device->GetBackbufferSize(device->driverData, &w, &h);
+		frame = FNA3D_INTERNAL_GetCaptureFrame(capture, w * h * 4);
+		frame->frame = capture->frameCount;
+		frame->width = w;
+		frame->height = h;
+		frame->readback = device->RequestReadback(
+			device->driverData,
+			NULL,
+			FNA3D_SURFACEFORMAT_COLOR,
+			0,
+			0,
+			w,
+			h,
+			0,
+			w * h * 4
+		);
+		if (frame->readback == NULL)
+		{
+			FNA3D_INTERNAL_ReleaseCaptureFrame(capture, frame);
+		}
+		else
+		{
+			capture->pending[capture->pendingCount] = frame;
+			capture->pendingCount += 1;
+		}
+	}
+	capture->frameCount += 1;
+}
+
+/* Redundant State Filter Internals */
+
+#define FILTER_BLENDSTATE		0x01
+#define FILTER_DEPTHSTENCILSTATE	0x02
+#define FILTER_RASTERIZERSTATE		0x04
+#define FILTER_VIEWPORT			0x08
+#define FILTER_SCISSORRECT		0x10
+
+typedef struct FNA3D_StateFilter FNA3D_StateFilter;
+
+struct FNA3D_StateFilter
+{
+	/* FILTER_* bits for which of the shadowed states below are known */
+	uint32_t valid;
+
+	/* The blend factor, multisample mask and reference stencil can change
+	 * underneath these, so the full structs are kept to rehash them.
+	 */
+	FNA3D_BlendState blendState;
+	StateHash blendStateHash;
+	FNA3D_DepthStencilState depthStencilState;
+	StateHash depthStencilStateHash;
+
+	StateHash rasterizerStateHash;
+	FNA3D_Viewport viewport;
+	FNA3D_Rect scissorRect;
+
+	uint8_t samplerValid[MAX_TOTAL_SAMPLERS];
+	FNA3D_Texture *textures[MAX_TOTAL_SAMPLERS];
+	StateHash samplers[MAX_TOTAL_SAMPLERS];
+
+	FNA3D_StateFilterStatistics stats;
+};
+
+static inline uint8_t FNA3D_INTERNAL_StateHashEqual(StateHash a, StateHash b)
+{
+	return a.a == b.a && a.b == b.b;
+}
+
+static void FNA3D_INTERNAL_InvalidateSamplerFilter(FNA3D_StateFilter *filter)
+{
+	SDL_memset(filter->samplerValid, '\0', sizeof(filter->samplerValid));
+}
+
+static void FNA3D_INTERNAL_InvalidateStateFilter(FNA3D_StateFilter *filter)
+{
+	filter->valid = 0;
+	FNA3D_INTERNAL_InvalidateSamplerFilter(filter);
+}
+
+static uint8_t FNA3D_INTERNAL_FilterBlendState(
+	FNA3D_StateFilter *filter,
+	FNA3D_BlendState *blendState,
+	StateHash hash
+) {
+	filter->stats.blendStateCalls += 1;
+	if (	(filter->valid & FILTER_BLENDSTATE) &&
+		FNA3D_INTERNAL_StateHashEqual(hash, filter->blendStateHash)	)
+	{
+		filter->stats.blendStateFiltered += 1;
+		return 1;
+	}
+	filter->blendState = *blendState;
+	filter->blendStateHash = hash;
+	filter->valid |= FILTER_BLENDSTATE;
+	return 0;
+}
+
+static uint8_t FNA3D_INTERNAL_FilterDepthStencilState(
+	FNA3D_StateFilter *filter,
+	FNA3D_DepthStencilState *depthStencilState,
+	StateHash hash
+) {
+	filter->stats.depthStencilStateCalls += 1;
+	if (	(filter->valid & FILTER_DEPTHSTENCILSTATE) &&
+		FNA3D_INTERNAL_StateHashEqual(hash, filter->depthStencilStateHash)	)
+	{
+		filter->stats.depthStencilStateFiltered += 1;
+		return 1;
+	}
+	filter->depthStencilState = *depthStencilState;
+	filter->depthStencilStateHash = hash;
+	filter->valid |= FILTER_DEPTHSTENCILSTATE;
+	return 0;
+}
+
+static uint8_t FNA3D_INTERNAL_FilterRasterizerState(
+	FNA3D_StateFilter *filter,
+	FNA3D_RasterizerState *rasterizerState
+) {
+	StateHash hash = GetRasterizerStateHash(
+		*rasterizerState,
+		rasterizerState->depthBias
+	);
+	filter->stats.rasterizerStateCalls += 1;
+	if (	(filter->valid & FILTER_RASTERIZERSTATE) &&
+		FNA3D_INTERNAL_StateHashEqual(hash, filter->rasterizerStateHash)	)
+	{
+		filter->stats.rasterizerStateFiltered += 1;
+		return 1;
+	}
+	filter->rasterizerStateHash = hash;
+	filter->valid |= FILTER_RASTERIZERSTATE;
+	return 0;
+}
+
+static uint8_t FNA3D_INTERNAL_FilterSampler(
+	FNA3D_StateFilter *filter,
+	int32_t slot,
+	FNA3D_Texture *texture,
+	StateHash hash
+) {
+	int32_t i;
+	filter->stats.samplerCalls += 1;
+	if (	filter->samplerValid[slot] &&
+		filter->textures[slot] == texture &&
+		FNA3D_INTERNAL_StateHashEqual(hash, filter->samplers[slot])	)
+	{
+		filter->stats.samplerFiltered += 1;
+		return 1;
+	}
+
+	/* Some renderers store sampler state on the texture itself, so any
+	 * other slot using this texture can't be trusted anymore.
+	 */
+	if (texture != NULL)
+	{
+		for (i = 0; i < MAX_TOTAL_SAMPLERS; i += 1)
+		{
+			if (filter->textures[i] == texture)
+			{
+				filter->samplerValid[i] = 0;
+			}
+		}
+	}
+
+	filter->samplerValid[slot] = 1;
+	filter->textures[slot] = texture;
+	filter->samplers[slot] = hash;
+	return 0;
+}
+
+static uint8_t FNA3D_INTERNAL_FilterViewport(
+	FNA3D_StateFilter *filter,
+	FNA3D_Viewport *viewport
+) {
+	filter->stats.viewportCalls += 1;
+	if (	(filter->valid & FILTER_VIEWPORT) &&
+		viewport->x == filter->viewport.x &&
+		viewport->y == filter->viewport.y &&
+		viewport->w == filter->viewport.w &&
+		viewport->h == filter->viewport.h &&
+		viewport->minDepth == filter->viewport.minDepth &&
+		viewport->maxDepth == filter->viewport.maxDepth	)
+	{
+		filter->stats.viewportFiltered += 1;
+		return 1;
+	}
+	filter->viewport = *viewport;
+	filter->valid |= FILTER_VIEWPORT;
+	return 0;
+}
+
+static uint8_t FNA3D_INTERNAL_FilterScissorRect(
+	FNA3D_StateFilter *filter,
+	FNA3D_Rect *scissor
+) {
+	filter->stats.scissorRectCalls += 1;
+	if (	(filter->valid & FILTER_SCISSORRECT) &&
+		scissor->x == filter->scissorRect.x &&
+		scissor->y == filter->scissorRect.y &&
+		scissor->w == filter->scissorRect.w &&
+		scissor->h == filter->scissorRect.h	)
+	{
+		filter->stats.scissorRectFiltered += 1;
+		return 1;
+	}
+	filter->scissorRect = *scissor;
+	filter->valid |= FILTER_SCISSORRECT;
+	return 0;
+}
+
+/* Anything that binds textures behind our back (uploads, readbacks, target
+ * resolves) may have clobbered the sampler state we think is bound.
+ */
+static inline void FNA3D_INTERNAL_TexturesTouched(FNA3D_Device *device)
+{
+	if (device->stateFilter != NULL)
+	{
+		FNA3D_INTERNAL_InvalidateSamplerFilter(device->stateFilter);
+	}
+}
+
+static FNA3D_StateFilter* FNA3D_INTERNAL_CreateStateFilter(void)
+{
+	if (!SDL_GetHintBoolean("FNA3D_FILTER_REDUNDANT_STATE", SDL_FALSE))
+	{
+		return NULL;
+	}
+	return (FNA3D_StateFilter*) SDL_calloc(1, sizeof(FNA3D_StateFilter));
+}
+
+/* Effect Cache Internals */
+
+/* Every effect is a clone of a prototype that is compiled once per unique
+ * bytecode. MOJOSHADER_cloneEffect shares the compiled shaders and only copies
+ * the parameter storage, so loading the same effect again is cheap. The
+ * prototypes are never handed out, so their parameters keep the defaults that
+ * a freshly compiled effect would have. Each prototype counts the clones it
+ * has handed out, and goes away along with the last of them.
+ */
+
+typedef struct FNA3D_EffectPrototype FNA3D_EffectPrototype;
+
+struct FNA3D_EffectPrototype
+{
+	uint64_t hash;
+	uint8_t *effectCode;
+	uint32_t effectCodeLength;
+	FNA3D_Effect *effect;
+	int32_t users;
+	FNA3D_EffectPrototype *next;
+};
+
+typedef struct FNA3D_EffectCache
+{
+	/* Only held for lookups, never across driver calls */
+	SDL_mutex *lock;
+	FNA3D_EffectPrototype *prototypes;
+	PackedHashMap clones; /* FNA3D_Effect* -> FNA3D_EffectPrototype* */
+} FNA3D_EffectCache;
+
+static uint64_t FNA3D_INTERNAL_HashEffectCode(
+	uint8_t *effectCode,
+	uint32_t effectCodeLength
+) {
+	/* FNV-1a */
+	uint64_t result = 0xCBF29CE484222325ULL;
+	uint32_t i;
+	for (i = 0; i < effectCodeLength; i += 1)
+	{
+		result = (result ^ effectCode[i]) * 0x00000100000001B3ULL;
+	}
+	return result;
+}
+
+static FNA3D_EffectPrototype* FNA3D_INTERNAL_FindEffectPrototype(
+	FNA3D_EffectCache *cache,
+	uint8_t *effectCode,
+	uint32_t effectCodeLength,
+	uint64_t hash
+) {
+	FNA3D_EffectPrototype *result;
+
+	SDL_LockMutex(cache->lock);
+	result = cache->prototypes;
+	while (result != NULL)
+	{
+		if (	result->hash == hash &&
+			result->effectCodeLength == effectCodeLength &&
+			SDL_memcmp(
+				result->effectCode,
+				effectCode,
+				effectCodeLength
+			) == 0	)
+		{
+			/* Taken now, before anyone can dispose of it */
+			result->users += 1;
+			break;
+		}
+		result = result->next;
+	}
+	SDL_UnlockMutex(cache->lock);
+	return result;
+}
+
+static FNA3D_EffectPrototype* FNA3D_INTERNAL_AddEffectPrototype(
+	FNA3D_EffectCache *cache,
+	uint8_t *effectCode,
+	uint32_t effectCodeLength,
+	uint64_t hash,
+	FNA3D_Effect *effect
+) {
+	FNA3D_EffectPrototype *result;
+
+	result = (FNA3D_EffectPrototype*) SDL_malloc(
+		sizeof(FNA3D_EffectPrototype)
+	);
+	result->hash = hash;
+	result->effectCode = (uint8_t*) SDL_malloc(effectCodeLength);
+	SDL_memcpy(result->effectCode, effectCode, effectCodeLength);
+	result->effectCodeLength = effectCodeLength;
+	result->effect = effect;
+	result->users = 1;
+
+	/* If another thread beat us here, both stick around. That's fine. */
+	SDL_LockMutex(cache->lock);
+	result->next = cache->prototypes;
+	cache->prototypes = result;
+	SDL_UnlockMutex(cache->lock);
+
+	return result;
+}
+
+static void FNA3D_INTERNAL_AddEffectClone(
+	FNA3D_EffectCache *cache,
+	FNA3D_Effect *effect,
+	FNA3D_EffectPrototype *prototype
+) {
+	uint64_t key = (uint64_t) (size_t) effect;
+
+	SDL_LockMutex(cache->lock);
+	PackedHashMap_Put(&cache->clones, &key, prototype);
+	SDL_UnlockMutex(cache->lock);
+}
+
+/* Returns the prototype if this was its last clone, for the caller to dispose */
+static FNA3D_EffectPrototype* FNA3D_INTERNAL_RemoveEffectClone(
+	FNA3D_EffectCache *cache,
+	FNA3D_Effect *effect
+) {
+	FNA3D_EffectPrototype *result, *curr, *prev;
+	uint64_t key = (uint64_t) (size_t) effect;
+
+	SDL_LockMutex(cache->lock);
+	result = (FNA3D_EffectPrototype*) PackedHashMap_Get(&cache->clones, &key);
+	if (result == NULL)
+	{
+		/* Broken effects and FNA3D_CloneEffect results aren't tracked */
+		SDL_UnlockMutex(cache->lock);
+		return NULL;
+	}
+	PackedHashMap_Remove(&cache->clones, &key);
+
+	result->users -= 1;
+	if (result->users > 0)
+	{
+		SDL_UnlockMutex(cache->lock);
+		return NULL;
+	}
+
+	prev = NULL;
+	curr = cache->prototypes;
+	while (curr != result)
+	{
+		prev = curr;
+		curr = curr->next;
+	}
+	if (prev == NULL)
+	{
+		cache->prototypes = result->next;
+	}
+	else
+	{
+		prev->next = result->next;
+	}
+	SDL_UnlockMutex(cache->lock);
+	return result;
+}
+
+static FNA3D_EffectCache* FNA3D_INTERNAL_CreateEffectCache(void)
+{
+	FNA3D_EffectCache *result = (FNA3D_EffectCache*) SDL_malloc(
+		sizeof(FNA3D_EffectCache)
+	);
+	result->lock = SDL_CreateMutex();
+	result->prototypes = NULL;
+	PackedHashMap_Init(&result->clones, 1);
+	return result;
+}
+
+static void FNA3D_INTERNAL_DestroyEffectCache(FNA3D_Device *device)
+{
+	FNA3D_EffectCache *cache = device->effectCache;
+	FNA3D_EffectPrototype *next;
+
+	while (cache->prototypes != NULL)
+	{
+		next = cache->prototypes->next;
+		device->AddDisposeEffect(
+			device->driverData,
+			cache->prototypes->effect
+		);
+		SDL_free(cache->prototypes->effectCode);
+		SDL_free(cache->prototypes);
+		cache->prototypes = next;
+	}
+	PackedHashMap_Free(&cache->clones);
+	SDL_DestroyMutex(cache->lock);
+	SDL_free(cache);
+	device->effectCache = NULL;
+}
+
 /* Init/Quit */
 
 FNA3D_Device* FNA3D_CreateDevice(
 	FNA3D_PresentationParameters *presentationParameters,
 	uint8_t debugMode
 ) {
+	FNA3D_Device *result;
+
 	if (selectedDriver < 0)
 	{
 		FNA3D_LogError("Call FNA3D_PrepareWindowAttributes first!");
 		return NULL;
 	}
 
-	return drivers[selectedDriver]->CreateDevice(
+	result = drivers[selectedDriver]->CreateDevice(
 		presentationParameters,
 		debugMode
 	);
+	if (result == NULL)
+	{
+		return NULL;
+	}
+	result->capture = NULL;
+	result->stateFilter = FNA3D_INTERNAL_CreateStateFilter();
+	result->vertexDeclarations = NULL;
+	result->nextVertexDeclarationID = 1;
+	result->vertexDeclarationLock = SDL_CreateMutex();
+	result->vertexDeclarationBindings = NULL;
+	result->vertexDeclarationBindingCapacity = 0;
+	result->effectCache = FNA3D_INTERNAL_CreateEffectCache();
+	result->logInfo = NULL;
+	result->logWarn = NULL;
+	result->logError = NULL;
+	return result;
+}
+
+FNA3D_Device* FNA3D_CreateHeadlessDevice(
+	FNA3D_PresentationParameters *presentationParameters,
+	uint8_t debugMode
+) {
+	FNA3D_Device *result = NULL;
+	uint32_t i;
+	const char *hint = SDL_GetHint("FNA3D_FORCE_DRIVER");
+
+	/* Headless devices don't touch selectedDriver, so any number of them
+	 * can be created from any number of threads.
+	 */
+	for (i = 0; drivers[i] != NULL; i += 1)
+	{
+		if (hint != NULL)
+		{
+			if (SDL_strcmp(hint, drivers[i]->Name) != 0)
+			{
+				continue;
+			}
+		}
+		if (drivers[i]->CreateHeadlessDevice == NULL)
+		{
+			continue;
+		}
+		result = drivers[i]->CreateHeadlessDevice(
+			presentationParameters,
+			debugMode
+		);
+		if (result != NULL)
+		{
+			break;
+		}
+	}
+	if (result == NULL)
+	{
+		FNA3D_LogError("No headless FNA3D driver found!");
+		return NULL;
+	}
+	result->capture = NULL;
+	result->stateFilter = FNA3D_INTERNAL_CreateStateFilter();
+	result->vertexDeclarations = NULL;
+	result->nextVertexDeclarationID = 1;
+	result->vertexDeclarationLock = SDL_CreateMutex();
+	result->vertexDeclarationBindings = NULL;
+	result->vertexDeclarationBindingCapacity = 0;
+	result->effectCache = FNA3D_INTERNAL_CreateEffectCache();
+	result->logInfo = NULL;
+	result->logWarn = NULL;
+	result->logError = NULL;
+	return result;
 }
 
 void FNA3D_DestroyDevice(FNA3D_Device *device)
 {
+	FNA3D_VertexDeclarationObject *next;
 	if (device == NULL)
 	{
 		return;
 	}
 
+	if (device->capture != NULL)
+	{
+		FNA3D_EndCapture(device);
+		if (device->capture != NULL)
+		{
+			FNA3D_INTERNAL_DestroyCapture(device->capture);
+			device->capture = NULL;
+		}
+	}
+
+	while (device->vertexDeclarations != NULL)
+	{
+		next = device->vertexDeclarations->next;
+		SDL_free(device->vertexDeclarations->declaration.elements);
+		SDL_free(device->vertexDeclarations);
+		device->vertexDeclarations = next;
+	}
+	SDL_DestroyMutex(device->vertexDeclarationLock);
+	SDL_free(device->vertexDeclarationBindings);
+
+	SDL_free(device->stateFilter);
+
+	FNA3D_INTERNAL_DestroyEffectCache(device);
+
 	device->DestroyDevice(device);
+
+	if (FNA3D_INTERNAL_GetLogDevice() == device)
+	{
+		SDL_TLSSet(logDevice, NULL, NULL);
+	}
 }
 
 /* Begin/End Frame */
@@ -214,6 +1043,10 @@ void FNA3D_BeginFrame(FNA3D_Device *device)
 	{
 		return;
 	}
+	if (device->stateFilter != NULL)
+	{
+		FNA3D_INTERNAL_InvalidateStateFilter(device->stateFilter);
+	}
 	device->BeginFrame(device->driverData);
 }
 
@@ -227,6 +1060,16 @@ void FNA3D_SwapBuffers(
 	{
 		return;
 	}
+	if (device->capture != NULL)
+	{
+		/* The backbuffer has to be read before it's presented */
+		FNA3D_INTERNAL_UpdateCapture(device);
+	}
+	if (device->stateFilter != NULL)
+	{
+		/* The blit to the window may go through the renderer's state */
+		FNA3D_INTERNAL_InvalidateStateFilter(device->stateFilter);
+	}
 	device->SwapBuffers(
 		device->driverData,
 		sourceRectangle,
@@ -320,6 +1163,52 @@ void FNA3D_DrawInstancedPrimitives(
 	);
 }
 
+void FNA3D_MultiDrawIndexedPrimitives(
+	FNA3D_Device *device,
+	FNA3D_PrimitiveType primitiveType,
+	FNA3D_DrawIndexedArgs *drawArgs,
+	int32_t drawCount,
+	FNA3D_Buffer *indices,
+	FNA3D_IndexElementSize indexElementSize
+) {
+	if (device == NULL || drawCount <= 0)
+	{
+		return;
+	}
+	device->MultiDrawIndexedPrimitives(
+		device->driverData,
+		primitiveType,
+		drawArgs,
+		drawCount,
+		indices,
+		indexElementSize
+	);
+}
+
+void FNA3D_MultiDrawIndexedPrimitivesIndirect(
+	FNA3D_Device *device,
+	FNA3D_PrimitiveType primitiveType,
+	FNA3D_Buffer *drawBuffer,
+	int32_t offsetInBytes,
+	int32_t drawCount,
+	FNA3D_Buffer *indices,
+	FNA3D_IndexElementSize indexElementSize
+) {
+	if (device == NULL || drawCount <= 0)
+	{
+		return;
+	}
+	device->MultiDrawIndexedPrimitivesIndirect(
+		device->driverData,
+		primitiveType,
+		drawBuffer,
+		offsetInBytes,
+		drawCount,
+		indices,
+		indexElementSize
+	);
+}
+
 void FNA3D_DrawPrimitives(
 	FNA3D_Device *device,
 	FNA3D_PrimitiveType primitiveType,
@@ -394,6 +1283,11 @@ void FNA3D_SetViewport(FNA3D_Device *device, FNA3D_Viewport *viewport)
 	{
 		return;
 	}
+	if (	device->stateFilter != NULL &&
+		FNA3D_INTERNAL_FilterViewport(device->stateFilter, viewport)	)
+	{
+		return;
+	}
 	device->SetViewport(device->driverData, viewport);
 }
 
@@ -403,6 +1297,11 @@ void FNA3D_SetScissorRect(FNA3D_Device *device, FNA3D_Rect *scissor)
 	{
 		return;
 	}
+	if (	device->stateFilter != NULL &&
+		FNA3D_INTERNAL_FilterScissorRect(device->stateFilter, scissor)	)
+	{
+		return;
+	}
 	device->SetScissorRect(device->driverData, scissor);
 }
 
@@ -425,6 +1324,14 @@ void FNA3D_SetBlendFactor(
 	{
 		return;
 	}
+	if (	device->stateFilter != NULL &&
+		(device->stateFilter->valid & FILTER_BLENDSTATE)	)
+	{
+		device->stateFilter->blendState.blendFactor = *blendFactor;
+		device->stateFilter->blendStateHash = GetBlendStateHash(
+			device->stateFilter->blendState
+		);
+	}
 	device->SetBlendFactor(device->driverData, blendFactor);
 }
 
@@ -443,6 +1350,14 @@ void FNA3D_SetMultiSampleMask(FNA3D_Device *device, int32_t mask)
 	{
 		return;
 	}
+	if (	device->stateFilter != NULL &&
+		(device->stateFilter->valid & FILTER_BLENDSTATE)	)
+	{
+		device->stateFilter->blendState.multiSampleMask = mask;
+		device->stateFilter->blendStateHash = GetBlendStateHash(
+			device->stateFilter->blendState
+		);
+	}
 	device->SetMultiSampleMask(device->driverData, mask);
 }
 
@@ -461,6 +1376,14 @@ void FNA3D_SetReferenceStencil(FNA3D_Device *device, int32_t ref)
 	{
 		return;
 	}
+	if (	device->stateFilter != NULL &&
+		(device->stateFilter->valid & FILTER_DEPTHSTENCILSTATE)	)
+	{
+		device->stateFilter->depthStencilState.referenceStencil = ref;
+		device->stateFilter->depthStencilStateHash = GetDepthStencilStateHash(
+			device->stateFilter->depthStencilState
+		);
+	}
 	device->SetReferenceStencil(device->driverData, ref);
 }
 
@@ -474,6 +1397,15 @@ void FNA3D_SetBlendState(
 	{
 		return;
 	}
+	if (	device->stateFilter != NULL &&
+		FNA3D_INTERNAL_FilterBlendState(
+			device->stateFilter,
+			blendState,
+			GetBlendStateHash(*blendState)
+		)	)
+	{
+		return;
+	}
 	device->SetBlendState(device->driverData, blendState);
 }
 
@@ -485,6 +1417,15 @@ void FNA3D_SetDepthStencilState(
 	{
 		return;
 	}
+	if (	device->stateFilter != NULL &&
+		FNA3D_INTERNAL_FilterDepthStencilState(
+			device->stateFilter,
+			depthStencilState,
+			GetDepthStencilStateHash(*depthStencilState)
+		)	)
+	{
+		return;
+	}
 	device->SetDepthStencilState(device->driverData, depthStencilState);
 }
 
@@ -496,33 +1437,281 @@ void FNA3D_ApplyRasterizerState(
 	{
 		return;
 	}
+	if (	device->stateFilter != NULL &&
+		FNA3D_INTERNAL_FilterRasterizerState(
+			device->stateFilter,
+			rasterizerState
+		)	)
+	{
+		return;
+	}
 	device->ApplyRasterizerState(device->driverData, rasterizerState);
 }
 
-void FNA3D_VerifySampler(
+void FNA3D_VerifySampler(
+	FNA3D_Device *device,
+	int32_t index,
+	FNA3D_Texture *texture,
+	FNA3D_SamplerState *sampler
+) {
+	if (device == NULL)
+	{
+		return;
+	}
+	if (	device->stateFilter != NULL &&
+		FNA3D_INTERNAL_FilterSampler(
+			device->stateFilter,
+			index,
+			texture,
+			GetSamplerStateHash(*sampler)
+		)	)
+	{
+		return;
+	}
+	device->VerifySampler(device->driverData, index, texture, sampler);
+}
+
+void FNA3D_VerifyVertexSampler(
+	FNA3D_Device *device,
+	int32_t index,
+	FNA3D_Texture *texture,
+	FNA3D_SamplerState *sampler
+) {
+	if (device == NULL)
+	{
+		return;
+	}
+	if (	device->stateFilter != NULL &&
+		FNA3D_INTERNAL_FilterSampler(
+			device->stateFilter,
+			MAX_TEXTURE_SAMPLERS + index,
+			texture,
+			GetSamplerStateHash(*sampler)
+		)	)
+	{
+		return;
+	}
+	device->VerifyVertexSampler(device->driverData, index, texture, sampler);
+}
+
+/* State Objects */
+
+FNA3D_BlendStateObject* FNA3D_CreateBlendState(
+	FNA3D_Device *device,
+	FNA3D_BlendState *blendState
+) {
+	FNA3D_BlendStateObject *result;
+	if (device == NULL)
+	{
+		return NULL;
+	}
+	result = (FNA3D_BlendStateObject*) SDL_malloc(
+		sizeof(FNA3D_BlendStateObject)
+	);
+	result->state = *blendState;
+	result->hash = GetBlendStateHash(*blendState);
+	result->driverState = NULL;
+	return result;
+}
+
+FNA3D_DepthStencilStateObject* FNA3D_CreateDepthStencilState(
+	FNA3D_Device *device,
+	FNA3D_DepthStencilState *depthStencilState
+) {
+	FNA3D_DepthStencilStateObject *result;
+	if (device == NULL)
+	{
+		return NULL;
+	}
+	result = (FNA3D_DepthStencilStateObject*) SDL_malloc(
+		sizeof(FNA3D_DepthStencilStateObject)
+	);
+	result->state = *depthStencilState;
+	result->hash = GetDepthStencilStateHash(*depthStencilState);
+	result->driverState = NULL;
+	return result;
+}
+
+FNA3D_RasterizerStateObject* FNA3D_CreateRasterizerState(
+	FNA3D_Device *device,
+	FNA3D_RasterizerState *rasterizerState
+) {
+	FNA3D_RasterizerStateObject *result;
+	if (device == NULL)
+	{
+		return NULL;
+	}
+	result = (FNA3D_RasterizerStateObject*) SDL_calloc(
+		1,
+		sizeof(FNA3D_RasterizerStateObject)
+	);
+	result->state = *rasterizerState;
+	return result;
+}
+
+FNA3D_SamplerStateObject* FNA3D_CreateSamplerState(
+	FNA3D_Device *device,
+	FNA3D_SamplerState *samplerState
+) {
+	FNA3D_SamplerStateObject *result;
+	if (device == NULL)
+	{
+		return NULL;
+	}
+	result = (FNA3D_SamplerStateObject*) SDL_malloc(
+		sizeof(FNA3D_SamplerStateObject)
+	);
+	result->state = *samplerState;
+	result->hash = GetSamplerStateHash(*samplerState);
+	result->driverState = NULL;
+	result->driverHandle = 0;
+	return result;
+}
+
+/* The driver objects are owned by the renderer's caches, not by us */
+
+void FNA3D_DestroyBlendState(
+	FNA3D_Device *device,
+	FNA3D_BlendStateObject *blendState
+) {
+	SDL_free(blendState);
+}
+
+void FNA3D_DestroyDepthStencilState(
+	FNA3D_Device *device,
+	FNA3D_DepthStencilStateObject *depthStencilState
+) {
+	SDL_free(depthStencilState);
+}
+
+void FNA3D_DestroyRasterizerState(
+	FNA3D_Device *device,
+	FNA3D_RasterizerStateObject *rasterizerState
+) {
+	SDL_free(rasterizerState);
+}
+
+void FNA3D_DestroySamplerState(
+	FNA3D_Device *device,
+	FNA3D_SamplerStateObject *samplerState
+) {
+	SDL_free(samplerState);
+}
+
+void FNA3D_SetBlendStateObject(
+	FNA3D_Device *device,
+	FNA3D_BlendStateObject *blendState
+) {
+	if (device == NULL)
+	{
+		return;
+	}
+	if (	device->stateFilter != NULL &&
+		FNA3D_INTERNAL_FilterBlendState(
+			device->stateFilter,
+			&blendState->state,
+			blendState->hash
+		)	)
+	{
+		return;
+	}
+	device->SetBlendStateObject(device->driverData, blendState);
+}
+
+void FNA3D_SetDepthStencilStateObject(
+	FNA3D_Device *device,
+	FNA3D_DepthStencilStateObject *depthStencilState
+) {
+	if (device == NULL)
+	{
+		return;
+	}
+	if (	device->stateFilter != NULL &&
+		FNA3D_INTERNAL_FilterDepthStencilState(
+			device->stateFilter,
+			&depthStencilState->state,
+			depthStencilState->hash
+		)	)
+	{
+		return;
+	}
+	device->SetDepthStencilStateObject(
+		device->driverData,
+		depthStencilState
+	);
+}
+
+void FNA3D_ApplyRasterizerStateObject(
+	FNA3D_Device *device,
+	FNA3D_RasterizerStateObject *rasterizerState
+) {
+	if (device == NULL)
+	{
+		return;
+	}
+	if (	device->stateFilter != NULL &&
+		FNA3D_INTERNAL_FilterRasterizerState(
+			device->stateFilter,
+			&rasterizerState->state
+		)	)
+	{
+		return;
+	}
+	device->ApplyRasterizerStateObject(
+		device->driverData,
+		rasterizerState
+	);
+}
+
+void FNA3D_VerifySamplerObject(
 	FNA3D_Device *device,
 	int32_t index,
 	FNA3D_Texture *texture,
-	FNA3D_SamplerState *sampler
+	FNA3D_SamplerStateObject *sampler
 ) {
 	if (device == NULL)
 	{
 		return;
 	}
-	device->VerifySampler(device->driverData, index, texture, sampler);
+	if (	device->stateFilter != NULL &&
+		FNA3D_INTERNAL_FilterSampler(
+			device->stateFilter,
+			index,
+			texture,
+			sampler->hash
+		)	)
+	{
+		return;
+	}
+	device->VerifySamplerObject(device->driverData, index, texture, sampler);
 }
 
-void FNA3D_VerifyVertexSampler(
+void FNA3D_VerifyVertexSamplerObject(
 	FNA3D_Device *device,
 	int32_t index,
 	FNA3D_Texture *texture,
-	FNA3D_SamplerState *sampler
+	FNA3D_SamplerStateObject *sampler
 ) {
 	if (device == NULL)
 	{
 		return;
 	}
-	device->VerifyVertexSampler(device->driverData, index, texture, sampler);
+	if (	device->stateFilter != NULL &&
+		FNA3D_INTERNAL_FilterSampler(
+			device->stateFilter,
+			MAX_TEXTURE_SAMPLERS + index,
+			texture,
+			sampler->hash
+		)	)
+	{
+		return;
+	}
+	device->VerifyVertexSamplerObject(
+		device->driverData,
+		index,
+		texture,
+		sampler
+	);
 }
 
 /* Vertex State */
@@ -541,6 +1730,7 @@ void FNA3D_ApplyVertexBufferBindings(
 	device->ApplyVertexBufferBindings(
 		device->driverData,
 		bindings,
+		NULL,
 		numBindings,
 		bindingsUpdated,
 		baseVertex
@@ -565,6 +1755,158 @@ void FNA3D_ApplyVertexDeclaration(
 	);
 }
 
+/* Interned Vertex Declarations */
+
+FNA3D_VertexDeclarationObject* FNA3D_CreateVertexDeclaration(
+	FNA3D_Device *device,
+	FNA3D_VertexDeclaration *vertexDeclaration
+) {
+	FNA3D_VertexDeclarationObject *result, *curr;
+	uint64_t hash;
+	int32_t elementsSize;
+	if (device == NULL)
+	{
+		return NULL;
+	}
+
+	/* Is this declaration already interned? */
+	elementsSize = (
+		vertexDeclaration->elementCount *
+		sizeof(FNA3D_VertexElement)
+	);
+	hash = GetVertexDeclarationHash(*vertexDeclaration, NULL);
+	SDL_LockMutex(device->vertexDeclarationLock);
+	for (curr = device->vertexDeclarations; curr != NULL; curr = curr->next)
+	{
+		if (	curr->hash == hash &&
+			curr->declaration.vertexStride == vertexDeclaration->vertexStride &&
+			curr->declaration.elementCount == vertexDeclaration->elementCount &&
+			SDL_memcmp(
+				curr->declaration.elements,
+				vertexDeclaration->elements,
+				elementsSize
+			) == 0	)
+		{
+			SDL_AtomicIncRef(&curr->refcount);
+			SDL_UnlockMutex(device->vertexDeclarationLock);
+			return curr;
+		}
+	}
+
+	result = (FNA3D_VertexDeclarationObject*) SDL_malloc(
+		sizeof(FNA3D_VertexDeclarationObject)
+	);
+	result->declaration.vertexStride = vertexDeclaration->vertexStride;
+	result->declaration.elementCount = vertexDeclaration->elementCount;
+	result->declaration.elements = (FNA3D_VertexElement*) SDL_malloc(
+		elementsSize
+	);
+	SDL_memcpy(
+		result->declaration.elements,
+		vertexDeclaration->elements,
+		elementsSize
+	);
+	result->id = device->nextVertexDeclarationID++;
+	result->hash = hash;
+	result->shaderFactor = GetVertexDeclarationShaderFactor(
+		*vertexDeclaration
+	);
+	SDL_AtomicSet(&result->refcount, 1);
+	LinkedList_Add(device->vertexDeclarations, result, curr);
+	SDL_UnlockMutex(device->vertexDeclarationLock);
+	return result;
+}
+
+void FNA3D_DestroyVertexDeclaration(
+	FNA3D_Device *device,
+	FNA3D_VertexDeclarationObject *vertexDeclaration
+) {
+	FNA3D_VertexDeclarationObject *curr, *prev;
+	if (device == NULL)
+	{
+		return;
+	}
+
+	/* The lock keeps a concurrent Create from reviving the last reference
+	 * while it is being unlinked.
+	 */
+	SDL_LockMutex(device->vertexDeclarationLock);
+	if (!SDL_AtomicDecRef(&vertexDeclaration->refcount))
+	{
+		SDL_UnlockMutex(device->vertexDeclarationLock);
+		return;
+	}
+	LinkedList_Remove(
+		device->vertexDeclarations,
+		vertexDeclaration,
+		curr,
+		prev
+	);
+	SDL_UnlockMutex(device->vertexDeclarationLock);
+	SDL_free(vertexDeclaration->declaration.elements);
+	SDL_free(vertexDeclaration);
+}
+
+uint64_t FNA3D_GetVertexDeclarationID(
+	FNA3D_Device *device,
+	FNA3D_VertexDeclarationObject *vertexDeclaration
+) {
+	if (device == NULL)
+	{
+		return 0;
+	}
+	return vertexDeclaration->id;
+}
+
+void FNA3D_ApplyVertexBufferBindingObjects(
+	FNA3D_Device *device,
+	FNA3D_VertexBufferBinding *bindings,
+	FNA3D_VertexDeclarationObject **declarations,
+	int32_t numBindings,
+	uint8_t bindingsUpdated,
+	int32_t baseVertex
+) {
+	int32_t i;
+	FNA3D_VertexBufferBinding *copy;
+	if (device == NULL)
+	{
+		return;
+	}
+
+	/* The caller's bindings are left alone, the driver gets a copy with
+	 * the interned layouts. Some drivers read the bindings again at draw
+	 * time, so the copy lives on the device rather than the stack.
+	 */
+	if (numBindings > device->vertexDeclarationBindingCapacity)
+	{
+		copy = (FNA3D_VertexBufferBinding*) SDL_realloc(
+			device->vertexDeclarationBindings,
+			sizeof(FNA3D_VertexBufferBinding) * numBindings
+		);
+		if (copy == NULL)
+		{
+			FNA3D_LogError("Out of memory applying vertex bindings!");
+			return;
+		}
+		device->vertexDeclarationBindings = copy;
+		device->vertexDeclarationBindingCapacity = numBindings;
+	}
+	copy = device->vertexDeclarationBindings;
+	for (i = 0; i < numBindings; i += 1)
+	{
+		copy[i] = bindings[i];
+		copy[i].vertexDeclaration = declarations[i]->declaration;
+	}
+	device->ApplyVertexBufferBindings(
+		device->driverData,
+		copy,
+		declarations,
+		numBindings,
+		bindingsUpdated,
+		baseVertex
+	);
+}
+
 /* Render Targets */
 
 void FNA3D_SetRenderTargets(
@@ -578,6 +1920,16 @@ void FNA3D_SetRenderTargets(
 	{
 		return;
 	}
+	if (device->stateFilter != NULL)
+	{
+		/* Viewport origin and depth bias scale depend on the target */
+		device->stateFilter->valid &= ~(
+			FILTER_RASTERIZERSTATE |
+			FILTER_VIEWPORT |
+			FILTER_SCISSORRECT
+		);
+		FNA3D_INTERNAL_InvalidateSamplerFilter(device->stateFilter);
+	}
 	device->SetRenderTargets(
 		device->driverData,
 		renderTargets,
@@ -595,6 +1947,7 @@ void FNA3D_ResolveTarget(
 	{
 		return;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	device->ResolveTarget(device->driverData, target);
 }
 
@@ -608,6 +1961,10 @@ void FNA3D_ResetBackbuffer(
 	{
 		return;
 	}
+	if (device->stateFilter != NULL)
+	{
+		FNA3D_INTERNAL_InvalidateStateFilter(device->stateFilter);
+	}
 	device->ResetBackbuffer(device->driverData, presentationParameters);
 }
 
@@ -624,6 +1981,7 @@ void FNA3D_ReadBackbuffer(
 	{
 		return;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	device->ReadBackbuffer(
 		device->driverData,
 		x,
@@ -690,6 +2048,7 @@ FNA3D_Texture* FNA3D_CreateTexture2D(
 	{
 		return NULL;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	return device->CreateTexture2D(
 		device->driverData,
 		format,
@@ -712,6 +2071,7 @@ FNA3D_Texture* FNA3D_CreateTexture3D(
 	{
 		return NULL;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	return device->CreateTexture3D(
 		device->driverData,
 		format,
@@ -733,6 +2093,7 @@ FNA3D_Texture* FNA3D_CreateTextureCube(
 	{
 		return NULL;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	return device->CreateTextureCube(
 		device->driverData,
 		format,
@@ -750,6 +2111,7 @@ void FNA3D_AddDisposeTexture(
 	{
 		return;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	device->AddDisposeTexture(device->driverData, texture);
 }
 
@@ -769,6 +2131,7 @@ void FNA3D_SetTextureData2D(
 	{
 		return;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	device->SetTextureData2D(
 		device->driverData,
 		texture,
@@ -801,6 +2164,7 @@ void FNA3D_SetTextureData3D(
 	{
 		return;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	device->SetTextureData3D(
 		device->driverData,
 		texture,
@@ -834,6 +2198,7 @@ void FNA3D_SetTextureDataCube(
 	{
 		return;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	device->SetTextureDataCube(
 		device->driverData,
 		texture,
@@ -865,6 +2230,7 @@ void FNA3D_SetTextureDataYUV(
 	{
 		return;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	device->SetTextureDataYUV(
 		device->driverData,
 		y,
@@ -879,6 +2245,18 @@ void FNA3D_SetTextureDataYUV(
 	);
 }
 
+void FNA3D_GenerateMipmaps(
+	FNA3D_Device *device,
+	FNA3D_Texture *texture
+) {
+	if (device == NULL)
+	{
+		return;
+	}
+	FNA3D_INTERNAL_TexturesTouched(device);
+	device->GenerateMipmaps(device->driverData, texture);
+}
+
 void FNA3D_GetTextureData2D(
 	FNA3D_Device *device,
 	FNA3D_Texture *texture,
@@ -895,6 +2273,7 @@ void FNA3D_GetTextureData2D(
 	{
 		return;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	device->GetTextureData2D(
 		device->driverData,
 		texture,
@@ -927,6 +2306,7 @@ void FNA3D_GetTextureData3D(
 	{
 		return;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	device->GetTextureData3D(
 		device->driverData,
 		texture,
@@ -960,6 +2340,7 @@ void FNA3D_GetTextureDataCube(
 	{
 		return;
 	}
+	FNA3D_INTERNAL_TexturesTouched(device);
 	device->GetTextureDataCube(
 		device->driverData,
 		texture,
@@ -1200,19 +2581,58 @@ void FNA3D_CreateEffect(
 	FNA3D_Effect **effect,
 	MOJOSHADER_effect **effectData
 ) {
+	FNA3D_EffectPrototype *prototype;
+	FNA3D_Effect *prototypeEffect;
+	MOJOSHADER_effect *prototypeData;
+	uint64_t hash;
+
 	if (device == NULL)
 	{
 		*effect = NULL;
 		*effectData = NULL;
 		return;
 	}
-	device->CreateEffect(
-		device->driverData,
+
+	hash = FNA3D_INTERNAL_HashEffectCode(effectCode, effectCodeLength);
+	prototype = FNA3D_INTERNAL_FindEffectPrototype(
+		device->effectCache,
 		effectCode,
 		effectCodeLength,
+		hash
+	);
+	if (prototype == NULL)
+	{
+		device->CreateEffect(
+			device->driverData,
+			effectCode,
+			effectCodeLength,
+			&prototypeEffect,
+			&prototypeData
+		);
+
+		/* Don't hang on to broken effects, let the caller see them */
+		if (prototypeData->error_count > 0)
+		{
+			*effect = prototypeEffect;
+			*effectData = prototypeData;
+			return;
+		}
+
+		prototype = FNA3D_INTERNAL_AddEffectPrototype(
+			device->effectCache,
+			effectCode,
+			effectCodeLength,
+			hash,
+			prototypeEffect
+		);
+	}
+	device->CloneEffect(
+		device->driverData,
+		prototype->effect,
 		effect,
 		effectData
 	);
+	FNA3D_INTERNAL_AddEffectClone(device->effectCache, *effect, prototype);
 }
 
 void FNA3D_CloneEffect(
@@ -1239,11 +2659,20 @@ void FNA3D_AddDisposeEffect(
 	FNA3D_Device *device,
 	FNA3D_Effect *effect
 ) {
+	FNA3D_EffectPrototype *prototype;
+
 	if (device == NULL)
 	{
 		return;
 	}
+	prototype = FNA3D_INTERNAL_RemoveEffectClone(device->effectCache, effect);
 	device->AddDisposeEffect(device->driverData, effect);
+	if (prototype != NULL)
+	{
+		device->AddDisposeEffect(device->driverData, prototype->effect);
+		SDL_free(prototype->effectCode);
+		SDL_free(prototype);
+	}
 }
 
 void FNA3D_SetEffectTechnique(
@@ -1361,6 +2790,376 @@ int32_t FNA3D_QueryPixelCount(
 	return device->QueryPixelCount(device->driverData, query);
 }
 
+/* Readbacks */
+
+FNA3D_Readback* FNA3D_RequestReadback(
+	FNA3D_Device *device,
+	FNA3D_Texture *texture,
+	FNA3D_SurfaceFormat format,
+	int32_t x,
+	int32_t y,
+	int32_t w,
+	int32_t h,
+	int32_t level,
+	int32_t dataLength
+) {
+	if (device == NULL)
+	{
+		return NULL;
+	}
+	FNA3D_INTERNAL_TexturesTouched(device);
+	return device->RequestReadback(
+		device->driverData,
+		texture,
+		format,
+		x,
+		y,
+		w,
+		h,
+		level,
+		dataLength
+	);
+}
+
+uint8_t FNA3D_PollReadback(
+	FNA3D_Device *device,
+	FNA3D_Readback *readback,
+	void* data
+) {
+	if (device == NULL)
+	{
+		return 1;
+	}
+	return device->PollReadback(device->driverData, readback, data);
+}
+
+/* Frame Capture */
+
+void FNA3D_BeginCapture(
+	FNA3D_Device *device,
+	FNA3D_CaptureFunc callback,
+	void* userdata,
+	int32_t everyNFrames
+) {
+	FNA3D_Capture *capture;
+
+	if (device == NULL)
+	{
+		return;
+	}
+	if (callback == NULL)
+	{
+		FNA3D_LogError("FNA3D_BeginCapture needs a callback!");
+		return;
+	}
+
+	/* Restarting is fine, the old capture is flushed first */
+	FNA3D_EndCapture(device);
+
+	capture = device->capture;
+	if (capture == NULL)
+	{
+		/* Could still exist if readbacks from the last one are pending */
+		capture = (FNA3D_Capture*) SDL_malloc(sizeof(FNA3D_Capture));
+		SDL_zerop(capture);
+		capture->lock = SDL_CreateMutex();
+		capture->cond = SDL_CreateCond();
+		device->capture = capture;
+	}
+
+	capture->callback = callback;
+	capture->userdata = userdata;
+	capture->everyNFrames = SDL_max(everyNFrames, 1);
+	capture->frameCount = 0;
+	capture->quit = 0;
+	capture->active = 1;
+	capture->thread = SDL_CreateThread(
+		FNA3D_INTERNAL_CaptureThread,
+		"FNA3D Capture",
+		capture
+	);
+}
+
+void FNA3D_EndCapture(FNA3D_Device *device)
+{
+	FNA3D_Capture *capture;
+	int32_t i;
+
+	if (device == NULL || device->capture == NULL)
+	{
+		return;
+	}
+	capture = device->capture;
+	if (!capture->active)
+	{
+		return;
+	}
+	capture->active = 0;
+
+	/* Let the thread drain the queue, then wait for it */
+	SDL_LockMutex(capture->lock);
+	capture->quit = 1;
+	SDL_CondSignal(capture->cond);
+	SDL_UnlockMutex(capture->lock);
+	SDL_WaitThread(capture->thread, NULL);
+	capture->thread = NULL;
+
+	/* The GPU still owns these, SwapBuffers releases them later */
+	for (i = 0; i < capture->pendingCount; i += 1)
+	{
+		capture->pending[i]->discard = 1;
+	}
+	if (capture->pendingCount == 0)
+	{
+		FNA3D_INTERNAL_DestroyCapture(capture);
+		device->capture = NULL;
+	}
+}
+
+/* Command Streams */
+
+static const size_t streamCommandSizes[] =
+{
+	sizeof(FNA3D_StreamClear),
+	sizeof(FNA3D_StreamDrawIndexed),
+	sizeof(FNA3D_StreamDrawIndexed),
+	sizeof(FNA3D_StreamDraw),
+	sizeof(FNA3D_StreamSetViewport),
+	sizeof(FNA3D_StreamSetScissorRect),
+	sizeof(FNA3D_StreamSetBlendFactor),
+	sizeof(FNA3D_StreamSetValue),
+	sizeof(FNA3D_StreamSetValue),
+	sizeof(FNA3D_StreamSetBlendState),
+	sizeof(FNA3D_StreamSetDepthStencilState),
+	sizeof(FNA3D_StreamApplyRasterizerState),
+	sizeof(FNA3D_StreamVerifySampler),
+	sizeof(FNA3D_StreamVerifySampler),
+	sizeof(FNA3D_StreamApplyVertexBufferBindings),
+	sizeof(FNA3D_StreamSetRenderTargets),
+	sizeof(FNA3D_StreamApplyEffect)
+};
+
+void FNA3D_ExecuteCommandStream(
+	FNA3D_Device *device,
+	uint8_t *buffer,
+	int32_t length
+) {
+	uint8_t *cmd, *end;
+	FNA3D_StreamCommandType type;
+	size_t size;
+
+	if (device == NULL)
+	{
+		return;
+	}
+
+	cmd = buffer;
+	end = buffer + length;
+	while (cmd < end)
+	{
+		/* Validate before touching anything past the type */
+		if ((size_t) (end - cmd) < sizeof(FNA3D_StreamCommandType))
+		{
+			FNA3D_LogError("Command stream is truncated!");
+			return;
+		}
+		type = *((FNA3D_StreamCommandType*) cmd);
+		if ((uint32_t) type >= SDL_arraysize(streamCommandSizes))
+		{
+			FNA3D_LogError(
+				"Unknown stream command %d at offset %d",
+				type,
+				(int32_t) (cmd - buffer)
+			);
+			return;
+		}
+		size = streamCommandSizes[type];
+		if ((size_t) (end - cmd) < size)
+		{
+			FNA3D_LogError("Command stream is truncated!");
+			return;
+		}
+
+		switch (type)
+		{
+			#define STREAM_CMD(t) t *c = (t*) cmd;
+
+			case FNA3D_STREAMCOMMAND_CLEAR:
+			{
+				STREAM_CMD(FNA3D_StreamClear)
+				FNA3D_Clear(
+					device,
+					c->options,
+					&c->color,
+					c->depth,
+					c->stencil
+				);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_DRAWINDEXEDPRIMITIVES:
+			{
+				STREAM_CMD(FNA3D_StreamDrawIndexed)
+				FNA3D_DrawIndexedPrimitives(
+					device,
+					c->primitiveType,
+					c->baseVertex,
+					c->minVertexIndex,
+					c->numVertices,
+					c->startIndex,
+					c->primitiveCount,
+					c->indices,
+					c->indexElementSize
+				);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_DRAWINSTANCEDPRIMITIVES:
+			{
+				STREAM_CMD(FNA3D_StreamDrawIndexed)
+				FNA3D_DrawInstancedPrimitives(
+					device,
+					c->primitiveType,
+					c->baseVertex,
+					c->minVertexIndex,
+					c->numVertices,
+					c->startIndex,
+					c->primitiveCount,
+					c->instanceCount,
+					c->indices,
+					c->indexElementSize
+				);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_DRAWPRIMITIVES:
+			{
+				STREAM_CMD(FNA3D_StreamDraw)
+				FNA3D_DrawPrimitives(
+					device,
+					c->primitiveType,
+					c->vertexStart,
+					c->primitiveCount
+				);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_SETVIEWPORT:
+			{
+				STREAM_CMD(FNA3D_StreamSetViewport)
+				FNA3D_SetViewport(device, &c->viewport);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_SETSCISSORRECT:
+			{
+				STREAM_CMD(FNA3D_StreamSetScissorRect)
+				FNA3D_SetScissorRect(device, &c->scissor);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_SETBLENDFACTOR:
+			{
+				STREAM_CMD(FNA3D_StreamSetBlendFactor)
+				FNA3D_SetBlendFactor(device, &c->blendFactor);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_SETMULTISAMPLEMASK:
+			{
+				STREAM_CMD(FNA3D_StreamSetValue)
+				FNA3D_SetMultiSampleMask(device, c->value);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_SETREFERENCESTENCIL:
+			{
+				STREAM_CMD(FNA3D_StreamSetValue)
+				FNA3D_SetReferenceStencil(device, c->value);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_SETBLENDSTATE:
+			{
+				STREAM_CMD(FNA3D_StreamSetBlendState)
+				FNA3D_SetBlendState(device, &c->blendState);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_SETDEPTHSTENCILSTATE:
+			{
+				STREAM_CMD(FNA3D_StreamSetDepthStencilState)
+				FNA3D_SetDepthStencilState(
+					device,
+					&c->depthStencilState
+				);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_APPLYRASTERIZERSTATE:
+			{
+				STREAM_CMD(FNA3D_StreamApplyRasterizerState)
+				FNA3D_ApplyRasterizerState(
+					device,
+					&c->rasterizerState
+				);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_VERIFYSAMPLER:
+			{
+				STREAM_CMD(FNA3D_StreamVerifySampler)
+				FNA3D_VerifySampler(
+					device,
+					c->index,
+					c->texture,
+					&c->sampler
+				);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_VERIFYVERTEXSAMPLER:
+			{
+				STREAM_CMD(FNA3D_StreamVerifySampler)
+				FNA3D_VerifyVertexSampler(
+					device,
+					c->index,
+					c->texture,
+					&c->sampler
+				);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_APPLYVERTEXBUFFERBINDINGS:
+			{
+				STREAM_CMD(FNA3D_StreamApplyVertexBufferBindings)
+				FNA3D_ApplyVertexBufferBindings(
+					device,
+					c->bindings,
+					c->numBindings,
+					c->bindingsUpdated,
+					c->baseVertex
+				);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_SETRENDERTARGETS:
+			{
+				STREAM_CMD(FNA3D_StreamSetRenderTargets)
+				FNA3D_SetRenderTargets(
+					device,
+					c->renderTargets,
+					c->numRenderTargets,
+					c->depthStencilBuffer,
+					c->depthFormat
+				);
+				break;
+			}
+			case FNA3D_STREAMCOMMAND_APPLYEFFECT:
+			{
+				STREAM_CMD(FNA3D_StreamApplyEffect)
+				FNA3D_ApplyEffect(
+					device,
+					c->effect,
+					c->pass,
+					c->stateChanges
+				);
+				break;
+			}
+
+			#undef STREAM_CMD
+		}
+
+		/* Every command starts on an 8-byte boundary */
+		cmd += (size + 7) & ~((size_t) 7);
+	}
+}
+
 /* Feature Queries */
 
 uint8_t FNA3D_SupportsDXT1(FNA3D_Device *device)
@@ -1399,6 +3198,15 @@ uint8_t FNA3D_SupportsNoOverwrite(FNA3D_Device *device)
 	return device->SupportsNoOverwrite(device->driverData);
 }
 
+uint8_t FNA3D_SupportsIndirectDraws(FNA3D_Device *device)
+{
+	if (device == NULL)
+	{
+		return 0;
+	}
+	return device->SupportsIndirectDraws(device->driverData);
+}
+
 void FNA3D_GetMaxTextureSlots(
 	FNA3D_Device *device,
 	int32_t *textures,
@@ -1431,6 +3239,21 @@ int32_t FNA3D_GetMaxMultiSampleCount(
 	);
 }
 
+/* Redundant State Filter */
+
+uint8_t FNA3D_GetStateFilterStatistics(
+	FNA3D_Device *device,
+	FNA3D_StateFilterStatistics *statistics
+) {
+	if (device == NULL || device->stateFilter == NULL)
+	{
+		SDL_zerop(statistics);
+		return 0;
+	}
+	*statistics = device->stateFilter->stats;
+	return 1;
+}
+
 /* Debugging */
 
 void FNA3D_SetStringMarker(FNA3D_Device *device, const char *text)
@@ -29,6 +29,7 @@
 
 #include "mojoshader.h"
 #include "FNA3D.h"
+#include "FNA3D_PipelineCache.h"
 
 /* Windows/Visual Studio cruft */
 #ifdef _WIN32
@@ -41,6 +42,25 @@ extern void FNA3D_LogInfo(const char *fmt, ...);
 extern void FNA3D_LogWarn(const char *fmt, ...);
 extern void FNA3D_LogError(const char *fmt, ...);
 
+/* MojoShader Backend Locks */
+
+/* Each MojoShader backend keeps one current context for the whole process.
+ * Drivers with a context per device hold their device's own lock while using
+ * MojoShader, then this (recursive) lock while their context is current, so
+ * devices on other threads can't swap it out. Devices of different drivers
+ * never wait on each other.
+ */
+typedef enum FNA3D_ShaderBackend
+{
+	FNA3D_SHADERBACKEND_OPENGL,
+	FNA3D_SHADERBACKEND_VULKAN,
+	FNA3D_SHADERBACKEND_D3D11,
+	FNA3D_SHADERBACKEND_COUNT
+} FNA3D_ShaderBackend;
+
+extern void FNA3D_LockShaderBackend(FNA3D_ShaderBackend backend);
+extern void FNA3D_UnlockShaderBackend(FNA3D_ShaderBackend backend);
+
 /* Internal Helper Utilities */
 
 #define LinkedList_Add(start, toAdd, curr) \
@@ -192,6 +212,46 @@ static inline int32_t IndexSize(FNA3D_IndexElementSize size)
 	return (size == FNA3D_INDEXELEMENTSIZE_16BIT) ? 2 : 4;
 }
 
+/* Pre-baked State Objects */
+
+/* driverState is filled in lazily by the driver on first use and points into
+ * the renderer's own state caches, so it is never freed by the object.
+ */
+
+struct FNA3D_BlendStateObject
+{
+	FNA3D_BlendState state;
+	StateHash hash;
+	void *driverState;
+};
+
+struct FNA3D_DepthStencilStateObject
+{
+	FNA3D_DepthStencilState state;
+	StateHash hash;
+	void *driverState;
+};
+
+struct FNA3D_RasterizerStateObject
+{
+	FNA3D_RasterizerState state;
+
+	/* The real depth bias depends on the depth format, so this one is
+	 * resolved per format rather than once.
+	 */
+	void *driverState[FNA3D_DEPTHFORMAT_D24S8 + 1];
+};
+
+struct FNA3D_SamplerStateObject
+{
+	FNA3D_SamplerState state;
+	StateHash hash;
+	void *driverState;
+
+	/* For drivers whose samplers are 64-bit handles rather than pointers */
+	uint64_t driverHandle;
+};
+
 /* XNA GraphicsDevice Limits */
 
 #define MAX_TEXTURE_SAMPLERS		16
@@ -203,6 +263,10 @@ static inline int32_t IndexSize(FNA3D_IndexElementSize size)
 
 #define MAX_RENDERTARGET_BINDINGS	4
 
+/* Asynchronous readbacks in flight, per device */
+
+#define MAX_READBACKS			8
+
 /* FNA3D_Device Definition */
 
 typedef struct FNA3D_Renderer FNA3D_Renderer;
@@ -262,6 +326,23 @@ struct FNA3D_Device
 		FNA3D_Buffer *indices,
 		FNA3D_IndexElementSize indexElementSize
 	);
+	void (*MultiDrawIndexedPrimitives)(
+		FNA3D_Renderer *driverData,
+		FNA3D_PrimitiveType primitiveType,
+		FNA3D_DrawIndexedArgs *drawArgs,
+		int32_t drawCount,
+		FNA3D_Buffer *indices,
+		FNA3D_IndexElementSize indexElementSize
+	);
+	void (*MultiDrawIndexedPrimitivesIndirect)(
+		FNA3D_Renderer *driverData,
+		FNA3D_PrimitiveType primitiveType,
+		FNA3D_Buffer *drawBuffer,
+		int32_t offsetInBytes,
+		int32_t drawCount,
+		FNA3D_Buffer *indices,
+		FNA3D_IndexElementSize indexElementSize
+	);
 	void (*DrawPrimitives)(
 		FNA3D_Renderer *driverData,
 		FNA3D_PrimitiveType primitiveType,
@@ -334,11 +415,39 @@ struct FNA3D_Device
 		FNA3D_SamplerState *sampler
 	);
 
+	/* State Objects */
+
+	void (*SetBlendStateObject)(
+		FNA3D_Renderer *driverData,
+		FNA3D_BlendStateObject *blendState
+	);
+	void (*SetDepthStencilStateObject)(
+		FNA3D_Renderer *driverData,
+		FNA3D_DepthStencilStateObject *depthStencilState
+	);
+	void (*ApplyRasterizerStateObject)(
+		FNA3D_Renderer *driverData,
+		FNA3D_RasterizerStateObject *rasterizerState
+	);
+	void (*VerifySamplerObject)(
+		FNA3D_Renderer *driverData,
+		int32_t index,
+		FNA3D_Texture *texture,
+		FNA3D_SamplerStateObject *sampler
+	);
+	void (*VerifyVertexSamplerObject)(
+		FNA3D_Renderer *driverData,
+		int32_t index,
+		FNA3D_Texture *texture,
+		FNA3D_SamplerStateObject *sampler
+	);
+
 	/* Vertex State */
 
 	void (*ApplyVertexBufferBindings)(
 		FNA3D_Renderer *driverData,
 		FNA3D_VertexBufferBinding *bindings,
+		FNA3D_VertexDeclarationObject **declarations,
 		int32_t numBindings,
 		uint8_t bindingsUpdated,
 		int32_t baseVertex
@@ -475,6 +584,10 @@ struct FNA3D_Device
 		void* data,
 		int32_t dataLength
 	);
+	void (*GenerateMipmaps)(
+		FNA3D_Renderer *driverData,
+		FNA3D_Texture *texture
+	);
 	void (*GetTextureData2D)(
 		FNA3D_Renderer *driverData,
 		FNA3D_Texture *texture,
@@ -651,12 +764,32 @@ struct FNA3D_Device
 		FNA3D_Query *query
 	);
 
+	/* Readbacks */
+
+	FNA3D_Readback* (*RequestReadback)(
+		FNA3D_Renderer *driverData,
+		FNA3D_Texture *texture,
+		FNA3D_SurfaceFormat format,
+		int32_t x,
+		int32_t y,
+		int32_t w,
+		int32_t h,
+		int32_t level,
+		int32_t dataLength
+	);
+	uint8_t (*PollReadback)(
+		FNA3D_Renderer *driverData,
+		FNA3D_Readback *readback,
+		void* data
+	);
+
 	/* Feature Queries */
 
 	uint8_t (*SupportsDXT1)(FNA3D_Renderer *driverData);
 	uint8_t (*SupportsS3TC)(FNA3D_Renderer *driverData);
 	uint8_t (*SupportsHardwareInstancing)(FNA3D_Renderer *driverData);
 	uint8_t (*SupportsNoOverwrite)(FNA3D_Renderer *driverData);
+	uint8_t (*SupportsIndirectDraws)(FNA3D_Renderer *driverData);
 
 	void (*GetMaxTextureSlots)(
 		FNA3D_Renderer *driverData,
@@ -675,6 +808,27 @@ struct FNA3D_Device
 
 	/* Opaque pointer for the Driver */
 	FNA3D_Renderer *driverData;
+
+	/* Frame capture state, owned by FNA3D.c. NULL when not capturing. */
+	struct FNA3D_Capture *capture;
+
+	/* Redundant state filter, owned by FNA3D.c. NULL when disabled. */
+	struct FNA3D_StateFilter *stateFilter;
+
+	/* Interned vertex declarations, owned by FNA3D.c */
+	FNA3D_VertexDeclarationObject *vertexDeclarations;
+	uint64_t nextVertexDeclarationID;
+	SDL_mutex *vertexDeclarationLock;
+	FNA3D_VertexBufferBinding *vertexDeclarationBindings; /* Scratch array */
+	int32_t vertexDeclarationBindingCapacity;
+
+	/* Effect bytecode cache, owned by FNA3D.c */
+	struct FNA3D_EffectCache *effectCache;
+
+	/* Log hooks from FNA3D_HookDeviceLogFunctions. NULL uses the global hook. */
+	FNA3D_LogFunc logInfo;
+	FNA3D_LogFunc logWarn;
+	FNA3D_LogFunc logError;
 };
 
 #define ASSIGN_DRIVER_FUNC(func, name) \
@@ -688,6 +842,8 @@ struct FNA3D_Device
 	ASSIGN_DRIVER_FUNC(Clear, name) \
 	ASSIGN_DRIVER_FUNC(DrawIndexedPrimitives, name) \
 	ASSIGN_DRIVER_FUNC(DrawInstancedPrimitives, name) \
+	ASSIGN_DRIVER_FUNC(MultiDrawIndexedPrimitives, name) \
+	ASSIGN_DRIVER_FUNC(MultiDrawIndexedPrimitivesIndirect, name) \
 	ASSIGN_DRIVER_FUNC(DrawPrimitives, name) \
 	ASSIGN_DRIVER_FUNC(DrawUserIndexedPrimitives, name) \
 	ASSIGN_DRIVER_FUNC(DrawUserPrimitives, name) \
@@ -704,6 +860,11 @@ struct FNA3D_Device
 	ASSIGN_DRIVER_FUNC(ApplyRasterizerState, name) \
 	ASSIGN_DRIVER_FUNC(VerifySampler, name) \
 	ASSIGN_DRIVER_FUNC(VerifyVertexSampler, name) \
+	ASSIGN_DRIVER_FUNC(SetBlendStateObject, name) \
+	ASSIGN_DRIVER_FUNC(SetDepthStencilStateObject, name) \
+	ASSIGN_DRIVER_FUNC(ApplyRasterizerStateObject, name) \
+	ASSIGN_DRIVER_FUNC(VerifySamplerObject, name) \
+	ASSIGN_DRIVER_FUNC(VerifyVertexSamplerObject, name) \
 	ASSIGN_DRIVER_FUNC(ApplyVertexBufferBindings, name) \
 	ASSIGN_DRIVER_FUNC(ApplyVertexDeclaration, name) \
 	ASSIGN_DRIVER_FUNC(SetRenderTargets, name) \
@@ -722,6 +883,7 @@ struct FNA3D_Device
 	ASSIGN_DRIVER_FUNC(SetTextureData3D, name) \
 	ASSIGN_DRIVER_FUNC(SetTextureDataCube, name) \
 	ASSIGN_DRIVER_FUNC(SetTextureDataYUV, name) \
+	ASSIGN_DRIVER_FUNC(GenerateMipmaps, name) \
 	ASSIGN_DRIVER_FUNC(GetTextureData2D, name) \
 	ASSIGN_DRIVER_FUNC(GetTextureData3D, name) \
 	ASSIGN_DRIVER_FUNC(GetTextureDataCube, name) \
@@ -749,10 +911,13 @@ struct FNA3D_Device
 	ASSIGN_DRIVER_FUNC(QueryEnd, name) \
 	ASSIGN_DRIVER_FUNC(QueryComplete, name) \
 	ASSIGN_DRIVER_FUNC(QueryPixelCount, name) \
+	ASSIGN_DRIVER_FUNC(RequestReadback, name) \
+	ASSIGN_DRIVER_FUNC(PollReadback, name) \
 	ASSIGN_DRIVER_FUNC(SupportsDXT1, name) \
 	ASSIGN_DRIVER_FUNC(SupportsS3TC, name) \
 	ASSIGN_DRIVER_FUNC(SupportsHardwareInstancing, name) \
 	ASSIGN_DRIVER_FUNC(SupportsNoOverwrite, name) \
+	ASSIGN_DRIVER_FUNC(SupportsIndirectDraws, name) \
 	ASSIGN_DRIVER_FUNC(GetMaxTextureSlots, name) \
 	ASSIGN_DRIVER_FUNC(GetMaxMultiSampleCount, name) \
 	ASSIGN_DRIVER_FUNC(SetStringMarker, name)
@@ -766,6 +931,10 @@ typedef struct FNA3D_Driver
 		FNA3D_PresentationParameters *presentationParameters,
 		uint8_t debugMode
 	);
+	FNA3D_Device* (*CreateHeadlessDevice)(
+		FNA3D_PresentationParameters *presentationParameters,
+		uint8_t debugMode
+	); /* NULL if the driver always needs a window */
 } FNA3D_Driver;
 
 extern FNA3D_Driver VulkanDriver;
@@ -29,7 +29,6 @@
 #include "FNA3D_Driver.h"
 #include "FNA3D_PipelineCache.h"
 #include "FNA3D_Driver_D3D11.h"
-#include "stb_ds.h"
 
 #include <SDL.h>
 #include <SDL_syswm.h>
@@ -69,6 +68,7 @@ typedef struct D3D11Texture /* Cast FNA3D_Texture* to this! */
 	/* Basic Info */
 	int32_t levelCount;
 	uint8_t isRenderTarget;
+	uint8_t canGenerateMips; /* Created with D3D11_RESOURCE_MISC_GENERATE_MIPS */
 	FNA3D_SurfaceFormat format;
 
 	/* Dimensions */
@@ -150,6 +150,12 @@ typedef struct D3D11Query /* Cast FNA3D_Query* to this! */
 	ID3D11Query *handle;
 } D3D11Query;
 
+typedef struct D3D11Readback /* Cast FNA3D_Readback* to this! */
+{
+	uint8_t *data;
+	int32_t dataLength;
+} D3D11Readback;
+
 typedef struct D3D11Backbuffer
 {
 	int32_t width;
@@ -246,11 +252,11 @@ typedef struct D3D11Renderer /* Cast FNA3D_Renderer* to this! */
 	FNA3D_IndexElementSize indexElementSize;
 
 	/* Resource Caches */
-	StateHashMap *blendStateCache;
-	StateHashMap *depthStencilStateCache;
-	StateHashMap *rasterizerStateCache;
-	StateHashMap *samplerStateCache;
-	UInt64HashMap *inputLayoutCache;
+	PackedHashMap blendStateCache;
+	PackedHashMap depthStencilStateCache;
+	PackedHashMap rasterizerStateCache;
+	PackedHashMap samplerStateCache;
+	PackedHashMap inputLayoutCache;
 
 	/* User Buffers */
 	ID3D11Buffer *userVertexBuffer;
@@ -267,6 +273,7 @@ typedef struct D3D11Renderer /* Cast FNA3D_Renderer* to this! */
 	FNA3D_DepthFormat currentDepthFormat;
 
 	/* MojoShader Interop */
+	ShaderCache shaderCache;
 	MOJOSHADER_effect *currentEffect;
 	const MOJOSHADER_effectTechnique *currentTechnique;
 	uint32_t currentPass;
@@ -513,6 +520,19 @@ static inline uint32_t CalcSubresource(
 	return mipLevel + (arraySlice * numLevels);
 }
 
+static inline uint8_t SupportsMipAutogen(
+	D3D11Renderer *renderer,
+	FNA3D_SurfaceFormat format
+) {
+	UINT formatSupport = 0;
+	ID3D11Device_CheckFormatSupport(
+		renderer->device,
+		XNAToD3D_TextureFormat[format],
+		&formatSupport
+	);
+	return (formatSupport & D3D11_FORMAT_SUPPORT_MIP_AUTOGEN) != 0;
+}
+
 static inline uint8_t BlendEquals(FNA3D_Color *a, FNA3D_Color *b)
 {
 	return (	a->r == b->r &&
@@ -533,7 +553,7 @@ static ID3D11BlendState* FetchBlendState(
 
 	/* Can we just reuse an existing state? */
 	hash = GetBlendStateHash(*state);
-	result = hmget(renderer->blendStateCache, hash);
+	result = PackedHashMap_GetState(&renderer->blendStateCache, hash);
 	if (result != NULL)
 	{
 		/* The state is already cached! */
@@ -596,7 +616,7 @@ static ID3D11BlendState* FetchBlendState(
 		&desc,
 		&result
 	);
-	hmput(renderer->blendStateCache, hash, result);
+	PackedHashMap_PutState(&renderer->blendStateCache, hash, result);
 
 	/* Return the state! */
 	return result;
@@ -613,7 +633,7 @@ static ID3D11DepthStencilState* FetchDepthStencilState(
 
 	/* Can we just reuse an existing state? */
 	hash = GetDepthStencilStateHash(*state);
-	result = hmget(renderer->depthStencilStateCache, hash);
+	result = PackedHashMap_GetState(&renderer->depthStencilStateCache, hash);
 	if (result != NULL)
 	{
 		/* The state is already cached! */
@@ -673,7 +693,7 @@ static ID3D11DepthStencilState* FetchDepthStencilState(
 		&desc,
 		&result
 	);
-	hmput(renderer->depthStencilStateCache, hash, result);
+	PackedHashMap_PutState(&renderer->depthStencilStateCache, hash, result);
 
 	/* Return the state! */
 	return result;
@@ -694,7 +714,7 @@ static ID3D11RasterizerState* FetchRasterizerState(
 
 	/* Can we just reuse an existing state? */
 	hash = GetRasterizerStateHash(*state, depthBias);
-	result = hmget(renderer->rasterizerStateCache, hash);
+	result = PackedHashMap_GetState(&renderer->rasterizerStateCache, hash);
 	if (result != NULL)
 	{
 		/* The state is already cached! */
@@ -719,7 +739,7 @@ static ID3D11RasterizerState* FetchRasterizerState(
 		&desc,
 		&result
 	);
-	hmput(renderer->rasterizerStateCache, hash, result);
+	PackedHashMap_PutState(&renderer->rasterizerStateCache, hash, result);
 
 	/* Return the state! */
 	return result;
@@ -735,7 +755,7 @@ static ID3D11SamplerState* FetchSamplerState(
 
 	/* Can we just reuse an existing state? */
 	hash = GetSamplerStateHash(*state);
-	result = hmget(renderer->samplerStateCache, hash);
+	result = PackedHashMap_GetState(&renderer->samplerStateCache, hash);
 	if (result != NULL)
 	{
 		/* The state is already cached! */
@@ -763,7 +783,7 @@ static ID3D11SamplerState* FetchSamplerState(
 		&desc,
 		&result
 	);
-	hmput(renderer->samplerStateCache, hash, result);
+	PackedHashMap_PutState(&renderer->samplerStateCache, hash, result);
 
 	/* Return the state! */
 	return result;
@@ -772,6 +792,7 @@ static ID3D11SamplerState* FetchSamplerState(
 static ID3D11InputLayout* FetchBindingsInputLayout(
 	D3D11Renderer *renderer,
 	FNA3D_VertexBufferBinding *bindings,
+	FNA3D_VertexDeclarationObject **declarations,
 	int32_t numBindings,
 	uint64_t *hash
 ) {
@@ -789,12 +810,13 @@ static ID3D11InputLayout* FetchBindingsInputLayout(
 	MOJOSHADER_d3d11GetBoundShaders(&vertexShader, &blah);
 
 	/* Can we just reuse an existing input layout? */
-	*hash = GetVertexBufferBindingsHash(
+	*hash = GetVertexDeclarationObjectsHash(
 		bindings,
+		declarations,
 		numBindings,
 		vertexShader
 	);
-	result = hmget(renderer->inputLayoutCache, *hash);
+	result = PackedHashMap_Get(&renderer->inputLayoutCache, hash);
 	if (result != NULL)
 	{
 		/* This input layout has already been cached! */
@@ -932,7 +954,7 @@ static ID3D11InputLayout* FetchBindingsInputLayout(
 	SDL_free(elements);
 
 	/* Return the new input layout! */
-	hmput(renderer->inputLayoutCache, *hash, result);
+	PackedHashMap_Put(&renderer->inputLayoutCache, hash, result);
 	return result;
 }
 
@@ -958,7 +980,7 @@ static ID3D11InputLayout* FetchDeclarationInputLayout(
 		*vertexDeclaration,
 		vertexShader
 	);
-	result = hmget(renderer->inputLayoutCache, *hash);
+	result = PackedHashMap_Get(&renderer->inputLayoutCache, hash);
 	if (result != NULL)
 	{
 		/* This input layout has already been cached! */
@@ -1079,7 +1101,7 @@ static ID3D11InputLayout* FetchDeclarationInputLayout(
 	SDL_free(elements);
 
 	/* Return the new input layout! */
-	hmput(renderer->inputLayoutCache, *hash, result);
+	PackedHashMap_Put(&renderer->inputLayoutCache, hash, result);
 	return result;
 }
 
@@ -1106,6 +1128,15 @@ static void D3D11_GetTextureData2D(
 	void* data,
 	int32_t dataLength
 );
+static void D3D11_GetVertexBufferData(
+	FNA3D_Renderer *driverData,
+	FNA3D_Buffer *buffer,
+	int32_t offsetInBytes,
+	void* data,
+	int32_t elementCount,
+	int32_t elementSizeInBytes,
+	int32_t vertexStride
+);
 
 static void D3D11_GetDrawableSize(void *window, int32_t *x, int32_t *y);
 
@@ -1157,39 +1188,54 @@ static void D3D11_DestroyDevice(FNA3D_Device *device)
 	IDXGISwapChain_Release(renderer->swapchain);
 
 	/* Release blend states */
-	for (i = 0; i < hmlen(renderer->blendStateCache); i += 1)
+	for (i = 0; i < renderer->blendStateCache.capacity; i += 1)
 	{
-		ID3D11BlendState_Release((ID3D11BlendState*) renderer->blendStateCache[i].value);
+		if (renderer->blendStateCache.tags[i] != 0)
+		{
+			ID3D11BlendState_Release((ID3D11BlendState*) PackedHashMap_Value(&renderer->blendStateCache, i));
+		}
 	}
-	hmfree(renderer->blendStateCache);
+	PackedHashMap_Free(&renderer->blendStateCache);
 
 	/* Release depth stencil states */
-	for (i = 0; i < hmlen(renderer->depthStencilStateCache); i += 1)
+	for (i = 0; i < renderer->depthStencilStateCache.capacity; i += 1)
 	{
-		ID3D11DepthStencilState_Release((ID3D11DepthStencilState*) renderer->depthStencilStateCache[i].value);
+		if (renderer->depthStencilStateCache.tags[i] != 0)
+		{
+			ID3D11DepthStencilState_Release((ID3D11DepthStencilState*) PackedHashMap_Value(&renderer->depthStencilStateCache, i));
+		}
 	}
-	hmfree(renderer->depthStencilStateCache);
+	PackedHashMap_Free(&renderer->depthStencilStateCache);
 
 	/* Release input layouts */
-	for (i = 0; i < hmlen(renderer->inputLayoutCache); i += 1)
+	for (i = 0; i < renderer->inputLayoutCache.capacity; i += 1)
 	{
-		ID3D11InputLayout_Release((ID3D11InputLayout*) renderer->inputLayoutCache[i].value);
+		if (renderer->inputLayoutCache.tags[i] != 0)
+		{
+			ID3D11InputLayout_Release((ID3D11InputLayout*) PackedHashMap_Value(&renderer->inputLayoutCache, i));
+		}
 	}
-	hmfree(renderer->inputLayoutCache);
+	PackedHashMap_Free(&renderer->inputLayoutCache);
 
 	/* Release rasterizer states */
-	for (i = 0; i < hmlen(renderer->rasterizerStateCache); i += 1)
+	for (i = 0; i < renderer->rasterizerStateCache.capacity; i += 1)
 	{
-		ID3D11RasterizerState_Release((ID3D11RasterizerState*) renderer->rasterizerStateCache[i].value);
+		if (renderer->rasterizerStateCache.tags[i] != 0)
+		{
+			ID3D11RasterizerState_Release((ID3D11RasterizerState*) PackedHashMap_Value(&renderer->rasterizerStateCache, i));
+		}
 	}
-	hmfree(renderer->rasterizerStateCache);
+	PackedHashMap_Free(&renderer->rasterizerStateCache);
 
 	/* Release sampler states */
-	for (i = 0; i < hmlen(renderer->samplerStateCache); i += 1)
+	for (i = 0; i < renderer->samplerStateCache.capacity; i += 1)
 	{
-		ID3D11SamplerState_Release((ID3D11SamplerState*) renderer->samplerStateCache[i].value);
+		if (renderer->samplerStateCache.tags[i] != 0)
+		{
+			ID3D11SamplerState_Release((ID3D11SamplerState*) PackedHashMap_Value(&renderer->samplerStateCache, i));
+		}
 	}
-	hmfree(renderer->samplerStateCache);
+	PackedHashMap_Free(&renderer->samplerStateCache);
 
 	/* Release the annotation, if applicable */
 	if (renderer->annotation != NULL)
@@ -1201,7 +1247,10 @@ static void D3D11_DestroyDevice(FNA3D_Device *device)
 	IUnknown_Release((IUnknown*) renderer->factory);
 
 	/* Release the MojoShader context */
+	FNA3D_LockShaderBackend(FNA3D_SHADERBACKEND_D3D11);
+	ShaderCache_Free(&renderer->shaderCache);
 	MOJOSHADER_d3d11DestroyContext();
+	FNA3D_UnlockShaderBackend(FNA3D_SHADERBACKEND_D3D11);
 
 	/* Release the device */
 	ID3D11DeviceContext_Release(renderer->context);
@@ -1769,6 +1818,94 @@ static void D3D11_DrawInstancedPrimitives(
 	SDL_UnlockMutex(renderer->ctxLock);
 }
 
+static void D3D11_MultiDrawIndexedPrimitives(
+	FNA3D_Renderer *driverData,
+	FNA3D_PrimitiveType primitiveType,
+	FNA3D_DrawIndexedArgs *drawArgs,
+	int32_t drawCount,
+	FNA3D_Buffer *indices,
+	FNA3D_IndexElementSize indexElementSize
+) {
+	D3D11Renderer *renderer = (D3D11Renderer*) driverData;
+	D3D11Buffer *d3dIndices = (D3D11Buffer*) indices;
+	int32_t i;
+
+	SDL_LockMutex(renderer->ctxLock);
+
+	/* Bind index buffer */
+	if (renderer->indexBuffer != d3dIndices->handle)
+	{
+		renderer->indexBuffer = d3dIndices->handle;
+		renderer->indexElementSize = indexElementSize;
+		ID3D11DeviceContext_IASetIndexBuffer(
+			renderer->context,
+			d3dIndices->handle,
+			XNAToD3D_IndexType[indexElementSize],
+			0
+		);
+	}
+
+	/* Set up draw state */
+	if (renderer->topology != primitiveType)
+	{
+		renderer->topology = primitiveType;
+		ID3D11DeviceContext_IASetPrimitiveTopology(
+			renderer->context,
+			XNAToD3D_Primitive[primitiveType]
+		);
+	}
+
+	/* No multi-draw in D3D11, but at least the state is only set once */
+	for (i = 0; i < drawCount; i += 1)
+	{
+		ID3D11DeviceContext_DrawIndexedInstanced(
+			renderer->context,
+			drawArgs[i].indexCount,
+			drawArgs[i].instanceCount,
+			drawArgs[i].startIndex,
+			drawArgs[i].baseVertex,
+			drawArgs[i].baseInstance
+		);
+	}
+
+	SDL_UnlockMutex(renderer->ctxLock);
+}
+
+static void D3D11_MultiDrawIndexedPrimitivesIndirect(
+	FNA3D_Renderer *driverData,
+	FNA3D_PrimitiveType primitiveType,
+	FNA3D_Buffer *drawBuffer,
+	int32_t offsetInBytes,
+	int32_t drawCount,
+	FNA3D_Buffer *indices,
+	FNA3D_IndexElementSize indexElementSize
+) {
+	/* DrawIndexedInstancedIndirect needs D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS
+	 * at creation time, which vertex buffers don't have, so read it back.
+	 */
+	FNA3D_DrawIndexedArgs *drawArgs = (FNA3D_DrawIndexedArgs*) SDL_malloc(
+		sizeof(FNA3D_DrawIndexedArgs) * drawCount
+	);
+	D3D11_GetVertexBufferData(
+		driverData,
+		drawBuffer,
+		offsetInBytes,
+		drawArgs,
+		drawCount,
+		sizeof(FNA3D_DrawIndexedArgs),
+		sizeof(FNA3D_DrawIndexedArgs)
+	);
+	D3D11_MultiDrawIndexedPrimitives(
+		driverData,
+		primitiveType,
+		drawArgs,
+		drawCount,
+		indices,
+		indexElementSize
+	);
+	SDL_free(drawArgs);
+}
+
 static void D3D11_DrawPrimitives(
 	FNA3D_Renderer *driverData,
 	FNA3D_PrimitiveType primitiveType,
@@ -2196,12 +2333,11 @@ static void D3D11_SetReferenceStencil(FNA3D_Renderer *driverData, int32_t ref)
 
 /* Immutable Render States */
 
-static void D3D11_SetBlendState(
-	FNA3D_Renderer *driverData,
+static void D3D11_INTERNAL_SetBlendState(
+	D3D11Renderer *renderer,
+	ID3D11BlendState *bs,
 	FNA3D_BlendState *blendState
 ) {
-	D3D11Renderer *renderer = (D3D11Renderer*) driverData;
-	ID3D11BlendState *bs = FetchBlendState(renderer, blendState);
 	float factor[4];
 
 	if (	renderer->blendState != bs ||
@@ -2226,13 +2362,23 @@ static void D3D11_SetBlendState(
 	}
 }
 
-static void D3D11_SetDepthStencilState(
+static void D3D11_SetBlendState(
 	FNA3D_Renderer *driverData,
-	FNA3D_DepthStencilState *depthStencilState
+	FNA3D_BlendState *blendState
 ) {
 	D3D11Renderer *renderer = (D3D11Renderer*) driverData;
-	ID3D11DepthStencilState *ds = FetchDepthStencilState(renderer, depthStencilState);
+	D3D11_INTERNAL_SetBlendState(
+		renderer,
+		FetchBlendState(renderer, blendState),
+		blendState
+	);
+}
 
+static void D3D11_INTERNAL_SetDepthStencilState(
+	D3D11Renderer *renderer,
+	ID3D11DepthStencilState *ds,
+	FNA3D_DepthStencilState *depthStencilState
+) {
 	if (	renderer->depthStencilState != ds ||
 		renderer->stencilRef != depthStencilState->referenceStencil	)
 	{
@@ -2248,13 +2394,22 @@ static void D3D11_SetDepthStencilState(
 	}
 }
 
-static void D3D11_ApplyRasterizerState(
+static void D3D11_SetDepthStencilState(
 	FNA3D_Renderer *driverData,
-	FNA3D_RasterizerState *rasterizerState
+	FNA3D_DepthStencilState *depthStencilState
 ) {
 	D3D11Renderer *renderer = (D3D11Renderer*) driverData;
-	ID3D11RasterizerState *rs = FetchRasterizerState(renderer, rasterizerState);
+	D3D11_INTERNAL_SetDepthStencilState(
+		renderer,
+		FetchDepthStencilState(renderer, depthStencilState),
+		depthStencilState
+	);
+}
 
+static void D3D11_INTERNAL_ApplyRasterizerState(
+	D3D11Renderer *renderer,
+	ID3D11RasterizerState *rs
+) {
 	if (renderer->rasterizerState != rs)
 	{
 		renderer->rasterizerState = rs;
@@ -2267,6 +2422,17 @@ static void D3D11_ApplyRasterizerState(
 	}
 }
 
+static void D3D11_ApplyRasterizerState(
+	FNA3D_Renderer *driverData,
+	FNA3D_RasterizerState *rasterizerState
+) {
+	D3D11Renderer *renderer = (D3D11Renderer*) driverData;
+	D3D11_INTERNAL_ApplyRasterizerState(
+		renderer,
+		FetchRasterizerState(renderer, rasterizerState)
+	);
+}
+
 static void D3D11_VerifySampler(
 	FNA3D_Renderer *driverData,
 	int32_t index,
@@ -2412,11 +2578,106 @@ static void D3D11_VerifyVertexSampler(
 	);
 }
 
+/* State Objects */
+
+static void D3D11_SetBlendStateObject(
+	FNA3D_Renderer *driverData,
+	FNA3D_BlendStateObject *blendState
+) {
+	D3D11Renderer *renderer = (D3D11Renderer*) driverData;
+	if (blendState->driverState == NULL)
+	{
+		blendState->driverState = FetchBlendState(
+			renderer,
+			&blendState->state
+		);
+	}
+	D3D11_INTERNAL_SetBlendState(
+		renderer,
+		(ID3D11BlendState*) blendState->driverState,
+		&blendState->state
+	);
+}
+
+static void D3D11_SetDepthStencilStateObject(
+	FNA3D_Renderer *driverData,
+	FNA3D_DepthStencilStateObject *depthStencilState
+) {
+	D3D11Renderer *renderer = (D3D11Renderer*) driverData;
+	if (depthStencilState->driverState == NULL)
+	{
+		depthStencilState->driverState = FetchDepthStencilState(
+			renderer,
+			&depthStencilState->state
+		);
+	}
+	D3D11_INTERNAL_SetDepthStencilState(
+		renderer,
+		(ID3D11DepthStencilState*) depthStencilState->driverState,
+		&depthStencilState->state
+	);
+}
+
+static void D3D11_ApplyRasterizerStateObject(
+	FNA3D_Renderer *driverData,
+	FNA3D_RasterizerStateObject *rasterizerState
+) {
+	D3D11Renderer *renderer = (D3D11Renderer*) driverData;
+	void **rs = &rasterizerState->driverState[renderer->currentDepthFormat];
+	if (*rs == NULL)
+	{
+		*rs = FetchRasterizerState(renderer, &rasterizerState->state);
+	}
+	D3D11_INTERNAL_ApplyRasterizerState(
+		renderer,
+		(ID3D11RasterizerState*) *rs
+	);
+}
+
+static void D3D11_VerifySamplerObject(
+	FNA3D_Renderer *driverData,
+	int32_t index,
+	FNA3D_Texture *texture,
+	FNA3D_SamplerStateObject *sampler
+) {
+	D3D11Renderer *renderer = (D3D11Renderer*) driverData;
+
+	/* Same texture, same baked sampler? Nothing to do! */
+	if (	texture != NULL &&
+		sampler->driverState != NULL &&
+		renderer->textures[index] == (D3D11Texture*) texture &&
+		renderer->samplers[index] == sampler->driverState	)
+	{
+		return;
+	}
+
+	D3D11_VerifySampler(driverData, index, texture, &sampler->state);
+	if (texture != NULL)
+	{
+		sampler->driverState = renderer->samplers[index];
+	}
+}
+
+static void D3D11_VerifyVertexSamplerObject(
+	FNA3D_Renderer *driverData,
+	int32_t index,
+	FNA3D_Texture *texture,
+	FNA3D_SamplerStateObject *sampler
+) {
+	D3D11_VerifySamplerObject(
+		driverData,
+		MAX_TEXTURE_SAMPLERS + index,
+		texture,
+		sampler
+	);
+}
+
 /* Vertex State */
 
 static void D3D11_ApplyVertexBufferBindings(
 	FNA3D_Renderer *driverData,
 	FNA3D_VertexBufferBinding *bindings,
+	FNA3D_VertexDeclarationObject **declarations,
 	int32_t numBindings,
 	uint8_t bindingsUpdated,
 	int32_t baseVertex
@@ -2436,6 +2697,7 @@ static void D3D11_ApplyVertexBufferBindings(
 	inputLayout = FetchBindingsInputLayout(
 		renderer,
 		bindings,
+		declarations,
 		numBindings,
 		&hash
 	);
@@ -3069,6 +3331,12 @@ static FNA3D_Texture* D3D11_CreateTexture2D(
 		desc.BindFlags |= D3D11_BIND_RENDER_TARGET;
 		desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
 	}
+	else if (levelCount > 1 && SupportsMipAutogen(renderer, format))
+	{
+		/* Needed for GenerateMipmaps */
+		desc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	}
 
 	/* Create the texture */
 	ID3D11Device_CreateTexture2D(
@@ -3079,6 +3347,7 @@ static FNA3D_Texture* D3D11_CreateTexture2D(
 	);
 	result->levelCount = levelCount;
 	result->isRenderTarget = isRenderTarget;
+	result->canGenerateMips = (desc.MiscFlags & D3D11_RESOURCE_MISC_GENERATE_MIPS) != 0;
 	result->format = format;
 	result->twod.width = width;
 	result->twod.height = height;
@@ -3145,6 +3414,7 @@ static FNA3D_Texture* D3D11_CreateTexture3D(
 	);
 	result->levelCount = levelCount;
 	result->isRenderTarget = 0;
+	result->canGenerateMips = 0;
 	result->format = format;
 	result->threed.width = width;
 	result->threed.height = height;
@@ -3197,6 +3467,12 @@ static FNA3D_Texture* D3D11_CreateTextureCube(
 		desc.BindFlags |= D3D11_BIND_RENDER_TARGET;
 		desc.MiscFlags |= D3D11_RESOURCE_MISC_GENERATE_MIPS;
 	}
+	else if (levelCount > 1 && SupportsMipAutogen(renderer, format))
+	{
+		/* Needed for GenerateMipmaps */
+		desc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+		desc.MiscFlags |= D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	}
 
 	/* Create the texture */
 	ID3D11Device_CreateTexture2D(
@@ -3207,6 +3483,7 @@ static FNA3D_Texture* D3D11_CreateTextureCube(
 	);
 	result->levelCount = levelCount;
 	result->isRenderTarget = isRenderTarget;
+	result->canGenerateMips = (desc.MiscFlags & D3D11_RESOURCE_MISC_GENERATE_MIPS) != 0;
 	result->format = format;
 	result->cube.size = size;
 
@@ -3508,6 +3785,38 @@ static void D3D11_SetTextureDataYUV(
 	SDL_UnlockMutex(renderer->ctxLock);
 }
 
+static void D3D11_GenerateMipmaps(
+	FNA3D_Renderer *driverData,
+	FNA3D_Texture *texture
+) {
+	D3D11Renderer *renderer = (D3D11Renderer*) driverData;
+	D3D11Texture *tex = (D3D11Texture*) texture;
+
+	if (tex->levelCount <= 1)
+	{
+		return;
+	}
+
+	/* GenerateMips needs a texture created for it, which the format
+	 * support check may not have allowed.
+	 */
+	if (!tex->canGenerateMips)
+	{
+		FNA3D_LogWarn(
+			"%s\n",
+			"Texture format cannot autogenerate mips, mipmaps were not generated"
+		);
+		return;
+	}
+
+	SDL_LockMutex(renderer->ctxLock);
+	ID3D11DeviceContext_GenerateMips(
+		renderer->context,
+		tex->shaderView
+	);
+	SDL_UnlockMutex(renderer->ctxLock);
+}
+
 static void D3D11_GetTextureData2D(
 	FNA3D_Renderer *driverData,
 	FNA3D_Texture *texture,
@@ -4291,13 +4600,14 @@ static void D3D11_CreateEffect(
 	FNA3D_Effect **effect,
 	MOJOSHADER_effect **effectData
 ) {
+	D3D11Renderer *renderer = (D3D11Renderer*) driverData;
 	int32_t i;
 	MOJOSHADER_effectShaderContext shaderBackend;
 	D3D11Effect *result;
 
-	shaderBackend.compileShader = (MOJOSHADER_compileShaderFunc) MOJOSHADER_d3d11CompileShader;
-	shaderBackend.shaderAddRef = (MOJOSHADER_shaderAddRefFunc) MOJOSHADER_d3d11ShaderAddRef;
-	shaderBackend.deleteShader = (MOJOSHADER_deleteShaderFunc) MOJOSHADER_d3d11DeleteShader;
+	shaderBackend.compileShader = ShaderCache_CompileShader;
+	shaderBackend.shaderAddRef = ShaderCache_ShaderAddRef;
+	shaderBackend.deleteShader = ShaderCache_DeleteShader;
 	shaderBackend.getParseData = (MOJOSHADER_getParseDataFunc) MOJOSHADER_d3d11GetShaderParseData;
 	shaderBackend.bindShaders = (MOJOSHADER_bindShadersFunc) MOJOSHADER_d3d11BindShaders;
 	shaderBackend.getBoundShaders = (MOJOSHADER_getBoundShadersFunc) MOJOSHADER_d3d11GetBoundShaders;
@@ -4307,6 +4617,8 @@ static void D3D11_CreateEffect(
 	shaderBackend.f = NULL;
 	shaderBackend.malloc_data = NULL;
 
+	FNA3D_LockShaderBackend(FNA3D_SHADERBACKEND_D3D11);
+	ShaderCache_MakeCurrent(&renderer->shaderCache);
 	*effectData = MOJOSHADER_compileEffect(
 		effectCode,
 		effectCodeLength,
@@ -4316,6 +4628,7 @@ static void D3D11_CreateEffect(
 		0,
 		&shaderBackend
 	);
+	FNA3D_UnlockShaderBackend(FNA3D_SHADERBACKEND_D3D11);
 
 	for (i = 0; i < (*effectData)->error_count; i += 1)
 	{
@@ -4336,10 +4649,14 @@ static void D3D11_CloneEffect(
 	FNA3D_Effect **effect,
 	MOJOSHADER_effect **effectData
 ) {
+	D3D11Renderer *renderer = (D3D11Renderer*) driverData;
 	D3D11Effect *d3dCloneSource = (D3D11Effect*) cloneSource;
 	D3D11Effect *result;
 
+	FNA3D_LockShaderBackend(FNA3D_SHADERBACKEND_D3D11);
+	ShaderCache_MakeCurrent(&renderer->shaderCache);
 	*effectData = MOJOSHADER_cloneEffect(d3dCloneSource->effect);
+	FNA3D_UnlockShaderBackend(FNA3D_SHADERBACKEND_D3D11);
 	if (*effectData == NULL)
 	{
 		FNA3D_LogError(
@@ -4369,7 +4686,10 @@ static void D3D11_AddDisposeEffect(
 		renderer->currentPass = 0;
 		renderer->effectApplied = 1;
 	}
+	FNA3D_LockShaderBackend(FNA3D_SHADERBACKEND_D3D11);
+	ShaderCache_MakeCurrent(&renderer->shaderCache);
 	MOJOSHADER_deleteEffect(effectData);
+	FNA3D_UnlockShaderBackend(FNA3D_SHADERBACKEND_D3D11);
 	SDL_UnlockMutex(renderer->ctxLock);
 	SDL_free(effect);
 }
@@ -4557,6 +4877,72 @@ static int32_t D3D11_QueryPixelCount(
 	return (int32_t) result;
 }
 
+/* Readbacks */
+
+static FNA3D_Readback* D3D11_RequestReadback(
+	FNA3D_Renderer *driverData,
+	FNA3D_Texture *texture,
+	FNA3D_SurfaceFormat format,
+	int32_t x,
+	int32_t y,
+	int32_t w,
+	int32_t h,
+	int32_t level,
+	int32_t dataLength
+) {
+	D3D11Readback *result = (D3D11Readback*) SDL_malloc(
+		sizeof(D3D11Readback)
+	);
+	result->dataLength = dataLength;
+	result->data = (uint8_t*) SDL_malloc(dataLength);
+
+	/* No async path here, so just read it right now */
+	if (texture == NULL)
+	{
+		D3D11_ReadBackbuffer(
+			driverData,
+			x,
+			y,
+			w,
+			h,
+			result->data,
+			dataLength
+		);
+	}
+	else
+	{
+		D3D11_GetTextureData2D(
+			driverData,
+			texture,
+			format,
+			x,
+			y,
+			w,
+			h,
+			level,
+			result->data,
+			dataLength
+		);
+	}
+
+	return (FNA3D_Readback*) result;
+}
+
+static uint8_t D3D11_PollReadback(
+	FNA3D_Renderer *driverData,
+	FNA3D_Readback *readback,
+	void* data
+) {
+	D3D11Readback *d3dReadback = (D3D11Readback*) readback;
+	if (data != NULL)
+	{
+		SDL_memcpy(data, d3dReadback->data, d3dReadback->dataLength);
+	}
+	SDL_free(d3dReadback->data);
+	SDL_free(d3dReadback);
+	return 1;
+}
+
 /* Feature Queries */
 
 static uint8_t D3D11_SupportsDXT1(FNA3D_Renderer *driverData)
@@ -4581,6 +4967,11 @@ static uint8_t D3D11_SupportsNoOverwrite(FNA3D_Renderer *driverData)
 	return 1;
 }
 
+static uint8_t D3D11_SupportsIndirectDraws(FNA3D_Renderer *driverData)
+{
+	return 0;
+}
+
 static void D3D11_GetMaxTextureSlots(
 	FNA3D_Renderer *driverData,
 	int32_t *textures,
@@ -5001,7 +5392,9 @@ static FNA3D_Device* D3D11_CreateDevice(
 	);
 	renderer->supportsS3tc = (supportsDxt3 || supportsDxt5);
 
-	/* Initialize MojoShader context */
+	/* Initialize MojoShader context. MojoShader's D3D11 backend has one
+	 * implicit context per process, so only one D3D11 device may exist.
+	 */
 	MOJOSHADER_d3d11CreateContext(
 		renderer->device,
 		renderer->context,
@@ -5009,6 +5402,12 @@ static FNA3D_Device* D3D11_CreateDevice(
 		NULL,
 		NULL
 	);
+	ShaderCache_Init(
+		&renderer->shaderCache,
+		(MOJOSHADER_compileShaderFunc) MOJOSHADER_d3d11CompileShader,
+		(MOJOSHADER_shaderAddRefFunc) MOJOSHADER_d3d11ShaderAddRef,
+		(MOJOSHADER_deleteShaderFunc) MOJOSHADER_d3d11DeleteShader
+	);
 
 	/* Initialize texture and sampler collections */
 	for (i = 0; i < MAX_TOTAL_SAMPLERS; i += 1)
@@ -5069,10 +5468,11 @@ static FNA3D_Device* D3D11_CreateDevice(
 	renderer->ctxLock = SDL_CreateMutex();
 
 	/* Initialize state object caches */
-	hmdefault(renderer->blendStateCache, NULL);
-	hmdefault(renderer->depthStencilStateCache, NULL);
-	hmdefault(renderer->rasterizerStateCache, NULL);
-	hmdefault(renderer->samplerStateCache, NULL);
+	PackedHashMap_Init(&renderer->blendStateCache, 2);
+	PackedHashMap_Init(&renderer->depthStencilStateCache, 2);
+	PackedHashMap_Init(&renderer->rasterizerStateCache, 2);
+	PackedHashMap_Init(&renderer->samplerStateCache, 2);
+	PackedHashMap_Init(&renderer->inputLayoutCache, 1);
 
 	/* Create and return the FNA3D_Device */
 	result = (FNA3D_Device*) SDL_malloc(sizeof(FNA3D_Device));
@@ -5353,7 +5753,8 @@ FNA3D_Driver D3D11Driver = {
 	"D3D11",
 	D3D11_PrepareWindowAttributes,
 	D3D11_GetDrawableSize,
-	D3D11_CreateDevice
+	D3D11_CreateDevice,
+	NULL
 };
 
 #else
@@ -28,7 +28,6 @@
 
 #include "FNA3D_Driver_Metal.h"
 #include "FNA3D_PipelineCache.h"
-#include "stb_ds.h"
 
 /* Internal Structures */
 
@@ -37,7 +36,7 @@ typedef struct MetalRenderbuffer MetalRenderbuffer;
 typedef struct MetalBuffer MetalBuffer;
 typedef struct MetalEffect MetalEffect;
 typedef struct MetalQuery MetalQuery;
-typedef struct PipelineHashMap PipelineHashMap;
+typedef struct MetalReadback MetalReadback;
 
 struct MetalTexture /* Cast from FNA3D_Texture* */
 {
@@ -97,10 +96,16 @@ struct MetalRenderbuffer /* Cast from FNA3D_Renderbuffer* */
 	int32_t multiSampleCount;
 };
 
+typedef struct MetalEffectLibrary
+{
+	void *handle; /* MTLLibrary */
+	SDL_atomic_t refcount;
+} MetalEffectLibrary;
+
 struct MetalEffect /* Cast from FNA3D_Effect* */
 {
 	MOJOSHADER_effect *effect;
-	void *library; /* MTLLibrary */
+	MetalEffectLibrary *library; /* Shared with clones, like the shaders */
 };
 
 struct MetalQuery /* Cast from FNA3D_Query* */
@@ -108,6 +113,12 @@ struct MetalQuery /* Cast from FNA3D_Query* */
 	MTLBuffer *handle;
 };
 
+struct MetalReadback /* Cast from FNA3D_Readback* */
+{
+	uint8_t *data;
+	int32_t dataLength;
+};
+
 typedef struct MetalBackbuffer
 {
 	int32_t width;
@@ -140,6 +151,7 @@ typedef struct MetalRenderer /* Cast from FNA3D_Renderer* */
 	uint8_t supportsS3tc;
 	uint8_t supportsDxt1;
 	uint8_t supportsOcclusionQueries;
+	uint8_t supportsBaseVertex;
 	uint8_t maxMultiSampleCount;
 
 	/* Basic Metal Objects */
@@ -184,6 +196,7 @@ typedef struct MetalRenderer /* Cast from FNA3D_Renderer* */
 	FNA3D_Color blendColor;
 	int32_t multiSampleMask;
 	FNA3D_BlendState blendState;
+	StateHash blendStateHash;
 	MTLRenderPipelineState *ldPipelineState;
 
 	/* Stencil State */
@@ -212,6 +225,7 @@ typedef struct MetalRenderer /* Cast from FNA3D_Renderer* */
 
 	/* Depth Stencil State */
 	FNA3D_DepthStencilState depthStencilState;
+	StateHash depthStencilStateHash;
 	MTLDepthStencilState *defaultDepthStencilState;
 	MTLDepthStencilState *ldDepthStencilState;
 	MTLPixelFormat D16Format;
@@ -233,6 +247,8 @@ typedef struct MetalRenderer /* Cast from FNA3D_Renderer* */
 	int32_t ldFragUniformOffset;
 	MTLBuffer *ldVertexBuffers[MAX_BOUND_VERTEX_BUFFERS];
 	int32_t ldVertexBufferOffsets[MAX_BOUND_VERTEX_BUFFERS];
+	int32_t ldVertexBufferStrides[MAX_BOUND_VERTEX_BUFFERS];
+	int32_t ldVertexBufferCount;
 
 	/* Render Targets */
 	MTLTexture *currentAttachments[MAX_RENDERTARGET_BINDINGS];
@@ -252,10 +268,10 @@ typedef struct MetalRenderer /* Cast from FNA3D_Renderer* */
 	uint8_t shouldClearStencil;
 
 	/* Pipeline State Object Caches */
-	UInt64HashMap *vertexDescriptorCache;
-	PipelineHashMap *pipelineStateCache;
-	StateHashMap *depthStencilStateCache;
-	StateHashMap *samplerStateCache;
+	PackedHashMap vertexDescriptorCache;
+	PackedHashMap pipelineStateCache;
+	PackedHashMap depthStencilStateCache;
+	PackedHashMap samplerStateCache;
 
 	/* MojoShader Interop */
 	MOJOSHADER_effect *currentEffect;
@@ -965,6 +981,7 @@ static void UpdateRenderPass(MetalRenderer *renderer)
 		renderer->ldVertexBuffers[i] = NULL;
 		renderer->ldVertexBufferOffsets[i] = 0;
 	}
+	renderer->ldVertexBufferCount = 0;
 }
 
 /* Pipeline Stall Function */
@@ -1218,15 +1235,8 @@ typedef struct PipelineHash
 	uint64_t d;
 } PipelineHash;
 
-struct PipelineHashMap
-{
-	PipelineHash key;
-	MTLRenderPipelineState *value;
-};
-
-static int32_t GetBlendStateHashCode(FNA3D_BlendState blendState)
+static int32_t GetBlendStateHashCode(StateHash hash)
 {
-	StateHash hash = GetBlendStateHash(blendState);
 	return (
 		(hash.a ^ (hash.a >> 32)) +
 		(hash.b ^ (hash.b >> 32))
@@ -1304,7 +1314,7 @@ static PipelineHash GetPipelineHash(MetalRenderer *renderer)
 	result.b = (uint64_t) pixl;
 	result.c = (uint64_t) renderer->currentVertexDescriptor;
 	result.d = (
-		(uint64_t) GetBlendStateHashCode(renderer->blendState) << 32 |
+		(uint64_t) GetBlendStateHashCode(renderer->blendStateHash) << 32 |
 		(uint64_t) packedProperties
 	);
 	return result;
@@ -1313,6 +1323,7 @@ static PipelineHash GetPipelineHash(MetalRenderer *renderer)
 static MTLRenderPipelineState* FetchRenderPipeline(MetalRenderer *renderer)
 {
 	PipelineHash hash = GetPipelineHash(renderer);
+	uint64_t key[4];
 	MTLRenderPipelineDescriptor *pipelineDesc;
 	MTLFunction *vertHandle;
 	MTLFunction *fragHandle;
@@ -1323,7 +1334,14 @@ static MTLRenderPipelineState* FetchRenderPipeline(MetalRenderer *renderer)
 	MTLRenderPipelineState *result;
 
 	/* Can we just reuse an existing pipeline? */
-	result = hmget(renderer->pipelineStateCache, hash);
+	key[0] = hash.a;
+	key[1] = hash.b;
+	key[2] = hash.c;
+	key[3] = hash.d;
+	result = (MTLRenderPipelineState*) PackedHashMap_Get(
+		&renderer->pipelineStateCache,
+		key
+	);
 	if (result != NULL)
 	{
 		/* We already have this state cached! */
@@ -1478,7 +1496,7 @@ static MTLRenderPipelineState* FetchRenderPipeline(MetalRenderer *renderer)
 		renderer->device,
 		pipelineDesc
 	);
-	hmput(renderer->pipelineStateCache, hash, result);
+	PackedHashMap_Put(&renderer->pipelineStateCache, key, result);
 
 	/* Clean up */
 	objc_release(pipelineDesc);
@@ -1512,8 +1530,11 @@ static MTLDepthStencilState* FetchDepthStencilState(MetalRenderer *renderer)
 	}
 
 	/* Can we just reuse an existing state? */
-	hash = GetDepthStencilStateHash(renderer->depthStencilState);
-	state = hmget(renderer->depthStencilStateCache, hash);
+	hash = renderer->depthStencilStateHash;
+	state = (MTLDepthStencilState*) PackedHashMap_GetState(
+		&renderer->depthStencilStateCache,
+		hash
+	);
 	if (state != NULL)
 	{
 		/* This state has already been cached! */
@@ -1633,7 +1654,7 @@ static MTLDepthStencilState* FetchDepthStencilState(MetalRenderer *renderer)
 		renderer->device,
 		dsDesc
 	);
-	hmput(renderer->depthStencilStateCache, hash, state);
+	PackedHashMap_PutState(&renderer->depthStencilStateCache, hash, state);
 
 	/* Clean up */
 	objc_release(dsDesc);
@@ -1653,7 +1674,10 @@ static MTLSamplerState* FetchSamplerState(
 
 	/* Can we reuse an existing state? */
 	hash = GetSamplerStateHash(*samplerState);
-	state = hmget(renderer->samplerStateCache, hash);
+	state = (MTLSamplerState*) PackedHashMap_GetState(
+		&renderer->samplerStateCache,
+		hash
+	);
 	if (state != NULL)
 	{
 		/* This state has already been cached! */
@@ -1720,7 +1744,7 @@ static MTLSamplerState* FetchSamplerState(
 		renderer->device,
 		desc
 	);
-	hmput(renderer->samplerStateCache, hash, state);
+	PackedHashMap_PutState(&renderer->samplerStateCache, hash, state);
 
 	/* Clean up */
 	objc_release(desc);
@@ -1777,6 +1801,7 @@ static MTLTexture* FetchTransientTexture(
 static MTLVertexDescriptor* FetchVertexBufferBindingsDescriptor(
 	MetalRenderer *renderer,
 	FNA3D_VertexBufferBinding *bindings,
+	FNA3D_VertexDeclarationObject **declarations,
 	int32_t numBindings
 ) {
 	uint64_t hash;
@@ -1792,12 +1817,16 @@ static MTLVertexDescriptor* FetchVertexBufferBindingsDescriptor(
 	MOJOSHADER_mtlGetBoundShaders(&vertexShader, &blah);
 
 	/* Can we just reuse an existing descriptor? */
-	hash = GetVertexBufferBindingsHash(
+	hash = GetVertexDeclarationObjectsHash(
 		bindings,
+		declarations,
 		numBindings,
 		vertexShader
 	);
-	result = hmget(renderer->vertexDescriptorCache, hash);
+	result = (MTLVertexDescriptor*) PackedHashMap_Get(
+		&renderer->vertexDescriptorCache,
+		&hash
+	);
 	if (result != NULL)
 	{
 		/* This descriptor has already been cached! */
@@ -1894,7 +1923,7 @@ static MTLVertexDescriptor* FetchVertexBufferBindingsDescriptor(
 		}
 	}
 
-	hmput(renderer->vertexDescriptorCache, hash, result);
+	PackedHashMap_Put(&renderer->vertexDescriptorCache, &hash, result);
 	return result;
 }
 
@@ -1919,7 +1948,10 @@ static MTLVertexDescriptor* FetchVertexDeclarationDescriptor(
 		*vertexDeclaration,
 		vertexShader
 	);
-	result = hmget(renderer->vertexDescriptorCache, hash);
+	result = (MTLVertexDescriptor*) PackedHashMap_Get(
+		&renderer->vertexDescriptorCache,
+		&hash
+	);
 	if (result != NULL)
 	{
 		/* This descriptor has already been cached! */
@@ -2000,7 +2032,7 @@ static MTLVertexDescriptor* FetchVertexDeclarationDescriptor(
 		vertexDeclaration->vertexStride
 	);
 
-	hmput(renderer->vertexDescriptorCache, hash, result);
+	PackedHashMap_Put(&renderer->vertexDescriptorCache, &hash, result);
 	return result;
 }
 
@@ -2019,32 +2051,44 @@ static void METAL_DestroyDevice(FNA3D_Device *device)
 	EndPass(renderer);
 
 	/* Release vertex descriptors */
-	for (i = 0; i < hmlen(renderer->vertexDescriptorCache); i += 1)
+	for (i = 0; i < renderer->vertexDescriptorCache.capacity; i += 1)
 	{
-		objc_release(renderer->vertexDescriptorCache[i].value);
+		if (renderer->vertexDescriptorCache.tags[i] != 0)
+		{
+			objc_release(PackedHashMap_Value(&renderer->vertexDescriptorCache, i));
+		}
 	}
-	hmfree(renderer->vertexDescriptorCache);
+	PackedHashMap_Free(&renderer->vertexDescriptorCache);
 
 	/* Release depth stencil states */
-	for (i = 0; i < hmlen(renderer->depthStencilStateCache); i += 1)
+	for (i = 0; i < renderer->depthStencilStateCache.capacity; i += 1)
 	{
-		objc_release(renderer->depthStencilStateCache[i].value);
+		if (renderer->depthStencilStateCache.tags[i] != 0)
+		{
+			objc_release(PackedHashMap_Value(&renderer->depthStencilStateCache, i));
+		}
 	}
-	hmfree(renderer->depthStencilStateCache);
+	PackedHashMap_Free(&renderer->depthStencilStateCache);
 
 	/* Release pipeline states */
-	for (i = 0; i < hmlen(renderer->pipelineStateCache); i += 1)
+	for (i = 0; i < renderer->pipelineStateCache.capacity; i += 1)
 	{
-		objc_release(renderer->pipelineStateCache[i].value);
+		if (renderer->pipelineStateCache.tags[i] != 0)
+		{
+			objc_release(PackedHashMap_Value(&renderer->pipelineStateCache, i));
+		}
 	}
-	hmfree(renderer->pipelineStateCache);
+	PackedHashMap_Free(&renderer->pipelineStateCache);
 
 	/* Release sampler states */
-	for (i = 0; i < hmlen(renderer->samplerStateCache); i += 1)
+	for (i = 0; i < renderer->samplerStateCache.capacity; i += 1)
 	{
-		objc_release(renderer->samplerStateCache[i].value);
+		if (renderer->samplerStateCache.tags[i] != 0)
+		{
+			objc_release(PackedHashMap_Value(&renderer->samplerStateCache, i));
+		}
 	}
-	hmfree(renderer->samplerStateCache);
+	PackedHashMap_Free(&renderer->samplerStateCache);
 
 	/* Release transient textures */
 	tex = renderer->transientTextures;
@@ -2409,6 +2453,149 @@ static void METAL_DrawIndexedPrimitives(
 	);
 }
 
+static void OffsetVertexBuffers(MetalRenderer *renderer, int32_t baseVertex)
+{
+	int32_t i;
+
+	/* Shifts the bound vertex buffers without touching the tracked offsets,
+	 * so passing 0 puts back what ApplyVertexBufferBindings bound.
+	 */
+	for (i = 0; i < renderer->ldVertexBufferCount; i += 1)
+	{
+		if (renderer->ldVertexBufferStrides[i] == 0)
+		{
+			continue;
+		}
+		mtlSetVertexBufferOffset(
+			renderer->renderCommandEncoder,
+			renderer->ldVertexBufferOffsets[i] + (
+				baseVertex * renderer->ldVertexBufferStrides[i]
+			),
+			i
+		);
+	}
+}
+
+static void METAL_MultiDrawIndexedPrimitives(
+	FNA3D_Renderer *driverData,
+	FNA3D_PrimitiveType primitiveType,
+	FNA3D_DrawIndexedArgs *drawArgs,
+	int32_t drawCount,
+	FNA3D_Buffer *indices,
+	FNA3D_IndexElementSize indexElementSize
+) {
+	MetalRenderer *renderer = (MetalRenderer*) driverData;
+	MetalBuffer *indexBuffer = (MetalBuffer*) indices;
+	int32_t i, totalIndexOffset;
+	uint8_t offsetBuffers = 0;
+
+	indexBuffer->boundThisFrame = 1;
+	for (i = 0; i < drawCount; i += 1)
+	{
+		totalIndexOffset = (
+			(drawArgs[i].startIndex * IndexSize(indexElementSize)) +
+			indexBuffer->internalOffset
+		);
+		if (	drawArgs[i].baseVertex == 0 &&
+			drawArgs[i].baseInstance == 0	)
+		{
+			mtlDrawIndexedPrimitives(
+				renderer->renderCommandEncoder,
+				XNAToMTL_Primitive[primitiveType],
+				drawArgs[i].indexCount,
+				XNAToMTL_IndexType[indexElementSize],
+				indexBuffer->handle,
+				totalIndexOffset,
+				drawArgs[i].instanceCount
+			);
+		}
+		else if (renderer->supportsBaseVertex)
+		{
+			mtlDrawIndexedPrimitivesBaseVertex(
+				renderer->renderCommandEncoder,
+				XNAToMTL_Primitive[primitiveType],
+				drawArgs[i].indexCount,
+				XNAToMTL_IndexType[indexElementSize],
+				indexBuffer->handle,
+				totalIndexOffset,
+				drawArgs[i].instanceCount,
+				drawArgs[i].baseVertex,
+				drawArgs[i].baseInstance
+			);
+		}
+		else if (drawArgs[i].baseInstance != 0)
+		{
+			FNA3D_LogError(
+				"baseInstance requires an A9 GPU or newer, skipping draw"
+			);
+		}
+		else
+		{
+			/* A8 and older can only do this via buffer offsets */
+			OffsetVertexBuffers(renderer, drawArgs[i].baseVertex);
+			offsetBuffers = 1;
+			mtlDrawIndexedPrimitives(
+				renderer->renderCommandEncoder,
+				XNAToMTL_Primitive[primitiveType],
+				drawArgs[i].indexCount,
+				XNAToMTL_IndexType[indexElementSize],
+				indexBuffer->handle,
+				totalIndexOffset,
+				drawArgs[i].instanceCount
+			);
+		}
+	}
+
+	if (offsetBuffers)
+	{
+		OffsetVertexBuffers(renderer, 0);
+	}
+}
+
+static void METAL_GetVertexBufferData(
+	FNA3D_Renderer *driverData,
+	FNA3D_Buffer *buffer,
+	int32_t offsetInBytes,
+	void* data,
+	int32_t elementCount,
+	int32_t elementSizeInBytes,
+	int32_t vertexStride
+);
+static void METAL_MultiDrawIndexedPrimitivesIndirect(
+	FNA3D_Renderer *driverData,
+	FNA3D_PrimitiveType primitiveType,
+	FNA3D_Buffer *drawBuffer,
+	int32_t offsetInBytes,
+	int32_t drawCount,
+	FNA3D_Buffer *indices,
+	FNA3D_IndexElementSize indexElementSize
+) {
+	/* Metal's indirect draws only take one range per call, and our buffers
+	 * are CPU-visible anyway, so just copy the arguments out and loop.
+	 */
+	FNA3D_DrawIndexedArgs *drawArgs = (FNA3D_DrawIndexedArgs*) SDL_malloc(
+		sizeof(FNA3D_DrawIndexedArgs) * drawCount
+	);
+	METAL_GetVertexBufferData(
+		driverData,
+		drawBuffer,
+		offsetInBytes,
+		drawArgs,
+		drawCount,
+		sizeof(FNA3D_DrawIndexedArgs),
+		sizeof(FNA3D_DrawIndexedArgs)
+	);
+	METAL_MultiDrawIndexedPrimitives(
+		driverData,
+		primitiveType,
+		drawArgs,
+		drawCount,
+		indices,
+		indexElementSize
+	);
+	SDL_free(drawArgs);
+}
+
 static void METAL_DrawPrimitives(
 	FNA3D_Renderer *driverData,
 	FNA3D_PrimitiveType primitiveType,
@@ -2607,6 +2794,7 @@ static void METAL_SetBlendState(
 		blendState,
 		sizeof(FNA3D_BlendState)
 	);
+	renderer->blendStateHash = GetBlendStateHash(*blendState);
 	METAL_SetBlendFactor(
 		driverData,
 		&blendState->blendFactor
@@ -2623,6 +2811,9 @@ static void METAL_SetDepthStencilState(
 		depthStencilState,
 		sizeof(FNA3D_DepthStencilState)
 	);
+	renderer->depthStencilStateHash = GetDepthStencilStateHash(
+		*depthStencilState
+	);
 	METAL_SetReferenceStencil(
 		driverData,
 		depthStencilState->referenceStencil
@@ -2761,6 +2952,88 @@ static void METAL_VerifyVertexSampler(
 	);
 }
 
+/* State Objects */
+
+static void METAL_SetBlendStateObject(
+	FNA3D_Renderer *driverData,
+	FNA3D_BlendStateObject *blendState
+) {
+	MetalRenderer *renderer = (MetalRenderer*) driverData;
+	SDL_memcpy(
+		&renderer->blendState,
+		&blendState->state,
+		sizeof(FNA3D_BlendState)
+	);
+	renderer->blendStateHash = blendState->hash;
+	METAL_SetBlendFactor(
+		driverData,
+		&blendState->state.blendFactor
+	); /* Dynamic state! */
+}
+
+static void METAL_SetDepthStencilStateObject(
+	FNA3D_Renderer *driverData,
+	FNA3D_DepthStencilStateObject *depthStencilState
+) {
+	MetalRenderer *renderer = (MetalRenderer*) driverData;
+	SDL_memcpy(
+		&renderer->depthStencilState,
+		&depthStencilState->state,
+		sizeof(FNA3D_DepthStencilState)
+	);
+	renderer->depthStencilStateHash = depthStencilState->hash;
+	METAL_SetReferenceStencil(
+		driverData,
+		depthStencilState->state.referenceStencil
+	); /* Dynamic state! */
+}
+
+static void METAL_ApplyRasterizerStateObject(
+	FNA3D_Renderer *driverData,
+	FNA3D_RasterizerStateObject *rasterizerState
+) {
+	/* Rasterizer state is all dynamic, nothing to bake */
+	METAL_ApplyRasterizerState(driverData, &rasterizerState->state);
+}
+
+static void METAL_VerifySamplerObject(
+	FNA3D_Renderer *driverData,
+	int32_t index,
+	FNA3D_Texture *texture,
+	FNA3D_SamplerStateObject *sampler
+) {
+	MetalRenderer *renderer = (MetalRenderer*) driverData;
+
+	/* Same texture, same baked sampler? Nothing to do! */
+	if (	texture != NULL &&
+		sampler->driverState != NULL &&
+		renderer->textures[index] == (MetalTexture*) texture &&
+		renderer->samplers[index] == sampler->driverState	)
+	{
+		return;
+	}
+
+	METAL_VerifySampler(driverData, index, texture, &sampler->state);
+	if (texture != NULL)
+	{
+		sampler->driverState = renderer->samplers[index];
+	}
+}
+
+static void METAL_VerifyVertexSamplerObject(
+	FNA3D_Renderer *driverData,
+	int32_t index,
+	FNA3D_Texture *texture,
+	FNA3D_SamplerStateObject *sampler
+) {
+	METAL_VerifySamplerObject(
+		driverData,
+		MAX_TEXTURE_SAMPLERS + index,
+		texture,
+		sampler
+	);
+}
+
 /* Vertex State */
 
 static void BindResources(MetalRenderer *renderer)
@@ -2896,6 +3169,7 @@ static void BindResources(MetalRenderer *renderer)
 static void METAL_ApplyVertexBufferBindings(
 	FNA3D_Renderer *driverData,
 	FNA3D_VertexBufferBinding *bindings,
+	FNA3D_VertexDeclarationObject **declarations,
 	int32_t numBindings,
 	uint8_t bindingsUpdated,
 	int32_t baseVertex
@@ -2908,6 +3182,7 @@ static void METAL_ApplyVertexBufferBindings(
 	renderer->currentVertexDescriptor = FetchVertexBufferBindingsDescriptor(
 		renderer,
 		bindings,
+		declarations,
 		numBindings
 	);
 
@@ -2916,13 +3191,17 @@ static void METAL_ApplyVertexBufferBindings(
 	BindResources(renderer);
 
 	/* Bind the vertex buffers */
+	renderer->ldVertexBufferCount = numBindings;
 	for (i = 0; i < numBindings; i += 1)
 	{
 		vertexBuffer = (MetalBuffer*) bindings[i].vertexBuffer;
 		if (vertexBuffer == NULL)
 		{
+			renderer->ldVertexBufferStrides[i] = 0;
 			continue;
 		}
+		renderer->ldVertexBufferStrides[i] =
+			bindings[i].vertexDeclaration.vertexStride;
 
 		offset = vertexBuffer->internalOffset + (
 			(bindings[i].vertexOffset + baseVertex) *
@@ -3658,6 +3937,36 @@ static void METAL_SetTextureDataYUV(
 	);
 }
 
+static void METAL_GenerateMipmaps(
+	FNA3D_Renderer *driverData,
+	FNA3D_Texture *texture
+) {
+	MetalRenderer *renderer = (MetalRenderer*) driverData;
+	MetalTexture *mtlTexture = (MetalTexture*) texture;
+	MTLBlitCommandEncoder *blit;
+
+	if (!mtlTexture->hasMipmaps)
+	{
+		return;
+	}
+
+	/* We need an active command buffer */
+	METAL_BeginFrame(driverData);
+
+	/* End the render pass */
+	EndPass(renderer);
+
+	/* Generate the mip chain on the GPU */
+	blit = mtlMakeBlitCommandEncoder(renderer->commandBuffer);
+	mtlGenerateMipmapsForTexture(
+		blit,
+		mtlTexture->handle
+	);
+	mtlEndEncoding(blit);
+
+	renderer->needNewRenderPass = 1;
+}
+
 static void METAL_GetTextureData2D(
 	FNA3D_Renderer *driverData,
 	FNA3D_Texture *texture,
@@ -4148,6 +4457,10 @@ static void METAL_CreateEffect(
 	shaderBackend.f = NULL;
 	shaderBackend.malloc_data = NULL;
 
+	/* No ShaderCache here: MOJOSHADER_mtlCompileLibrary writes each
+	 * effect's library into its shaders, so they can't be shared with
+	 * other effects. Clones share the library along with the shaders.
+	 */
 	*effectData = MOJOSHADER_compileEffect(
 		effectCode,
 		effectCodeLength,
@@ -4168,7 +4481,11 @@ static void METAL_CreateEffect(
 
 	result = (MetalEffect*) SDL_malloc(sizeof(MetalEffect));
 	result->effect = *effectData;
-	result->library = MOJOSHADER_mtlCompileLibrary(*effectData);
+	result->library = (MetalEffectLibrary*) SDL_malloc(
+		sizeof(MetalEffectLibrary)
+	);
+	result->library->handle = MOJOSHADER_mtlCompileLibrary(*effectData);
+	SDL_AtomicSet(&result->library->refcount, 1);
 	*effect = (FNA3D_Effect*) result;
 }
 
@@ -4189,9 +4506,14 @@ static void METAL_CloneEffect(
 		);
 	}
 
+	/* The clone's shaders are the source's, which already have functions
+	 * from the source's library. Compiling another one would swap those
+	 * out from under every other clone.
+	 */
 	result = (MetalEffect*) SDL_malloc(sizeof(MetalEffect));
 	result->effect = *effectData;
-	result->library = MOJOSHADER_mtlCompileLibrary(*effectData);
+	result->library = mtlCloneSource->library;
+	SDL_AtomicIncRef(&result->library->refcount);
 	*effect = (FNA3D_Effect*) result;
 }
 
@@ -4209,7 +4531,11 @@ static void METAL_AddDisposeEffect(
 		renderer->currentTechnique = NULL;
 		renderer->currentPass = 0;
 	}
-	MOJOSHADER_mtlDeleteLibrary(mtlEffect->library);
+	if (SDL_AtomicDecRef(&mtlEffect->library->refcount))
+	{
+		MOJOSHADER_mtlDeleteLibrary(mtlEffect->library->handle);
+		SDL_free(mtlEffect->library);
+	}
 	MOJOSHADER_deleteEffect(mtlEffect->effect);
 	SDL_free(effect);
 }
@@ -4392,6 +4718,72 @@ static int32_t METAL_QueryPixelCount(
 	return (int32_t) (*((uint64_t*) contents));
 }
 
+/* Readbacks */
+
+static FNA3D_Readback* METAL_RequestReadback(
+	FNA3D_Renderer *driverData,
+	FNA3D_Texture *texture,
+	FNA3D_SurfaceFormat format,
+	int32_t x,
+	int32_t y,
+	int32_t w,
+	int32_t h,
+	int32_t level,
+	int32_t dataLength
+) {
+	MetalReadback *result = (MetalReadback*) SDL_malloc(
+		sizeof(MetalReadback)
+	);
+	result->dataLength = dataLength;
+	result->data = (uint8_t*) SDL_malloc(dataLength);
+
+	/* No async path here, so just read it right now */
+	if (texture == NULL)
+	{
+		METAL_ReadBackbuffer(
+			driverData,
+			x,
+			y,
+			w,
+			h,
+			result->data,
+			dataLength
+		);
+	}
+	else
+	{
+		METAL_GetTextureData2D(
+			driverData,
+			texture,
+			format,
+			x,
+			y,
+			w,
+			h,
+			level,
+			result->data,
+			dataLength
+		);
+	}
+
+	return (FNA3D_Readback*) result;
+}
+
+static uint8_t METAL_PollReadback(
+	FNA3D_Renderer *driverData,
+	FNA3D_Readback *readback,
+	void* data
+) {
+	MetalReadback *mtlReadback = (MetalReadback*) readback;
+	if (data != NULL)
+	{
+		SDL_memcpy(data, mtlReadback->data, mtlReadback->dataLength);
+	}
+	SDL_free(mtlReadback->data);
+	SDL_free(mtlReadback);
+	return 1;
+}
+
 /* Feature Queries */
 
 static uint8_t METAL_SupportsDXT1(FNA3D_Renderer *driverData)
@@ -4414,6 +4806,11 @@ static uint8_t METAL_SupportsNoOverwrite(FNA3D_Renderer *driverData)
 	return 1;
 }
 
+static uint8_t METAL_SupportsIndirectDraws(FNA3D_Renderer *driverData)
+{
+	return 0;
+}
+
 static void METAL_GetMaxTextureSlots(
 	FNA3D_Renderer *driverData,
 	int32_t *textures,
@@ -4680,6 +5077,7 @@ FNA3D_Device* METAL_CreateDevice(
 		renderer->isMac ||
 		HasModernAppleGPU(renderer->device)
 	);
+	renderer->supportsBaseVertex = renderer->supportsOcclusionQueries;
 
 	/* Determine supported depth formats */
 	renderer->D16Format = MTLPixelFormatDepth32Float;
@@ -4719,7 +5117,9 @@ FNA3D_Device* METAL_CreateDevice(
 		renderer->maxFramesInFlight
 	);
 
-	/* Initialize MojoShader context */
+	/* Initialize MojoShader context. MojoShader's Metal backend has one
+	 * implicit context per process, so only one Metal device may exist.
+	 */
 	MOJOSHADER_mtlCreateContext(
 		renderer->device,
 		renderer->maxFramesInFlight,
@@ -4752,10 +5152,10 @@ FNA3D_Device* METAL_CreateDevice(
 	InitializeFauxBackbuffer(renderer);
 
 	/* Initialize PSO caches */
-	hmdefault(renderer->pipelineStateCache, NULL);
-	hmdefault(renderer->depthStencilStateCache, NULL);
-	hmdefault(renderer->samplerStateCache, NULL);
-	hmdefault(renderer->vertexDescriptorCache, NULL);
+	PackedHashMap_Init(&renderer->pipelineStateCache, 4);
+	PackedHashMap_Init(&renderer->depthStencilStateCache, 2);
+	PackedHashMap_Init(&renderer->samplerStateCache, 2);
+	PackedHashMap_Init(&renderer->vertexDescriptorCache, 1);
 
 	/* Initialize renderer members not covered by SDL_memset('\0') */
 	renderer->multiSampleMask = -1; /* AKA 0xFFFFFFFF, ugh -flibit */
@@ -4771,7 +5171,8 @@ FNA3D_Driver MetalDriver = {
 	"Metal",
 	METAL_PrepareWindowAttributes,
 	METAL_GetDrawableSize,
-	METAL_CreateDevice
+	METAL_CreateDevice,
+	NULL
 };
 
 #else
@@ -378,6 +378,7 @@ static SEL selCopyFromTexture;
 static SEL selDepthAttachment;
 static SEL selDisplaySyncEnabled;
 static SEL selDrawIndexedPrimitives;
+static SEL selDrawIndexedPrimitivesBaseVertex;
 static SEL selDrawPrimitives;
 static SEL selDrawableSize;
 static SEL selEndEncoding;
@@ -525,6 +526,7 @@ static inline void InitObjC()
 	selDepthAttachment			= sel_registerName("depthAttachment");
 	selDisplaySyncEnabled			= sel_registerName("setDisplaySyncEnabled:");
 	selDrawIndexedPrimitives		= sel_registerName("drawIndexedPrimitives:indexCount:indexType:indexBuffer:indexBufferOffset:instanceCount:");
+	selDrawIndexedPrimitivesBaseVertex	= sel_registerName("drawIndexedPrimitives:indexCount:indexType:indexBuffer:indexBufferOffset:instanceCount:baseVertex:baseInstance:");
 	selDrawPrimitives			= sel_registerName("drawPrimitives:vertexStart:vertexCount:");
 	selDrawableSize				= sel_registerName("drawableSize");
 	selEndEncoding				= sel_registerName("endEncoding");
@@ -675,6 +677,7 @@ static inline void InitObjC()
 #define msg_vi		((void (*)(void*, SEL, int32_t)) objc_msgSend)
 #define msg_viU 	((void (*)(void*, SEL, int32_t, uint64_t)) objc_msgSend)
 #define msg_viUipUU	((void (*)(void*, SEL, int32_t, uint64_t, int32_t, void*, uint64_t, uint64_t)) objc_msgSend)
+#define msg_viUipUUlU	((void (*)(void*, SEL, int32_t, uint64_t, int32_t, void*, uint64_t, uint64_t, int64_t, uint64_t)) objc_msgSend)
 #define msg_viUU	((void (*)(void*, SEL, int32_t, uint64_t, uint64_t)) objc_msgSend)
 #define msg_vp		((void (*)(void*, SEL, void*)) objc_msgSend)
 #define msg_vpU 	((void (*)(void*, SEL, void*, uint64_t)) objc_msgSend)
@@ -1433,6 +1436,31 @@ static inline void mtlDrawIndexedPrimitives(
 	);
 }
 
+static inline void mtlDrawIndexedPrimitivesBaseVertex(
+	MTLRenderCommandEncoder *renderCommandEncoder,
+	MTLPrimitiveType primitiveType,
+	uint64_t indexCount,
+	MTLIndexType indexType,
+	MTLBuffer *indexBuffer,
+	uint64_t indexBufferOffset,
+	uint64_t instanceCount,
+	int64_t baseVertex,
+	uint64_t baseInstance
+) {
+	msg_viUipUUlU(
+		renderCommandEncoder,
+		selDrawIndexedPrimitivesBaseVertex,
+		primitiveType,
+		indexCount,
+		indexType,
+		indexBuffer,
+		indexBufferOffset,
+		instanceCount,
+		baseVertex,
+		baseInstance
+	);
+}
+
 static inline void mtlDrawPrimitives(
 	MTLRenderCommandEncoder *renderCommandEncoder,
 	MTLPrimitiveType primitive,
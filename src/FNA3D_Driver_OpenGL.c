@@ -41,6 +41,7 @@ typedef struct OpenGLRenderbuffer OpenGLRenderbuffer;
 typedef struct OpenGLBuffer OpenGLBuffer;
 typedef struct OpenGLEffect OpenGLEffect;
 typedef struct OpenGLQuery OpenGLQuery;
+typedef struct OpenGLReadback OpenGLReadback;
 
 struct OpenGLTexture /* Cast from FNA3D_Texture* */
 {
@@ -104,6 +105,7 @@ struct OpenGLRenderbuffer /* Cast from FNA3D_Renderbuffer* */
 struct OpenGLEffect /* Cast from FNA3D_Effect* */
 {
 	MOJOSHADER_effect *effect;
+	struct OpenGLParsedShaders *parsed; /* NULL if created on main thread */
 	OpenGLEffect *next; /* linked list */
 };
 
@@ -113,6 +115,18 @@ struct OpenGLQuery /* Cast from FNA3D_Query* */
 	OpenGLQuery *next; /* linked list */
 };
 
+struct OpenGLReadback /* Cast from FNA3D_Readback* */
+{
+	GLuint buffer; /* GL_PIXEL_PACK_BUFFER, kept around for reuse */
+	int32_t bufferSize;
+	GLsync fence;
+	uint8_t *data; /* Only used when we had to read immediately */
+	int32_t dataLength;
+	int32_t flipPitch; /* Nonzero for the backbuffer, which is upside-down */
+	int32_t flipRows;
+	uint8_t inUse;
+};
+
 typedef struct OpenGLBackbuffer
 {
 	#define BACKBUFFER_TYPE_NULL 0
@@ -152,6 +166,25 @@ typedef struct OpenGLRenderer /* Cast from FNA3D_Renderer* */
 	uint8_t useES3;
 	uint8_t useCoreProfile;
 
+	/* Headless context, EGL if we can get it, a hidden window if not */
+	uint8_t headless;
+	SDL_Window *headlessWindow;
+	void *eglLibrary;
+	EGLDisplay eglDisplay;
+	EGLContext eglContext;
+	EGLSurface eglSurface; /* EGL_NO_SURFACE when surfaceless */
+	eglfntype_eglGetProcAddress eglGetProcAddress;
+	eglfntype_eglQueryString eglQueryString;
+	eglfntype_eglGetDisplay eglGetDisplay;
+	eglfntype_eglInitialize eglInitialize;
+	eglfntype_eglBindAPI eglBindAPI;
+	eglfntype_eglChooseConfig eglChooseConfig;
+	eglfntype_eglCreateContext eglCreateContext;
+	eglfntype_eglCreatePbufferSurface eglCreatePbufferSurface;
+	eglfntype_eglMakeCurrent eglMakeCurrent;
+	eglfntype_eglDestroySurface eglDestroySurface;
+	eglfntype_eglDestroyContext eglDestroyContext;
+
 	/* The Faux-Backbuffer */
 	OpenGLBackbuffer *backbuffer;
 	FNA3D_DepthFormat windowDepthFormat;
@@ -176,9 +209,13 @@ typedef struct OpenGLRenderer /* Cast from FNA3D_Renderer* */
 	uint8_t supports_EXT_framebuffer_multisample;
 	uint8_t supports_ARB_internalformat_query;
 	uint8_t supports_ARB_invalidate_subdata;
+	uint8_t supports_ARB_map_buffer_range;
+	uint8_t supports_ARB_sync;
 	uint8_t supports_ARB_draw_instanced;
 	uint8_t supports_ARB_instanced_arrays;
 	uint8_t supports_ARB_draw_elements_base_vertex;
+	uint8_t supports_MultiDrawBaseVertex;
+	uint8_t supports_ARB_multi_draw_indirect;
 	uint8_t supports_EXT_draw_buffers2;
 	uint8_t supports_ARB_texture_multisample;
 	uint8_t supports_KHR_debug;
@@ -245,6 +282,12 @@ typedef struct OpenGLRenderer /* Cast from FNA3D_Renderer* */
 	GLuint currentVertexBuffer;
 	GLuint currentIndexBuffer;
 
+	/* Scratch arrays for glMultiDrawElementsBaseVertex */
+	int32_t multiDrawCapacity;
+	GLsizei *multiDrawCounts;
+	GLvoid **multiDrawOffsets;
+	GLint *multiDrawBaseVertices;
+
 	/* ld, or LastDrawn, vertex attributes */
 	int32_t ldBaseVertex;
 	FNA3D_VertexDeclaration *ldVertexDeclaration;
@@ -271,6 +314,9 @@ typedef struct OpenGLRenderer /* Cast from FNA3D_Renderer* */
 	float currentClearDepth;
 	int32_t currentClearStencil;
 
+	/* Readbacks */
+	OpenGLReadback readbacks[MAX_READBACKS];
+
 	/* Vertex Attributes */
 	int32_t numVertexAttributes;
 	OpenGLVertexAttribute attributes[MAX_VERTEX_ATTRIBUTES];
@@ -282,11 +328,14 @@ typedef struct OpenGLRenderer /* Cast from FNA3D_Renderer* */
 	/* MojoShader Interop */
 	const char *shaderProfile;
 	MOJOSHADER_glContext *shaderContext;
+	SDL_mutex *shaderContextLock;
+	ShaderCache shaderCache;
 	MOJOSHADER_effect *currentEffect;
 	const MOJOSHADER_effectTechnique *currentTechnique;
 	uint32_t currentPass;
 	uint8_t renderTargetBound;
 	uint8_t effectApplied;
+	uint8_t prelinkEffects;
 
 	/* Point Sprite Toggle */
 	uint8_t togglePointSprite;
@@ -608,6 +657,10 @@ struct FNA3D_Command
 	#define FNA3D_COMMAND_GETTEXTUREDATACUBE 16
 	#define FNA3D_COMMAND_GENCOLORRENDERBUFFER 17
 	#define FNA3D_COMMAND_GENDEPTHRENDERBUFFER 18
+	#define FNA3D_COMMAND_GENERATEMIPMAPS 19
+	#define FNA3D_COMMAND_REQUESTREADBACK 20
+	#define FNA3D_COMMAND_POLLREADBACK 21
+	#define FNA3D_COMMAND_UPLOADEFFECT 22 /* Internal, not an FNA3D call */
 	uint8_t type;
 	FNA3DNAMELESS union
 	{
@@ -626,6 +679,11 @@ struct FNA3D_Command
 			MOJOSHADER_effect **effectData;
 		} cloneEffect;
 
+		struct
+		{
+			FNA3D_Effect *effect;
+		} uploadEffect;
+
 		struct
 		{
 			uint8_t dynamic;
@@ -813,11 +871,41 @@ struct FNA3D_Command
 			int32_t multiSampleCount;
 			FNA3D_Renderbuffer *retval;
 		} genDepthStencilRenderbuffer;
+
+		struct
+		{
+			FNA3D_Texture *texture;
+		} generateMipmaps;
+
+		struct
+		{
+			FNA3D_Texture *texture;
+			FNA3D_SurfaceFormat format;
+			int32_t x;
+			int32_t y;
+			int32_t w;
+			int32_t h;
+			int32_t level;
+			int32_t dataLength;
+			FNA3D_Readback *retval;
+		} requestReadback;
+
+		struct
+		{
+			FNA3D_Readback *readback;
+			void* data;
+			uint8_t retval;
+		} pollReadback;
 	};
 	SDL_sem *semaphore;
 	FNA3D_Command *next;
 };
 
+static void OPENGL_INTERNAL_UploadEffect(
+	OpenGLRenderer *renderer,
+	OpenGLEffect *effect
+);
+
 static void FNA3D_ExecuteCommand(
 	FNA3D_Device *device,
 	FNA3D_Command *cmd
@@ -841,6 +929,12 @@ static void FNA3D_ExecuteCommand(
 				cmd->cloneEffect.effectData
 			);
 			break;
+		case FNA3D_COMMAND_UPLOADEFFECT:
+			OPENGL_INTERNAL_UploadEffect(
+				(OpenGLRenderer*) device->driverData,
+				(OpenGLEffect*) cmd->uploadEffect.effect
+			);
+			break;
 		case FNA3D_COMMAND_GENVERTEXBUFFER:
 			cmd->genVertexBuffer.retval = FNA3D_GenVertexBuffer(
 				device,
@@ -1039,6 +1133,32 @@ static void FNA3D_ExecuteCommand(
 				cmd->genDepthStencilRenderbuffer.multiSampleCount
 			);
 			break;
+		case FNA3D_COMMAND_GENERATEMIPMAPS:
+			FNA3D_GenerateMipmaps(
+				device,
+				cmd->generateMipmaps.texture
+			);
+			break;
+		case FNA3D_COMMAND_REQUESTREADBACK:
+			cmd->requestReadback.retval = FNA3D_RequestReadback(
+				device,
+				cmd->requestReadback.texture,
+				cmd->requestReadback.format,
+				cmd->requestReadback.x,
+				cmd->requestReadback.y,
+				cmd->requestReadback.w,
+				cmd->requestReadback.h,
+				cmd->requestReadback.level,
+				cmd->requestReadback.dataLength
+			);
+			break;
+		case FNA3D_COMMAND_POLLREADBACK:
+			cmd->pollReadback.retval = FNA3D_PollReadback(
+				device,
+				cmd->pollReadback.readback,
+				cmd->pollReadback.data
+			);
+			break;
 		default:
 			FNA3D_LogError(
 				"Cannot execute unknown command (value = %d)",
@@ -1135,6 +1255,19 @@ static inline void ToggleGLState(
 	}
 }
 
+static inline void LockShaderContext(OpenGLRenderer *renderer)
+{
+	SDL_LockMutex(renderer->shaderContextLock);
+	FNA3D_LockShaderBackend(FNA3D_SHADERBACKEND_OPENGL);
+	MOJOSHADER_glMakeContextCurrent(renderer->shaderContext);
+}
+
+static inline void UnlockShaderContext(OpenGLRenderer *renderer)
+{
+	FNA3D_UnlockShaderBackend(FNA3D_SHADERBACKEND_OPENGL);
+	SDL_UnlockMutex(renderer->shaderContextLock);
+}
+
 static inline void ForceToMainThread(
 	OpenGLRenderer *renderer,
 	FNA3D_Command *command
@@ -1157,6 +1290,7 @@ static void OPENGL_INTERNAL_CreateBackbuffer(
 	FNA3D_PresentationParameters *parameters
 );
 static void OPENGL_INTERNAL_DisposeBackbuffer(OpenGLRenderer *renderer);
+static void OPENGL_INTERNAL_DestroyEGLContext(OpenGLRenderer *renderer);
 static void OPENGL_INTERNAL_DestroyTexture(
 	OpenGLRenderer *renderer,
 	OpenGLTexture *texture
@@ -1194,6 +1328,20 @@ static void OPENGL_GetBackbufferSize(
 static void OPENGL_DestroyDevice(FNA3D_Device *device)
 {
 	OpenGLRenderer *renderer = (OpenGLRenderer*) device->driverData;
+	int32_t i;
+
+	for (i = 0; i < MAX_READBACKS; i += 1)
+	{
+		if (renderer->readbacks[i].fence != NULL)
+		{
+			renderer->glDeleteSync(renderer->readbacks[i].fence);
+		}
+		if (renderer->readbacks[i].buffer != 0)
+		{
+			renderer->glDeleteBuffers(1, &renderer->readbacks[i].buffer);
+		}
+		SDL_free(renderer->readbacks[i].data);
+	}
 
 	if (renderer->useCoreProfile)
 	{
@@ -1215,8 +1363,16 @@ static void OPENGL_DestroyDevice(FNA3D_Device *device)
 	SDL_free(renderer->backbuffer);
 	renderer->backbuffer = NULL;
 
+	SDL_free(renderer->multiDrawCounts);
+	SDL_free(renderer->multiDrawOffsets);
+	SDL_free(renderer->multiDrawBaseVertices);
+
+	LockShaderContext(renderer);
+	ShaderCache_Free(&renderer->shaderCache);
 	MOJOSHADER_glMakeContextCurrent(NULL);
 	MOJOSHADER_glDestroyContext(renderer->shaderContext);
+	UnlockShaderContext(renderer);
+	SDL_DestroyMutex(renderer->shaderContextLock);
 
 	SDL_DestroyMutex(renderer->commandsLock);
 	SDL_DestroyMutex(renderer->disposeTexturesLock);
@@ -1226,7 +1382,18 @@ static void OPENGL_DestroyDevice(FNA3D_Device *device)
 	SDL_DestroyMutex(renderer->disposeEffectsLock);
 	SDL_DestroyMutex(renderer->disposeQueriesLock);
 
-	SDL_GL_DeleteContext(renderer->context);
+	if (renderer->eglContext != EGL_NO_CONTEXT)
+	{
+		OPENGL_INTERNAL_DestroyEGLContext(renderer);
+	}
+	else
+	{
+		SDL_GL_DeleteContext(renderer->context);
+	}
+	if (renderer->headlessWindow != NULL)
+	{
+		SDL_DestroyWindow(renderer->headlessWindow);
+	}
 
 	SDL_free(renderer);
 	SDL_free(device);
@@ -1304,7 +1471,11 @@ static void OPENGL_SwapBuffers(
 	 * specific regions given to Present().
 	 * -flibit
 	 */
-	if (renderer->backbuffer->type == BACKBUFFER_TYPE_OPENGL)
+	if (renderer->headless)
+	{
+		/* Nothing to present to, the frame stays in the faux-backbuffer */
+	}
+	else if (renderer->backbuffer->type == BACKBUFFER_TYPE_OPENGL)
 	{
 		if (sourceRectangle != NULL)
 		{
@@ -1447,9 +1618,16 @@ static void OPENGL_SetPresentationInterval(
 	FNA3D_Renderer *driverData,
 	FNA3D_PresentInterval presentInterval
 ) {
+	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
 	const char *osVersion;
 	int32_t disableLateSwapTear;
 
+	/* Headless devices never present */
+	if (renderer->headless)
+	{
+		return;
+	}
+
 	if (	presentInterval == FNA3D_PRESENTINTERVAL_DEFAULT ||
 		presentInterval == FNA3D_PRESENTINTERVAL_ONE	)
 	{
@@ -1725,6 +1903,269 @@ static void OPENGL_DrawInstancedPrimitives(
 	}
 }
 
+static void OPENGL_INTERNAL_RebaseVertexAttributes(
+	OpenGLRenderer *renderer,
+	int32_t baseVertex
+) {
+	int32_t i;
+	OpenGLVertexAttribute *attr;
+
+	/* Same workaround as OPENGL_ApplyVertexBufferBindings: without native
+	 * base vertex support, the offset goes into the attribute pointers.
+	 * Per-instance attributes are not offset by the base vertex.
+	 * ldBaseVertex is negative for vertex arrays, which can't be rebased.
+	 */
+	if (renderer->ldBaseVertex < 0 || baseVertex == renderer->ldBaseVertex)
+	{
+		return;
+	}
+
+	for (i = 0; i < renderer->numVertexAttributes; i += 1)
+	{
+		if (	!renderer->previousAttributeEnabled[i] ||
+			renderer->previousAttributeDivisor[i] != 0	)
+		{
+			continue;
+		}
+		attr = &renderer->attributes[i];
+		attr->currentPointer = (uint8_t*) attr->currentPointer + (
+			(intptr_t) (baseVertex - renderer->ldBaseVertex) *
+			(intptr_t) attr->currentStride
+		);
+		BindVertexBuffer(renderer, attr->currentBuffer);
+		renderer->glVertexAttribPointer(
+			i,
+			XNAToGL_VertexAttribSize[attr->currentFormat],
+			XNAToGL_VertexAttribType[attr->currentFormat],
+			attr->currentNormalized,
+			attr->currentStride,
+			attr->currentPointer
+		);
+	}
+
+	/* The next ApplyVertexBufferBindings will see this and re-point */
+	renderer->ldBaseVertex = baseVertex;
+}
+
+static void OPENGL_MultiDrawIndexedPrimitives(
+	FNA3D_Renderer *driverData,
+	FNA3D_PrimitiveType primitiveType,
+	FNA3D_DrawIndexedArgs *drawArgs,
+	int32_t drawCount,
+	FNA3D_Buffer *indices,
+	FNA3D_IndexElementSize indexElementSize
+) {
+	uint8_t tps, batch;
+	int32_t i;
+	void *offset;
+	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
+	OpenGLBuffer *buffer = (OpenGLBuffer*) indices;
+	GLenum primitive = XNAToGL_Primitive[primitiveType];
+	GLenum indexType = XNAToGL_IndexType[indexElementSize];
+	int32_t indexSize = IndexSize(indexElementSize);
+
+	BindIndexBuffer(renderer, buffer->handle);
+
+	tps = (	renderer->togglePointSprite &&
+		primitiveType == FNA3D_PRIMITIVETYPE_POINTLIST_EXT	);
+	if (tps)
+	{
+		renderer->glEnable(GL_POINT_SPRITE);
+	}
+
+	/* MultiDrawElementsBaseVertex has no instance count, so only batch if
+	 * every range is a plain draw. Otherwise keep the submission order!
+	 */
+	batch = (
+		renderer->supports_MultiDrawBaseVertex &&
+		renderer->supports_ARB_draw_elements_base_vertex
+	);
+	for (i = 0; i < drawCount && batch; i += 1)
+	{
+		batch = (drawArgs[i].instanceCount == 1);
+	}
+
+	/* Draw! */
+	if (batch)
+	{
+		if (drawCount > renderer->multiDrawCapacity)
+		{
+			renderer->multiDrawCapacity = drawCount;
+			renderer->multiDrawCounts = (GLsizei*) SDL_realloc(
+				renderer->multiDrawCounts,
+				sizeof(GLsizei) * drawCount
+			);
+			renderer->multiDrawOffsets = (GLvoid**) SDL_realloc(
+				renderer->multiDrawOffsets,
+				sizeof(GLvoid*) * drawCount
+			);
+			renderer->multiDrawBaseVertices = (GLint*) SDL_realloc(
+				renderer->multiDrawBaseVertices,
+				sizeof(GLint) * drawCount
+			);
+		}
+		for (i = 0; i < drawCount; i += 1)
+		{
+			renderer->multiDrawCounts[i] = drawArgs[i].indexCount;
+			renderer->multiDrawOffsets[i] = (GLvoid*) (size_t) (
+				drawArgs[i].startIndex * indexSize
+			);
+			renderer->multiDrawBaseVertices[i] = drawArgs[i].baseVertex;
+		}
+		renderer->glMultiDrawElementsBaseVertex(
+			primitive,
+			renderer->multiDrawCounts,
+			indexType,
+			(const GLvoid* const*) renderer->multiDrawOffsets,
+			drawCount,
+			renderer->multiDrawBaseVertices
+		);
+	}
+	else
+	{
+		for (i = 0; i < drawCount; i += 1)
+		{
+			offset = (void*) (size_t) (drawArgs[i].startIndex * indexSize);
+			if (drawArgs[i].instanceCount != 1)
+			{
+				SDL_assert(renderer->supports_ARB_draw_instanced);
+				if (renderer->supports_ARB_draw_elements_base_vertex)
+				{
+					renderer->glDrawElementsInstancedBaseVertex(
+						primitive,
+						drawArgs[i].indexCount,
+						indexType,
+						offset,
+						drawArgs[i].instanceCount,
+						drawArgs[i].baseVertex
+					);
+				}
+				else
+				{
+					OPENGL_INTERNAL_RebaseVertexAttributes(
+						renderer,
+						drawArgs[i].baseVertex
+					);
+					renderer->glDrawElementsInstanced(
+						primitive,
+						drawArgs[i].indexCount,
+						indexType,
+						offset,
+						drawArgs[i].instanceCount
+					);
+				}
+			}
+			else if (renderer->supports_ARB_draw_elements_base_vertex)
+			{
+				renderer->glDrawElementsBaseVertex(
+					primitive,
+					drawArgs[i].indexCount,
+					indexType,
+					offset,
+					drawArgs[i].baseVertex
+				);
+			}
+			else
+			{
+				OPENGL_INTERNAL_RebaseVertexAttributes(
+					renderer,
+					drawArgs[i].baseVertex
+				);
+				renderer->glDrawElements(
+					primitive,
+					drawArgs[i].indexCount,
+					indexType,
+					offset
+				);
+			}
+		}
+	}
+
+	if (tps)
+	{
+		renderer->glDisable(GL_POINT_SPRITE);
+	}
+}
+
+static void OPENGL_GetVertexBufferData(
+	FNA3D_Renderer *driverData,
+	FNA3D_Buffer *buffer,
+	int32_t offsetInBytes,
+	void* data,
+	int32_t elementCount,
+	int32_t elementSizeInBytes,
+	int32_t vertexStride
+);
+
+static void OPENGL_MultiDrawIndexedPrimitivesIndirect(
+	FNA3D_Renderer *driverData,
+	FNA3D_PrimitiveType primitiveType,
+	FNA3D_Buffer *drawBuffer,
+	int32_t offsetInBytes,
+	int32_t drawCount,
+	FNA3D_Buffer *indices,
+	FNA3D_IndexElementSize indexElementSize
+) {
+	uint8_t tps;
+	FNA3D_DrawIndexedArgs *drawArgs;
+	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
+	OpenGLBuffer *buffer = (OpenGLBuffer*) indices;
+
+	if (!renderer->supports_ARB_multi_draw_indirect)
+	{
+		/* Slow path, stall on the draw buffer and loop on the CPU */
+		drawArgs = (FNA3D_DrawIndexedArgs*) SDL_malloc(
+			sizeof(FNA3D_DrawIndexedArgs) * drawCount
+		);
+		OPENGL_GetVertexBufferData(
+			driverData,
+			drawBuffer,
+			offsetInBytes,
+			drawArgs,
+			drawCount,
+			sizeof(FNA3D_DrawIndexedArgs),
+			sizeof(FNA3D_DrawIndexedArgs)
+		);
+		OPENGL_MultiDrawIndexedPrimitives(
+			driverData,
+			primitiveType,
+			drawArgs,
+			drawCount,
+			indices,
+			indexElementSize
+		);
+		SDL_free(drawArgs);
+		return;
+	}
+
+	BindIndexBuffer(renderer, buffer->handle);
+	renderer->glBindBuffer(
+		GL_DRAW_INDIRECT_BUFFER,
+		((OpenGLBuffer*) drawBuffer)->handle
+	);
+
+	tps = (	renderer->togglePointSprite &&
+		primitiveType == FNA3D_PRIMITIVETYPE_POINTLIST_EXT	);
+	if (tps)
+	{
+		renderer->glEnable(GL_POINT_SPRITE);
+	}
+
+	/* Draw! */
+	renderer->glMultiDrawElementsIndirect(
+		XNAToGL_Primitive[primitiveType],
+		XNAToGL_IndexType[indexElementSize],
+		(void*) (size_t) offsetInBytes,
+		drawCount,
+		sizeof(FNA3D_DrawIndexedArgs)
+	);
+
+	if (tps)
+	{
+		renderer->glDisable(GL_POINT_SPRITE);
+	}
+}
+
 static void OPENGL_DrawPrimitives(
 	FNA3D_Renderer *driverData,
 	FNA3D_PrimitiveType primitiveType,
@@ -2518,6 +2959,51 @@ static void OPENGL_VerifyVertexSampler(
 	);
 }
 
+/* State Objects */
+
+/* GL compares the state fields directly rather than hashing them, so there's
+ * nothing to bake here. Just unwrap the structs.
+ */
+
+static void OPENGL_SetBlendStateObject(
+	FNA3D_Renderer *driverData,
+	FNA3D_BlendStateObject *blendState
+) {
+	OPENGL_SetBlendState(driverData, &blendState->state);
+}
+
+static void OPENGL_SetDepthStencilStateObject(
+	FNA3D_Renderer *driverData,
+	FNA3D_DepthStencilStateObject *depthStencilState
+) {
+	OPENGL_SetDepthStencilState(driverData, &depthStencilState->state);
+}
+
+static void OPENGL_ApplyRasterizerStateObject(
+	FNA3D_Renderer *driverData,
+	FNA3D_RasterizerStateObject *rasterizerState
+) {
+	OPENGL_ApplyRasterizerState(driverData, &rasterizerState->state);
+}
+
+static void OPENGL_VerifySamplerObject(
+	FNA3D_Renderer *driverData,
+	int32_t index,
+	FNA3D_Texture *texture,
+	FNA3D_SamplerStateObject *sampler
+) {
+	OPENGL_VerifySampler(driverData, index, texture, &sampler->state);
+}
+
+static void OPENGL_VerifyVertexSamplerObject(
+	FNA3D_Renderer *driverData,
+	int32_t index,
+	FNA3D_Texture *texture,
+	FNA3D_SamplerStateObject *sampler
+) {
+	OPENGL_VerifyVertexSampler(driverData, index, texture, &sampler->state);
+}
+
 /* Vertex State */
 
 static inline void OPENGL_INTERNAL_FlushGLVertexAttributes(OpenGLRenderer *renderer)
@@ -2552,6 +3038,7 @@ static inline void OPENGL_INTERNAL_FlushGLVertexAttributes(OpenGLRenderer *rende
 static void OPENGL_ApplyVertexBufferBindings(
 	FNA3D_Renderer *driverData,
 	FNA3D_VertexBufferBinding *bindings,
+	FNA3D_VertexDeclarationObject **declarations,
 	int32_t numBindings,
 	uint8_t bindingsUpdated,
 	int32_t baseVertex
@@ -2572,6 +3059,8 @@ static void OPENGL_ApplyVertexBufferBindings(
 		baseVertex = 0;
 	}
 
+	LockShaderContext(renderer);
+
 	if (	bindingsUpdated ||
 		baseVertex != renderer->ldBaseVertex ||
 		renderer->effectApplied	)
@@ -2670,6 +3159,8 @@ static void OPENGL_ApplyVertexBufferBindings(
 		renderer->backbuffer->width, renderer->backbuffer->height,
 		renderer->renderTargetBound
 	);
+
+	UnlockShaderContext(renderer);
 }
 
 static void OPENGL_ApplyVertexDeclaration(
@@ -2690,6 +3181,8 @@ static void OPENGL_ApplyVertexDeclaration(
 	BindVertexBuffer(renderer, 0);
 	basePtr += (vertexDeclaration->vertexStride * vertexOffset);
 
+	LockShaderContext(renderer);
+
 	if (	vertexDeclaration != renderer->ldVertexDeclaration ||
 		basePtr != renderer->ldPointer ||
 		renderer->effectApplied	)
@@ -2775,6 +3268,8 @@ static void OPENGL_ApplyVertexDeclaration(
 		renderer->backbuffer->width, renderer->backbuffer->height,
 		renderer->renderTargetBound
 	);
+
+	UnlockShaderContext(renderer);
 }
 
 /* Render Targets */
@@ -3070,13 +3565,21 @@ static void OPENGL_INTERNAL_CreateBackbuffer(
 ) {
 	int32_t useFauxBackbuffer;
 	int32_t drawX, drawY;
-	SDL_GL_GetDrawableSize(
-		(SDL_Window*) parameters->deviceWindowHandle,
-		&drawX,
-		&drawY
-	);
-	useFauxBackbuffer = (	drawX != parameters->backBufferWidth ||
-				drawY != parameters->backBufferHeight	);
+	if (renderer->headless)
+	{
+		/* There's no real backbuffer worth drawing to */
+		useFauxBackbuffer = 1;
+	}
+	else
+	{
+		SDL_GL_GetDrawableSize(
+			(SDL_Window*) parameters->deviceWindowHandle,
+			&drawX,
+			&drawY
+		);
+		useFauxBackbuffer = (	drawX != parameters->backBufferWidth ||
+					drawY != parameters->backBufferHeight	);
+	}
 	useFauxBackbuffer = (	useFauxBackbuffer ||
 				(parameters->multiSampleCount > 0)	);
 
@@ -3499,106 +4002,199 @@ static void OPENGL_ResetBackbuffer(
 	OPENGL_INTERNAL_CreateBackbuffer(renderer, presentationParameters);
 }
 
-static void OPENGL_ReadBackbuffer(
-	FNA3D_Renderer *driverData,
-	int32_t x,
-	int32_t y,
-	int32_t w,
-	int32_t h,
-	void* data,
-	int32_t dataLength
+static inline void OPENGL_INTERNAL_FlipRows(
+	uint8_t *data,
+	int32_t pitch,
+	int32_t rows
 ) {
-	GLuint prevReadBuffer, prevDrawBuffer;
-	int32_t pitch, row;
-	uint8_t *temp;
-	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
-	uint8_t *dataPtr = (uint8_t*) data;
+	/* Swap through a small stack buffer instead of a heap row,
+	 * SDL_memcpy does the vectorized copying for us.
+	 */
+	uint8_t temp[512];
+	uint8_t *top, *bottom;
+	int32_t row, offset, chunk;
+
+	for (row = 0; row < rows / 2; row += 1)
+	{
+		top = data + (row * pitch);
+		bottom = data + ((rows - row - 1) * pitch);
+		for (offset = 0; offset < pitch; offset += chunk)
+		{
+			chunk = SDL_min(pitch - offset, (int32_t) sizeof(temp));
+			SDL_memcpy(temp, top + offset, chunk);
+			SDL_memcpy(top + offset, bottom + offset, chunk);
+			SDL_memcpy(bottom + offset, temp, chunk);
+		}
+	}
+}
+
+static uint8_t OPENGL_INTERNAL_ReadPixels(
+	OpenGLRenderer *renderer,
+	FNA3D_Texture *texture, /* NULL for the backbuffer */
+	FNA3D_SurfaceFormat format,
+	int32_t x,
+	int32_t y,
+	int32_t w,
+	int32_t h,
+	int32_t level,
+	void* data /* Offset if GL_PIXEL_PACK_BUFFER is bound */
+) {
+	GLuint prevReadBuffer, prevDrawBuffer;
+	GLenum glFormat, glType;
+	OpenGLTexture *glTexture = (OpenGLTexture*) texture;
+	uint8_t result = 1;
 
 	prevReadBuffer = renderer->currentReadFramebuffer;
+	prevDrawBuffer = renderer->currentDrawFramebuffer;
 
-	if (renderer->backbuffer->multiSampleCount > 0)
+	if (texture == NULL)
 	{
-		/* We have to resolve the renderbuffer to a texture first. */
-		prevDrawBuffer = renderer->currentDrawFramebuffer;
+		glFormat = GL_RGBA;
+		glType = GL_UNSIGNED_BYTE;
 
-		if (renderer->backbuffer->opengl.texture == 0)
+		if (renderer->backbuffer->multiSampleCount > 0)
 		{
-			renderer->glGenTextures(
-				1,
-				&renderer->backbuffer->opengl.texture
-			);
-			renderer->glBindTexture(
+			/* We have to resolve the renderbuffer to a texture first. */
+			if (renderer->backbuffer->opengl.texture == 0)
+			{
+				renderer->glGenTextures(
+					1,
+					&renderer->backbuffer->opengl.texture
+				);
+				renderer->glBindTexture(
+					GL_TEXTURE_2D,
+					renderer->backbuffer->opengl.texture
+				);
+				renderer->glTexImage2D(
+					GL_TEXTURE_2D,
+					0,
+					GL_RGBA,
+					renderer->backbuffer->width,
+					renderer->backbuffer->height,
+					0,
+					GL_RGBA,
+					GL_UNSIGNED_BYTE,
+					NULL
+				);
+				renderer->glBindTexture(
+					renderer->textures[0]->target,
+					renderer->textures[0]->handle
+				);
+			}
+			BindFramebuffer(renderer, renderer->resolveFramebufferDraw);
+			renderer->glFramebufferTexture2D(
+				GL_FRAMEBUFFER,
+				GL_COLOR_ATTACHMENT0,
 				GL_TEXTURE_2D,
-				renderer->backbuffer->opengl.texture
+				renderer->backbuffer->opengl.texture,
+				0
 			);
-			renderer->glTexImage2D(
-				GL_TEXTURE_2D,
-				0,
-				GL_RGBA,
-				renderer->backbuffer->width,
-				renderer->backbuffer->height,
-				0,
-				GL_RGBA,
-				GL_UNSIGNED_BYTE,
-				NULL
+			BindReadFramebuffer(renderer, renderer->backbuffer->opengl.handle);
+
+			/* Only resolve the region we're actually reading */
+			renderer->glBlitFramebuffer(
+				x, y, x + w, y + h,
+				x, y, x + w, y + h,
+				GL_COLOR_BUFFER_BIT,
+				GL_LINEAR
 			);
-			renderer->glBindTexture(
-				renderer->textures[0]->target,
-				renderer->textures[0]->handle
+			/* Don't invalidate the backbuffer here! */
+			BindReadFramebuffer(renderer, renderer->resolveFramebufferDraw);
+		}
+		else
+		{
+			BindReadFramebuffer(
+				renderer,
+				(renderer->backbuffer->type == BACKBUFFER_TYPE_OPENGL) ?
+					renderer->backbuffer->opengl.handle :
+					0
 			);
 		}
-		BindFramebuffer(renderer, renderer->resolveFramebufferDraw);
+	}
+	else
+	{
+		glFormat = XNAToGL_TextureFormat[format];
+		glType = XNAToGL_TextureDataType[format];
+		if (glFormat == GL_COMPRESSED_TEXTURE_FORMATS)
+		{
+			return 0;
+		}
+
+		/* ES3 only promises RGBA8 reads, everything else gets
+		 * the full GetTexImage treatment.
+		 */
+		if (renderer->useES3 && format != FNA3D_SURFACEFORMAT_COLOR)
+		{
+			return 0;
+		}
+
+		BindFramebuffer(renderer, renderer->resolveFramebufferRead);
 		renderer->glFramebufferTexture2D(
 			GL_FRAMEBUFFER,
 			GL_COLOR_ATTACHMENT0,
 			GL_TEXTURE_2D,
-			renderer->backbuffer->opengl.texture,
-			0
+			glTexture->handle,
+			level
 		);
-		BindReadFramebuffer(renderer, renderer->backbuffer->opengl.handle);
-		renderer->glBlitFramebuffer(
-			0, 0, renderer->backbuffer->width, renderer->backbuffer->height,
-			0, 0, renderer->backbuffer->width, renderer->backbuffer->height,
-			GL_COLOR_BUFFER_BIT,
-			GL_LINEAR
+
+		/* Not every format is color-renderable, and thus readable */
+		result = renderer->glCheckFramebufferStatus(
+			GL_FRAMEBUFFER
+		) == GL_FRAMEBUFFER_COMPLETE;
+	}
+
+	if (result)
+	{
+		renderer->glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		renderer->glReadPixels(
+			x,
+			y,
+			w,
+			h,
+			glFormat,
+			glType,
+			data
 		);
-		/* Don't invalidate the backbuffer here! */
-		BindDrawFramebuffer(renderer, prevDrawBuffer);
-		BindReadFramebuffer(renderer, renderer->resolveFramebufferDraw);
+		renderer->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	}
+
+	if (prevReadBuffer == prevDrawBuffer)
+	{
+		BindFramebuffer(renderer, prevReadBuffer);
 	}
 	else
 	{
-		BindReadFramebuffer(
-			renderer,
-			(renderer->backbuffer->type == BACKBUFFER_TYPE_OPENGL) ?
-				renderer->backbuffer->opengl.handle :
-				0
-		);
+		BindReadFramebuffer(renderer, prevReadBuffer);
+		BindDrawFramebuffer(renderer, prevDrawBuffer);
 	}
+	return result;
+}
 
-	renderer->glReadPixels(
+static void OPENGL_ReadBackbuffer(
+	FNA3D_Renderer *driverData,
+	int32_t x,
+	int32_t y,
+	int32_t w,
+	int32_t h,
+	void* data,
+	int32_t dataLength
+) {
+	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
+
+	OPENGL_INTERNAL_ReadPixels(
+		renderer,
+		NULL,
+		FNA3D_SURFACEFORMAT_COLOR,
 		x,
 		y,
 		w,
 		h,
-		GL_RGBA,
-		GL_UNSIGNED_BYTE,
+		0,
 		data
 	);
 
-	BindReadFramebuffer(renderer, prevReadBuffer);
-
 	/* Now we get to do a software-based flip! Yes, really! -flibit */
-	pitch = w * 4;
-	temp = (uint8_t*) SDL_malloc(pitch);
-	for (row = 0; row < h / 2; row += 1)
-	{
-		/* Top to temp, bottom to top, temp to bottom */
-		SDL_memcpy(temp, dataPtr + (row * pitch), pitch);
-		SDL_memcpy(dataPtr + (row * pitch), dataPtr + ((h - row - 1) * pitch), pitch);
-		SDL_memcpy(dataPtr + ((h - row - 1) * pitch), temp, pitch);
-	}
-	SDL_free(temp);
+	OPENGL_INTERNAL_FlipRows((uint8_t*) data, w * 4, h);
 }
 
 static void OPENGL_GetBackbufferSize(
@@ -4247,6 +4843,34 @@ static void OPENGL_SetTextureDataYUV(
 	renderer->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 }
 
+static void OPENGL_GenerateMipmaps(
+	FNA3D_Renderer *driverData,
+	FNA3D_Texture *texture
+) {
+	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
+	OpenGLTexture *glTexture = (OpenGLTexture*) texture;
+	OpenGLTexture *prevTex;
+	FNA3D_Command cmd;
+
+	if (!glTexture->hasMipmaps)
+	{
+		return;
+	}
+
+	if (renderer->threadID != SDL_ThreadID())
+	{
+		cmd.type = FNA3D_COMMAND_GENERATEMIPMAPS;
+		cmd.generateMipmaps.texture = texture;
+		ForceToMainThread(renderer, &cmd);
+		return;
+	}
+
+	prevTex = renderer->textures[0];
+	BindTexture(renderer, glTexture);
+	renderer->glGenerateMipmap(glTexture->target);
+	BindTexture(renderer, prevTex);
+}
+
 static void OPENGL_GetTextureData2D(
 	FNA3D_Renderer *driverData,
 	FNA3D_Texture *texture,
@@ -4326,6 +4950,19 @@ static void OPENGL_GetTextureData2D(
 			data
 		);
 	}
+	else if (OPENGL_INTERNAL_ReadPixels(
+		renderer,
+		texture,
+		format,
+		x,
+		y,
+		w,
+		h,
+		level,
+		data
+	)) {
+		/* Read just the subrect through a framebuffer, done! */
+	}
 	else
 	{
 		glFormatSize = Texture_GetFormatSize(format);
@@ -5019,106 +5656,558 @@ static void* MOJOSHADERCALL OPENGL_INTERNAL_CompileShader(
 	);
 }
 
-static void OPENGL_CreateEffect(
-	FNA3D_Renderer *driverData,
-	uint8_t *effectCode,
-	uint32_t effectCodeLength,
-	FNA3D_Effect **effect,
-	MOJOSHADER_effect **effectData
+static void OPENGL_INTERNAL_PrelinkEffect(
+	OpenGLRenderer *renderer,
+	MOJOSHADER_effect *effectData
 ) {
-	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
-	OpenGLEffect *result;
+	const MOJOSHADER_effectTechnique *technique = effectData->current_technique;
+	MOJOSHADER_effectStateChanges stateChanges;
+	uint32_t numPasses, pass;
 	int32_t i;
-	FNA3D_Command cmd;
-	MOJOSHADER_effectShaderContext shaderBackend;
 
-	if (renderer->threadID != SDL_ThreadID())
+	/* Programs are linked on the first draw that uses them, which is a
+	 * hitch of 20-100ms per program on some drivers. Going through every
+	 * pass here moves all of that into the loading screen instead.
+	 *
+	 * effectBegin saves the bound shaders and effectEnd restores them, so
+	 * the currently applied effect (if any) is left alone.
+	 */
+	SDL_zero(stateChanges);
+	for (i = 0; i < effectData->technique_count; i += 1)
 	{
-		cmd.type = FNA3D_COMMAND_CREATEEFFECT;
-		cmd.createEffect.effectCode = effectCode;
-		cmd.createEffect.effectCodeLength = effectCodeLength;
-		cmd.createEffect.effect = effect;
-		cmd.createEffect.effectData = effectData;
-		ForceToMainThread(renderer, &cmd);
-		return;
+		MOJOSHADER_effectSetTechnique(
+			effectData,
+			&effectData->techniques[i]
+		);
+		MOJOSHADER_effectBegin(effectData, &numPasses, 1, &stateChanges);
+		for (pass = 0; pass < numPasses; pass += 1)
+		{
+			MOJOSHADER_effectBeginPass(effectData, pass);
+			MOJOSHADER_glProgramReady();
+			MOJOSHADER_effectEndPass(effectData);
+		}
+		MOJOSHADER_effectEnd(effectData);
 	}
+	MOJOSHADER_effectSetTechnique(effectData, technique);
 
-	shaderBackend.compileShader = OPENGL_INTERNAL_CompileShader;
-	shaderBackend.shaderAddRef = (MOJOSHADER_shaderAddRefFunc) MOJOSHADER_glShaderAddRef;
-	shaderBackend.deleteShader = (MOJOSHADER_deleteShaderFunc) MOJOSHADER_glDeleteShader;
-	shaderBackend.getParseData = (MOJOSHADER_getParseDataFunc) MOJOSHADER_glGetShaderParseData;
-	shaderBackend.bindShaders = (MOJOSHADER_bindShadersFunc) MOJOSHADER_glBindShaders;
-	shaderBackend.getBoundShaders = (MOJOSHADER_getBoundShadersFunc) MOJOSHADER_glGetBoundShaders;
-	shaderBackend.mapUniformBufferMemory = MOJOSHADER_glMapUniformBufferMemory;
-	shaderBackend.unmapUniformBufferMemory = MOJOSHADER_glUnmapUniformBufferMemory;
-	shaderBackend.m = NULL;
-	shaderBackend.f = NULL;
-	shaderBackend.malloc_data = NULL;
+	/* The attribute bindings went with the program */
+	renderer->effectApplied = 1;
+}
 
-	*effectData = MOJOSHADER_compileEffect(
-		effectCode,
-		effectCodeLength,
-		NULL,
-		0,
-		NULL,
-		0,
-		&shaderBackend
-	);
+/* Effects created off the main thread are parsed on the calling thread, with
+ * OpenGLParsedShader standing in for each GL shader. All MOJOSHADER_compileEffect
+ * needs from a shader is its parse data. Shaders already in the translation
+ * cache lend theirs, everything else is parsed with the bytecode profile, which
+ * gives us that without generating any GLSL. The effect parsing, preshaders and
+ * parameter reflection all happen there; only the shader compiles are left for
+ * the main thread, in OPENGL_INTERNAL_UploadEffect.
+ *
+ * The compileShader callback has no userdata, so whether this thread is
+ * parsing is kept in thread-local storage. When it's not set, the callbacks
+ * below are just the regular MojoShader GL functions.
+ */
 
-	for (i = 0; i < (*effectData)->error_count; i += 1)
-	{
-		FNA3D_LogError(
-			"MOJOSHADER_compileEffect Error: %s",
-			(*effectData)->errors[i].error
-		);
-	}
+typedef struct OpenGLParsedShader OpenGLParsedShader;
 
-	result = (OpenGLEffect*) SDL_malloc(sizeof(OpenGLEffect));
-	result->effect = *effectData;
-	result->next = NULL;
-	*effect = (FNA3D_Effect*) result;
-}
+struct OpenGLParsedShader
+{
+	const MOJOSHADER_parseData *parseData;
+	uint8_t ownsParseData;
+	MOJOSHADER_glShader *shader; /* Cache hit, until the effect takes it */
+	char *mainfn;
+	unsigned char *tokenbuf;
+	unsigned int bufsize;
+	MOJOSHADER_swizzle *swiz;
+	unsigned int swizcount;
+	MOJOSHADER_samplerMap *smap;
+	unsigned int smapcount;
+	OpenGLParsedShader *next;
+};
 
-static void OPENGL_CloneEffect(
-	FNA3D_Renderer *driverData,
-	FNA3D_Effect *cloneSource,
-	FNA3D_Effect **effect,
-	MOJOSHADER_effect **effectData
-) {
-	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
-	OpenGLEffect *glCloneSource = (OpenGLEffect*) cloneSource;
-	OpenGLEffect *result;
-	FNA3D_Command cmd;
+/* The effect may keep pointers into the parse data (sampler names, for
+ * instance), so it lives as long as the effect and all of its clones do.
+ */
+typedef struct OpenGLParsedShaders
+{
+	SDL_atomic_t refcount;
+	OpenGLParsedShader *shaders;
+} OpenGLParsedShaders;
 
-	if (renderer->threadID != SDL_ThreadID())
-	{
-		cmd.type = FNA3D_COMMAND_CLONEEFFECT;
-		cmd.cloneEffect.cloneSource = cloneSource;
-		cmd.cloneEffect.effect = effect;
-		cmd.cloneEffect.effectData = effectData;
-		ForceToMainThread(renderer, &cmd);
-		return;
-	}
+static SDL_TLSID parseThreadRenderer = 0;
 
-	*effectData = MOJOSHADER_cloneEffect(glCloneSource->effect);
-	if (*effectData == NULL)
-	{
-		FNA3D_LogError(
-			"%s", MOJOSHADER_glGetError()
+static inline uint8_t OPENGL_INTERNAL_IsParseThread(void)
+{
+	return (	parseThreadRenderer != 0 &&
+			SDL_TLSGet(parseThreadRenderer) != NULL	);
+}
+
+static void* MOJOSHADERCALL OPENGL_INTERNAL_ParseShader(
+	const char *mainfn,
+	const unsigned char *tokenbuf,
+	const unsigned int bufsize,
+	const MOJOSHADER_swizzle *swiz,
+	const unsigned int swizcount,
+	const MOJOSHADER_samplerMap *smap,
+	const unsigned int smapcount
+) {
+	OpenGLRenderer *renderer;
+	OpenGLParsedShader *result;
+
+	if (!OPENGL_INTERNAL_IsParseThread())
+	{
+		return ShaderCache_CompileShader(
+			mainfn,
+			tokenbuf,
+			bufsize,
+			swiz,
+			swizcount,
+			smap,
+			smapcount
 		);
 	}
 
-	result = (OpenGLEffect*) SDL_malloc(sizeof(OpenGLEffect));
-	result->effect = *effectData;
+	result = (OpenGLParsedShader*) SDL_malloc(sizeof(OpenGLParsedShader));
 	result->next = NULL;
-	*effect = (FNA3D_Effect*) result;
-}
 
-static void OPENGL_INTERNAL_DestroyEffect(
-	OpenGLRenderer *renderer,
-	OpenGLEffect *effect
+	/* Translated before? Then there's nothing to parse or compile */
+	renderer = (OpenGLRenderer*) SDL_TLSGet(parseThreadRenderer);
+	LockShaderContext(renderer);
+	ShaderCache_MakeCurrent(&renderer->shaderCache);
+	result->shader = (MOJOSHADER_glShader*) ShaderCache_LookupShader(
+		mainfn,
+		tokenbuf,
+		bufsize,
+		swiz,
+		swizcount,
+		smap,
+		smapcount
+	);
+	UnlockShaderContext(renderer);
+	if (result->shader != NULL)
+	{
+		result->parseData = MOJOSHADER_glGetShaderParseData(result->shader);
+		result->ownsParseData = 0;
+		result->mainfn = NULL;
+		result->tokenbuf = NULL;
+		result->bufsize = 0;
+		result->swiz = NULL;
+		result->swizcount = 0;
+		result->smap = NULL;
+		result->smapcount = 0;
+		return result;
+	}
+
+	result->ownsParseData = 1;
+	result->parseData = MOJOSHADER_parse(
+		MOJOSHADER_PROFILE_BYTECODE,
+		mainfn,
+		tokenbuf,
+		bufsize,
+		swiz,
+		swizcount,
+		smap,
+		smapcount,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	/* Keep everything the real compile will need */
+	result->mainfn = (mainfn != NULL) ? SDL_strdup(mainfn) : NULL;
+	result->tokenbuf = (unsigned char*) SDL_malloc(bufsize);
+	SDL_memcpy(result->tokenbuf, tokenbuf, bufsize);
+	result->bufsize = bufsize;
+	result->swiz = NULL;
+	result->swizcount = swizcount;
+	if (swizcount > 0)
+	{
+		result->swiz = (MOJOSHADER_swizzle*) SDL_malloc(
+			sizeof(MOJOSHADER_swizzle) * swizcount
+		);
+		SDL_memcpy(
+			result->swiz,
+			swiz,
+			sizeof(MOJOSHADER_swizzle) * swizcount
+		);
+	}
+	result->smap = NULL;
+	result->smapcount = smapcount;
+	if (smapcount > 0)
+	{
+		result->smap = (MOJOSHADER_samplerMap*) SDL_malloc(
+			sizeof(MOJOSHADER_samplerMap) * smapcount
+		);
+		SDL_memcpy(
+			result->smap,
+			smap,
+			sizeof(MOJOSHADER_samplerMap) * smapcount
+		);
+	}
+	return result;
+}
+
+static void OPENGL_INTERNAL_FreeParsedShader(OpenGLParsedShader *shader)
+{
+	if (shader->ownsParseData)
+	{
+		MOJOSHADER_freeParseData(shader->parseData);
+	}
+	SDL_free(shader->mainfn);
+	SDL_free(shader->tokenbuf);
+	SDL_free(shader->swiz);
+	SDL_free(shader->smap);
+	SDL_free(shader);
+}
+
+static void MOJOSHADERCALL OPENGL_INTERNAL_ShaderAddRef(void* shader)
+{
+	if (!OPENGL_INTERNAL_IsParseThread())
+	{
+		ShaderCache_ShaderAddRef(shader);
+	}
+}
+
+static void MOJOSHADERCALL OPENGL_INTERNAL_DeleteShader(void* shader)
+{
+	OpenGLParsedShader *parsed;
+	OpenGLRenderer *renderer;
+
+	if (!OPENGL_INTERNAL_IsParseThread())
+	{
+		ShaderCache_DeleteShader(shader);
+		return;
+	}
+
+	/* Only happens when compileEffect bails on the parse thread */
+	parsed = (OpenGLParsedShader*) shader;
+	if (parsed->shader != NULL)
+	{
+		renderer = (OpenGLRenderer*) SDL_TLSGet(parseThreadRenderer);
+		LockShaderContext(renderer);
+		ShaderCache_MakeCurrent(&renderer->shaderCache);
+		ShaderCache_DeleteShader(parsed->shader);
+		UnlockShaderContext(renderer);
+	}
+	OPENGL_INTERNAL_FreeParsedShader(parsed);
+}
+
+static const MOJOSHADER_parseData* MOJOSHADERCALL OPENGL_INTERNAL_GetParseData(
+	void* shader
+) {
+	if (!OPENGL_INTERNAL_IsParseThread())
+	{
+		return MOJOSHADER_glGetShaderParseData(
+			(MOJOSHADER_glShader*) shader
+		);
+	}
+	return ((OpenGLParsedShader*) shader)->parseData;
+}
+
+static inline uint8_t OPENGL_INTERNAL_IsShaderObject(
+	MOJOSHADER_effectObject *object
+) {
+	return (	(	object->type == MOJOSHADER_SYMTYPE_VERTEXSHADER ||
+				object->type == MOJOSHADER_SYMTYPE_PIXELSHADER	) &&
+			!object->shader.is_preshader &&
+			object->shader.shader != NULL	);
+}
+
+/* Effects are allocated with these, so OPENGL_INTERNAL_AddEffectError can
+ * grow the error list and MOJOSHADER_deleteEffect will still free it.
+ */
+
+static void* MOJOSHADERCALL OPENGL_INTERNAL_EffectMalloc(int bytes, void *data)
+{
+	return SDL_malloc(bytes);
+}
+
+static void MOJOSHADERCALL OPENGL_INTERNAL_EffectFree(void *ptr, void *data)
+{
+	SDL_free(ptr);
+}
+
+static void OPENGL_INTERNAL_AddEffectError(
+	MOJOSHADER_effect *effectData,
+	const char *error
+) {
+	MOJOSHADER_error *result;
+
+	FNA3D_LogError("MOJOSHADER_compileEffect Error: %s", error);
+
+	effectData->errors = (MOJOSHADER_error*) SDL_realloc(
+		effectData->errors,
+		sizeof(MOJOSHADER_error) * (effectData->error_count + 1)
+	);
+	result = &effectData->errors[effectData->error_count];
+	result->error = SDL_strdup(error);
+	result->filename = NULL;
+	result->error_position = -1;
+	effectData->error_count += 1;
+}
+
+/* The effect maps its parameters and sampler states onto each shader by
+ * symbol and sampler index, using the parse data it saw on the parse thread,
+ * but from then on it indexes the GL shader's parse data with them. Both lists
+ * are read straight out of the shader's constant table and dcl instructions,
+ * in order, before any profile gets involved, so the bytecode parse and the
+ * GLSL parse agree. Check anyway, a mismatch would bind the wrong uniforms.
+ */
+static uint8_t OPENGL_INTERNAL_ParseDataMatches(
+	const MOJOSHADER_parseData *bytecode,
+	const MOJOSHADER_parseData *glsl
+) {
+	const MOJOSHADER_symbol *a, *b;
+	int32_t i;
+
+	if (	bytecode->symbol_count != glsl->symbol_count ||
+		bytecode->sampler_count != glsl->sampler_count	)
+	{
+		return 0;
+	}
+	for (i = 0; i < bytecode->symbol_count; i += 1)
+	{
+		a = &bytecode->symbols[i];
+		b = &glsl->symbols[i];
+		if (	SDL_strcmp(a->name, b->name) != 0 ||
+			a->register_set != b->register_set ||
+			a->register_index != b->register_index ||
+			a->register_count != b->register_count	)
+		{
+			return 0;
+		}
+	}
+	for (i = 0; i < bytecode->sampler_count; i += 1)
+	{
+		if (	bytecode->samplers[i].index != glsl->samplers[i].index ||
+			bytecode->samplers[i].type != glsl->samplers[i].type	)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void OPENGL_INTERNAL_ReleaseParsedShaders(OpenGLParsedShaders *parsed)
+{
+	OpenGLParsedShader *shader, *next;
+
+	if (parsed == NULL || !SDL_AtomicDecRef(&parsed->refcount))
+	{
+		return;
+	}
+	shader = parsed->shaders;
+	while (shader != NULL)
+	{
+		next = shader->next;
+		OPENGL_INTERNAL_FreeParsedShader(shader);
+		shader = next;
+	}
+	SDL_free(parsed);
+}
+
+static void OPENGL_INTERNAL_UploadEffect(
+	OpenGLRenderer *renderer,
+	OpenGLEffect *effect
+) {
+	MOJOSHADER_effect *effectData = effect->effect;
+	MOJOSHADER_effectObject *object;
+	OpenGLParsedShader *parsed;
+	int32_t i;
+
+	effect->parsed = (OpenGLParsedShaders*) SDL_malloc(
+		sizeof(OpenGLParsedShaders)
+	);
+	SDL_AtomicSet(&effect->parsed->refcount, 1);
+	effect->parsed->shaders = NULL;
+
+	LockShaderContext(renderer);
+	ShaderCache_MakeCurrent(&renderer->shaderCache);
+	for (i = 0; i < effectData->object_count; i += 1)
+	{
+		object = &effectData->objects[i];
+		if (!OPENGL_INTERNAL_IsShaderObject(object))
+		{
+			continue;
+		}
+
+		/* Swap in the real shader, hang on to the parse data */
+		parsed = (OpenGLParsedShader*) object->shader.shader;
+		if (parsed->shader != NULL)
+		{
+			/* Found in the cache, the parse data is already its own */
+			object->shader.shader = parsed->shader;
+			parsed->shader = NULL;
+		}
+		else
+		{
+			object->shader.shader = ShaderCache_CompileShader(
+				parsed->mainfn,
+				parsed->tokenbuf,
+				parsed->bufsize,
+				parsed->swiz,
+				parsed->swizcount,
+				parsed->smap,
+				parsed->smapcount
+			);
+			if (object->shader.shader == NULL)
+			{
+				OPENGL_INTERNAL_AddEffectError(
+					effectData,
+					MOJOSHADER_glGetError()
+				);
+			}
+			else if (!OPENGL_INTERNAL_ParseDataMatches(
+				parsed->parseData,
+				MOJOSHADER_glGetShaderParseData(
+					(MOJOSHADER_glShader*) object->shader.shader
+				)
+			)) {
+				OPENGL_INTERNAL_AddEffectError(
+					effectData,
+					"GLSL shader reflection does not match bytecode"
+				);
+			}
+		}
+		parsed->next = effect->parsed->shaders;
+		effect->parsed->shaders = parsed;
+	}
+	if (renderer->prelinkEffects && effectData->error_count == 0)
+	{
+		OPENGL_INTERNAL_PrelinkEffect(renderer, effectData);
+	}
+	UnlockShaderContext(renderer);
+}
+
+static void OPENGL_CreateEffect(
+	FNA3D_Renderer *driverData,
+	uint8_t *effectCode,
+	uint32_t effectCodeLength,
+	FNA3D_Effect **effect,
+	MOJOSHADER_effect **effectData
+) {
+	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
+	OpenGLEffect *result;
+	int32_t i;
+	FNA3D_Command cmd;
+	MOJOSHADER_effectShaderContext shaderBackend;
+	uint8_t onMainThread = renderer->threadID == SDL_ThreadID();
+
+	shaderBackend.compileShader = OPENGL_INTERNAL_ParseShader;
+	shaderBackend.shaderAddRef = OPENGL_INTERNAL_ShaderAddRef;
+	shaderBackend.deleteShader = OPENGL_INTERNAL_DeleteShader;
+	shaderBackend.getParseData = OPENGL_INTERNAL_GetParseData;
+	shaderBackend.bindShaders = (MOJOSHADER_bindShadersFunc) MOJOSHADER_glBindShaders;
+	shaderBackend.getBoundShaders = (MOJOSHADER_getBoundShadersFunc) MOJOSHADER_glGetBoundShaders;
+	shaderBackend.mapUniformBufferMemory = MOJOSHADER_glMapUniformBufferMemory;
+	shaderBackend.unmapUniformBufferMemory = MOJOSHADER_glUnmapUniformBufferMemory;
+	shaderBackend.m = OPENGL_INTERNAL_EffectMalloc;
+	shaderBackend.f = OPENGL_INTERNAL_EffectFree;
+	shaderBackend.malloc_data = NULL;
+
+	if (onMainThread)
+	{
+		LockShaderContext(renderer);
+		ShaderCache_MakeCurrent(&renderer->shaderCache);
+	}
+	else
+	{
+		/* Parse here, no GL context needed */
+		SDL_TLSSet(parseThreadRenderer, renderer, NULL);
+	}
+	*effectData = MOJOSHADER_compileEffect(
+		effectCode,
+		effectCodeLength,
+		NULL,
+		0,
+		NULL,
+		0,
+		&shaderBackend
+	);
+	if (onMainThread)
+	{
+		if (renderer->prelinkEffects && (*effectData)->error_count == 0)
+		{
+			OPENGL_INTERNAL_PrelinkEffect(renderer, *effectData);
+		}
+		UnlockShaderContext(renderer);
+	}
+	else
+	{
+		SDL_TLSSet(parseThreadRenderer, NULL, NULL);
+	}
+
+	for (i = 0; i < (*effectData)->error_count; i += 1)
+	{
+		FNA3D_LogError(
+			"MOJOSHADER_compileEffect Error: %s",
+			(*effectData)->errors[i].error
+		);
+	}
+
+	result = (OpenGLEffect*) SDL_malloc(sizeof(OpenGLEffect));
+	result->effect = *effectData;
+	result->parsed = NULL;
+	result->next = NULL;
+	*effect = (FNA3D_Effect*) result;
+
+	if (!onMainThread)
+	{
+		/* Only the GL shader objects are made on the main thread */
+		cmd.type = FNA3D_COMMAND_UPLOADEFFECT;
+		cmd.uploadEffect.effect = *effect;
+		ForceToMainThread(renderer, &cmd);
+	}
+}
+
+static void OPENGL_CloneEffect(
+	FNA3D_Renderer *driverData,
+	FNA3D_Effect *cloneSource,
+	FNA3D_Effect **effect,
+	MOJOSHADER_effect **effectData
+) {
+	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
+	OpenGLEffect *glCloneSource = (OpenGLEffect*) cloneSource;
+	OpenGLEffect *result;
+	FNA3D_Command cmd;
+
+	if (renderer->threadID != SDL_ThreadID())
+	{
+		cmd.type = FNA3D_COMMAND_CLONEEFFECT;
+		cmd.cloneEffect.cloneSource = cloneSource;
+		cmd.cloneEffect.effect = effect;
+		cmd.cloneEffect.effectData = effectData;
+		ForceToMainThread(renderer, &cmd);
+		return;
+	}
+
+	LockShaderContext(renderer);
+	ShaderCache_MakeCurrent(&renderer->shaderCache);
+	*effectData = MOJOSHADER_cloneEffect(glCloneSource->effect);
+	if (*effectData == NULL)
+	{
+		FNA3D_LogError(
+			"%s", MOJOSHADER_glGetError()
+		);
+	}
+	UnlockShaderContext(renderer);
+
+	result = (OpenGLEffect*) SDL_malloc(sizeof(OpenGLEffect));
+	result->effect = *effectData;
+	result->parsed = glCloneSource->parsed;
+	if (result->parsed != NULL)
+	{
+		SDL_AtomicIncRef(&result->parsed->refcount);
+	}
+	result->next = NULL;
+	*effect = (FNA3D_Effect*) result;
+}
+
+static void OPENGL_INTERNAL_DestroyEffect(
+	OpenGLRenderer *renderer,
+	OpenGLEffect *effect
 ) {
 	MOJOSHADER_effect *glEffect = effect->effect;
+	LockShaderContext(renderer);
 	if (glEffect == renderer->currentEffect)
 	{
 		MOJOSHADER_effectEndPass(renderer->currentEffect);
@@ -5128,7 +6217,10 @@ static void OPENGL_INTERNAL_DestroyEffect(
 		renderer->currentPass = 0;
 		renderer->effectApplied = 1;
 	}
+	ShaderCache_MakeCurrent(&renderer->shaderCache);
 	MOJOSHADER_deleteEffect(glEffect);
+	UnlockShaderContext(renderer);
+	OPENGL_INTERNAL_ReleaseParsedShaders(effect->parsed);
 	SDL_free(effect);
 }
 
@@ -5175,6 +6267,7 @@ static void OPENGL_ApplyEffect(
 	uint32_t whatever;
 
 	renderer->effectApplied = 1;
+	LockShaderContext(renderer);
 	if (effectData == renderer->currentEffect)
 	{
 		if (	technique == renderer->currentTechnique &&
@@ -5183,12 +6276,14 @@ static void OPENGL_ApplyEffect(
 			MOJOSHADER_effectCommitChanges(
 				renderer->currentEffect
 			);
+			UnlockShaderContext(renderer);
 			return;
 		}
 		MOJOSHADER_effectEndPass(renderer->currentEffect);
 		MOJOSHADER_effectBeginPass(renderer->currentEffect, pass);
 		renderer->currentTechnique = technique;
 		renderer->currentPass = pass;
+		UnlockShaderContext(renderer);
 		return;
 	}
 	else if (renderer->currentEffect != NULL)
@@ -5203,6 +6298,7 @@ static void OPENGL_ApplyEffect(
 		stateChanges
 	);
 	MOJOSHADER_effectBeginPass(effectData, pass);
+	UnlockShaderContext(renderer);
 	renderer->currentEffect = effectData;
 	renderer->currentTechnique = technique;
 	renderer->currentPass = pass;
@@ -5217,6 +6313,7 @@ static void OPENGL_BeginPassRestore(
 	MOJOSHADER_effect *effectData = ((OpenGLEffect*) effect)->effect;
 	uint32_t whatever;
 
+	LockShaderContext(renderer);
 	MOJOSHADER_effectBegin(
 		effectData,
 		&whatever,
@@ -5224,6 +6321,7 @@ static void OPENGL_BeginPassRestore(
 		stateChanges
 	);
 	MOJOSHADER_effectBeginPass(effectData, 0);
+	UnlockShaderContext(renderer);
 	renderer->effectApplied = 1;
 }
 
@@ -5234,8 +6332,10 @@ static void OPENGL_EndPassRestore(
 	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
 	MOJOSHADER_effect *effectData = ((OpenGLEffect*) effect)->effect;
 
+	LockShaderContext(renderer);
 	MOJOSHADER_effectEndPass(effectData);
 	MOJOSHADER_effectEnd(effectData);
+	UnlockShaderContext(renderer);
 	renderer->effectApplied = 1;
 }
 
@@ -5348,6 +6448,227 @@ static int32_t OPENGL_QueryPixelCount(
 	return (int32_t) result;
 }
 
+/* Readbacks */
+
+static FNA3D_Readback* OPENGL_RequestReadback(
+	FNA3D_Renderer *driverData,
+	FNA3D_Texture *texture,
+	FNA3D_SurfaceFormat format,
+	int32_t x,
+	int32_t y,
+	int32_t w,
+	int32_t h,
+	int32_t level,
+	int32_t dataLength
+) {
+	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
+	OpenGLReadback *readback = NULL;
+	int32_t i;
+	FNA3D_Command cmd;
+
+	if (renderer->threadID != SDL_ThreadID())
+	{
+		cmd.type = FNA3D_COMMAND_REQUESTREADBACK;
+		cmd.requestReadback.texture = texture;
+		cmd.requestReadback.format = format;
+		cmd.requestReadback.x = x;
+		cmd.requestReadback.y = y;
+		cmd.requestReadback.w = w;
+		cmd.requestReadback.h = h;
+		cmd.requestReadback.level = level;
+		cmd.requestReadback.dataLength = dataLength;
+		ForceToMainThread(renderer, &cmd);
+		return cmd.requestReadback.retval;
+	}
+
+	for (i = 0; i < MAX_READBACKS; i += 1)
+	{
+		if (!renderer->readbacks[i].inUse)
+		{
+			readback = &renderer->readbacks[i];
+			break;
+		}
+	}
+	if (readback == NULL)
+	{
+		FNA3D_LogError(
+			"Too many readbacks in flight, poll the old ones first!"
+		);
+		return NULL;
+	}
+
+	readback->dataLength = dataLength;
+	readback->inUse = 1;
+
+	if (	renderer->supports_ARB_map_buffer_range &&
+		renderer->supports_ARB_sync	)
+	{
+		if (readback->buffer == 0)
+		{
+			renderer->glGenBuffers(1, &readback->buffer);
+		}
+		renderer->glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+		if (readback->bufferSize < dataLength)
+		{
+			renderer->glBufferData(
+				GL_PIXEL_PACK_BUFFER,
+				dataLength,
+				NULL,
+				GL_STREAM_READ
+			);
+			readback->bufferSize = dataLength;
+		}
+
+		/* The pixels go into the PBO, glReadPixels returns immediately */
+		if (OPENGL_INTERNAL_ReadPixels(
+			renderer,
+			texture,
+			format,
+			x,
+			y,
+			w,
+			h,
+			level,
+			NULL
+		)) {
+			renderer->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			readback->fence = renderer->glFenceSync(
+				GL_SYNC_GPU_COMMANDS_COMPLETE,
+				0
+			);
+
+			/* Flip while copying out of the PBO, rather than in place */
+			readback->flipPitch = (texture == NULL) ? w * 4 : 0;
+			readback->flipRows = h;
+			return (FNA3D_Readback*) readback;
+		}
+		renderer->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	/* No PBOs, or a format we can't read asynchronously. Just read it now. */
+	readback->data = (uint8_t*) SDL_malloc(dataLength);
+	readback->flipPitch = 0;
+	if (texture == NULL)
+	{
+		OPENGL_ReadBackbuffer(
+			driverData,
+			x,
+			y,
+			w,
+			h,
+			readback->data,
+			dataLength
+		);
+	}
+	else
+	{
+		OPENGL_GetTextureData2D(
+			driverData,
+			texture,
+			format,
+			x,
+			y,
+			w,
+			h,
+			level,
+			readback->data,
+			dataLength
+		);
+	}
+
+	return (FNA3D_Readback*) readback;
+}
+
+static uint8_t OPENGL_PollReadback(
+	FNA3D_Renderer *driverData,
+	FNA3D_Readback *readback,
+	void* data
+) {
+	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
+	OpenGLReadback *glReadback = (OpenGLReadback*) readback;
+	uint8_t *src, *dst;
+	int32_t row;
+	GLenum status;
+	FNA3D_Command cmd;
+
+	if (renderer->threadID != SDL_ThreadID())
+	{
+		cmd.type = FNA3D_COMMAND_POLLREADBACK;
+		cmd.pollReadback.readback = readback;
+		cmd.pollReadback.data = data;
+		ForceToMainThread(renderer, &cmd);
+		return cmd.pollReadback.retval;
+	}
+
+	if (glReadback->data != NULL)
+	{
+		if (data != NULL)
+		{
+			SDL_memcpy(data, glReadback->data, glReadback->dataLength);
+		}
+		SDL_free(glReadback->data);
+		glReadback->data = NULL;
+		glReadback->inUse = 0;
+		return 1;
+	}
+
+	/* Flush, but don't wait, we'll get polled again next frame */
+	status = renderer->glClientWaitSync(
+		glReadback->fence,
+		GL_SYNC_FLUSH_COMMANDS_BIT,
+		0
+	);
+	if (status == GL_TIMEOUT_EXPIRED)
+	{
+		return 0;
+	}
+	if (status == GL_WAIT_FAILED)
+	{
+		FNA3D_LogWarn("Readback fence wait failed, reading anyway");
+	}
+	renderer->glDeleteSync(glReadback->fence);
+	glReadback->fence = NULL;
+
+	if (data != NULL)
+	{
+		renderer->glBindBuffer(GL_PIXEL_PACK_BUFFER, glReadback->buffer);
+		src = (uint8_t*) renderer->glMapBufferRange(
+			GL_PIXEL_PACK_BUFFER,
+			0,
+			glReadback->dataLength,
+			GL_MAP_READ_BIT
+		);
+		if (src == NULL)
+		{
+			FNA3D_LogError("Could not map readback buffer!");
+		}
+		else if (glReadback->flipPitch > 0)
+		{
+			dst = (uint8_t*) data;
+			for (row = 0; row < glReadback->flipRows; row += 1)
+			{
+				SDL_memcpy(
+					dst + (row * glReadback->flipPitch),
+					src + ((glReadback->flipRows - row - 1) * glReadback->flipPitch),
+					glReadback->flipPitch
+				);
+			}
+		}
+		else
+		{
+			SDL_memcpy(data, src, glReadback->dataLength);
+		}
+		if (src != NULL)
+		{
+			renderer->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		renderer->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	glReadback->inUse = 0;
+	return 1;
+}
+
 /* Feature Queries */
 
 static uint8_t OPENGL_SupportsDXT1(FNA3D_Renderer *driverData)
@@ -5374,6 +6695,12 @@ static uint8_t OPENGL_SupportsNoOverwrite(FNA3D_Renderer *driverData)
 	return 0;
 }
 
+static uint8_t OPENGL_SupportsIndirectDraws(FNA3D_Renderer *driverData)
+{
+	OpenGLRenderer *renderer = (OpenGLRenderer*) driverData;
+	return renderer->supports_ARB_multi_draw_indirect;
+}
+
 static void OPENGL_GetMaxTextureSlots(
 	FNA3D_Renderer *driverData,
 	int32_t *textures,
@@ -5471,6 +6798,18 @@ static void GLAPIENTRY DebugCall(
 
 /* Load GL Entry Points */
 
+static void* OPENGL_INTERNAL_GetProcAddress(
+	OpenGLRenderer *renderer,
+	const char *ep
+) {
+	/* SDL can't look anything up for a context it didn't make */
+	if (renderer->eglContext != EGL_NO_CONTEXT)
+	{
+		return renderer->eglGetProcAddress(ep);
+	}
+	return SDL_GL_GetProcAddress(ep);
+}
+
 static inline void LoadEntryPoints(
 	OpenGLRenderer *renderer,
 	const char *driverInfo,
@@ -5496,25 +6835,29 @@ static inline void LoadEntryPoints(
 	renderer->supports_EXT_framebuffer_multisample = 1;
 	renderer->supports_ARB_internalformat_query = 1;
 	renderer->supports_ARB_invalidate_subdata = 1;
+	renderer->supports_ARB_map_buffer_range = 1;
+	renderer->supports_ARB_sync = 1;
 	renderer->supports_ARB_draw_instanced = 1;
 	renderer->supports_ARB_instanced_arrays = 1;
 	renderer->supports_ARB_draw_elements_base_vertex = 1;
+	renderer->supports_MultiDrawBaseVertex = 1;
+	renderer->supports_ARB_multi_draw_indirect = 1;
 	renderer->supports_EXT_draw_buffers2 = 1;
 	renderer->supports_ARB_texture_multisample = 1;
 	renderer->supports_KHR_debug = 1;
 	renderer->supports_GREMEDY_string_marker = 1;
 
 	#define GL_PROC(ext, ret, func, parms) \
-		renderer->func = (glfntype_##func) SDL_GL_GetProcAddress(#func); \
+		renderer->func = (glfntype_##func) OPENGL_INTERNAL_GetProcAddress(renderer, #func); \
 		if (renderer->func == NULL) \
 		{ \
 			renderer->supports_##ext = 0; \
 		}
 	#define GL_PROC_EXT(ext, fallback, ret, func, parms) \
-		renderer->func = (glfntype_##func) SDL_GL_GetProcAddress(#func); \
+		renderer->func = (glfntype_##func) OPENGL_INTERNAL_GetProcAddress(renderer, #func); \
 		if (renderer->func == NULL) \
 		{ \
-			renderer->func = (glfntype_##func) SDL_GL_GetProcAddress(#func #fallback); \
+			renderer->func = (glfntype_##func) OPENGL_INTERNAL_GetProcAddress(renderer, #func #fallback); \
 			if (renderer->func == NULL) \
 			{ \
 				renderer->supports_##ext = 0; \
@@ -5580,7 +6923,8 @@ static inline void LoadEntryPoints(
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wpedantic"
 			renderer->glInvalidateFramebuffer =
-				(glfntype_glInvalidateFramebuffer) SDL_GL_GetProcAddress(
+				(glfntype_glInvalidateFramebuffer) OPENGL_INTERNAL_GetProcAddress(
+					renderer,
 					"glDiscardFramebufferEXT"
 			);
 #pragma GCC diagnostic pop
@@ -5621,7 +6965,7 @@ static inline void LoadEntryPoints(
 	{
 		#define LOAD_COLORMASK(suffix) \
 		renderer->glColorMaski = (glfntype_glColorMaski) \
-			SDL_GL_GetProcAddress("glColorMask" #suffix);
+			OPENGL_INTERNAL_GetProcAddress(renderer, "glColorMask" #suffix);
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wpedantic"
 		LOAD_COLORMASK(IndexedEXT)
@@ -5713,7 +7057,7 @@ static inline void LoadEntryPoints(
 
 static void* MOJOSHADERCALL GLGetProcAddress(const char *ep, void* d)
 {
-	return SDL_GL_GetProcAddress(ep);
+	return OPENGL_INTERNAL_GetProcAddress((OpenGLRenderer*) d, ep);
 }
 
 static inline void CheckExtensions(
@@ -5849,10 +7193,275 @@ void OPENGL_GetDrawableSize(void* window, int32_t *x, int32_t *y)
 #endif
 }
 
-FNA3D_Device* OPENGL_CreateDevice(
+/* Headless EGL Context */
+
+#if defined(_WIN32)
+#define EGL_LIBRARY_NAME "libEGL.dll"
+#elif defined(__APPLE__)
+#define EGL_LIBRARY_NAME "libEGL.dylib"
+#else
+#define EGL_LIBRARY_NAME "libEGL.so.1"
+#endif
+
+static void OPENGL_INTERNAL_DestroyEGLContext(OpenGLRenderer *renderer)
+{
+	if (renderer->eglContext != EGL_NO_CONTEXT)
+	{
+		renderer->eglMakeCurrent(
+			renderer->eglDisplay,
+			EGL_NO_SURFACE,
+			EGL_NO_SURFACE,
+			EGL_NO_CONTEXT
+		);
+		renderer->eglDestroyContext(
+			renderer->eglDisplay,
+			renderer->eglContext
+		);
+		renderer->eglContext = EGL_NO_CONTEXT;
+	}
+	if (renderer->eglSurface != EGL_NO_SURFACE)
+	{
+		renderer->eglDestroySurface(
+			renderer->eglDisplay,
+			renderer->eglSurface
+		);
+		renderer->eglSurface = EGL_NO_SURFACE;
+	}
+
+	/* The display is not terminated, other headless devices may be
+	 * using it. EGL hands the same display back to everyone.
+	 */
+	renderer->eglDisplay = EGL_NO_DISPLAY;
+
+	if (renderer->eglLibrary != NULL)
+	{
+		SDL_UnloadObject(renderer->eglLibrary);
+		renderer->eglLibrary = NULL;
+	}
+}
+
+static uint8_t OPENGL_INTERNAL_CreateEGLContext(OpenGLRenderer *renderer)
+{
+	eglfntype_eglGetPlatformDisplayEXT getPlatformDisplay;
+	const char *extensions;
+	int32_t profile, major, minor, flags;
+	uint8_t useES;
+	EGLint eglMajor, eglMinor, numConfigs;
+	EGLConfig config;
+	EGLint configAttribs[13];
+	EGLint contextAttribs[9];
+	EGLint pbufferAttribs[] =
+	{
+		EGL_WIDTH, 1,
+		EGL_HEIGHT, 1,
+		EGL_NONE
+	};
+	int32_t i;
+
+	renderer->eglLibrary = SDL_LoadObject(EGL_LIBRARY_NAME);
+	if (renderer->eglLibrary == NULL)
+	{
+		return 0;
+	}
+
+	#define LOAD_EGL(func) \
+		renderer->func = (eglfntype_##func) SDL_LoadFunction( \
+			renderer->eglLibrary, \
+			#func \
+		); \
+		if (renderer->func == NULL) \
+		{ \
+			OPENGL_INTERNAL_DestroyEGLContext(renderer); \
+			return 0; \
+		}
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+	LOAD_EGL(eglGetProcAddress)
+	LOAD_EGL(eglQueryString)
+	LOAD_EGL(eglGetDisplay)
+	LOAD_EGL(eglInitialize)
+	LOAD_EGL(eglBindAPI)
+	LOAD_EGL(eglChooseConfig)
+	LOAD_EGL(eglCreateContext)
+	LOAD_EGL(eglCreatePbufferSurface)
+	LOAD_EGL(eglMakeCurrent)
+	LOAD_EGL(eglDestroySurface)
+	LOAD_EGL(eglDestroyContext)
+#pragma GCC diagnostic pop
+	#undef LOAD_EGL
+
+	/* Mesa can give us a display that doesn't need a display server */
+	renderer->eglDisplay = EGL_NO_DISPLAY;
+	extensions = renderer->eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (	extensions != NULL &&
+		SDL_strstr(extensions, "EGL_MESA_platform_surfaceless") != NULL	)
+	{
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+		getPlatformDisplay = (eglfntype_eglGetPlatformDisplayEXT)
+			renderer->eglGetProcAddress("eglGetPlatformDisplayEXT");
+#pragma GCC diagnostic pop
+		if (getPlatformDisplay != NULL)
+		{
+			renderer->eglDisplay = getPlatformDisplay(
+				EGL_PLATFORM_SURFACELESS_MESA,
+				EGL_DEFAULT_DISPLAY,
+				NULL
+			);
+		}
+	}
+	if (renderer->eglDisplay == EGL_NO_DISPLAY)
+	{
+		renderer->eglDisplay = renderer->eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	if (	renderer->eglDisplay == EGL_NO_DISPLAY ||
+		!renderer->eglInitialize(renderer->eglDisplay, &eglMajor, &eglMinor)	)
+	{
+		OPENGL_INTERNAL_DestroyEGLContext(renderer);
+		return 0;
+	}
+
+	/* Ask for the same context PrepareWindowAttributes asked SDL for */
+	SDL_GL_GetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, &profile);
+	SDL_GL_GetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, &major);
+	SDL_GL_GetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, &minor);
+	SDL_GL_GetAttribute(SDL_GL_CONTEXT_FLAGS, &flags);
+	useES = (profile & SDL_GL_CONTEXT_PROFILE_ES) != 0;
+
+	i = 0;
+	configAttribs[i++] = EGL_SURFACE_TYPE;
+	configAttribs[i++] = EGL_PBUFFER_BIT;
+	configAttribs[i++] = EGL_RENDERABLE_TYPE;
+	configAttribs[i++] = useES ? EGL_OPENGL_ES3_BIT : EGL_OPENGL_BIT;
+	configAttribs[i++] = EGL_RED_SIZE;
+	configAttribs[i++] = 8;
+	configAttribs[i++] = EGL_GREEN_SIZE;
+	configAttribs[i++] = 8;
+	configAttribs[i++] = EGL_BLUE_SIZE;
+	configAttribs[i++] = 8;
+	configAttribs[i++] = EGL_ALPHA_SIZE;
+	configAttribs[i++] = 8;
+	configAttribs[i++] = EGL_NONE;
+
+	i = 0;
+	contextAttribs[i++] = EGL_CONTEXT_MAJOR_VERSION;
+	contextAttribs[i++] = major;
+	contextAttribs[i++] = EGL_CONTEXT_MINOR_VERSION;
+	contextAttribs[i++] = minor;
+	if (!useES)
+	{
+		contextAttribs[i++] = EGL_CONTEXT_OPENGL_PROFILE_MASK;
+		contextAttribs[i++] = (profile & SDL_GL_CONTEXT_PROFILE_CORE) ?
+			EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT :
+			EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT;
+	}
+	if (flags & SDL_GL_CONTEXT_DEBUG_FLAG)
+	{
+		contextAttribs[i++] = EGL_CONTEXT_FLAGS_KHR;
+		contextAttribs[i++] = EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR;
+	}
+	contextAttribs[i++] = EGL_NONE;
+
+	if (	!renderer->eglBindAPI(useES ? EGL_OPENGL_ES_API : EGL_OPENGL_API) ||
+		!renderer->eglChooseConfig(
+			renderer->eglDisplay,
+			configAttribs,
+			&config,
+			1,
+			&numConfigs
+		) ||
+		numConfigs == 0	)
+	{
+		OPENGL_INTERNAL_DestroyEGLContext(renderer);
+		return 0;
+	}
+
+	renderer->eglContext = renderer->eglCreateContext(
+		renderer->eglDisplay,
+		config,
+		EGL_NO_CONTEXT,
+		contextAttribs
+	);
+	if (renderer->eglContext == EGL_NO_CONTEXT)
+	{
+		OPENGL_INTERNAL_DestroyEGLContext(renderer);
+		return 0;
+	}
+
+	/* We only ever draw to FBOs, so skip the surface if we can */
+	extensions = renderer->eglQueryString(renderer->eglDisplay, EGL_EXTENSIONS);
+	if (	extensions == NULL ||
+		SDL_strstr(extensions, "EGL_KHR_surfaceless_context") == NULL	)
+	{
+		renderer->eglSurface = renderer->eglCreatePbufferSurface(
+			renderer->eglDisplay,
+			config,
+			pbufferAttribs
+		);
+		if (renderer->eglSurface == EGL_NO_SURFACE)
+		{
+			OPENGL_INTERNAL_DestroyEGLContext(renderer);
+			return 0;
+		}
+	}
+
+	if (!renderer->eglMakeCurrent(
+		renderer->eglDisplay,
+		renderer->eglSurface,
+		renderer->eglSurface,
+		renderer->eglContext
+	)) {
+		OPENGL_INTERNAL_DestroyEGLContext(renderer);
+		return 0;
+	}
+
+	FNA3D_LogInfo(
+		"Headless OpenGL context: EGL %d.%d, %s",
+		eglMajor,
+		eglMinor,
+		(renderer->eglSurface == EGL_NO_SURFACE) ? "surfaceless" : "pbuffer"
+	);
+	return 1;
+}
+
+#undef EGL_LIBRARY_NAME
+
+static SDL_Window* OPENGL_INTERNAL_CreateHeadlessWindow(void)
+{
+	uint32_t flags;
+	SDL_Window *window;
+
+	/* Without EGL, the best SDL can do is a hidden window that is never
+	 * presented to. This needs a working video driver!
+	 */
+	if (!OPENGL_PrepareWindowAttributes(&flags))
+	{
+		return NULL;
+	}
+	window = SDL_CreateWindow(
+		"FNA3D Headless",
+		SDL_WINDOWPOS_UNDEFINED,
+		SDL_WINDOWPOS_UNDEFINED,
+		1,
+		1,
+		flags | SDL_WINDOW_HIDDEN
+	);
+	if (window == NULL)
+	{
+		FNA3D_LogError(
+			"Could not create headless window: %s",
+			SDL_GetError()
+		);
+	}
+	return window;
+}
+
+static FNA3D_Device* OPENGL_INTERNAL_CreateDevice(
 	FNA3D_PresentationParameters *presentationParameters,
-	uint8_t debugMode
+	uint8_t debugMode,
+	uint8_t headless
 ) {
+	SDL_Window *window;
 	int32_t flags;
 	int32_t depthSize, stencilSize;
 	SDL_SysWMinfo wmInfo;
@@ -5875,6 +7484,9 @@ FNA3D_Device* OPENGL_CreateDevice(
 	renderer->parentDevice = result;
 	result->driverData = (FNA3D_Renderer*) renderer;
 
+	renderer->headless = headless;
+	window = (SDL_Window*) presentationParameters->deviceWindowHandle;
+
 	/* Debug context support */
 	if (debugMode && SDL_strcmp("Emscripten", SDL_GetPlatform()) != 0)
 	{
@@ -5884,10 +7496,26 @@ FNA3D_Device* OPENGL_CreateDevice(
 		);
 	}
 
-	/* Create OpenGL context */
-	renderer->context = SDL_GL_CreateContext(
-		(SDL_Window*) presentationParameters->deviceWindowHandle
-	);
+	/* Create OpenGL context. Headless devices make their own. */
+	if (headless && OPENGL_INTERNAL_CreateEGLContext(renderer))
+	{
+		window = NULL;
+	}
+	else
+	{
+		if (headless)
+		{
+			renderer->headlessWindow = OPENGL_INTERNAL_CreateHeadlessWindow();
+			if (renderer->headlessWindow == NULL)
+			{
+				SDL_free(renderer);
+				SDL_free(result);
+				return NULL;
+			}
+			window = renderer->headlessWindow;
+		}
+		renderer->context = SDL_GL_CreateContext(window);
+	}
 
 	/* Check for a possible ES/Core context */
 	SDL_GL_GetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, &flags);
@@ -5899,8 +7527,17 @@ FNA3D_Device* OPENGL_CreateDevice(
 	debugMode = (flags & SDL_GL_CONTEXT_DEBUG_FLAG) != 0;
 
 	/* Check the window's depth/stencil format */
-	SDL_GL_GetAttribute(SDL_GL_DEPTH_SIZE, &depthSize);
-	SDL_GL_GetAttribute(SDL_GL_STENCIL_SIZE, &stencilSize);
+	if (window == NULL)
+	{
+		/* EGL context, there is no window framebuffer at all */
+		depthSize = 0;
+		stencilSize = 0;
+	}
+	else
+	{
+		SDL_GL_GetAttribute(SDL_GL_DEPTH_SIZE, &depthSize);
+		SDL_GL_GetAttribute(SDL_GL_STENCIL_SIZE, &stencilSize);
+	}
 	if (depthSize == 0 && stencilSize == 0)
 	{
 		renderer->windowDepthFormat = FNA3D_DEPTHFORMAT_NONE;
@@ -5937,10 +7574,11 @@ FNA3D_Device* OPENGL_CreateDevice(
 
 	/* UIKit needs special treatment for backbuffer behavior */
 	SDL_VERSION(&wmInfo.version);
-	SDL_GetWindowWMInfo(
-		(SDL_Window*) presentationParameters->deviceWindowHandle,
-		&wmInfo
-	);
+	wmInfo.subsystem = SDL_SYSWM_UNKNOWN;
+	if (window != NULL)
+	{
+		SDL_GetWindowWMInfo(window, &wmInfo);
+	}
 #ifdef SDL_VIDEO_UIKIT
 	if (wmInfo.subsystem == SDL_SYSWM_UIKIT)
 	{
@@ -5952,7 +7590,7 @@ FNA3D_Device* OPENGL_CreateDevice(
 	/* Print GL information */
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wpedantic"
-	renderer->glGetString = (glfntype_glGetString) SDL_GL_GetProcAddress("glGetString");
+	renderer->glGetString = (glfntype_glGetString) OPENGL_INTERNAL_GetProcAddress(renderer, "glGetString");
 #pragma GCC diagnostic pop
 	if (!renderer->glGetString)
 	{
@@ -5983,12 +7621,19 @@ FNA3D_Device* OPENGL_CreateDevice(
 	}
 
 	/* Initialize shader context */
+	renderer->shaderContextLock = SDL_CreateMutex();
+	renderer->shaderContext = NULL;
+	LockShaderContext(renderer);
+	if (parseThreadRenderer == 0)
+	{
+		parseThreadRenderer = SDL_TLSCreate();
+	}
 	renderer->shaderProfile = SDL_GetHint("FNA3D_MOJOSHADER_PROFILE");
 	if (renderer->shaderProfile == NULL || renderer->shaderProfile[0] == '\0')
 	{
 		renderer->shaderProfile = MOJOSHADER_glBestProfile(
 			GLGetProcAddress,
-			NULL,
+			renderer,
 			NULL,
 			NULL,
 			NULL
@@ -6004,14 +7649,27 @@ FNA3D_Device* OPENGL_CreateDevice(
 	renderer->shaderContext = MOJOSHADER_glCreateContext(
 		renderer->shaderProfile,
 		GLGetProcAddress,
-		NULL,
+		renderer,
 		NULL,
 		NULL,
 		NULL
 	);
 	MOJOSHADER_glMakeContextCurrent(renderer->shaderContext);
+	ShaderCache_Init(
+		&renderer->shaderCache,
+		OPENGL_INTERNAL_CompileShader,
+		(MOJOSHADER_shaderAddRefFunc) MOJOSHADER_glShaderAddRef,
+		(MOJOSHADER_deleteShaderFunc) MOJOSHADER_glDeleteShader
+	);
+	UnlockShaderContext(renderer);
 	FNA3D_LogInfo("MojoShader Profile: %s", renderer->shaderProfile);
 
+	/* Link at load time instead of on first use? */
+	renderer->prelinkEffects = SDL_GetHintBoolean(
+		"FNA3D_OPENGL_PRELINK_EFFECTS",
+		0
+	);
+
 	/* Some users might want pixely upscaling... */
 	renderer->backbufferScaleMode = SDL_GetHintBoolean(
 		"FNA3D_BACKBUFFER_SCALE_NEAREST", 0
@@ -6185,11 +7843,49 @@ FNA3D_Device* OPENGL_CreateDevice(
 	return result;
 }
 
+FNA3D_Device* OPENGL_CreateDevice(
+	FNA3D_PresentationParameters *presentationParameters,
+	uint8_t debugMode
+) {
+	return OPENGL_INTERNAL_CreateDevice(
+		presentationParameters,
+		debugMode,
+		0
+	);
+}
+
+FNA3D_Device* OPENGL_CreateHeadlessDevice(
+	FNA3D_PresentationParameters *presentationParameters,
+	uint8_t debugMode
+) {
+	uint32_t flags;
+
+	/* The context attributes still go through SDL, even for EGL. Any
+	 * video driver will do, including "offscreen" and "dummy".
+	 */
+	if (SDL_WasInit(SDL_INIT_VIDEO) == 0)
+	{
+		FNA3D_LogError("Video system not initialized");
+		return NULL;
+	}
+	if (!OPENGL_PrepareWindowAttributes(&flags))
+	{
+		return NULL;
+	}
+
+	return OPENGL_INTERNAL_CreateDevice(
+		presentationParameters,
+		debugMode,
+		1
+	);
+}
+
 FNA3D_Driver OpenGLDriver = {
 	"OpenGL",
 	OPENGL_PrepareWindowAttributes,
 	OPENGL_GetDrawableSize,
-	OPENGL_CreateDevice
+	OPENGL_CreateDevice,
+	OPENGL_CreateHeadlessDevice
 };
 
 #else
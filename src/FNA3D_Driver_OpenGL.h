@@ -44,6 +44,8 @@ typedef char		GLchar;
 typedef uintptr_t	GLsizeiptr;
 typedef intptr_t	GLintptr;
 typedef unsigned char	GLboolean;
+typedef uint64_t	GLuint64;
+typedef struct __GLsync	*GLsync;
 
 /* Hint */
 #define GL_DONT_CARE					0x1100
@@ -210,6 +212,7 @@ typedef unsigned char	GLboolean;
 #define GL_TEXTURE_MAX_LEVEL				0x813D
 #define GL_TEXTURE_LOD_BIAS				0x8501
 #define GL_UNPACK_ALIGNMENT				0x0CF5
+#define GL_PACK_ALIGNMENT				0x0D05
 
 /* Multitexture */
 #define GL_TEXTURE0					0x84C0
@@ -221,6 +224,10 @@ typedef unsigned char	GLboolean;
 #define GL_ELEMENT_ARRAY_BUFFER 			0x8893
 #define GL_STREAM_DRAW  				0x88E0
 #define GL_STATIC_DRAW  				0x88E4
+#define GL_STREAM_READ  				0x88E1
+#define GL_PIXEL_PACK_BUFFER				0x88EB
+#define GL_DRAW_INDIRECT_BUFFER 			0x8F3F
+#define GL_MAP_READ_BIT 				0x0001
 #define GL_MAX_VERTEX_ATTRIBS				0x8869
 
 /* Render targets */
@@ -229,6 +236,16 @@ typedef unsigned char	GLboolean;
 #define GL_DRAW_FRAMEBUFFER				0x8CA9
 #define GL_RENDERBUFFER 				0x8D41
 #define GL_MAX_DRAW_BUFFERS				0x8824
+#define GL_FRAMEBUFFER_COMPLETE 			0x8CD5
+
+/* Sync Objects */
+#define GL_SYNC_GPU_COMMANDS_COMPLETE			0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT			0x00000001
+#define GL_ALREADY_SIGNALED				0x911A
+#define GL_TIMEOUT_EXPIRED				0x911B
+#define GL_CONDITION_SATISFIED				0x911C
+#define GL_WAIT_FAILED  				0x911D
+#define GL_TIMEOUT_IGNORED				0xFFFFFFFFFFFFFFFFull
 
 /* Draw Primitives */
 #define GL_POINTS					0x0000
@@ -303,6 +320,92 @@ typedef void (GLAPIENTRY *DEBUGPROC)(
 /* glGetString is a bit different since we load it early */
 typedef const GLubyte* (GLAPIENTRY *glfntype_glGetString)(GLenum a);
 
+/* EGL, for headless devices. We load libEGL ourselves, so only the little bit
+ * of the API we call is declared here.
+ */
+typedef unsigned int	EGLBoolean;
+typedef unsigned int	EGLenum;
+typedef int32_t		EGLint;
+typedef void*		EGLDisplay;
+typedef void*		EGLConfig;
+typedef void*		EGLContext;
+typedef void*		EGLSurface;
+
+#define EGL_DEFAULT_DISPLAY				((void*) 0)
+#define EGL_NO_DISPLAY					((EGLDisplay) 0)
+#define EGL_NO_CONTEXT					((EGLContext) 0)
+#define EGL_NO_SURFACE					((EGLSurface) 0)
+#define EGL_NONE					0x3038
+#define EGL_EXTENSIONS					0x3055
+#define EGL_ALPHA_SIZE					0x3021
+#define EGL_BLUE_SIZE					0x3022
+#define EGL_GREEN_SIZE					0x3023
+#define EGL_RED_SIZE					0x3024
+#define EGL_SURFACE_TYPE				0x3033
+#define EGL_RENDERABLE_TYPE				0x3040
+#define EGL_HEIGHT					0x3056
+#define EGL_WIDTH					0x3057
+#define EGL_PBUFFER_BIT					0x0001
+#define EGL_OPENGL_BIT					0x0008
+#define EGL_OPENGL_ES3_BIT				0x0040
+#define EGL_OPENGL_ES_API				0x30A0
+#define EGL_OPENGL_API					0x30A2
+#define EGL_CONTEXT_MAJOR_VERSION			0x3098
+#define EGL_CONTEXT_MINOR_VERSION			0x30FB
+#define EGL_CONTEXT_FLAGS_KHR				0x30FC
+#define EGL_CONTEXT_OPENGL_PROFILE_MASK			0x30FD
+#define EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT		0x0001
+#define EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT	0x0002
+#define EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR		0x0001
+#define EGL_PLATFORM_SURFACELESS_MESA			0x31DD
+
+typedef void* (GLAPIENTRY *eglfntype_eglGetProcAddress)(const char *procname);
+typedef const char* (GLAPIENTRY *eglfntype_eglQueryString)(EGLDisplay dpy, EGLint name);
+typedef EGLDisplay (GLAPIENTRY *eglfntype_eglGetDisplay)(void *display_id);
+typedef EGLDisplay (GLAPIENTRY *eglfntype_eglGetPlatformDisplayEXT)(
+	EGLenum platform,
+	void *native_display,
+	const EGLint *attrib_list
+);
+typedef EGLBoolean (GLAPIENTRY *eglfntype_eglInitialize)(
+	EGLDisplay dpy,
+	EGLint *major,
+	EGLint *minor
+);
+typedef EGLBoolean (GLAPIENTRY *eglfntype_eglBindAPI)(EGLenum api);
+typedef EGLBoolean (GLAPIENTRY *eglfntype_eglChooseConfig)(
+	EGLDisplay dpy,
+	const EGLint *attrib_list,
+	EGLConfig *configs,
+	EGLint config_size,
+	EGLint *num_config
+);
+typedef EGLContext (GLAPIENTRY *eglfntype_eglCreateContext)(
+	EGLDisplay dpy,
+	EGLConfig config,
+	EGLContext share_context,
+	const EGLint *attrib_list
+);
+typedef EGLSurface (GLAPIENTRY *eglfntype_eglCreatePbufferSurface)(
+	EGLDisplay dpy,
+	EGLConfig config,
+	const EGLint *attrib_list
+);
+typedef EGLBoolean (GLAPIENTRY *eglfntype_eglMakeCurrent)(
+	EGLDisplay dpy,
+	EGLSurface draw,
+	EGLSurface read,
+	EGLContext ctx
+);
+typedef EGLBoolean (GLAPIENTRY *eglfntype_eglDestroySurface)(
+	EGLDisplay dpy,
+	EGLSurface surface
+);
+typedef EGLBoolean (GLAPIENTRY *eglfntype_eglDestroyContext)(
+	EGLDisplay dpy,
+	EGLContext ctx
+);
+
 #endif /* FNA3D_DRIVER_OPENGL_H */
 
 /* vim: set noexpandtab shiftwidth=8 tabstop=8: */
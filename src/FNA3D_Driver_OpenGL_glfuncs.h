@@ -45,6 +45,7 @@ GL_PROC(BaseGL, void, glDisable, (GLenum a))
 GL_PROC(BaseGL, void, glDisableVertexAttribArray, (GLint a))
 GL_PROC(BaseGL, void, glDrawArrays, (GLenum a, GLint b, GLsizei c))
 GL_PROC(BaseGL, void, glDrawBuffers, (GLsizei a, const GLenum *b))
+GL_PROC(BaseGL, void, glDrawElements, (GLenum a, GLsizei b, GLenum c, const GLvoid *d))
 GL_PROC(BaseGL, void, glDrawRangeElements, (GLenum a, GLuint b, GLuint c, GLsizei d, GLenum e, const GLvoid *f))
 GL_PROC(BaseGL, void, glEnable, (GLenum a))
 GL_PROC(BaseGL, void, glEnableVertexAttribArray, (GLint a))
@@ -78,6 +79,7 @@ GL_PROC(CoreGL, const GLubyte*, glGetStringi, (GLenum a, GLuint b))
 
 /* Base vertex support makes life WAY easier for batching */
 GL_PROC_EXT(ARB_draw_elements_base_vertex, OES, void, glDrawElementsInstancedBaseVertex, (GLenum a, GLsizei b, GLenum c, const GLvoid *d, GLsizei e, GLint f))
+GL_PROC_EXT(ARB_draw_elements_base_vertex, OES, void, glDrawElementsBaseVertex, (GLenum a, GLsizei b, GLenum c, const GLvoid *d, GLint e))
 GL_PROC_EXT(ARB_draw_elements_base_vertex, OES, void, glDrawRangeElementsBaseVertex, (GLenum a, GLuint b, GLuint c, GLsizei d, GLenum e, const GLvoid *f, GLint g))
 
 /* These are in every desktop driver and _should_ be in every ES3 driver */
@@ -108,6 +110,7 @@ GL_PROC(NonES3NonCore, void, glTexEnvi, (GLenum a, GLenum b, GLint c))
 /* Needed for render targets. We're flexible, but not _that_ flexible. */
 GL_PROC_EXT(ARB_framebuffer_object, EXT, void, glBindFramebuffer, (GLenum a, GLuint b))
 GL_PROC_EXT(ARB_framebuffer_object, EXT, void, glBindRenderbuffer, (GLenum a, GLuint b))
+GL_PROC_EXT(ARB_framebuffer_object, EXT, GLenum, glCheckFramebufferStatus, (GLenum a))
 GL_PROC_EXT(ARB_framebuffer_object, EXT, void, glDeleteFramebuffers, (GLsizei a, const GLuint *b))
 GL_PROC_EXT(ARB_framebuffer_object, EXT, void, glDeleteRenderbuffers, (GLsizei a, const GLuint *b))
 GL_PROC_EXT(ARB_framebuffer_object, EXT, void, glFramebufferRenderbuffer, (GLenum a, GLenum b, GLenum c, GLuint d))
@@ -127,6 +130,17 @@ GL_PROC(ARB_internalformat_query, void, glGetInternalformativ, (GLenum a, GLenum
 /* This is mostly needed by ES3, where loads/stores are a huge slowdown */
 GL_PROC(ARB_invalidate_subdata, void, glInvalidateFramebuffer, (GLenum a, GLsizei b, const GLenum *c))
 
+/* Asynchronous readbacks, both of these are core in GL 3.x and ES3 */
+GL_PROC(ARB_map_buffer_range, void*, glMapBufferRange, (GLenum a, GLintptr b, GLsizeiptr c, GLbitfield d))
+GL_PROC(ARB_map_buffer_range, GLboolean, glUnmapBuffer, (GLenum a))
+GL_PROC(ARB_sync, GLsync, glFenceSync, (GLenum a, GLbitfield b))
+GL_PROC(ARB_sync, GLenum, glClientWaitSync, (GLsync a, GLbitfield b, GLuint64 c))
+GL_PROC(ARB_sync, void, glDeleteSync, (GLsync a))
+
+/* Multi-draw is separate from base vertex on ES, and indirect is GL 4.3/ES 3.1 */
+GL_PROC_EXT(MultiDrawBaseVertex, EXT, void, glMultiDrawElementsBaseVertex, (GLenum a, const GLsizei *b, GLenum c, const GLvoid * const *d, GLsizei e, const GLint *f))
+GL_PROC_EXT(ARB_multi_draw_indirect, EXT, void, glMultiDrawElementsIndirect, (GLenum a, GLenum b, const GLvoid *c, GLsizei d, GLsizei e))
+
 /* Hardware instancing is nice to have, but isn't used all the time */
 GL_PROC(ARB_draw_instanced, void, glDrawElementsInstanced, (GLenum a, GLsizei b, GLenum c, const GLvoid *d, GLsizei e))
 GL_PROC(ARB_instanced_arrays, void, glVertexAttribDivisor, (GLuint a, GLuint b))
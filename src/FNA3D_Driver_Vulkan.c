@@ -42,6 +42,7 @@
 
 #define SAMPLER_DESCRIPTOR_POOL_SIZE 256
 #define UNIFORM_BUFFER_DESCRIPTOR_POOL_SIZE 32
+#define PRESENT_WAIT_TIMEOUT 100000000 /* 100ms */
 
 const VkComponentMapping IDENTITY_SWIZZLE =
 {
@@ -92,10 +93,9 @@ typedef struct VulkanDepthStencilBuffer VulkanDepthStencilBuffer;
 typedef struct VulkanBuffer VulkanBuffer;
 typedef struct VulkanEffect VulkanEffect;
 typedef struct VulkanQuery VulkanQuery;
-typedef struct PipelineHashMap PipelineHashMap;
+typedef struct VulkanReadback VulkanReadback;
 typedef struct RenderPassHashMap RenderPassHashMap;
 typedef struct FramebufferHashMap FramebufferHashMap;
-typedef struct SamplerStateHashMap SamplerStateHashMap;
 typedef struct PipelineLayoutHashMap PipelineLayoutHashMap;
 
 typedef struct SurfaceFormatMapping {
@@ -151,15 +151,17 @@ typedef struct PipelineHash
 	VkRenderPass renderPass;
 } PipelineHash;
 
-struct PipelineHashMap
-{
-	PipelineHash key;
-	VkPipeline value;
-};
+/* PipelineHash packed into words, with nothing left to chance for padding */
+#define PIPELINE_KEY_WORDS 12
 
 typedef struct RenderPassHash
 {
 	uint32_t attachmentCount;
+	uint32_t multiSampleCount;
+	uint32_t colorFormats[MAX_RENDERTARGET_BINDINGS];
+	uint32_t depthFormat;
+	uint32_t loadMultiSample;
+	uint32_t storeMultiSample;
 } RenderPassHash;
 
 struct RenderPassHashMap
@@ -168,16 +170,19 @@ struct RenderPassHashMap
 	VkRenderPass value;
 };
 
-struct FramebufferHashMap
+typedef struct FramebufferHash
 {
-	RenderPassHash key;
-	VkFramebuffer value;
-};
+	VkImageView colorAttachmentViews[MAX_RENDERTARGET_BINDINGS];
+	VkImageView colorMultiSampleAttachmentViews[MAX_RENDERTARGET_BINDINGS];
+	VkImageView depthStencilAttachmentView;
+	uint32_t width;
+	uint32_t height;
+} FramebufferHash;
 
-struct SamplerStateHashMap
+struct FramebufferHashMap
 {
-	StateHash key;
-	VkSampler value;
+	FramebufferHash key;
+	VkFramebuffer value;
 };
 
 /* FIXME: this can be packed better */
@@ -203,10 +208,18 @@ struct VulkanQuery {
 	uint32_t index;
 };
 
+struct VulkanReadback {
+	VulkanBuffer *buffer;
+	uint64_t submitID; /* Done once this submission has finished */
+	int32_t dataLength;
+	uint8_t inUse;
+};
+
 struct VulkanTexture {
 	FNAVulkanImageData *imageData;
 	VulkanBuffer *stagingBuffer;
 	uint8_t hasMipmaps;
+	int32_t levelCount;
 	int32_t width;
 	int32_t height;
 	uint8_t isPrivate;
@@ -218,6 +231,7 @@ struct VulkanTexture {
 	float anisotropy;
 	int32_t maxMipmapLevel;
 	float lodBias;
+	VulkanColorBuffer *colorBuffer; /* Created when first used as a target */
 	VkImage *next; /* linked list */
 };
 
@@ -229,6 +243,7 @@ static VulkanTexture NullTexture =
 	0,
 	0,
 	0,
+	0,
 	FNA3D_SURFACEFORMAT_COLOR,
 	FNA3D_TEXTUREADDRESSMODE_WRAP,
 	FNA3D_TEXTUREADDRESSMODE_WRAP,
@@ -237,6 +252,7 @@ static VulkanTexture NullTexture =
 	0.0f,
 	0,
 	0.0f,
+	NULL,
 	NULL
 };
 
@@ -248,8 +264,13 @@ struct VulkanRenderbuffer /* Cast from FNA3D_Renderbuffer */
 
 struct VulkanColorBuffer
 {
-	VkImageView handle;
+	VkImageView handle; /* Resolve target if multisampled */
 	VkExtent2D dimensions;
+	VkFormat format;
+	FNAVulkanImageData *image; /* NULL for the backbuffer */
+	FNAVulkanImageData *multiSampleTexture; /* NULL if not multisampled */
+	VkSampleCountFlagBits multiSampleCount;
+	uint8_t multiSampleSplit; /* Passes on this target have been split */
 };
 
 struct VulkanDepthStencilBuffer
@@ -280,17 +301,29 @@ typedef struct FNAVulkanRenderer
 	VkPhysicalDevice physicalDevice;
 	VkPhysicalDeviceProperties physicalDeviceProperties;
 	VkDevice logicalDevice;
+	uint8_t supportsLazilyAllocatedMemory;
+	uint8_t supportsMultiDrawIndirect;
 
 	QueueFamilyIndices queueFamilyIndices;
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
 
+	/* Headless devices have no surface or swapchain */
+	uint8_t headless;
 	VkSurfaceKHR surface;
 	VkSwapchainKHR swapChain;
 	FNAVulkanImageData *swapChainImages;
 	uint32_t swapChainImageCount;
 	VkExtent2D swapChainExtent;
+	VkFormat swapChainFormat;
 	uint32_t currentSwapChainIndex;
+	FNA3D_PresentInterval presentInterval;
+	uint8_t needNewSwapChain;
+
+	/* Frame pacing, 0 lets the presentation engine decide */
+	uint32_t maxFrameLatency;
+	uint8_t supportsPresentWait;
+	uint64_t presentID;
 
 	VkCommandPool commandPool;
 	VkPipelineCache pipelineCache;
@@ -317,6 +350,7 @@ typedef struct FNAVulkanRenderer
 	SurfaceFormatMapping surfaceFormatMapping;
 	FNA3D_SurfaceFormat fauxBackbufferSurfaceFormat;
 	FNAVulkanImageData fauxBackbufferColorImageData;
+	FNAVulkanImageData fauxBackbufferMultiSampleColorImageData;
 	VulkanColorBuffer fauxBackbufferColor;
 	VulkanDepthStencilBuffer fauxBackbufferDepthStencil;
 	VkFramebuffer fauxBackbufferFramebuffer;
@@ -326,6 +360,11 @@ typedef struct FNAVulkanRenderer
 	FNA3D_DepthFormat fauxBackbufferDepthFormat;
 	VkSampleCountFlagBits fauxBackbufferMultisampleCount;
 
+	/* When the backbuffer matches the swapchain, the swapchain image is
+	 * bound as the backbuffer color attachment and no blit is needed.
+	 */
+	uint8_t useFauxBackbuffer;
+
 	VulkanColorBuffer *colorAttachments[MAX_RENDERTARGET_BINDINGS];
 	uint32_t colorAttachmentCount;
 	VulkanDepthStencilBuffer *depthStencilAttachment;
@@ -338,8 +377,10 @@ typedef struct FNAVulkanRenderer
 
 	VkSampleMask multiSampleMask[MAX_MULTISAMPLE_MASK_SIZE];
 	FNA3D_BlendState blendState;
+	StateHash blendStateHash;
 
 	FNA3D_DepthStencilState depthStencilState;
+	StateHash depthStencilStateHash;
 	FNA3D_RasterizerState rasterizerState;
 	FNA3D_PrimitiveType currentPrimitiveType;
 
@@ -431,17 +472,27 @@ typedef struct FNAVulkanRenderer
 	uint32_t framebufferCount;
 
 	PipelineLayoutHashMap *pipelineLayoutHashMap;
-	PipelineHashMap *pipelineHashMap;
+	PackedHashMap pipelineHashMap;
 	RenderPassHashMap *renderPassHashMap;
 	FramebufferHashMap *framebufferHashMap;
-	SamplerStateHashMap *samplerStateHashMap;
+	PackedHashMap samplerStateHashMap;
 
 	VkFence renderQueueFence;
 	VkSemaphore imageAvailableSemaphore;
 	VkSemaphore renderFinishedSemaphore;
+	uint8_t imageAvailableSemaphorePending;
+
+	/* Every queue submission gets an ID, so work can be checked later */
+	uint64_t submitCount;
+	uint64_t completedSubmitCount;
+
+	/* Readback staging ring */
+	VulkanReadback readbacks[MAX_READBACKS];
 
 	/* MojoShader Interop */
 	MOJOSHADER_vkContext *mojoshaderContext;
+	SDL_mutex *mojoshaderContextLock;
+	ShaderCache shaderCache;
 	MOJOSHADER_effect *currentEffect;
 	const MOJOSHADER_effectTechnique *currentTechnique;
 	uint32_t currentPass;
@@ -693,6 +744,7 @@ static void CheckPrimitiveTypeAndBindPipeline(
 static void CheckVertexBufferBindingsAndBindPipeline(
 	FNAVulkanRenderer *renderer,
 	FNA3D_VertexBufferBinding *bindings,
+	FNA3D_VertexDeclarationObject **declarations,
 	int32_t numBindings
 );
 
@@ -730,6 +782,7 @@ static uint8_t CreateImage(
 	FNAVulkanRenderer *renderer,
 	uint32_t width,
 	uint32_t height,
+	uint32_t levelCount,
 	VkSampleCountFlagBits samples,
 	VkFormat format,
 	VkComponentMapping swizzle,
@@ -741,6 +794,16 @@ static uint8_t CreateImage(
 	FNAVulkanImageData *imageData
 );
 
+static uint8_t CreateMultiSampleColorImage(
+	FNAVulkanRenderer *renderer,
+	uint32_t width,
+	uint32_t height,
+	VkSampleCountFlagBits samples,
+	VkFormat format,
+	VkComponentMapping swizzle,
+	FNAVulkanImageData *imageData
+);
+
 static VulkanTexture* CreateTexture(
 	FNAVulkanRenderer *renderer,
 	FNA3D_SurfaceFormat format,
@@ -789,6 +852,8 @@ static PipelineHash GetPipelineHash(
 	FNAVulkanRenderer *renderer
 );
 
+static void PackPipelineHash(PipelineHash *hash, uint64_t *key);
+
 static PipelineLayoutHash GetPipelineLayoutHash(
 	FNAVulkanRenderer *renderer,
 	MOJOSHADER_vkShader *vertShader,
@@ -865,13 +930,26 @@ static void SetStencilReferenceValueCommand(FNAVulkanRenderer *renderer);
 
 static void Stall(FNAVulkanRenderer *renderer);
 
+static uint8_t CreateFauxBackbufferColor(
+	FNAVulkanRenderer *renderer
+);
+
+static uint8_t RecreateSwapChain(
+	FNAVulkanRenderer *renderer
+);
+
 static void SubmitPipelineBarrier(
 	FNAVulkanRenderer *renderer
 );
 
+static void LockGlobalFunctions(void);
+static void ReleaseVulkanLibrary(void);
+
 /* static vars */
 
 static PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = NULL;
+static SDL_SpinLock globalFunctionsGuard = 0;
+static SDL_mutex *globalFunctionsLock = NULL;
 
 #define VULKAN_GLOBAL_FUNCTION(name) static PFN_##name name = NULL;
 #include "FNA3D_Driver_Vulkan_global_funcs.h"
@@ -1389,11 +1467,30 @@ static void LogVulkanResult(
 	}
 }
 
+/* MojoShader Context Functions */
+
+static inline void LockShaderContext(FNAVulkanRenderer *renderer)
+{
+	SDL_LockMutex(renderer->mojoshaderContextLock);
+	FNA3D_LockShaderBackend(FNA3D_SHADERBACKEND_VULKAN);
+	MOJOSHADER_vkMakeContextCurrent(renderer->mojoshaderContext);
+}
+
+static inline void UnlockShaderContext(FNAVulkanRenderer *renderer)
+{
+	FNA3D_UnlockShaderBackend(FNA3D_SHADERBACKEND_VULKAN);
+	SDL_UnlockMutex(renderer->mojoshaderContextLock);
+}
+
 /* Command Functions */
 
 static void BindPipeline(FNAVulkanRenderer *renderer)
 {	
-	VkPipeline pipeline = FetchPipeline(renderer);
+	VkPipeline pipeline;
+
+	LockShaderContext(renderer);
+	pipeline = FetchPipeline(renderer);
+	UnlockShaderContext(renderer);
 
 	if (pipeline != renderer->currentPipeline)
 	{
@@ -1658,6 +1755,7 @@ static void BindResources(FNAVulkanRenderer *renderer)
 	VkBuffer *vUniform, *fUniform;
 	unsigned long long vOff, fOff, vSize, fSize;
 
+	LockShaderContext(renderer);
 	MOJOSHADER_vkGetUniformBuffers(
 		(void**) &vUniform,
 		&vOff,
@@ -1666,36 +1764,42 @@ static void BindResources(FNAVulkanRenderer *renderer)
 		&fOff,
 		&fSize
 	);
+	UnlockShaderContext(renderer);
 
+	/* The uniform descriptors are dynamic and always point at the start of
+	 * MojoShader's uniform ring. Moving to a new block within the same ring
+	 * only changes the dynamic offset passed at bind time, so descriptor sets
+	 * are only allocated and written when the ring itself or the block size
+	 * changes, rather than on every uniform upload.
+	 */
 	if (renderer->currentPipelineLayoutHash.vertUniformBufferCount)
 	{
-		/* TODO: need to treat buffer pointer and offset changes differently */
 		if (	vUniform != renderer->ldVertUniformBuffers[renderer->currentSwapChainIndex] ||
-				vOff != renderer->ldVertUniformOffsets[renderer->currentSwapChainIndex]		)
+				vSize != renderer->vertUniformBufferInfo[renderer->currentSwapChainIndex].range	)
 		{
 			renderer->vertUniformBufferInfo[renderer->currentSwapChainIndex].buffer = *vUniform;
-			renderer->vertUniformBufferInfo[renderer->currentSwapChainIndex].offset = vOff;
+			renderer->vertUniformBufferInfo[renderer->currentSwapChainIndex].offset = 0;
 			renderer->vertUniformBufferInfo[renderer->currentSwapChainIndex].range = vSize;
 
 			vertUniformBufferDescriptorSetNeedsUpdate = 1;
 			renderer->ldVertUniformBuffers[renderer->currentSwapChainIndex] = vUniform;
-			renderer->ldVertUniformOffsets[renderer->currentSwapChainIndex] = vOff;
 		}
+		renderer->ldVertUniformOffsets[renderer->currentSwapChainIndex] = vOff;
 	}
 
 	if (renderer->currentPipelineLayoutHash.fragUniformBufferCount)
 	{
 		if (	fUniform != renderer->ldFragUniformBuffers[renderer->currentSwapChainIndex] ||
-				fOff != renderer->ldFragUniformOffsets[renderer->currentSwapChainIndex]		)
+				fSize != renderer->fragUniformBufferInfo[renderer->currentSwapChainIndex].range	)
 		{
 			renderer->fragUniformBufferInfo[renderer->currentSwapChainIndex].buffer = *fUniform;
-			renderer->fragUniformBufferInfo[renderer->currentSwapChainIndex].offset = fOff;
+			renderer->fragUniformBufferInfo[renderer->currentSwapChainIndex].offset = 0;
 			renderer->fragUniformBufferInfo[renderer->currentSwapChainIndex].range = fSize;
 
 			fragUniformBufferDescriptorSetNeedsUpdate = 1;
 			renderer->ldFragUniformBuffers[renderer->currentSwapChainIndex] = fUniform;
-			renderer->ldFragUniformOffsets[renderer->currentSwapChainIndex] = fOff;
 		}
+		renderer->ldFragUniformOffsets[renderer->currentSwapChainIndex] = fOff;
 	}
 
 	VkDescriptorSetLayout uniformBufferLayouts[2];
@@ -1885,7 +1989,6 @@ static void BindResources(FNAVulkanRenderer *renderer)
 		renderer->currentFragUniformBufferDescriptorSet
 	};
 
-	/* TODO: update offsets for UBOs */	
 	renderer->vkCmdBindDescriptorSets(
 		renderer->commandBuffers[renderer->commandBufferCount - 1],
 		VK_PIPELINE_BIND_POINT_GRAPHICS,
@@ -1966,15 +2069,19 @@ static void CheckPrimitiveTypeAndBindPipeline(
 static void CheckVertexBufferBindingsAndBindPipeline(
 	FNAVulkanRenderer *renderer,
 	FNA3D_VertexBufferBinding *bindings,
+	FNA3D_VertexDeclarationObject **declarations,
 	int32_t numBindings
 ) {
 	MOJOSHADER_vkShader *vertexShader, *blah;
 	uint64_t hash;
 
+	LockShaderContext(renderer);
 	MOJOSHADER_vkGetBoundShaders(&vertexShader, &blah);
+	UnlockShaderContext(renderer);
 
-	hash = GetVertexBufferBindingsHash(
+	hash = GetVertexDeclarationObjectsHash(
 		bindings,
+		declarations,
 		numBindings,
 		vertexShader
 	);
@@ -2008,7 +2115,9 @@ static void CheckVertexDeclarationAndBindPipeline(
 	MOJOSHADER_vkShader *vertexShader, *blah;
 	uint64_t hash;
 
+	LockShaderContext(renderer);
 	MOJOSHADER_vkGetBoundShaders(&vertexShader, &blah);
+	UnlockShaderContext(renderer);
 
 	hash = GetVertexDeclarationHash(
 		*vertexDeclaration,
@@ -2182,7 +2291,11 @@ static VulkanBuffer* CreateBuffer(
 	}
 	else if (resourceAccessType == RESOURCE_ACCESS_VERTEX_BUFFER)
 	{
-		usageFlags = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+		/* Vertex buffers double as FNA3D_DrawIndexedArgs storage */
+		usageFlags = (
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+		);
 	}
 	else if (	resourceAccessType == RESOURCE_ACCESS_VERTEX_SHADER_READ_UNIFORM_BUFFER ||
 				resourceAccessType == RESOURCE_ACCESS_FRAGMENT_SHADER_READ_UNIFORM_BUFFER	)
@@ -2259,8 +2372,8 @@ static void SetBufferData(
 		renderer->vkMapMemory(
 			renderer->logicalDevice,
 			vulkanBuffer->deviceMemory,
-			vulkanBuffer->internalOffset,
-			vulkanBuffer->size,
+			0,
+			VK_WHOLE_SIZE,
 			0,
 			&contents
 		);
@@ -2281,8 +2394,8 @@ static void SetBufferData(
 	renderer->vkMapMemory(
 		renderer->logicalDevice,
 		vulkanBuffer->deviceMemory,
-		vulkanBuffer->internalOffset + offsetInBytes,
-		dataLength,
+		0,
+		VK_WHOLE_SIZE,
 		0,
 		&contents
 	);
@@ -2373,6 +2486,13 @@ void VULKAN_DestroyDevice(FNA3D_Device *device)
 		LogVulkanResult("vkDeviceWaitIdle", waitResult);
 	}
 
+	LockShaderContext(renderer);
+	ShaderCache_Free(&renderer->shaderCache);
+	MOJOSHADER_vkMakeContextCurrent(NULL);
+	MOJOSHADER_vkDestroyContext(renderer->mojoshaderContext);
+	UnlockShaderContext(renderer);
+	SDL_DestroyMutex(renderer->mojoshaderContextLock);
+
 	renderer->vkDestroySemaphore(
 		renderer->logicalDevice,
 		renderer->imageAvailableSemaphore,
@@ -2418,13 +2538,16 @@ void VULKAN_DestroyDevice(FNA3D_Device *device)
 		NULL
 	);
 
-	for (uint32_t i = 0; i < hmlenu(renderer->pipelineHashMap); i++)
+	for (uint32_t i = 0; i < renderer->pipelineHashMap.capacity; i++)
 	{
-		renderer->vkDestroyPipeline(
-			renderer->logicalDevice,
-			renderer->pipelineHashMap[i].value,
-			NULL
-		);
+		if (renderer->pipelineHashMap.tags[i] != 0)
+		{
+			renderer->vkDestroyPipeline(
+				renderer->logicalDevice,
+				(VkPipeline) renderer->pipelineHashMap.values[i],
+				NULL
+			);
+		}
 	}
 
 	for (uint32_t i = 0; i < MAX_VERTEXTEXTURE_SAMPLERS; i++)
@@ -2508,23 +2631,47 @@ void VULKAN_DestroyDevice(FNA3D_Device *device)
 		NULL
 	);
 
-	renderer->vkDestroyImageView(
-		renderer->logicalDevice,
-		renderer->fauxBackbufferColorImageData.view,
-		NULL
-	);
+	if (renderer->fauxBackbufferColorImageData.image != VK_NULL_HANDLE)
+	{
+		renderer->vkDestroyImageView(
+			renderer->logicalDevice,
+			renderer->fauxBackbufferColorImageData.view,
+			NULL
+		);
 
-	renderer->vkDestroyImage(
-		renderer->logicalDevice,
-		renderer->fauxBackbufferColorImageData.image,
-		NULL
-	);
+		renderer->vkDestroyImage(
+			renderer->logicalDevice,
+			renderer->fauxBackbufferColorImageData.image,
+			NULL
+		);
 
-	renderer->vkFreeMemory(
-		renderer->logicalDevice,
-		renderer->fauxBackbufferColorImageData.memory,
-		NULL
-	);
+		renderer->vkFreeMemory(
+			renderer->logicalDevice,
+			renderer->fauxBackbufferColorImageData.memory,
+			NULL
+		);
+	}
+
+	if (renderer->fauxBackbufferColor.multiSampleTexture != NULL)
+	{
+		renderer->vkDestroyImageView(
+			renderer->logicalDevice,
+			renderer->fauxBackbufferMultiSampleColorImageData.view,
+			NULL
+		);
+
+		renderer->vkDestroyImage(
+			renderer->logicalDevice,
+			renderer->fauxBackbufferMultiSampleColorImageData.image,
+			NULL
+		);
+
+		renderer->vkFreeMemory(
+			renderer->logicalDevice,
+			renderer->fauxBackbufferMultiSampleColorImageData.memory,
+			NULL
+		);
+	}
 
 	renderer->vkDestroyImageView(
 		renderer->logicalDevice,
@@ -2544,36 +2691,50 @@ void VULKAN_DestroyDevice(FNA3D_Device *device)
 		NULL
 	);
 
-	for (uint32_t i = 0; i < renderer->swapChainImageCount; i++)
+	if (!renderer->headless)
 	{
-		renderer->vkDestroyImageView(
+		for (uint32_t i = 0; i < renderer->swapChainImageCount; i++)
+		{
+			renderer->vkDestroyImageView(
+				renderer->logicalDevice,
+				renderer->swapChainImages[i].view,
+				NULL
+			);
+		}
+
+		renderer->vkDestroySwapchainKHR(
 			renderer->logicalDevice,
-			renderer->swapChainImages[i].view,
+			renderer->swapChain,
 			NULL
 		);
 	}
 
-	renderer->vkDestroySwapchainKHR(
-		renderer->logicalDevice,
-		renderer->swapChain,
-		NULL
-	);
-
 	renderer->vkDestroyDevice(renderer->logicalDevice, NULL);
 
-	renderer->vkDestroySurfaceKHR(
-		renderer->instance,
-		renderer->surface,
-		NULL
-	);
+	if (!renderer->headless)
+	{
+		renderer->vkDestroySurfaceKHR(
+			renderer->instance,
+			renderer->surface,
+			NULL
+		);
+	}
 
 	renderer->vkDestroyInstance(renderer->instance, NULL);
 
+	/* Nothing from the loader is called past this point */
+	if (renderer->headless)
+	{
+		LockGlobalFunctions();
+		ReleaseVulkanLibrary();
+		SDL_UnlockMutex(globalFunctionsLock);
+	}
+
 	hmfree(renderer->pipelineLayoutHashMap);
-	hmfree(renderer->pipelineHashMap);
+	PackedHashMap_Free(&renderer->pipelineHashMap);
 	hmfree(renderer->renderPassHashMap);
 	hmfree(renderer->framebufferHashMap);
-	hmfree(renderer->samplerStateHashMap);
+	PackedHashMap_Free(&renderer->samplerStateHashMap);
 
 	SDL_free(renderer->ldVertexBuffers);
 	SDL_free(renderer->ldFragUniformBuffers);
@@ -2765,6 +2926,7 @@ static uint8_t CreateImage(
 	FNAVulkanRenderer *renderer,
 	uint32_t width,
 	uint32_t height,
+	uint32_t levelCount,
 	VkSampleCountFlagBits samples,
 	VkFormat format,
 	VkComponentMapping swizzle,
@@ -2787,7 +2949,7 @@ static uint8_t CreateImage(
 	imageCreateInfo.extent.width = width;
 	imageCreateInfo.extent.height = height;
 	imageCreateInfo.extent.depth = 1;
-	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.mipLevels = levelCount;
 	imageCreateInfo.arrayLayers = 1;
 	imageCreateInfo.samples = samples;
 	imageCreateInfo.tiling = tiling;
@@ -2887,7 +3049,7 @@ static uint8_t CreateImage(
 	imageViewCreateInfo.components = swizzle;
 	imageViewCreateInfo.subresourceRange.aspectMask = aspectMask;
 	imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
-	imageViewCreateInfo.subresourceRange.levelCount = 1;
+	imageViewCreateInfo.subresourceRange.levelCount = levelCount;
 	imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
 	imageViewCreateInfo.subresourceRange.layerCount = 1;
 
@@ -2917,6 +3079,44 @@ static uint8_t CreateImage(
 	return 1;
 }
 
+static uint8_t CreateMultiSampleColorImage(
+	FNAVulkanRenderer *renderer,
+	uint32_t width,
+	uint32_t height,
+	VkSampleCountFlagBits samples,
+	VkFormat format,
+	VkComponentMapping swizzle,
+	FNAVulkanImageData *imageData
+) {
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	/* The samples are normally resolved at the end of the render pass and
+	 * never stored, so on tilers this image never has to leave tile memory.
+	 */
+	if (renderer->supportsLazilyAllocatedMemory)
+	{
+		usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		memoryProperties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+	}
+
+	return CreateImage(
+		renderer,
+		width,
+		height,
+		1,
+		samples,
+		format,
+		swizzle,
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_TYPE_2D,
+		usage,
+		memoryProperties,
+		imageData
+	);
+}
+
 static VulkanTexture* CreateTexture(
 	FNAVulkanRenderer *renderer,
 	FNA3D_SurfaceFormat format,
@@ -2939,17 +3139,30 @@ static VulkanTexture* CreateTexture(
 
 	SurfaceFormatMapping surfaceFormatMapping = XNAToVK_SurfaceFormat[format];
 
+	VkImageUsageFlags usageFlags = (
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+		VK_IMAGE_USAGE_SAMPLED_BIT
+	);
+
+	/* Mip generation blits from one level of the image to the next */
+	if (levelCount > 1)
+	{
+		usageFlags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+
 	CreateImage(
 		renderer,
 		width,
 		height,
+		levelCount,
 		VK_SAMPLE_COUNT_1_BIT,
 		surfaceFormatMapping.formatColor,
 		surfaceFormatMapping.swizzle,
 		VK_IMAGE_ASPECT_COLOR_BIT,
 		VK_IMAGE_TILING_OPTIMAL,
 		imageType,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		usageFlags,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		result->imageData
 	);
@@ -2958,6 +3171,7 @@ static VulkanTexture* CreateTexture(
 	result->height = height;
 	result->format = format;
 	result->hasMipmaps = levelCount > 1;
+	result->levelCount = levelCount;
 	result->isPrivate = isRenderTarget;
 	result->wrapS = FNA3D_TEXTUREADDRESSMODE_WRAP;
 	result->wrapT = FNA3D_TEXTUREADDRESSMODE_WRAP;
@@ -3152,92 +3366,545 @@ static uint8_t BlitFramebuffer(
 	return 1;
 }
 
-static PipelineLayoutHash GetPipelineLayoutHash(
+static void GenerateMipmaps(
 	FNAVulkanRenderer *renderer,
-	MOJOSHADER_vkShader *vertShader,
-	MOJOSHADER_vkShader *fragShader
+	VulkanTexture *texture
 ) {
-	PipelineLayoutHash hash;
-	hash.vertUniformBufferCount = MOJOSHADER_vkGetShaderParseData(vertShader)->uniform_count > 0;
-	hash.vertSamplerCount = MOJOSHADER_vkGetShaderParseData(vertShader)->sampler_count;
-	hash.fragUniformBufferCount = MOJOSHADER_vkGetShaderParseData(fragShader)->uniform_count > 0;
-	hash.fragSamplerCount = MOJOSHADER_vkGetShaderParseData(fragShader)->sampler_count;
-	return hash;
-}
+	VkImageBlit blit;
+	VkFormatProperties formatProperties;
+	VkFilter filter;
+	ImageMemoryBarrierCreateInfo memoryBarrierCreateInfo;
+	VulkanResourceAccessType prevAccessType;
+	VulkanResourceAccessType nextAccessType;
+	int32_t level, srcWidth, srcHeight, dstWidth, dstHeight;
 
-static VkPipelineLayout FetchPipelineLayout(
-	FNAVulkanRenderer *renderer,
-	MOJOSHADER_vkShader *vertShader,
-	MOJOSHADER_vkShader *fragShader
-) {
-	PipelineLayoutHash hash = GetPipelineLayoutHash(renderer, vertShader, fragShader);
-	renderer->currentPipelineLayoutHash = hash;
+	if (texture->levelCount <= 1)
+	{
+		return;
+	}
 
-	if (hmgeti(renderer->pipelineLayoutHashMap, hash) != -1)
+	/* Blits are optional for some formats (compressed formats never have
+	 * them), and linear filtering is optional for blits that do work.
+	 */
+	renderer->vkGetPhysicalDeviceFormatProperties(
+		renderer->physicalDevice,
+		XNAToVK_SurfaceFormat[texture->format].formatColor,
+		&formatProperties
+	);
+	if (	!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) ||
+		!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT)	)
 	{
-		return hmget(renderer->pipelineLayoutHashMap, hash);
+		FNA3D_LogWarn(
+			"%s\n",
+			"Texture format cannot be blitted, mipmaps were not generated"
+		);
+		return;
+	}
+	if (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)
+	{
+		filter = VK_FILTER_LINEAR;
+	}
+	else
+	{
+		filter = VK_FILTER_NEAREST;
 	}
 
-	VkDescriptorSetLayout setLayouts[4];
+	if (!renderer->commandBufferBegunThisFrame)
+	{
+		AllocateAndBeginCommandBuffer(renderer);
+	}
 
-	setLayouts[0] = renderer->vertSamplerDescriptorSetLayouts[hash.vertSamplerCount];
-	setLayouts[1] = renderer->fragSamplerDescriptorSetLayouts[hash.fragSamplerCount];
-	setLayouts[2] = renderer->vertUniformBufferDescriptorSetLayouts[hash.vertUniformBufferCount];
-	setLayouts[3] = renderer->fragUniformBufferDescriptorSetLayouts[hash.fragUniformBufferCount];
+	/* Transfer commands cannot be recorded inside of a render pass */
+	if (renderer->renderPassInProgress)
+	{
+		EndPass(renderer);
+		renderer->needNewRenderPass = 1;
+	}
 
-	VkPipelineLayoutCreateInfo layoutCreateInfo = {
-		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO
-	};
+	memoryBarrierCreateInfo.prevAccessCount = 1;
+	memoryBarrierCreateInfo.nextAccessCount = 1;
+	memoryBarrierCreateInfo.image = texture->imageData->image;
+	memoryBarrierCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	memoryBarrierCreateInfo.subresourceRange.baseArrayLayer = 0;
+	memoryBarrierCreateInfo.subresourceRange.layerCount = 1;
+	memoryBarrierCreateInfo.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	memoryBarrierCreateInfo.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+	/* Level 0 is the source of the chain, the rest get overwritten */
+	nextAccessType = RESOURCE_ACCESS_TRANSFER_READ;
+	memoryBarrierCreateInfo.pPrevAccesses = &texture->imageData->resourceAccessType;
+	memoryBarrierCreateInfo.pNextAccesses = &nextAccessType;
+	memoryBarrierCreateInfo.subresourceRange.baseMipLevel = 0;
+	memoryBarrierCreateInfo.subresourceRange.levelCount = 1;
+	memoryBarrierCreateInfo.discardContents = 0;
+
+	CreateImageMemoryBarrier(
+		renderer,
+		memoryBarrierCreateInfo
+	);
 
-	layoutCreateInfo.setLayoutCount = 4;
-	layoutCreateInfo.pSetLayouts = setLayouts;
+	nextAccessType = RESOURCE_ACCESS_TRANSFER_WRITE;
+	memoryBarrierCreateInfo.subresourceRange.baseMipLevel = 1;
+	memoryBarrierCreateInfo.subresourceRange.levelCount = texture->levelCount - 1;
+	memoryBarrierCreateInfo.discardContents = 1;
 
-	VkPipelineLayout layout;
-	VkResult vulkanResult = renderer->vkCreatePipelineLayout(
-		renderer->logicalDevice,
-		&layoutCreateInfo,
-		NULL,
-		&layout
+	CreateImageMemoryBarrier(
+		renderer,
+		memoryBarrierCreateInfo
 	);
 
-	if (vulkanResult != VK_SUCCESS)
-	{
-		LogVulkanResult("vkCreatePipelineLayout", vulkanResult);
-		return NULL;
-	}
+	SubmitPipelineBarrier(renderer);
 
-	hmput(renderer->pipelineLayoutHashMap, hash, layout);
-	return layout;
-}
+	blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.srcSubresource.baseArrayLayer = 0;
+	blit.srcSubresource.layerCount = 1;
+	blit.srcOffsets[0].x = 0;
+	blit.srcOffsets[0].y = 0;
+	blit.srcOffsets[0].z = 0;
+	blit.srcOffsets[1].z = 1;
 
-static VkPipeline FetchPipeline(
-	FNAVulkanRenderer *renderer
-) {
-	VkResult vulkanResult;
+	blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.dstSubresource.baseArrayLayer = 0;
+	blit.dstSubresource.layerCount = 1;
+	blit.dstOffsets[0].x = 0;
+	blit.dstOffsets[0].y = 0;
+	blit.dstOffsets[0].z = 0;
+	blit.dstOffsets[1].z = 1;
 
-	PipelineHash hash = GetPipelineHash(renderer);
+	srcWidth = texture->width;
+	srcHeight = texture->height;
 
-	if (hmgeti(renderer->pipelineHashMap, hash) != -1)
+	for (level = 1; level < texture->levelCount; level += 1)
 	{
-		return hmget(renderer->pipelineHashMap, hash);
-	}
-
-	VkPipeline pipeline;
+		dstWidth = SDL_max(srcWidth >> 1, 1);
+		dstHeight = SDL_max(srcHeight >> 1, 1);
 
-	/* NOTE: because viewport and scissor are dynamic,
-	 * values must be set using the command buffer
-	 */
-	VkPipelineViewportStateCreateInfo viewportStateInfo = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
-	viewportStateInfo.viewportCount = 1;
-	viewportStateInfo.scissorCount = 1;
+		blit.srcSubresource.mipLevel = level - 1;
+		blit.srcOffsets[1].x = srcWidth;
+		blit.srcOffsets[1].y = srcHeight;
 
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
-	inputAssemblyInfo.topology = XNAToVK_Topology[renderer->currentPrimitiveType];
-	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+		blit.dstSubresource.mipLevel = level;
+		blit.dstOffsets[1].x = dstWidth;
+		blit.dstOffsets[1].y = dstHeight;
 
-	VkVertexInputBindingDescription bindingDescriptions[renderer->numVertexBindings];
-	VkVertexInputAttributeDescription attributeDescriptions[renderer->numVertexBindings * MAX_VERTEX_ATTRIBUTES];
-	uint32_t attributeDescriptionCount;
+		renderer->vkCmdBlitImage(
+			renderer->commandBuffers[renderer->commandBufferCount - 1],
+			texture->imageData->image,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			texture->imageData->image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1,
+			&blit,
+			filter
+		);
+
+		/* The level we just wrote is the source for the next blit */
+		prevAccessType = RESOURCE_ACCESS_TRANSFER_WRITE;
+		nextAccessType = RESOURCE_ACCESS_TRANSFER_READ;
+		memoryBarrierCreateInfo.pPrevAccesses = &prevAccessType;
+		memoryBarrierCreateInfo.pNextAccesses = &nextAccessType;
+		memoryBarrierCreateInfo.subresourceRange.baseMipLevel = level;
+		memoryBarrierCreateInfo.subresourceRange.levelCount = 1;
+		memoryBarrierCreateInfo.discardContents = 0;
+
+		CreateImageMemoryBarrier(
+			renderer,
+			memoryBarrierCreateInfo
+		);
+
+		SubmitPipelineBarrier(renderer);
+
+		srcWidth = dstWidth;
+		srcHeight = dstHeight;
+	}
+
+	/* Every level is now TRANSFER_READ, so the whole image can be tracked
+	 * as one resource again.
+	 */
+	texture->imageData->resourceAccessType = RESOURCE_ACCESS_TRANSFER_READ;
+}
+
+static FNAVulkanImageData* GetBackbufferImage(
+	FNAVulkanRenderer *renderer
+) {
+	/* The swapchain image is only valid after an image has been acquired! */
+	if (renderer->useFauxBackbuffer)
+	{
+		return &renderer->fauxBackbufferColorImageData;
+	}
+	return &renderer->swapChainImages[renderer->currentSwapChainIndex];
+}
+
+static VulkanReadback* RecordReadback(
+	FNAVulkanRenderer *renderer,
+	FNAVulkanImageData *imageData,
+	int32_t imageLevelCount,
+	int32_t x,
+	int32_t y,
+	int32_t z,
+	int32_t w,
+	int32_t h,
+	int32_t d,
+	int32_t level,
+	int32_t layer,
+	int32_t dataLength
+) {
+	VulkanReadback *readback = NULL;
+	VulkanResourceAccessType prevAccessType = imageData->resourceAccessType;
+	VulkanResourceAccessType nextAccessType;
+	ImageMemoryBarrierCreateInfo imageBarrierCreateInfo;
+	BufferMemoryBarrierCreateInfo bufferBarrierCreateInfo;
+	VkBufferImageCopy imageCopy;
+
+	for (uint32_t i = 0; i < MAX_READBACKS; i++)
+	{
+		if (!renderer->readbacks[i].inUse)
+		{
+			readback = &renderer->readbacks[i];
+			break;
+		}
+	}
+
+	if (readback == NULL)
+	{
+		FNA3D_LogError(
+			"Too many readbacks in flight, poll the old ones first!"
+		);
+		return NULL;
+	}
+
+	/* Staging buffers stay around, they only ever grow */
+	if (readback->buffer != NULL && readback->buffer->size < dataLength)
+	{
+		DestroyBuffer(
+			(FNA3D_Renderer*) renderer,
+			(FNA3D_Buffer*) readback->buffer
+		);
+		readback->buffer = NULL;
+	}
+	if (readback->buffer == NULL)
+	{
+		readback->buffer = CreateBuffer(
+			renderer,
+			FNA3D_BUFFERUSAGE_NONE,
+			dataLength,
+			RESOURCE_ACCESS_TRANSFER_WRITE
+		);
+	}
+
+	if (!renderer->commandBufferBegunThisFrame)
+	{
+		AllocateAndBeginCommandBuffer(renderer);
+	}
+
+	/* Transfer commands cannot be recorded inside of a render pass */
+	if (renderer->renderPassInProgress)
+	{
+		EndPass(renderer);
+		renderer->needNewRenderPass = 1;
+	}
+
+	imageBarrierCreateInfo.prevAccessCount = 1;
+	imageBarrierCreateInfo.nextAccessCount = 1;
+	imageBarrierCreateInfo.image = imageData->image;
+	imageBarrierCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageBarrierCreateInfo.subresourceRange.baseArrayLayer = 0;
+	imageBarrierCreateInfo.subresourceRange.baseMipLevel = 0;
+	imageBarrierCreateInfo.subresourceRange.layerCount = 1;
+	imageBarrierCreateInfo.subresourceRange.levelCount = imageLevelCount;
+	imageBarrierCreateInfo.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrierCreateInfo.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrierCreateInfo.discardContents = 0;
+
+	bufferBarrierCreateInfo.prevAccessCount = 1;
+	bufferBarrierCreateInfo.nextAccessCount = 1;
+	bufferBarrierCreateInfo.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrierCreateInfo.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrierCreateInfo.buffer = readback->buffer->handle;
+	bufferBarrierCreateInfo.offset = 0;
+	bufferBarrierCreateInfo.size = readback->buffer->internalBufferSize;
+
+	if (imageData->resourceAccessType != RESOURCE_ACCESS_TRANSFER_READ)
+	{
+		nextAccessType = RESOURCE_ACCESS_TRANSFER_READ;
+		imageBarrierCreateInfo.pPrevAccesses = &imageData->resourceAccessType;
+		imageBarrierCreateInfo.pNextAccesses = &nextAccessType;
+
+		CreateImageMemoryBarrier(
+			renderer,
+			imageBarrierCreateInfo
+		);
+
+		imageData->resourceAccessType = nextAccessType;
+	}
+
+	if (readback->buffer->resourceAccessType != RESOURCE_ACCESS_TRANSFER_WRITE)
+	{
+		nextAccessType = RESOURCE_ACCESS_TRANSFER_WRITE;
+		bufferBarrierCreateInfo.pPrevAccesses = &readback->buffer->resourceAccessType;
+		bufferBarrierCreateInfo.pNextAccesses = &nextAccessType;
+
+		CreateBufferMemoryBarrier(
+			renderer,
+			bufferBarrierCreateInfo
+		);
+
+		readback->buffer->resourceAccessType = nextAccessType;
+	}
+
+	SubmitPipelineBarrier(renderer);
+
+	imageCopy.bufferOffset = 0;
+	imageCopy.bufferRowLength = 0; /* Tightly packed */
+	imageCopy.bufferImageHeight = 0;
+	imageCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageCopy.imageSubresource.mipLevel = level;
+	imageCopy.imageSubresource.baseArrayLayer = layer;
+	imageCopy.imageSubresource.layerCount = 1;
+	imageCopy.imageOffset.x = x;
+	imageCopy.imageOffset.y = y;
+	imageCopy.imageOffset.z = z;
+	imageCopy.imageExtent.width = w;
+	imageCopy.imageExtent.height = h;
+	imageCopy.imageExtent.depth = d;
+
+	renderer->vkCmdCopyImageToBuffer(
+		renderer->commandBuffers[renderer->commandBufferCount - 1],
+		imageData->image,
+		AccessMap[imageData->resourceAccessType].imageLayout,
+		readback->buffer->handle,
+		1,
+		&imageCopy
+	);
+
+	/* Make the copy visible to the host once the fence is signaled */
+	nextAccessType = RESOURCE_ACCESS_HOST_READ;
+	bufferBarrierCreateInfo.pPrevAccesses = &readback->buffer->resourceAccessType;
+	bufferBarrierCreateInfo.pNextAccesses = &nextAccessType;
+
+	CreateBufferMemoryBarrier(
+		renderer,
+		bufferBarrierCreateInfo
+	);
+
+	readback->buffer->resourceAccessType = nextAccessType;
+
+	/* Put the image back where we found it, so the callers' tracking of
+	 * attachment images stays valid.
+	 */
+	if (	prevAccessType != RESOURCE_ACCESS_NONE &&
+		prevAccessType != RESOURCE_ACCESS_TRANSFER_READ	)
+	{
+		imageBarrierCreateInfo.pPrevAccesses = &imageData->resourceAccessType;
+		imageBarrierCreateInfo.pNextAccesses = &prevAccessType;
+
+		CreateImageMemoryBarrier(
+			renderer,
+			imageBarrierCreateInfo
+		);
+
+		imageData->resourceAccessType = prevAccessType;
+	}
+
+	SubmitPipelineBarrier(renderer);
+
+	/* This will be part of whatever gets submitted next */
+	readback->submitID = renderer->submitCount + 1;
+	readback->dataLength = dataLength;
+	readback->inUse = 1;
+
+	return readback;
+}
+
+static uint8_t ReadbackComplete(
+	FNAVulkanRenderer *renderer,
+	VulkanReadback *readback
+) {
+	if (readback->submitID <= renderer->completedSubmitCount)
+	{
+		return 1;
+	}
+
+	/* Still being recorded, nothing to wait on yet */
+	if (readback->submitID > renderer->submitCount)
+	{
+		return 0;
+	}
+
+	/* The fence belongs to the latest submission, which includes ours */
+	if (renderer->vkGetFenceStatus(
+		renderer->logicalDevice,
+		renderer->renderQueueFence
+	) == VK_SUCCESS) {
+		renderer->completedSubmitCount = renderer->submitCount;
+		return 1;
+	}
+
+	return 0;
+}
+
+static void CopyReadbackData(
+	FNAVulkanRenderer *renderer,
+	VulkanReadback *readback,
+	void* data
+) {
+	void *contents;
+
+	if (data != NULL)
+	{
+		renderer->vkMapMemory(
+			renderer->logicalDevice,
+			readback->buffer->deviceMemory,
+			0,
+			readback->dataLength,
+			0,
+			&contents
+		);
+
+		SDL_memcpy(data, contents, readback->dataLength);
+
+		renderer->vkUnmapMemory(
+			renderer->logicalDevice,
+			readback->buffer->deviceMemory
+		);
+	}
+
+	readback->inUse = 0;
+}
+
+static void ReadImageImmediately(
+	FNAVulkanRenderer *renderer,
+	FNAVulkanImageData *imageData,
+	int32_t imageLevelCount,
+	int32_t x,
+	int32_t y,
+	int32_t z,
+	int32_t w,
+	int32_t h,
+	int32_t d,
+	int32_t level,
+	int32_t layer,
+	void* data,
+	int32_t dataLength
+) {
+	VulkanReadback *readback = RecordReadback(
+		renderer,
+		imageData,
+		imageLevelCount,
+		x,
+		y,
+		z,
+		w,
+		h,
+		d,
+		level,
+		layer,
+		dataLength
+	);
+
+	if (readback == NULL)
+	{
+		return;
+	}
+
+	/* The whole point of GetData: submit everything and wait for it */
+	Stall(renderer);
+	CopyReadbackData(renderer, readback, data);
+}
+
+static PipelineLayoutHash GetPipelineLayoutHash(
+	FNAVulkanRenderer *renderer,
+	MOJOSHADER_vkShader *vertShader,
+	MOJOSHADER_vkShader *fragShader
+) {
+	PipelineLayoutHash hash;
+	hash.vertUniformBufferCount = MOJOSHADER_vkGetShaderParseData(vertShader)->uniform_count > 0;
+	hash.vertSamplerCount = MOJOSHADER_vkGetShaderParseData(vertShader)->sampler_count;
+	hash.fragUniformBufferCount = MOJOSHADER_vkGetShaderParseData(fragShader)->uniform_count > 0;
+	hash.fragSamplerCount = MOJOSHADER_vkGetShaderParseData(fragShader)->sampler_count;
+	return hash;
+}
+
+static VkPipelineLayout FetchPipelineLayout(
+	FNAVulkanRenderer *renderer,
+	MOJOSHADER_vkShader *vertShader,
+	MOJOSHADER_vkShader *fragShader
+) {
+	PipelineLayoutHash hash = GetPipelineLayoutHash(renderer, vertShader, fragShader);
+	renderer->currentPipelineLayoutHash = hash;
+
+	if (hmgeti(renderer->pipelineLayoutHashMap, hash) != -1)
+	{
+		return hmget(renderer->pipelineLayoutHashMap, hash);
+	}
+
+	VkDescriptorSetLayout setLayouts[4];
+
+	setLayouts[0] = renderer->vertSamplerDescriptorSetLayouts[hash.vertSamplerCount];
+	setLayouts[1] = renderer->fragSamplerDescriptorSetLayouts[hash.fragSamplerCount];
+	setLayouts[2] = renderer->vertUniformBufferDescriptorSetLayouts[hash.vertUniformBufferCount];
+	setLayouts[3] = renderer->fragUniformBufferDescriptorSetLayouts[hash.fragUniformBufferCount];
+
+	VkPipelineLayoutCreateInfo layoutCreateInfo = {
+		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO
+	};
+
+	layoutCreateInfo.setLayoutCount = 4;
+	layoutCreateInfo.pSetLayouts = setLayouts;
+
+	VkPipelineLayout layout;
+	VkResult vulkanResult = renderer->vkCreatePipelineLayout(
+		renderer->logicalDevice,
+		&layoutCreateInfo,
+		NULL,
+		&layout
+	);
+
+	if (vulkanResult != VK_SUCCESS)
+	{
+		LogVulkanResult("vkCreatePipelineLayout", vulkanResult);
+		return NULL;
+	}
+
+	hmput(renderer->pipelineLayoutHashMap, hash, layout);
+	return layout;
+}
+
+static VkPipeline FetchPipeline(
+	FNAVulkanRenderer *renderer
+) {
+	VkResult vulkanResult;
+
+	PipelineHash hash = GetPipelineHash(renderer);
+	uint64_t key[PIPELINE_KEY_WORDS];
+	VkPipeline cached;
+
+	PackPipelineHash(&hash, key);
+	cached = (VkPipeline) PackedHashMap_GetHandle(
+		&renderer->pipelineHashMap,
+		key
+	);
+	if (cached != VK_NULL_HANDLE)
+	{
+		return cached;
+	}
+
+	VkPipeline pipeline;
+
+	/* NOTE: because viewport and scissor are dynamic,
+	 * values must be set using the command buffer
+	 */
+	VkPipelineViewportStateCreateInfo viewportStateInfo = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+	viewportStateInfo.viewportCount = 1;
+	viewportStateInfo.scissorCount = 1;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+	inputAssemblyInfo.topology = XNAToVK_Topology[renderer->currentPrimitiveType];
+	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+	VkVertexInputBindingDescription bindingDescriptions[renderer->numVertexBindings];
+	VkVertexInputAttributeDescription attributeDescriptions[renderer->numVertexBindings * MAX_VERTEX_ATTRIBUTES];
+	uint32_t attributeDescriptionCount;
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
 		VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO
@@ -3283,7 +3950,8 @@ static VkPipeline FetchPipeline(
 	multisamplingInfo.sampleShadingEnable = VK_FALSE;
 	multisamplingInfo.minSampleShading = 1.0f;
 	multisamplingInfo.pSampleMask = renderer->multiSampleMask;
-	multisamplingInfo.rasterizationSamples = XNAToVK_SampleCount(renderer->rasterizerState.multiSampleAntiAlias);
+	/* Must match the sample count of the current render pass */
+	multisamplingInfo.rasterizationSamples = renderer->colorAttachments[0]->multiSampleCount;
 	multisamplingInfo.alphaToCoverageEnable = VK_FALSE;
 	multisamplingInfo.alphaToOneEnable = VK_FALSE;
 
@@ -3447,7 +4115,11 @@ static VkPipeline FetchPipeline(
 	/* putting this here is kind of a kludge -cosmonaut */
 	renderer->currentPipelineLayout = pipelineLayout;
 
-	hmput(renderer->pipelineHashMap, hash, pipeline);
+	PackedHashMap_PutHandle(
+		&renderer->pipelineHashMap,
+		key,
+		(uint64_t) pipeline
+	);
 	return pipeline;
 }
 
@@ -3467,20 +4139,35 @@ static VkRenderPass FetchRenderPass(
 	/* otherwise lets make a new one */
 	VkRenderPass renderPass;
 
-	VkAttachmentDescription attachmentDescriptions[MAX_RENDERTARGET_BINDINGS + 1];
+	/* Color, then depth/stencil, then one resolve attachment per color */
+	VkAttachmentDescription attachmentDescriptions[MAX_RENDERTARGET_BINDINGS * 2 + 1];
+	VkSampleCountFlagBits multiSampleCount = (VkSampleCountFlagBits) hash.multiSampleCount;
+	uint8_t isMultiSampled = multiSampleCount > VK_SAMPLE_COUNT_1_BIT;
 
 	for (uint32_t i = 0; i < renderer->colorAttachmentCount; i++)
 	{
-		/* TODO: handle multisample */
-
 		attachmentDescriptions[i].flags = 0;
-		attachmentDescriptions[i].format = renderer->surfaceFormatMapping.formatColor;
-		attachmentDescriptions[i].samples = VK_SAMPLE_COUNT_1_BIT;
-		attachmentDescriptions[i].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		attachmentDescriptions[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachmentDescriptions[i].format = renderer->colorAttachments[i]->format;
+		attachmentDescriptions[i].samples = multiSampleCount;
+		/* A pass that continues a split one has to pick the samples up
+		 * again, or its resolve would overwrite the target with garbage.
+		 */
+		if (hash.loadMultiSample)
+		{
+			attachmentDescriptions[i].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+			attachmentDescriptions[i].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		}
+		else
+		{
+			attachmentDescriptions[i].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachmentDescriptions[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+		/* Otherwise the samples only live until the subpass resolves them */
+		attachmentDescriptions[i].storeOp = (isMultiSampled && !hash.storeMultiSample) ?
+			VK_ATTACHMENT_STORE_OP_DONT_CARE :
+			VK_ATTACHMENT_STORE_OP_STORE;
 		attachmentDescriptions[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		attachmentDescriptions[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attachmentDescriptions[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		attachmentDescriptions[i].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	}
 
@@ -3498,7 +4185,7 @@ static VkRenderPass FetchRenderPass(
 		depthStencilAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 		attachmentDescriptions[renderer->colorAttachmentCount].flags = 0;
 		attachmentDescriptions[renderer->colorAttachmentCount].format = XNAToVK_DepthFormat(renderer->currentDepthFormat);
-		attachmentDescriptions[renderer->colorAttachmentCount].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachmentDescriptions[renderer->colorAttachmentCount].samples = multiSampleCount;
 		attachmentDescriptions[renderer->colorAttachmentCount].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		attachmentDescriptions[renderer->colorAttachmentCount].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		attachmentDescriptions[renderer->colorAttachmentCount].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -3512,6 +4199,27 @@ static VkRenderPass FetchRenderPass(
 		renderer->depthStencilAttachmentActive = 0;
 	}
 
+	uint32_t resolveAttachmentStart = renderer->colorAttachmentCount + renderer->depthStencilAttachmentActive;
+	uint32_t resolveAttachmentCount = 0;
+	VkAttachmentReference resolveAttachmentReferences[MAX_RENDERTARGET_BINDINGS];
+
+	if (isMultiSampled)
+	{
+		for (uint32_t i = 0; i < renderer->colorAttachmentCount; i++)
+		{
+			attachmentDescriptions[resolveAttachmentStart + i] = attachmentDescriptions[i];
+			attachmentDescriptions[resolveAttachmentStart + i].samples = VK_SAMPLE_COUNT_1_BIT;
+			/* The resolve overwrites every pixel, nothing to load */
+			attachmentDescriptions[resolveAttachmentStart + i].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachmentDescriptions[resolveAttachmentStart + i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachmentDescriptions[resolveAttachmentStart + i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			resolveAttachmentReferences[i].attachment = resolveAttachmentStart + i;
+			resolveAttachmentReferences[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		}
+		resolveAttachmentCount = renderer->colorAttachmentCount;
+	}
+
 	VkSubpassDescription subpass;
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	subpass.flags = 0;
@@ -3519,7 +4227,7 @@ static VkRenderPass FetchRenderPass(
 	subpass.pInputAttachments = NULL;
 	subpass.colorAttachmentCount = renderer->colorAttachmentCount;
 	subpass.pColorAttachments = colorAttachmentReferences;
-	subpass.pResolveAttachments = NULL;
+	subpass.pResolveAttachments = isMultiSampled ? resolveAttachmentReferences : NULL;
 	subpass.preserveAttachmentCount = 0;
 	subpass.pPreserveAttachments = NULL;
 
@@ -3546,7 +4254,7 @@ static VkRenderPass FetchRenderPass(
 	VkRenderPassCreateInfo renderPassCreateInfo = {
 		VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO
 	};
-	renderPassCreateInfo.attachmentCount = renderer->colorAttachmentCount + renderer->depthStencilAttachmentActive;
+	renderPassCreateInfo.attachmentCount = resolveAttachmentStart + resolveAttachmentCount;
 	renderPassCreateInfo.pAttachments = attachmentDescriptions;
 	renderPassCreateInfo.subpassCount = 1;
 	renderPassCreateInfo.pSubpasses = &subpass;
@@ -3580,7 +4288,25 @@ static VkFramebuffer FetchFramebuffer(
 	FNAVulkanRenderer *renderer,
 	VkRenderPass renderPass
 ) {
-	RenderPassHash hash = GetRenderPassHash(renderer);
+	FramebufferHash hash;
+	uint8_t isMultiSampled = GetRenderPassHash(renderer).multiSampleCount > VK_SAMPLE_COUNT_1_BIT;
+
+	/* The views are part of the key, the backbuffer may change per frame */
+	SDL_zero(hash);
+	for (uint32_t i = 0; i < renderer->colorAttachmentCount; i++)
+	{
+		hash.colorAttachmentViews[i] = renderer->colorAttachments[i]->handle;
+		if (renderer->colorAttachments[i]->multiSampleTexture != NULL)
+		{
+			hash.colorMultiSampleAttachmentViews[i] = renderer->colorAttachments[i]->multiSampleTexture->view;
+		}
+	}
+	if (renderer->depthStencilAttachmentActive)
+	{
+		hash.depthStencilAttachmentView = renderer->depthStencilAttachment->handle.view;
+	}
+	hash.width = renderer->colorAttachments[0]->dimensions.width;
+	hash.height = renderer->colorAttachments[0]->dimensions.height;
 
 	/* framebuffer is cached, can return it */
 	if (hmgeti(renderer->framebufferHashMap, hash) != -1)
@@ -3592,16 +4318,33 @@ static VkFramebuffer FetchFramebuffer(
 
 	VkFramebuffer framebuffer;
 
-	VkImageView imageViewAttachments[MAX_RENDERTARGET_BINDINGS + 1];
+	VkImageView imageViewAttachments[MAX_RENDERTARGET_BINDINGS * 2 + 1];
+	uint32_t attachmentCount = renderer->colorAttachmentCount + renderer->depthStencilAttachmentActive;
 
 	for (uint32_t i = 0; i < renderer->colorAttachmentCount; i++)
 	{
-		imageViewAttachments[i] = renderer->colorAttachments[i]->handle;
+		if (renderer->colorAttachments[i]->multiSampleTexture != NULL)
+		{
+			imageViewAttachments[i] = renderer->colorAttachments[i]->multiSampleTexture->view;
+		}
+		else
+		{
+			imageViewAttachments[i] = renderer->colorAttachments[i]->handle;
+		}
 	}
 	if (renderer->depthStencilAttachmentActive)
 	{
 		imageViewAttachments[renderer->colorAttachmentCount] = renderer->depthStencilAttachment->handle.view;
 	}
+	if (isMultiSampled)
+	{
+		/* The single-sample views are the resolve targets */
+		for (uint32_t i = 0; i < renderer->colorAttachmentCount; i++)
+		{
+			imageViewAttachments[attachmentCount + i] = renderer->colorAttachments[i]->handle;
+		}
+		attachmentCount += renderer->colorAttachmentCount;
+	}
 
 	VkFramebufferCreateInfo framebufferInfo = {
 		VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO
@@ -3609,10 +4352,10 @@ static VkFramebuffer FetchFramebuffer(
 
 	framebufferInfo.flags = 0;
 	framebufferInfo.renderPass = renderPass;
-	framebufferInfo.attachmentCount = renderer->colorAttachmentCount + renderer->depthStencilAttachmentActive;
+	framebufferInfo.attachmentCount = attachmentCount;
 	framebufferInfo.pAttachments = imageViewAttachments;
-	framebufferInfo.width = renderer->swapChainExtent.width;
-	framebufferInfo.height = renderer->swapChainExtent.height;
+	framebufferInfo.width = hash.width;
+	framebufferInfo.height = hash.height;
 	framebufferInfo.layers = 1;
 
 	VkResult vulkanResult;
@@ -3641,11 +4384,17 @@ static VkSampler FetchSamplerState(
 ) {
 	StateHash hash;
 
+	VkSampler cached;
+
 	hash = GetSamplerStateHash(*samplerState);
 
-	if (hmgeti(renderer->samplerStateHashMap, hash) != -1)
+	cached = (VkSampler) PackedHashMap_GetStateHandle(
+		&renderer->samplerStateHashMap,
+		hash
+	);
+	if (cached != VK_NULL_HANDLE)
 	{
-		return hmget(renderer->samplerStateHashMap, hash);
+		return cached;
 	}
 
 	VkSamplerCreateInfo createInfo = {
@@ -3683,7 +4432,11 @@ static VkSampler FetchSamplerState(
 		return 0;
 	}
 
-	hmput(renderer->samplerStateHashMap, hash, state);
+	PackedHashMap_PutStateHandle(
+		&renderer->samplerStateHashMap,
+		hash,
+		(uint64_t) state
+	);
 
 	return state;
 }
@@ -3692,12 +4445,12 @@ static PipelineHash GetPipelineHash(
 	FNAVulkanRenderer *renderer
 ) {
 	PipelineHash hash;
-	hash.blendState = GetBlendStateHash(renderer->blendState);
+	hash.blendState = renderer->blendStateHash;
 	hash.rasterizerState = GetRasterizerStateHash(
 		renderer->rasterizerState,
 		renderer->rasterizerState.depthBias * XNAToVK_DepthBiasScale[renderer->currentDepthFormat]
 	);
-	hash.depthStencilState = GetDepthStencilStateHash(renderer->depthStencilState);
+	hash.depthStencilState = renderer->depthStencilStateHash;
 	hash.vertexDeclarationHash = renderer->currentUserVertexDeclarationHash;
 	hash.vertexBufferBindingsHash = renderer->currentVertexBufferBindingHash;
 	hash.primitiveType = renderer->currentPrimitiveType;
@@ -3710,14 +4463,75 @@ static PipelineHash GetPipelineHash(
 	return hash;
 }
 
+static void PackPipelineHash(PipelineHash *hash, uint64_t *key)
+{
+	key[0] = hash->blendState.a;
+	key[1] = hash->blendState.b;
+	key[2] = hash->rasterizerState.a;
+	key[3] = hash->rasterizerState.b;
+	key[4] = hash->depthStencilState.a;
+	key[5] = hash->depthStencilState.b;
+	key[6] = hash->vertexBufferBindingsHash;
+	key[7] = hash->vertexDeclarationHash;
+	key[8] = (
+		(uint64_t) hash->primitiveType << 32 |
+		(uint64_t) hash->sampleMask
+	);
+	key[9] = hash->vertShader;
+	key[10] = hash->fragShader;
+	key[11] = (uint64_t) hash->renderPass;
+}
+
 static RenderPassHash GetRenderPassHash(
 	FNAVulkanRenderer *renderer
 ) {
 	RenderPassHash hash;
+	SDL_zero(hash);
 	hash.attachmentCount = renderer->colorAttachmentCount + renderer->depthStencilAttachmentActive;
+	hash.multiSampleCount = (renderer->colorAttachmentCount > 0) ?
+		renderer->colorAttachments[0]->multiSampleCount :
+		VK_SAMPLE_COUNT_1_BIT;
+	for (uint32_t i = 0; i < renderer->colorAttachmentCount; i++)
+	{
+		hash.colorFormats[i] = renderer->colorAttachments[i]->format;
+	}
+	hash.depthFormat = renderer->currentDepthFormat;
+
+	/* If a pass has already rendered into the samples since the target was
+	 * bound or cleared, this pass continues a split one and loads them.
+	 * Only targets that get split store their samples, everything else
+	 * keeps them transient.
+	 */
+	if (hash.multiSampleCount > VK_SAMPLE_COUNT_1_BIT)
+	{
+		hash.loadMultiSample = (
+			renderer->colorAttachments[0]->multiSampleTexture->resourceAccessType !=
+			RESOURCE_ACCESS_NONE
+		);
+		hash.storeMultiSample = hash.loadMultiSample;
+		for (uint32_t i = 0; i < renderer->colorAttachmentCount; i++)
+		{
+			hash.storeMultiSample |= renderer->colorAttachments[i]->multiSampleSplit;
+		}
+	}
 	return hash;
 }
 
+static void DiscardMultiSampleContents(
+	FNAVulkanRenderer *renderer
+) {
+	/* The next pass starts from scratch rather than loading the samples */
+	for (uint32_t i = 0; i < renderer->colorAttachmentCount; i++)
+	{
+		if (	renderer->colorAttachments[i] != NULL &&
+			renderer->colorAttachments[i]->multiSampleTexture != NULL	)
+		{
+			renderer->colorAttachments[i]->multiSampleTexture->resourceAccessType =
+				RESOURCE_ACCESS_NONE;
+		}
+	}
+}
+
 static uint8_t AllocateAndBeginCommandBuffer(
 	FNAVulkanRenderer *renderer
 ) {
@@ -3791,7 +4605,7 @@ static void BeginRenderPass(
 	/* FIXME: these values are not correct */
 	VkOffset2D offset = { 0, 0 };
 	renderPassBeginInfo.renderArea.offset = offset;
-	renderPassBeginInfo.renderArea.extent = renderer->swapChainExtent;
+	renderPassBeginInfo.renderArea.extent = renderer->colorAttachments[0]->dimensions;
 
 	renderPassBeginInfo.renderPass = renderer->renderPass;
 	renderPassBeginInfo.framebuffer = renderer->framebuffer;
@@ -3802,6 +4616,32 @@ static void BeginRenderPass(
 		VK_SUBPASS_CONTENTS_INLINE
 	);
 
+	/* The pass leaves every color image in the attachment layout */
+	if (renderer->colorAttachments[0] == &renderer->fauxBackbufferColor)
+	{
+		GetBackbufferImage(renderer)->resourceAccessType =
+			RESOURCE_ACCESS_COLOR_ATTACHMENT_READ_WRITE;
+	}
+	for (uint32_t i = 0; i < renderer->colorAttachmentCount; i++)
+	{
+		if (renderer->colorAttachments[i]->image != NULL)
+		{
+			renderer->colorAttachments[i]->image->resourceAccessType =
+				RESOURCE_ACCESS_COLOR_ATTACHMENT_READ_WRITE;
+		}
+		if (renderer->colorAttachments[i]->multiSampleTexture != NULL)
+		{
+			/* This target's passes get split, keep its samples from now on */
+			if (	renderer->colorAttachments[i]->multiSampleTexture->resourceAccessType !=
+				RESOURCE_ACCESS_NONE	)
+			{
+				renderer->colorAttachments[i]->multiSampleSplit = 1;
+			}
+			renderer->colorAttachments[i]->multiSampleTexture->resourceAccessType =
+				RESOURCE_ACCESS_COLOR_ATTACHMENT_READ_WRITE;
+		}
+	}
+
 	renderer->renderPassInProgress = 1;
 
 	VkViewport viewport;
@@ -3887,6 +4727,9 @@ void VULKAN_BeginFrame(FNA3D_Renderer *driverData)
 
 	if (renderer->frameInProgress) return;
 
+	/* A new frame never continues the last frame's passes */
+	DiscardMultiSampleContents(renderer);
+
 	result = renderer->vkWaitForFences(
 		renderer->logicalDevice,
 		1,
@@ -3897,6 +4740,11 @@ void VULKAN_BeginFrame(FNA3D_Renderer *driverData)
 
 	LogVulkanResult("vkWaitForFences", result);
 
+	if (result == VK_SUCCESS)
+	{
+		renderer->completedSubmitCount = renderer->submitCount;
+	}
+
 	renderer->vkResetFences(
 		renderer->logicalDevice,
 		1,
@@ -3935,34 +4783,149 @@ void VULKAN_BeginFrame(FNA3D_Renderer *driverData)
 			);
 		}
 
-		renderer->activeUniformBufferDescriptorPoolIndex = 0;
-		renderer->activeUniformBufferPoolUsage = 0;
+		renderer->activeUniformBufferDescriptorPoolIndex = 0;
+		renderer->activeUniformBufferPoolUsage = 0;
+
+		renderer->activeDescriptorSetCount = 0;
+		renderer->currentVertSamplerDescriptorSet = NULL;
+		renderer->currentFragSamplerDescriptorSet = NULL;
+		renderer->currentVertUniformBufferDescriptorSet = NULL;
+		renderer->currentFragUniformBufferDescriptorSet = NULL;
+	}
+
+	if (renderer->headless)
+	{
+		/* No swapchain to acquire, everything goes to the faux backbuffer */
+		renderer->frameInProgress = 1;
+		AllocateAndBeginCommandBuffer(renderer);
+		return;
+	}
+
+	if (renderer->needNewSwapChain)
+	{
+		RecreateSwapChain(renderer);
+	}
+
+	/* Don't let the CPU get too far ahead of what's on screen */
+	if (	renderer->supportsPresentWait &&
+		renderer->maxFrameLatency > 0 &&
+		renderer->presentID >= renderer->maxFrameLatency	)
+	{
+		result = renderer->vkWaitForPresentKHR(
+			renderer->logicalDevice,
+			renderer->swapChain,
+			renderer->presentID - renderer->maxFrameLatency + 1,
+			PRESENT_WAIT_TIMEOUT
+		);
+
+		/* Hidden windows may never present, so timeouts are fine */
+		if (result != VK_SUCCESS && result != VK_TIMEOUT)
+		{
+			LogVulkanResult("vkWaitForPresentKHR", result);
+		}
+	}
+
+	result = renderer->vkAcquireNextImageKHR(
+		renderer->logicalDevice,
+		renderer->swapChain,
+		UINT64_MAX,
+		renderer->imageAvailableSemaphore,
+		VK_NULL_HANDLE,
+		&renderer->currentSwapChainIndex
+	);
+
+	if (result == VK_ERROR_OUT_OF_DATE_KHR && RecreateSwapChain(renderer))
+	{
+		result = renderer->vkAcquireNextImageKHR(
+			renderer->logicalDevice,
+			renderer->swapChain,
+			UINT64_MAX,
+			renderer->imageAvailableSemaphore,
+			VK_NULL_HANDLE,
+			&renderer->currentSwapChainIndex
+		);
+	}
+
+	if (result == VK_SUBOPTIMAL_KHR)
+	{
+		/* Still presentable, replace it before the next frame */
+		renderer->needNewSwapChain = 1;
+	}
+	else if (result != VK_SUCCESS)
+	{
+		LogVulkanResult("vkAcquireNextImageKHR", result);
+		return;
+	}
+
+	renderer->imageAvailableSemaphorePending = 1;
+
+	if (!renderer->useFauxBackbuffer)
+	{
+		/* Render passes discard the old contents, no need to track them */
+		renderer->swapChainImages[renderer->currentSwapChainIndex].resourceAccessType = RESOURCE_ACCESS_NONE;
+		renderer->fauxBackbufferColor.handle = renderer->swapChainImages[renderer->currentSwapChainIndex].view;
+	}
+
+	renderer->frameInProgress = 1;
+
+	AllocateAndBeginCommandBuffer(renderer);
+}
+
+static void EndFrame(FNAVulkanRenderer *renderer)
+{
+	VulkanBuffer *buf = renderer->buffers;
+	while (buf != NULL)
+	{
+		buf->internalOffset = 0;
+		buf->boundThisFrame = 0;
+		buf->prevDataLength = 0;
+		buf = buf->next;
+	}
+
+	LockShaderContext(renderer);
+	MOJOSHADER_vkEndFrame();
+	UnlockShaderContext(renderer);
+
+	renderer->commandBufferBegunThisFrame = 0;
+	renderer->frameInProgress = 0;
+}
+
+static void SubmitHeadlessFrame(FNAVulkanRenderer *renderer)
+{
+	VkResult result;
+	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
 
-		renderer->activeDescriptorSetCount = 0;
-		renderer->currentVertSamplerDescriptorSet = NULL;
-		renderer->currentFragSamplerDescriptorSet = NULL;
-		renderer->currentVertUniformBufferDescriptorSet = NULL;
-		renderer->currentFragUniformBufferDescriptorSet = NULL;
+	result = renderer->vkEndCommandBuffer(
+		renderer->commandBuffers[renderer->commandBufferCount - 1]
+	);
+
+	if (result != VK_SUCCESS)
+	{
+		LogVulkanResult("vkEndCommandBuffer", result);
+		return;
 	}
 
-	result = renderer->vkAcquireNextImageKHR(
-		renderer->logicalDevice,
-		renderer->swapChain,
-		UINT64_MAX,
-		renderer->imageAvailableSemaphore,
-		VK_NULL_HANDLE,
-		&renderer->currentSwapChainIndex
+	/* Nothing to wait on or present, the fence is all we need */
+	submitInfo.commandBufferCount = renderer->commandBufferCount;
+	submitInfo.pCommandBuffers = renderer->commandBuffers;
+
+	result = renderer->vkQueueSubmit(
+		renderer->graphicsQueue,
+		1,
+		&submitInfo,
+		renderer->renderQueueFence
 	);
 
 	if (result != VK_SUCCESS)
 	{
-		LogVulkanResult("vkAcquireNextImageKHR", result);
+		LogVulkanResult("vkQueueSubmit", result);
 		return;
 	}
 
-	renderer->frameInProgress = 1;
+	renderer->submitCount += 1;
+	renderer->commandBufferCount = 0;
 
-	AllocateAndBeginCommandBuffer(renderer);
+	EndFrame(renderer);
 }
 
 void VULKAN_SwapBuffers(
@@ -3974,6 +4937,7 @@ void VULKAN_SwapBuffers(
 	VkResult result;
 	FNA3D_Rect srcRect;
 	FNA3D_Rect dstRect;
+	FNAVulkanImageData *swapChainImage;
 
 	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
 
@@ -3981,6 +4945,12 @@ void VULKAN_SwapBuffers(
 	VULKAN_SetRenderTargets(driverData, NULL, 0, NULL, FNA3D_DEPTHFORMAT_NONE);
 	EndPass(renderer); /* must end render pass before blitting */
 
+	if (renderer->headless)
+	{
+		SubmitHeadlessFrame(renderer);
+		return;
+	}
+
 	if (sourceRectangle != NULL)
 	{
 		srcRect = *sourceRectangle;
@@ -4008,16 +4978,88 @@ void VULKAN_SwapBuffers(
 		dstRect.h = h;
 	}
 
-	/* special case because of the attachment description */
-	renderer->fauxBackbufferColorImageData.resourceAccessType = RESOURCE_ACCESS_COLOR_ATTACHMENT_READ_WRITE;
+	swapChainImage = &renderer->swapChainImages[renderer->currentSwapChainIndex];
 
-	BlitFramebuffer(
-		renderer,
-		&renderer->fauxBackbufferColorImageData,
-		srcRect,
-		&renderer->swapChainImages[renderer->currentSwapChainIndex],
-		dstRect
-	);
+	if (	!renderer->useFauxBackbuffer &&
+		(	srcRect.x != 0 ||
+			srcRect.y != 0 ||
+			srcRect.w != (int32_t) renderer->swapChainExtent.width ||
+			srcRect.h != (int32_t) renderer->swapChainExtent.height ||
+			dstRect.x != 0 ||
+			dstRect.y != 0 ||
+			dstRect.w != (int32_t) renderer->swapChainExtent.width ||
+			dstRect.h != (int32_t) renderer->swapChainExtent.height	)	)
+	{
+		/* Scaling needs the faux backbuffer after all. Copy this frame
+		 * into it so it can be blitted below, then keep it around.
+		 */
+		if (CreateFauxBackbufferColor(renderer))
+		{
+			FNA3D_Rect fullRect;
+			fullRect.x = 0;
+			fullRect.y = 0;
+			fullRect.w = renderer->fauxBackbufferWidth;
+			fullRect.h = renderer->fauxBackbufferHeight;
+
+			BlitFramebuffer(
+				renderer,
+				swapChainImage,
+				fullRect,
+				&renderer->fauxBackbufferColorImageData,
+				fullRect
+			);
+		}
+	}
+
+	if (renderer->useFauxBackbuffer)
+	{
+		/* special case because of the attachment description,
+		 * unless we just copied the swapchain image into it
+		 */
+		if (renderer->fauxBackbufferColorImageData.resourceAccessType != RESOURCE_ACCESS_PRESENT)
+		{
+			renderer->fauxBackbufferColorImageData.resourceAccessType = RESOURCE_ACCESS_COLOR_ATTACHMENT_READ_WRITE;
+		}
+
+		BlitFramebuffer(
+			renderer,
+			&renderer->fauxBackbufferColorImageData,
+			srcRect,
+			swapChainImage,
+			dstRect
+		);
+	}
+	else if (swapChainImage->resourceAccessType != RESOURCE_ACCESS_PRESENT)
+	{
+		/* We rendered straight into the swapchain, just transition it */
+		VulkanResourceAccessType nextAccessType = RESOURCE_ACCESS_PRESENT;
+
+		ImageMemoryBarrierCreateInfo memoryBarrierCreateInfo;
+		memoryBarrierCreateInfo.pPrevAccesses = &swapChainImage->resourceAccessType;
+		memoryBarrierCreateInfo.prevAccessCount = 1;
+		memoryBarrierCreateInfo.pNextAccesses = &nextAccessType;
+		memoryBarrierCreateInfo.nextAccessCount = 1;
+		memoryBarrierCreateInfo.image = swapChainImage->image;
+		memoryBarrierCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		memoryBarrierCreateInfo.subresourceRange.baseArrayLayer = 0;
+		memoryBarrierCreateInfo.subresourceRange.baseMipLevel = 0;
+		memoryBarrierCreateInfo.subresourceRange.layerCount = 1;
+		memoryBarrierCreateInfo.subresourceRange.levelCount = 1;
+		memoryBarrierCreateInfo.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		memoryBarrierCreateInfo.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		memoryBarrierCreateInfo.discardContents = 0;
+
+		CreateImageMemoryBarrier(
+			renderer,
+			memoryBarrierCreateInfo
+		);
+
+		SubmitPipelineBarrier(
+			renderer
+		);
+
+		swapChainImage->resourceAccessType = RESOURCE_ACCESS_PRESENT;
+	}
 
 	VkResult vulkanResult = renderer->vkEndCommandBuffer(
 		renderer->commandBuffers[renderer->commandBufferCount - 1]
@@ -4037,8 +5079,9 @@ void VULKAN_SwapBuffers(
 		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
 	};
 
+	/* A mid-frame stall may have already waited for the image */
 	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.waitSemaphoreCount = renderer->imageAvailableSemaphorePending;
 	submitInfo.pWaitSemaphores = &renderer->imageAvailableSemaphore;
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.signalSemaphoreCount = 1;
@@ -4059,6 +5102,8 @@ void VULKAN_SwapBuffers(
 		return;
 	}
 
+	renderer->imageAvailableSemaphorePending = 0;
+	renderer->submitCount += 1;
 	renderer->commandBufferCount = 0;
 
 	VkSwapchainKHR swapChains[] = { renderer->swapChain };
@@ -4072,36 +5117,50 @@ void VULKAN_SwapBuffers(
 	presentInfo.pImageIndices = imageIndices;
 	presentInfo.pResults = NULL;
 
+#ifdef VK_KHR_present_id
+	VkPresentIdKHR presentIDInfo = { VK_STRUCTURE_TYPE_PRESENT_ID_KHR };
+	if (renderer->supportsPresentWait)
+	{
+		renderer->presentID += 1;
+		presentIDInfo.swapchainCount = 1;
+		presentIDInfo.pPresentIds = &renderer->presentID;
+		presentInfo.pNext = &presentIDInfo;
+	}
+#endif
+
 	result = renderer->vkQueuePresentKHR(
 		renderer->presentQueue,
 		&presentInfo
 	);
 
-	if (result != VK_SUCCESS)
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
 	{
-		LogVulkanResult("vkQueuePresentKHR", result);
+		renderer->needNewSwapChain = 1;
 	}
-
-	VulkanBuffer *buf = renderer->buffers;
-	while (buf != NULL)
+	else if (result != VK_SUCCESS)
 	{
-		buf->internalOffset = 0;
-		buf->boundThisFrame = 0;
-		buf->prevDataLength = 0;
-		buf = buf->next;
+		LogVulkanResult("vkQueuePresentKHR", result);
 	}
-	
-	MOJOSHADER_vkEndFrame();
 
-	renderer->commandBufferBegunThisFrame = 0;
-	renderer->frameInProgress = 0;
+	EndFrame(renderer);
 }
 
 void VULKAN_SetPresentationInterval(
 	FNA3D_Renderer *driverData,
 	FNA3D_PresentInterval presentInterval
 ) {
-	/* TODO */
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+
+	if (presentInterval == renderer->presentInterval)
+	{
+		return;
+	}
+
+	/* The present mode is baked into the swapchain. This may be called
+	 * in the middle of a frame, so wait until the next one to rebuild.
+	 */
+	renderer->presentInterval = presentInterval;
+	renderer->needNewSwapChain = 1;
 }
 
 /* Drawing */
@@ -4218,6 +5277,12 @@ void VULKAN_Clear(
 	}
 	else
 	{
+		/* The next pass clears the whole target first */
+		if (clearColor)
+		{
+			DiscardMultiSampleContents(renderer);
+		}
+
 		renderer->needNewRenderPass = 1;
 		renderer->shouldClearColor = clearColor;
 		renderer->clearColor = *color;
@@ -4337,6 +5402,141 @@ void VULKAN_DrawIndexedPrimitives(
 	);
 }
 
+static void BindMultiDrawBuffers(
+	FNAVulkanRenderer *renderer,
+	FNA3D_PrimitiveType primitiveType,
+	VulkanBuffer *indexBuffer,
+	FNA3D_IndexElementSize indexElementSize
+) {
+	VulkanBuffer *vertexBuffer;
+	VkBuffer vertexBuffers[MAX_BOUND_VERTEX_BUFFERS];
+	VkDeviceSize offsets[MAX_BOUND_VERTEX_BUFFERS];
+	uint32_t i, vertexBufferCount = 0;
+
+	CheckPrimitiveTypeAndBindPipeline(
+		renderer, primitiveType
+	);
+
+	BindResources(renderer);
+
+	/* Each draw supplies its own startIndex/baseVertex, so bind the
+	 * buffers at their base offsets and let vkCmdDrawIndexed* do the rest.
+	 */
+	indexBuffer->boundThisFrame = 1;
+	renderer->vkCmdBindIndexBuffer(
+		renderer->commandBuffers[renderer->commandBufferCount - 1],
+		indexBuffer->handle,
+		indexBuffer->internalOffset,
+		XNAToVK_IndexType[indexElementSize]
+	);
+
+	for (i = 0; i < renderer->numVertexBindings; i += 1)
+	{
+		vertexBuffer = (VulkanBuffer*) renderer->vertexBindings[i].vertexBuffer;
+		if (vertexBuffer == NULL)
+		{
+			continue;
+		}
+
+		vertexBuffer->boundThisFrame = 1;
+		vertexBuffers[vertexBufferCount] = vertexBuffer->handle;
+		offsets[vertexBufferCount] = vertexBuffer->internalOffset + (
+			renderer->vertexBindings[i].vertexOffset *
+			renderer->vertexBindings[i].vertexDeclaration.vertexStride
+		);
+		vertexBufferCount += 1;
+	}
+
+	renderer->vkCmdBindVertexBuffers(
+		renderer->commandBuffers[renderer->commandBufferCount - 1],
+		0,
+		vertexBufferCount,
+		vertexBuffers,
+		offsets
+	);
+}
+
+void VULKAN_MultiDrawIndexedPrimitives(
+	FNA3D_Renderer *driverData,
+	FNA3D_PrimitiveType primitiveType,
+	FNA3D_DrawIndexedArgs *drawArgs,
+	int32_t drawCount,
+	FNA3D_Buffer *indices,
+	FNA3D_IndexElementSize indexElementSize
+) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	int32_t i;
+
+	BindMultiDrawBuffers(
+		renderer,
+		primitiveType,
+		(VulkanBuffer*) indices,
+		indexElementSize
+	);
+
+	for (i = 0; i < drawCount; i += 1)
+	{
+		renderer->vkCmdDrawIndexed(
+			renderer->commandBuffers[renderer->commandBufferCount - 1],
+			drawArgs[i].indexCount,
+			drawArgs[i].instanceCount,
+			drawArgs[i].startIndex,
+			drawArgs[i].baseVertex,
+			drawArgs[i].baseInstance
+		);
+	}
+}
+
+void VULKAN_MultiDrawIndexedPrimitivesIndirect(
+	FNA3D_Renderer *driverData,
+	FNA3D_PrimitiveType primitiveType,
+	FNA3D_Buffer *drawBuffer,
+	int32_t offsetInBytes,
+	int32_t drawCount,
+	FNA3D_Buffer *indices,
+	FNA3D_IndexElementSize indexElementSize
+) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	VulkanBuffer *argsBuffer = (VulkanBuffer*) drawBuffer;
+	VkDeviceSize offset;
+	int32_t i;
+
+	BindMultiDrawBuffers(
+		renderer,
+		primitiveType,
+		(VulkanBuffer*) indices,
+		indexElementSize
+	);
+
+	argsBuffer->boundThisFrame = 1;
+	offset = argsBuffer->internalOffset + offsetInBytes;
+
+	if (renderer->supportsMultiDrawIndirect)
+	{
+		renderer->vkCmdDrawIndexedIndirect(
+			renderer->commandBuffers[renderer->commandBufferCount - 1],
+			argsBuffer->handle,
+			offset,
+			drawCount,
+			sizeof(FNA3D_DrawIndexedArgs)
+		);
+	}
+	else
+	{
+		/* Without multiDrawIndirect, drawCount must be 0 or 1 */
+		for (i = 0; i < drawCount; i += 1)
+		{
+			renderer->vkCmdDrawIndexedIndirect(
+				renderer->commandBuffers[renderer->commandBufferCount - 1],
+				argsBuffer->handle,
+				offset + (i * sizeof(FNA3D_DrawIndexedArgs)),
+				1,
+				sizeof(FNA3D_DrawIndexedArgs)
+			);
+		}
+	}
+}
+
 void VULKAN_DrawPrimitives(
 	FNA3D_Renderer *driverData,
 	FNA3D_PrimitiveType primitiveType,
@@ -4534,6 +5734,7 @@ void VULKAN_SetBlendFactor(
 			blendFactor->a != renderer->blendState.blendFactor.a	)
 	{
 		renderer->blendState.blendFactor = *blendFactor;
+		renderer->blendStateHash = GetBlendStateHash(renderer->blendState);
 
 		const float blendConstants[] =
 		{
@@ -4599,12 +5800,13 @@ void VULKAN_SetReferenceStencil(FNA3D_Renderer *driverData, int32_t ref)
 
 /* Immutable Render States */
 
-void VULKAN_SetBlendState(
-	FNA3D_Renderer *driverData,
-	FNA3D_BlendState *blendState
+static void SetBlendState(
+	FNAVulkanRenderer *renderer,
+	FNA3D_BlendState *blendState,
+	StateHash hash
 ) {
-	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
 	SDL_memcpy(&renderer->blendState, blendState, sizeof(FNA3D_BlendState));
+	renderer->blendStateHash = hash;
 
 	/* Dynamic state */
 	if (renderer->frameInProgress) {
@@ -4628,12 +5830,21 @@ void VULKAN_SetBlendState(
 	}
 }
 
-void VULKAN_SetDepthStencilState(
+void VULKAN_SetBlendState(
 	FNA3D_Renderer *driverData,
-	FNA3D_DepthStencilState *depthStencilState
+	FNA3D_BlendState *blendState
 ) {
 	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	SetBlendState(renderer, blendState, GetBlendStateHash(*blendState));
+}
+
+static void SetDepthStencilState(
+	FNAVulkanRenderer *renderer,
+	FNA3D_DepthStencilState *depthStencilState,
+	StateHash hash
+) {
 	SDL_memcpy(&renderer->depthStencilState, depthStencilState, sizeof(FNA3D_DepthStencilState));
+	renderer->depthStencilStateHash = hash;
 
 	/* Dynamic state */
 	if (renderer->renderPassInProgress)
@@ -4642,6 +5853,18 @@ void VULKAN_SetDepthStencilState(
 	}
 }
 
+void VULKAN_SetDepthStencilState(
+	FNA3D_Renderer *driverData,
+	FNA3D_DepthStencilState *depthStencilState
+) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	SetDepthStencilState(
+		renderer,
+		depthStencilState,
+		GetDepthStencilStateHash(*depthStencilState)
+	);
+}
+
 void VULKAN_ApplyRasterizerState(
 	FNA3D_Renderer *driverData,
 	FNA3D_RasterizerState *rasterizerState
@@ -4770,27 +5993,94 @@ void VULKAN_VerifySampler(
 		memoryBarrierCreateInfo.subresourceRange.baseArrayLayer = 0;
 		memoryBarrierCreateInfo.subresourceRange.baseMipLevel = 0;
 		memoryBarrierCreateInfo.subresourceRange.layerCount = 1;
-		memoryBarrierCreateInfo.subresourceRange.levelCount = 1;
+		memoryBarrierCreateInfo.subresourceRange.levelCount = vulkanTexture->levelCount;
 		memoryBarrierCreateInfo.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		memoryBarrierCreateInfo.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		memoryBarrierCreateInfo.discardContents = 0;
 
-		CreateImageMemoryBarrier(
-			renderer,
-			memoryBarrierCreateInfo
-		);
+		CreateImageMemoryBarrier(
+			renderer,
+			memoryBarrierCreateInfo
+		);
+
+		vulkanTexture->imageData->resourceAccessType = nextAccess;
+	}
+}
+
+void VULKAN_VerifyVertexSampler(
+	FNA3D_Renderer *driverData,
+	int32_t index,
+	FNA3D_Texture *texture,
+	FNA3D_SamplerState *sampler
+) {
+	/* TODO */
+}
+
+/* State Objects */
+
+void VULKAN_SetBlendStateObject(
+	FNA3D_Renderer *driverData,
+	FNA3D_BlendStateObject *blendState
+) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	SetBlendState(renderer, &blendState->state, blendState->hash);
+}
+
+void VULKAN_SetDepthStencilStateObject(
+	FNA3D_Renderer *driverData,
+	FNA3D_DepthStencilStateObject *depthStencilState
+) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	SetDepthStencilState(
+		renderer,
+		&depthStencilState->state,
+		depthStencilState->hash
+	);
+}
+
+void VULKAN_ApplyRasterizerStateObject(
+	FNA3D_Renderer *driverData,
+	FNA3D_RasterizerStateObject *rasterizerState
+) {
+	/* The rasterizer hash depends on the depth format, so it stays at
+	 * pipeline bind time.
+	 */
+	VULKAN_ApplyRasterizerState(driverData, &rasterizerState->state);
+}
+
+void VULKAN_VerifySamplerObject(
+	FNA3D_Renderer *driverData,
+	int32_t index,
+	FNA3D_Texture *texture,
+	FNA3D_SamplerStateObject *sampler
+) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	uint32_t fragArrayOffset = (renderer->currentSwapChainIndex * MAX_TOTAL_SAMPLERS) + MAX_VERTEXTEXTURE_SAMPLERS;
+	uint32_t textureIndex = fragArrayOffset + index;
 
-		vulkanTexture->imageData->resourceAccessType = nextAccess;
+	/* Same texture, same baked sampler? Nothing to do! */
+	if (	texture != NULL &&
+			sampler->driverHandle != 0 &&
+			renderer->textures[textureIndex] == (VulkanTexture*) texture &&
+			renderer->samplers[textureIndex] == (VkSampler) sampler->driverHandle	)
+	{
+		return;
+	}
+
+	VULKAN_VerifySampler(driverData, index, texture, &sampler->state);
+	if (texture != NULL)
+	{
+		sampler->driverHandle = (uint64_t) renderer->samplers[textureIndex];
 	}
 }
 
-void VULKAN_VerifyVertexSampler(
+void VULKAN_VerifyVertexSamplerObject(
 	FNA3D_Renderer *driverData,
 	int32_t index,
 	FNA3D_Texture *texture,
-	FNA3D_SamplerState *sampler
+	FNA3D_SamplerStateObject *sampler
 ) {
-	/* TODO */
+	VULKAN_VerifyVertexSampler(driverData, index, texture, &sampler->state);
 }
 
 /* Vertex State */
@@ -4798,6 +6088,7 @@ void VULKAN_VerifyVertexSampler(
 void VULKAN_ApplyVertexBufferBindings(
 	FNA3D_Renderer *driverData,
 	FNA3D_VertexBufferBinding *bindings,
+	FNA3D_VertexDeclarationObject **declarations,
 	int32_t numBindings,
 	uint8_t bindingsUpdated,
 	int32_t baseVertex
@@ -4807,6 +6098,7 @@ void VULKAN_ApplyVertexBufferBindings(
 	CheckVertexBufferBindingsAndBindPipeline(
 		renderer,
 		bindings,
+		declarations,
 		numBindings
 	);
 
@@ -4918,6 +6210,61 @@ static void EndPass(
 	}
 }
 
+static VulkanColorBuffer* FetchTextureColorBuffer(
+	FNAVulkanRenderer *renderer,
+	VulkanTexture *texture
+) {
+	SurfaceFormatMapping surfaceFormatMapping;
+	VulkanColorBuffer *colorBuffer;
+	VkResult result;
+
+	if (texture->colorBuffer != NULL)
+	{
+		return texture->colorBuffer;
+	}
+
+	surfaceFormatMapping = XNAToVK_SurfaceFormat[texture->format];
+
+	VkImageViewCreateInfo imageViewInfo = {
+		VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO
+	};
+	imageViewInfo.image = texture->imageData->image;
+	imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewInfo.format = surfaceFormatMapping.formatColor;
+	imageViewInfo.components = surfaceFormatMapping.swizzle;
+	imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageViewInfo.subresourceRange.baseMipLevel = 0; /* Attachments are one level */
+	imageViewInfo.subresourceRange.levelCount = 1;
+	imageViewInfo.subresourceRange.baseArrayLayer = 0;
+	imageViewInfo.subresourceRange.layerCount = 1;
+
+	colorBuffer = SDL_malloc(sizeof(VulkanColorBuffer));
+	colorBuffer->dimensions.width = texture->width;
+	colorBuffer->dimensions.height = texture->height;
+	colorBuffer->format = surfaceFormatMapping.formatColor;
+	colorBuffer->image = texture->imageData;
+	colorBuffer->multiSampleTexture = NULL;
+	colorBuffer->multiSampleCount = VK_SAMPLE_COUNT_1_BIT;
+	colorBuffer->multiSampleSplit = 0;
+
+	result = renderer->vkCreateImageView(
+		renderer->logicalDevice,
+		&imageViewInfo,
+		NULL,
+		&colorBuffer->handle
+	);
+
+	if (result != VK_SUCCESS)
+	{
+		LogVulkanResult("vkCreateImageView", result);
+		SDL_free(colorBuffer);
+		return NULL;
+	}
+
+	texture->colorBuffer = colorBuffer;
+	return colorBuffer;
+}
+
 void VULKAN_SetRenderTargets(
 	FNA3D_Renderer *driverData,
 	FNA3D_RenderTargetBinding *renderTargets,
@@ -4949,15 +6296,62 @@ void VULKAN_SetRenderTargets(
 	if (renderTargets == NULL)
 	{
 		renderer->colorAttachments[0] = &renderer->fauxBackbufferColor;
+		renderer->colorAttachmentCount = 1;
 		if (renderer->fauxBackbufferDepthFormat != FNA3D_DEPTHFORMAT_NONE)
 		{
 			renderer->depthStencilAttachment = &renderer->fauxBackbufferDepthStencil;
 			renderer->depthStencilAttachmentActive = 1;
 		}
+		renderer->currentDepthFormat = renderer->fauxBackbufferDepthFormat;
+		DiscardMultiSampleContents(renderer);
 		return;
 	}
 
-	/* TODO: update attachments */
+	/* Multisampled targets render into the renderbuffer and resolve into
+	 * the texture, everything else renders into the texture directly.
+	 */
+	renderer->colorAttachmentCount = 0;
+	for (int32_t i = 0; i < numRenderTargets; i += 1)
+	{
+		VulkanColorBuffer *colorBuffer;
+
+		if (renderTargets[i].colorBuffer != NULL)
+		{
+			colorBuffer = ((VulkanRenderbuffer*) renderTargets[i].colorBuffer)->colorBuffer;
+		}
+		else
+		{
+			colorBuffer = FetchTextureColorBuffer(
+				renderer,
+				(VulkanTexture*) renderTargets[i].texture
+			);
+		}
+
+		if (colorBuffer == NULL)
+		{
+			FNA3D_LogError(
+				"%s\n",
+				"Failed to create render target view, skipping target"
+			);
+			continue;
+		}
+
+		renderer->colorAttachments[renderer->colorAttachmentCount] = colorBuffer;
+		renderer->colorAttachmentCount += 1;
+	}
+
+	if (renderbuffer != NULL)
+	{
+		renderer->depthStencilAttachment = ((VulkanRenderbuffer*) renderbuffer)->depthBuffer;
+		renderer->depthStencilAttachmentActive = 1;
+		renderer->currentDepthFormat = depthFormat;
+	}
+	else
+	{
+		renderer->currentDepthFormat = FNA3D_DEPTHFORMAT_NONE;
+	}
+
+	DiscardMultiSampleContents(renderer);
 }
 
 /* Dynamic State Functions */
@@ -5025,12 +6419,17 @@ static void Stall(FNAVulkanRenderer *renderer)
 	VkResult result;
 	VulkanBuffer *buf;
 
+	VkPipelineStageFlags waitStages[] = {
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+	};
+
 	EndPass(renderer);
 
+	/* The work may be writing to the acquired swapchain image */
 	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
-	submitInfo.waitSemaphoreCount = 0;
-	submitInfo.pWaitSemaphores = NULL;
-	submitInfo.pWaitDstStageMask = NULL;
+	submitInfo.waitSemaphoreCount = renderer->imageAvailableSemaphorePending;
+	submitInfo.pWaitSemaphores = &renderer->imageAvailableSemaphore;
+	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.signalSemaphoreCount = 0;
 	submitInfo.pSignalSemaphores = NULL;
 	submitInfo.commandBufferCount = renderer->commandBufferCount;
@@ -5049,6 +6448,9 @@ static void Stall(FNAVulkanRenderer *renderer)
 		return;
 	}
 
+	renderer->imageAvailableSemaphorePending = 0;
+	renderer->submitCount += 1;
+
 	result = renderer->vkQueueWaitIdle(renderer->graphicsQueue);
 
 	if (result != VK_SUCCESS)
@@ -5057,6 +6459,8 @@ static void Stall(FNAVulkanRenderer *renderer)
 		return;
 	}
 
+	renderer->completedSubmitCount = renderer->submitCount;
+
 	renderer->commandBufferCount = 0;
 	AllocateAndBeginCommandBuffer(renderer);
 	renderer->needNewRenderPass = 1;
@@ -5110,7 +6514,24 @@ void VULKAN_ResolveTarget(
 	FNA3D_Renderer *driverData,
 	FNA3D_RenderTargetBinding *target
 ) {
-	/* TODO */
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+
+	/* Multisampled targets are resolved by the subpass resolve attachment,
+	 * which is only written once the pass ends. Close the pass so the
+	 * texture is complete before anything, mip generation included,
+	 * reads from it.
+	 */
+	if (target->colorBuffer != NULL && renderer->renderPassInProgress)
+	{
+		EndPass(renderer);
+		renderer->needNewRenderPass = 1;
+	}
+
+	/* If the target has mipmaps, regenerate them now */
+	if (target->levelCount > 1)
+	{
+		GenerateMipmaps(renderer, (VulkanTexture*) target->texture);
+	}
 }
 
 /* Backbuffer Functions */
@@ -5131,7 +6552,26 @@ void VULKAN_ReadBackbuffer(
 	void* data,
 	int32_t dataLen
 ) {
-	/* TODO */
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+
+	/* Make sure there's actually a backbuffer image to read from */
+	VULKAN_BeginFrame(driverData);
+
+	ReadImageImmediately(
+		renderer,
+		GetBackbufferImage(renderer),
+		1,
+		x,
+		y,
+		0,
+		w,
+		h,
+		1,
+		0,
+		0,
+		data,
+		dataLen
+	);
 }
 
 void VULKAN_GetBackbufferSize(
@@ -5229,30 +6669,55 @@ void VULKAN_SetTextureData2D(
 	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
 	VulkanTexture *vulkanTexture = (VulkanTexture*) texture;
 	VulkanBuffer *stagingBuffer = vulkanTexture->stagingBuffer;
+	VkDeviceSize stagingOffset;
 
 	void *stagingData;
 
+	if ((VkDeviceSize) dataLength > stagingBuffer->internalBufferSize)
+	{
+		FNA3D_LogError("SetTextureData2D: dataLength is larger than the texture");
+		return;
+	}
+
+	if (!renderer->commandBufferBegunThisFrame)
+	{
+		AllocateAndBeginCommandBuffer(renderer);
+	}
+
+	/* Each upload this frame gets its own region of the staging buffer,
+	 * since the copies only run when the commands are submitted. Offsets
+	 * have to be a multiple of the texel block size, 16 covers them all.
+	 */
+	stagingOffset = (
+		stagingBuffer->internalOffset +
+		stagingBuffer->prevDataLength +
+		15
+	) & ~((VkDeviceSize) 15);
+	if (stagingOffset + dataLength > stagingBuffer->internalBufferSize)
+	{
+		/* Out of room, let the pending copies finish before reusing it */
+		Stall(renderer);
+		stagingOffset = 0;
+	}
+	stagingBuffer->internalOffset = stagingOffset;
+	stagingBuffer->prevDataLength = dataLength;
+
 	renderer->vkMapMemory(
 		renderer->logicalDevice,
 		stagingBuffer->deviceMemory,
-		stagingBuffer->internalOffset,
-		stagingBuffer->size,
+		stagingOffset,
+		dataLength,
 		0,
 		&stagingData
 	);
 
-	SDL_memcpy(stagingData, data, stagingBuffer->size);
+	SDL_memcpy(stagingData, data, dataLength);
 
 	renderer->vkUnmapMemory(
 		renderer->logicalDevice,
 		stagingBuffer->deviceMemory
 	);
 
-	if (!renderer->commandBufferBegunThisFrame)
-	{
-		AllocateAndBeginCommandBuffer(renderer);
-	}
-
 	VulkanResourceAccessType nextResourceAccessType = RESOURCE_ACCESS_TRANSFER_WRITE;
 
 	if (vulkanTexture->imageData->resourceAccessType != nextResourceAccessType) 
@@ -5267,7 +6732,7 @@ void VULKAN_SetTextureData2D(
 		imageBarrierCreateInfo.subresourceRange.baseArrayLayer = 0;
 		imageBarrierCreateInfo.subresourceRange.baseMipLevel = 0;
 		imageBarrierCreateInfo.subresourceRange.layerCount = 1;
-		imageBarrierCreateInfo.subresourceRange.levelCount = 1;
+		imageBarrierCreateInfo.subresourceRange.levelCount = vulkanTexture->levelCount;
 		imageBarrierCreateInfo.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		imageBarrierCreateInfo.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		imageBarrierCreateInfo.discardContents = 0;
@@ -5292,7 +6757,7 @@ void VULKAN_SetTextureData2D(
 		bufferBarrierCreateInfo.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		bufferBarrierCreateInfo.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		bufferBarrierCreateInfo.buffer = stagingBuffer->handle;
-		bufferBarrierCreateInfo.offset = stagingBuffer->internalOffset;
+		bufferBarrierCreateInfo.offset = 0;
 		bufferBarrierCreateInfo.size = stagingBuffer->internalBufferSize;
 
 		CreateBufferMemoryBarrier(
@@ -5315,8 +6780,8 @@ void VULKAN_SetTextureData2D(
 	imageCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	imageCopy.imageSubresource.baseArrayLayer = 0;
 	imageCopy.imageSubresource.layerCount = 1;
-	imageCopy.imageSubresource.mipLevel = 0;
-	imageCopy.bufferOffset = 0;
+	imageCopy.imageSubresource.mipLevel = level;
+	imageCopy.bufferOffset = stagingOffset;
 	imageCopy.bufferRowLength = w;
 	imageCopy.bufferImageHeight = h;
 
@@ -5378,6 +6843,14 @@ void VULKAN_SetTextureDataYUV(
 	/* TODO */
 }
 
+void VULKAN_GenerateMipmaps(
+	FNA3D_Renderer *driverData,
+	FNA3D_Texture *texture
+) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	GenerateMipmaps(renderer, (VulkanTexture*) texture);
+}
+
 void VULKAN_GetTextureData2D(
 	FNA3D_Renderer *driverData,
 	FNA3D_Texture *texture,
@@ -5390,7 +6863,24 @@ void VULKAN_GetTextureData2D(
 	void* data,
 	int32_t dataLength
 ) {
-	/* TODO */
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	VulkanTexture *vulkanTexture = (VulkanTexture*) texture;
+
+	ReadImageImmediately(
+		renderer,
+		vulkanTexture->imageData,
+		vulkanTexture->levelCount,
+		x,
+		y,
+		0,
+		w,
+		h,
+		1,
+		level,
+		0,
+		data,
+		dataLength
+	);
 }
 
 void VULKAN_GetTextureData3D(
@@ -5407,7 +6897,24 @@ void VULKAN_GetTextureData3D(
 	void* data,
 	int32_t dataLength
 ) {
-	/* TODO */
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	VulkanTexture *vulkanTexture = (VulkanTexture*) texture;
+
+	ReadImageImmediately(
+		renderer,
+		vulkanTexture->imageData,
+		vulkanTexture->levelCount,
+		x,
+		y,
+		z,
+		w,
+		h,
+		d,
+		level,
+		0,
+		data,
+		dataLength
+	);
 }
 
 void VULKAN_GetTextureDataCube(
@@ -5423,7 +6930,24 @@ void VULKAN_GetTextureDataCube(
 	void* data,
 	int32_t dataLength
 ) {
-	/* TODO */
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	VulkanTexture *vulkanTexture = (VulkanTexture*) texture;
+
+	ReadImageImmediately(
+		renderer,
+		vulkanTexture->imageData,
+		vulkanTexture->levelCount,
+		x,
+		y,
+		0,
+		w,
+		h,
+		1,
+		level,
+		cubeMapFace,
+		data,
+		dataLength
+	);
 }
 
 /* Renderbuffers */
@@ -5463,6 +6987,11 @@ FNA3D_Renderbuffer* VULKAN_GenColorRenderbuffer(
 	renderbuffer->depthBuffer = NULL;
 	renderbuffer->colorBuffer = SDL_malloc(sizeof(VulkanColorBuffer));
 	renderbuffer->colorBuffer->dimensions = dimensions;
+	renderbuffer->colorBuffer->format = surfaceFormatMapping.formatColor;
+	renderbuffer->colorBuffer->image = vlkTexture->imageData;
+	renderbuffer->colorBuffer->multiSampleTexture = NULL;
+	renderbuffer->colorBuffer->multiSampleCount = VK_SAMPLE_COUNT_1_BIT;
+	renderbuffer->colorBuffer->multiSampleSplit = 0;
 
 	VkResult result = renderer->vkCreateImageView(
 		renderer->logicalDevice,
@@ -5480,9 +7009,50 @@ FNA3D_Renderbuffer* VULKAN_GenColorRenderbuffer(
 			"Failed to create color renderbuffer image view"
 		);
 
+		SDL_free(renderbuffer->colorBuffer);
+		SDL_free(renderbuffer);
 		return NULL;
 	}
 
+	/* The texture's view above becomes the resolve attachment */
+	if (multiSampleCount > 0)
+	{
+		renderbuffer->colorBuffer->multiSampleTexture = SDL_malloc(
+			sizeof(FNAVulkanImageData)
+		);
+		renderbuffer->colorBuffer->multiSampleCount = XNAToVK_SampleCount(
+			multiSampleCount
+		);
+
+		if (
+			!CreateMultiSampleColorImage(
+				renderer,
+				width,
+				height,
+				renderbuffer->colorBuffer->multiSampleCount,
+				surfaceFormatMapping.formatColor,
+				surfaceFormatMapping.swizzle,
+				renderbuffer->colorBuffer->multiSampleTexture
+			)
+		) {
+			SDL_LogError(
+				SDL_LOG_CATEGORY_APPLICATION,
+				"%s\n",
+				"Failed to create multisample color renderbuffer image"
+			);
+
+			renderer->vkDestroyImageView(
+				renderer->logicalDevice,
+				renderbuffer->colorBuffer->handle,
+				NULL
+			);
+			SDL_free(renderbuffer->colorBuffer->multiSampleTexture);
+			SDL_free(renderbuffer->colorBuffer);
+			SDL_free(renderbuffer);
+			return NULL;
+		}
+	}
+
 	return (FNA3D_Renderbuffer*) renderbuffer;
 }
 
@@ -5505,6 +7075,7 @@ FNA3D_Renderbuffer* VULKAN_GenDepthStencilRenderbuffer(
 			renderer,
 			width,
 			height,
+			1,
 			XNAToVK_SampleCount(multiSampleCount),
 			depthFormat,
 			IDENTITY_SWIZZLE,
@@ -5589,6 +7160,29 @@ void VULKAN_AddDisposeRenderbuffer(
 
 		/* The image is owned by the texture it's from, so we don't free it here. */
 
+		if (vlkRenderBuffer->colorBuffer->multiSampleTexture != NULL)
+		{
+			renderer->vkDestroyImageView(
+				renderer->logicalDevice,
+				vlkRenderBuffer->colorBuffer->multiSampleTexture->view,
+				NULL
+			);
+
+			renderer->vkDestroyImage(
+				renderer->logicalDevice,
+				vlkRenderBuffer->colorBuffer->multiSampleTexture->image,
+				NULL
+			);
+
+			renderer->vkFreeMemory(
+				renderer->logicalDevice,
+				vlkRenderBuffer->colorBuffer->multiSampleTexture->memory,
+				NULL
+			);
+
+			SDL_free(vlkRenderBuffer->colorBuffer->multiSampleTexture);
+		}
+
 		SDL_free(vlkRenderBuffer->colorBuffer);
 	}
 
@@ -5790,12 +7384,13 @@ void VULKAN_CreateEffect(
 	FNA3D_Effect **effect,
 	MOJOSHADER_effect **effectData
 ) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
 	MOJOSHADER_effectShaderContext shaderBackend;
 	VulkanEffect *result;
 
-	shaderBackend.compileShader = (MOJOSHADER_compileShaderFunc) MOJOSHADER_vkCompileShader;
-	shaderBackend.shaderAddRef = (MOJOSHADER_shaderAddRefFunc) MOJOSHADER_vkShaderAddRef;
-	shaderBackend.deleteShader = (MOJOSHADER_deleteShaderFunc) MOJOSHADER_vkDeleteShader;
+	shaderBackend.compileShader = ShaderCache_CompileShader;
+	shaderBackend.shaderAddRef = ShaderCache_ShaderAddRef;
+	shaderBackend.deleteShader = ShaderCache_DeleteShader;
 	shaderBackend.getParseData = (MOJOSHADER_getParseDataFunc) MOJOSHADER_vkGetShaderParseData;
 	shaderBackend.bindShaders = (MOJOSHADER_bindShadersFunc) MOJOSHADER_vkBindShaders;
 	shaderBackend.getBoundShaders = (MOJOSHADER_getBoundShadersFunc) MOJOSHADER_vkGetBoundShaders;
@@ -5805,6 +7400,8 @@ void VULKAN_CreateEffect(
 	shaderBackend.f = NULL;
 	shaderBackend.malloc_data = NULL;
 
+	LockShaderContext(renderer);
+	ShaderCache_MakeCurrent(&renderer->shaderCache);
 	*effectData = MOJOSHADER_compileEffect(
 		effectCode,
 		effectCodeLength,
@@ -5814,6 +7411,7 @@ void VULKAN_CreateEffect(
 		0,
 		&shaderBackend
 	);
+	UnlockShaderContext(renderer);
 
 	for (uint32_t i = 0; i < (*effectData)->error_count; i++)
 	{
@@ -5834,9 +7432,12 @@ void VULKAN_CloneEffect(
 	FNA3D_Effect **effect,
 	MOJOSHADER_effect **effectData
 ) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
 	VulkanEffect *vulkanCloneSource = (VulkanEffect*) cloneSource;
 	VulkanEffect *result;
 
+	LockShaderContext(renderer);
+	ShaderCache_MakeCurrent(&renderer->shaderCache);
 	*effectData = MOJOSHADER_cloneEffect(vulkanCloneSource->effect);
 	if (*effectData == NULL)
 	{
@@ -5844,6 +7445,7 @@ void VULKAN_CloneEffect(
 			"%s", MOJOSHADER_vkGetError()
 		);
 	}
+	UnlockShaderContext(renderer);
 
 	result = (VulkanEffect*) SDL_malloc(sizeof(VulkanEffect));
 	result->effect = *effectData;
@@ -5865,6 +7467,7 @@ void VULKAN_AddDisposeEffect(
 		LogVulkanResult("vkDeviceWaitIdle", waitResult);
 	}
 
+	LockShaderContext(renderer);
 	if (effectData == renderer->currentEffect) {
 		MOJOSHADER_effectEndPass(renderer->currentEffect);
 		MOJOSHADER_effectEnd(renderer->currentEffect);
@@ -5872,7 +7475,9 @@ void VULKAN_AddDisposeEffect(
 		renderer->currentTechnique = NULL;
 		renderer->currentPass = 0;
 	}
+	ShaderCache_MakeCurrent(&renderer->shaderCache);
 	MOJOSHADER_deleteEffect(effectData);
+	UnlockShaderContext(renderer);
 	SDL_free(effect);
 }
 
@@ -5899,6 +7504,7 @@ void VULKAN_ApplyEffect(
 
 	VULKAN_BeginFrame(driverData);
 
+	LockShaderContext(renderer);
 	if (effectData == renderer->currentEffect)
 	{
 		if (	technique == renderer->currentTechnique &&
@@ -5907,10 +7513,12 @@ void VULKAN_ApplyEffect(
 			MOJOSHADER_effectCommitChanges(
 				renderer->currentEffect
 			);
+			UnlockShaderContext(renderer);
 			return;
 		}
 		MOJOSHADER_effectEndPass(renderer->currentEffect);
 		MOJOSHADER_effectBeginPass(renderer->currentEffect, pass);
+		UnlockShaderContext(renderer);
 		renderer->currentTechnique = technique;
 		renderer->currentPass = pass;
 		return;
@@ -5929,6 +7537,7 @@ void VULKAN_ApplyEffect(
 	);
 
 	MOJOSHADER_effectBeginPass(effectData, pass);
+	UnlockShaderContext(renderer);
 	renderer->currentEffect = effectData;
 	renderer->currentTechnique = technique;
 	renderer->currentPass = pass;
@@ -5939,11 +7548,13 @@ void VULKAN_BeginPassRestore(
 	FNA3D_Effect *effect,
 	MOJOSHADER_effectStateChanges *stateChanges
 ) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
 	MOJOSHADER_effect *effectData = ((VulkanEffect *) effect)->effect;
 	uint32_t whatever;
 
 	VULKAN_BeginFrame(driverData);
 
+	LockShaderContext(renderer);
 	MOJOSHADER_effectBegin(
 			effectData,
 			&whatever,
@@ -5951,15 +7562,20 @@ void VULKAN_BeginPassRestore(
 			stateChanges
 	);
 	MOJOSHADER_effectBeginPass(effectData, 0);
+	UnlockShaderContext(renderer);
 }
 
 void VULKAN_EndPassRestore(
 	FNA3D_Renderer *driverData,
 	FNA3D_Effect *effect
 ) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
 	MOJOSHADER_effect *effectData = ((VulkanEffect *) effect)->effect;
+
+	LockShaderContext(renderer);
 	MOJOSHADER_effectEndPass(effectData);
 	MOJOSHADER_effectEnd(effectData);
+	UnlockShaderContext(renderer);
 }
 
 /* Queries */
@@ -6078,8 +7694,78 @@ int32_t VULKAN_QueryPixelCount(
 		return 0;
 	}
 
-	/* FIXME maybe signed/unsigned integer problems? */
-	return queryResult;
+	/* FIXME maybe signed/unsigned integer problems? */
+	return queryResult;
+}
+
+/* Readbacks */
+
+FNA3D_Readback* VULKAN_RequestReadback(
+	FNA3D_Renderer *driverData,
+	FNA3D_Texture *texture,
+	FNA3D_SurfaceFormat format,
+	int32_t x,
+	int32_t y,
+	int32_t w,
+	int32_t h,
+	int32_t level,
+	int32_t dataLength
+) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	VulkanTexture *vulkanTexture = (VulkanTexture*) texture;
+
+	if (texture == NULL)
+	{
+		/* Make sure there's actually a backbuffer image to read from */
+		VULKAN_BeginFrame(driverData);
+
+		return (FNA3D_Readback*) RecordReadback(
+			renderer,
+			GetBackbufferImage(renderer),
+			1,
+			x,
+			y,
+			0,
+			w,
+			h,
+			1,
+			0,
+			0,
+			dataLength
+		);
+	}
+
+	return (FNA3D_Readback*) RecordReadback(
+		renderer,
+		vulkanTexture->imageData,
+		vulkanTexture->levelCount,
+		x,
+		y,
+		0,
+		w,
+		h,
+		1,
+		level,
+		0,
+		dataLength
+	);
+}
+
+uint8_t VULKAN_PollReadback(
+	FNA3D_Renderer *driverData,
+	FNA3D_Readback *readback,
+	void* data
+) {
+	FNAVulkanRenderer *renderer = (FNAVulkanRenderer*) driverData;
+	VulkanReadback *vulkanReadback = (VulkanReadback*) readback;
+
+	if (!ReadbackComplete(renderer, vulkanReadback))
+	{
+		return 0;
+	}
+
+	CopyReadbackData(renderer, vulkanReadback, data);
+	return 1;
 }
 
 /* Feature Queries */
@@ -6104,6 +7790,12 @@ uint8_t VULKAN_SupportsNoOverwrite(FNA3D_Renderer *driverData)
 	/* TODO */
 }
 
+uint8_t VULKAN_SupportsIndirectDraws(FNA3D_Renderer *driverData)
+{
+	/* Even without multiDrawIndirect, single indirect draws are core */
+	return 1;
+}
+
 void VULKAN_GetMaxTextureSlots(
 	FNA3D_Renderer *driverData,
 	int32_t *textures,
@@ -6136,9 +7828,78 @@ intptr_t VULKAN_GetBufferSize(FNA3D_Buffer *buffer)
 	/* TODO */
 }
 
-static uint8_t LoadGlobalFunctions(void)
+#if defined(_WIN32)
+#define VULKAN_LIBRARY_NAME "vulkan-1.dll"
+#elif defined(__APPLE__)
+#define VULKAN_LIBRARY_NAME "libvulkan.1.dylib"
+#else
+#define VULKAN_LIBRARY_NAME "libvulkan.so.1"
+#endif
+
+/* Headless devices load the loader themselves, SDL_Vulkan wants video.
+ * Every headless device holds a reference, guarded by globalFunctionsLock.
+ */
+static void *vulkanLibrary = NULL;
+static uint32_t vulkanLibraryUsers = 0;
+
+static void LockGlobalFunctions(void)
+{
+	/* Loading may dlopen the loader, far too long to spin on. The mutex
+	 * itself lives as long as the process, like the functions it guards.
+	 */
+	SDL_AtomicLock(&globalFunctionsGuard);
+	if (globalFunctionsLock == NULL)
+	{
+		globalFunctionsLock = SDL_CreateMutex();
+	}
+	SDL_AtomicUnlock(&globalFunctionsGuard);
+	SDL_LockMutex(globalFunctionsLock);
+}
+
+static void ReleaseVulkanLibrary(void)
 {
-    vkGetInstanceProcAddr = SDL_Vulkan_GetVkGetInstanceProcAddr();
+	vulkanLibraryUsers -= 1;
+	if (vulkanLibraryUsers == 0)
+	{
+		SDL_UnloadObject(vulkanLibrary);
+		vulkanLibrary = NULL;
+	}
+}
+
+static uint8_t LoadGlobalFunctions(uint8_t headless)
+{
+	if (headless)
+	{
+		if (vulkanLibrary == NULL)
+		{
+			vulkanLibrary = SDL_LoadObject(VULKAN_LIBRARY_NAME);
+			if (vulkanLibrary == NULL)
+			{
+				FNA3D_LogError(
+					"SDL_LoadObject(\"%s\"): %s\n",
+					VULKAN_LIBRARY_NAME,
+					SDL_GetError()
+				);
+				return 0;
+			}
+		}
+		vulkanLibraryUsers += 1;
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+		vkGetInstanceProcAddr = (PFN_vkGetInstanceProcAddr) SDL_LoadFunction(
+			vulkanLibrary,
+			"vkGetInstanceProcAddr"
+		);
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+	}
+	else
+	{
+		vkGetInstanceProcAddr = SDL_Vulkan_GetVkGetInstanceProcAddr();
+	}
     if(!vkGetInstanceProcAddr)
     {
         SDL_LogError(
@@ -6165,6 +7926,8 @@ static uint8_t LoadGlobalFunctions(void)
 	return 1;
 }
 
+#undef VULKAN_LIBRARY_NAME
+
 static void LoadInstanceFunctions(
 	FNAVulkanRenderer *renderer
 ) {
@@ -6249,6 +8012,56 @@ static uint8_t CheckDeviceExtensionSupport(
 	return 1;
 }
 
+#if defined(VK_KHR_present_id) && defined(VK_KHR_present_wait)
+static uint8_t CheckPresentWaitSupport(
+	FNAVulkanRenderer *renderer
+) {
+	const char *extensionNames[] = {
+		VK_KHR_PRESENT_ID_EXTENSION_NAME,
+		VK_KHR_PRESENT_WAIT_EXTENSION_NAME
+	};
+	VkPhysicalDeviceProperties deviceProperties;
+	VkPhysicalDeviceFeatures2 deviceFeatures = {
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2
+	};
+	VkPhysicalDevicePresentIdFeaturesKHR presentIDFeatures = {
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR
+	};
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR
+	};
+
+	if (!CheckDeviceExtensionSupport(
+		renderer,
+		renderer->physicalDevice,
+		extensionNames,
+		2
+	)) {
+		return 0;
+	}
+
+	/* The extensions being there doesn't mean the features are */
+	renderer->vkGetPhysicalDeviceProperties(
+		renderer->physicalDevice,
+		&deviceProperties
+	);
+	if (	renderer->vkGetPhysicalDeviceFeatures2 == NULL ||
+		deviceProperties.apiVersion < VK_MAKE_VERSION(1, 1, 0)	)
+	{
+		return 0;
+	}
+
+	presentWaitFeatures.pNext = &presentIDFeatures;
+	deviceFeatures.pNext = &presentWaitFeatures;
+	renderer->vkGetPhysicalDeviceFeatures2(
+		renderer->physicalDevice,
+		&deviceFeatures
+	);
+
+	return presentIDFeatures.presentId && presentWaitFeatures.presentWait;
+}
+#endif
+
 static uint8_t QuerySwapChainSupport(
 	FNAVulkanRenderer *renderer,
 	VkPhysicalDevice physicalDevice,
@@ -6355,27 +8168,34 @@ static uint8_t IsDeviceIdeal(
 	renderer->vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
 
 	/* FIXME: need better structure for checking vs storing support details */
+	/* Headless devices have no surface, so there's no swapchain to check */
 	SwapChainSupportDetails swapChainSupportDetails;
-	if (!QuerySwapChainSupport(renderer, physicalDevice, surface, &swapChainSupportDetails))
+	if (surface != VK_NULL_HANDLE)
 	{
-		SDL_free(swapChainSupportDetails.formats);
-		SDL_free(swapChainSupportDetails.presentModes);
-		return 0;
-	}
+		if (!QuerySwapChainSupport(renderer, physicalDevice, surface, &swapChainSupportDetails))
+		{
+			SDL_free(swapChainSupportDetails.formats);
+			SDL_free(swapChainSupportDetails.presentModes);
+			return 0;
+		}
 
-	if (swapChainSupportDetails.formatsLength == 0 || swapChainSupportDetails.presentModesLength == 0)
-	{
-		SDL_free(swapChainSupportDetails.formats);
-		SDL_free(swapChainSupportDetails.presentModes);
-		return 0;
+		if (swapChainSupportDetails.formatsLength == 0 || swapChainSupportDetails.presentModesLength == 0)
+		{
+			SDL_free(swapChainSupportDetails.formats);
+			SDL_free(swapChainSupportDetails.presentModes);
+			return 0;
+		}
 	}
 
 	VkQueueFamilyProperties queueProps[queueFamilyCount];
 	renderer->vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueProps);
 
 	for (uint32_t i = 0; i < queueFamilyCount; i++) {
-		VkBool32 supportsPresent;
-		renderer->vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &supportsPresent);
+		VkBool32 supportsPresent = VK_TRUE;
+		if (surface != VK_NULL_HANDLE)
+		{
+			renderer->vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &supportsPresent);
+		}
 		if (supportsPresent && (queueProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0) {
 			queueFamilyIndices->graphicsFamily = i;
 			queueFamilyIndices->presentFamily = i;
@@ -6410,27 +8230,34 @@ static uint8_t IsDeviceSuitable(
 	uint32_t queueFamilyCount;
 	renderer->vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
 
+	/* Headless devices have no surface, so there's no swapchain to check */
 	SwapChainSupportDetails swapChainSupportDetails;
-	if (!QuerySwapChainSupport(renderer, physicalDevice, surface, &swapChainSupportDetails))
+	if (surface != VK_NULL_HANDLE)
 	{
-		SDL_free(swapChainSupportDetails.formats);
-		SDL_free(swapChainSupportDetails.presentModes);
-		return 0;
-	}
+		if (!QuerySwapChainSupport(renderer, physicalDevice, surface, &swapChainSupportDetails))
+		{
+			SDL_free(swapChainSupportDetails.formats);
+			SDL_free(swapChainSupportDetails.presentModes);
+			return 0;
+		}
 
-	if (swapChainSupportDetails.formatsLength == 0 || swapChainSupportDetails.presentModesLength == 0)
-	{
-		SDL_free(swapChainSupportDetails.formats);
-		SDL_free(swapChainSupportDetails.presentModes);
-		return 0;
+		if (swapChainSupportDetails.formatsLength == 0 || swapChainSupportDetails.presentModesLength == 0)
+		{
+			SDL_free(swapChainSupportDetails.formats);
+			SDL_free(swapChainSupportDetails.presentModes);
+			return 0;
+		}
 	}
 
 	VkQueueFamilyProperties queueProps[queueFamilyCount];
 	renderer->vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueProps);
 
 	for (uint32_t i = 0; i < queueFamilyCount; i++) {
-		VkBool32 supportsPresent;
-		renderer->vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &supportsPresent);
+		VkBool32 supportsPresent = VK_TRUE;
+		if (surface != VK_NULL_HANDLE)
+		{
+			renderer->vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &supportsPresent);
+		}
 		if (supportsPresent && (queueProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0) {
 			queueFamilyIndices->graphicsFamily = i;
 			queueFamilyIndices->presentFamily = i;
@@ -6504,16 +8331,23 @@ static uint8_t ChooseSwapPresentMode(
 	uint32_t availablePresentModesLength,
 	VkPresentModeKHR *outputPresentMode
 ) {
+	#define CHECK_MODE(m) \
+		for (uint32_t i = 0; i < availablePresentModesLength; i++) \
+		{ \
+			if (availablePresentModes[i] == m) \
+			{ \
+				*outputPresentMode = m; \
+				FNA3D_LogInfo("Using " #m "!"); \
+				return 1; \
+			} \
+		}
+
 	if (	desiredPresentInterval == FNA3D_PRESENTINTERVAL_DEFAULT ||
 			desiredPresentInterval == FNA3D_PRESENTINTERVAL_ONE	)
 	{
-		for (uint32_t i = 0; i < availablePresentModesLength; i++)
+		if (!SDL_GetHintBoolean("FNA3D_VULKAN_DISABLE_LATESWAPTEAR", 0))
 		{
-			if (availablePresentModes[i] == VK_PRESENT_MODE_FIFO_RELAXED_KHR)
-			{
-				*outputPresentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
-				return 1;
-			}
+			CHECK_MODE(VK_PRESENT_MODE_FIFO_RELAXED_KHR)
 		}
 	}
 	else if (desiredPresentInterval == FNA3D_PRESENTINTERVAL_TWO)
@@ -6524,18 +8358,26 @@ static uint8_t ChooseSwapPresentMode(
 			"FNA3D_PRESENTINTERVAL_TWO not supported in Vulkan"
 		);
 	}
-	else /* FNA3D_PRESENTINTERVAL_IMMEDIATE */
+	else if (desiredPresentInterval == FNA3D_PRESENTINTERVAL_IMMEDIATE)
 	{
-		for (uint32_t i = 0; i < availablePresentModesLength; i++)
+		/* Mailbox doesn't tear, but still renders as fast as it can */
+		if (SDL_GetHintBoolean("FNA3D_VULKAN_PREFER_MAILBOX", 0))
 		{
-			if (availablePresentModes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR)
-			{
-				*outputPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-				return 1;
-			}
+			CHECK_MODE(VK_PRESENT_MODE_MAILBOX_KHR)
 		}
+		CHECK_MODE(VK_PRESENT_MODE_IMMEDIATE_KHR)
+		CHECK_MODE(VK_PRESENT_MODE_MAILBOX_KHR)
+	}
+	else
+	{
+		FNA3D_LogError(
+			"Unrecognized PresentInterval: %d",
+			desiredPresentInterval
+		);
 	}
 
+	#undef CHECK_MODE
+
 	SDL_LogInfo(
 		SDL_LOG_CATEGORY_APPLICATION,
 		"%s\n",
@@ -6773,7 +8615,10 @@ static uint8_t CreateInstance(
 	appInfo.pApplicationName = "FNA";
 	appInfo.apiVersion = VK_MAKE_VERSION(1, 2, 137);
 
+	/* Headless devices never present, so they need no surface extensions */
+	instanceExtensionCount = 0;
 	if (
+		!renderer->headless &&
 		!SDL_Vulkan_GetInstanceExtensions(
 			presentationParameters->deviceWindowHandle,
 			&instanceExtensionCount,
@@ -6791,6 +8636,7 @@ static uint8_t CreateInstance(
 	instanceExtensionNames = SDL_stack_alloc(const char*, instanceExtensionCount);
 
 	if (
+		!renderer->headless &&
 		!SDL_Vulkan_GetInstanceExtensions(
 			presentationParameters->deviceWindowHandle,
 			&instanceExtensionCount,
@@ -6962,6 +8808,23 @@ static uint8_t DeterminePhysicalDevice(
 		&renderer->physicalDeviceProperties
 	);
 
+	/* Tilers expose lazily allocated memory for transient attachments */
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	renderer->vkGetPhysicalDeviceMemoryProperties(
+		renderer->physicalDevice,
+		&memoryProperties
+	);
+
+	renderer->supportsLazilyAllocatedMemory = 0;
+	for (i = 0; i < memoryProperties.memoryTypeCount; i++)
+	{
+		if (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+		{
+			renderer->supportsLazilyAllocatedMemory = 1;
+			break;
+		}
+	}
+
 	SDL_stack_free(physicalDevices);
 	return 1;
 }
@@ -6974,6 +8837,7 @@ static uint8_t CreateLogicalDevice(
 	VkResult vulkanResult;
 	VkDeviceCreateInfo deviceCreateInfo;
 	VkPhysicalDeviceFeatures deviceFeatures;
+	VkPhysicalDeviceFeatures supportedFeatures;
 
 	VkDeviceQueueCreateInfo *queueCreateInfos = SDL_stack_alloc(VkDeviceQueueCreateInfo, 2);
 	VkDeviceQueueCreateInfo queueCreateInfoGraphics;
@@ -7007,7 +8871,14 @@ static uint8_t CreateLogicalDevice(
 
 	/* specifying used device features */
 
+	renderer->vkGetPhysicalDeviceFeatures(
+		renderer->physicalDevice,
+		&supportedFeatures
+	);
+	renderer->supportsMultiDrawIndirect = supportedFeatures.multiDrawIndirect;
+
 	deviceFeatures.occlusionQueryPrecise = VK_TRUE;
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
 
 	/* creating the logical device */
 
@@ -7018,6 +8889,22 @@ static uint8_t CreateLogicalDevice(
 	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensionNames;
 	deviceCreateInfo.enabledExtensionCount = deviceExtensionCount;
 
+#if defined(VK_KHR_present_id) && defined(VK_KHR_present_wait)
+	VkPhysicalDevicePresentIdFeaturesKHR presentIDFeatures = {
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR
+	};
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR
+	};
+	if (renderer->supportsPresentWait)
+	{
+		presentIDFeatures.presentId = VK_TRUE;
+		presentWaitFeatures.pNext = &presentIDFeatures;
+		presentWaitFeatures.presentWait = VK_TRUE;
+		deviceCreateInfo.pNext = &presentWaitFeatures;
+	}
+#endif
+
 	vulkanResult = renderer->vkCreateDevice(renderer->physicalDevice, &deviceCreateInfo, NULL, &renderer->logicalDevice);
    	if (vulkanResult != VK_SUCCESS)
 	{
@@ -7114,7 +9001,18 @@ static uint8_t CreateSwapChain(
 		presentationParameters->backBufferHeight
 	);
 
-	imageCount = swapChainSupportDetails.capabilities.minImageCount + 1;
+	/* The image count is what bounds the queued frames without present_wait */
+	if (renderer->maxFrameLatency > 0)
+	{
+		imageCount = SDL_max(
+			swapChainSupportDetails.capabilities.minImageCount,
+			renderer->maxFrameLatency + 1
+		);
+	}
+	else
+	{
+		imageCount = swapChainSupportDetails.capabilities.minImageCount + 1;
+	}
 
 	if (	swapChainSupportDetails.capabilities.maxImageCount > 0 &&
 			imageCount > swapChainSupportDetails.capabilities.maxImageCount	)
@@ -7128,12 +9026,17 @@ static uint8_t CreateSwapChain(
 	swapChainCreateInfo.imageColorSpace = surfaceFormat.colorSpace;
 	swapChainCreateInfo.imageExtent = extent;
 	swapChainCreateInfo.imageArrayLayers = 1;
-	swapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	/* Transfer source is for when the swapchain is the backbuffer */
+	swapChainCreateInfo.imageUsage = (
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT
+	);
 	swapChainCreateInfo.preTransform = swapChainSupportDetails.capabilities.currentTransform;
 	swapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swapChainCreateInfo.presentMode = presentMode;
 	swapChainCreateInfo.clipped = VK_TRUE;
-	swapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+	swapChainCreateInfo.oldSwapchain = renderer->swapChain;
 
 	vulkanResult = renderer->vkCreateSwapchainKHR(renderer->logicalDevice, &swapChainCreateInfo, NULL, &renderer->swapChain);
 	
@@ -7160,6 +9063,9 @@ static uint8_t CreateSwapChain(
 	renderer->vkGetSwapchainImagesKHR(renderer->logicalDevice, renderer->swapChain, &swapChainImageCount, swapChainImages);
 	renderer->swapChainImageCount = swapChainImageCount;
 	renderer->swapChainExtent = extent;
+	renderer->swapChainFormat = surfaceFormat.format;
+	renderer->presentInterval = presentationParameters->presentationInterval;
+	renderer->presentID = 0;
 
 	for (uint32_t i = 0; i < swapChainImageCount; i++)
 	{
@@ -7363,25 +9269,31 @@ static uint8_t CreateDescriptorSetLayouts(
 	return 1;
 }
 
-static uint8_t CreateFauxBackbuffer(
-	FNAVulkanRenderer *renderer,
-	FNA3D_PresentationParameters *presentationParameters
+static uint8_t CreateFauxBackbufferColor(
+	FNAVulkanRenderer *renderer
 ) {
-	VkFormat vulkanDepthStencilFormat;
+	if (renderer->fauxBackbufferColorImageData.image != VK_NULL_HANDLE)
+	{
+		return 1;
+	}
 
+	/* This is always single-sample, it's what gets blitted to the swapchain */
 	if (
 		!CreateImage(
 			renderer,
-			presentationParameters->backBufferWidth,
-			presentationParameters->backBufferHeight,
-			XNAToVK_SampleCount(presentationParameters->multiSampleCount),
+			renderer->fauxBackbufferWidth,
+			renderer->fauxBackbufferHeight,
+			1,
+			VK_SAMPLE_COUNT_1_BIT,
 			renderer->surfaceFormatMapping.formatColor,
 			renderer->surfaceFormatMapping.swizzle,
 			VK_IMAGE_ASPECT_COLOR_BIT,
 			VK_IMAGE_TILING_OPTIMAL,
 			VK_IMAGE_TYPE_2D,
 			/* FIXME: transfer bit probably only needs to be set on 0? */
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+				VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+				VK_IMAGE_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			&renderer->fauxBackbufferColorImageData
 		)
@@ -7394,18 +9306,85 @@ static uint8_t CreateFauxBackbuffer(
 		return 0;
 	}
 
+	renderer->fauxBackbufferColor.handle = renderer->fauxBackbufferColorImageData.view;
+	renderer->fauxBackbufferColor.dimensions = renderer->fauxBackbufferColorImageData.dimensions;
+	renderer->useFauxBackbuffer = 1;
+
+	return 1;
+}
+
+static uint8_t CreateFauxBackbuffer(
+	FNAVulkanRenderer *renderer,
+	FNA3D_PresentationParameters *presentationParameters
+) {
+	VkFormat vulkanDepthStencilFormat;
+
 	renderer->fauxBackbufferWidth = presentationParameters->backBufferWidth;
 	renderer->fauxBackbufferHeight = presentationParameters->backBufferHeight;
 
-	renderer->fauxBackbufferColor.handle = renderer->fauxBackbufferColorImageData.view;
-	renderer->fauxBackbufferColor.dimensions = renderer->fauxBackbufferColorImageData.dimensions;
-	
+	renderer->fauxBackbufferColor.handle = VK_NULL_HANDLE;
+	renderer->fauxBackbufferColor.dimensions = renderer->swapChainExtent;
+	renderer->fauxBackbufferColor.format = renderer->surfaceFormatMapping.formatColor;
+	renderer->fauxBackbufferColor.image = NULL;
+	renderer->fauxBackbufferColor.multiSampleTexture = NULL;
+	renderer->fauxBackbufferColor.multiSampleCount = VK_SAMPLE_COUNT_1_BIT;
+	renderer->fauxBackbufferColor.multiSampleSplit = 0;
+
+	/* If nothing has to be scaled or converted on present, we can render
+	 * straight into the swapchain image. Attachments can't be swizzled!
+	 * Multisampling is fine, the render pass resolves into the swapchain.
+	 */
+	renderer->useFauxBackbuffer = (
+		renderer->headless ||
+		presentationParameters->backBufferWidth != renderer->swapChainExtent.width ||
+		presentationParameters->backBufferHeight != renderer->swapChainExtent.height ||
+		renderer->swapChainFormat != renderer->surfaceFormatMapping.formatColor ||
+		SDL_memcmp(
+			&renderer->surfaceFormatMapping.swizzle,
+			&IDENTITY_SWIZZLE,
+			sizeof(VkComponentMapping)
+		) != 0
+	);
+
+	if (renderer->useFauxBackbuffer && !CreateFauxBackbufferColor(renderer))
+	{
+		return 0;
+	}
+
 	renderer->colorAttachments[0] = &renderer->fauxBackbufferColor;
 	renderer->colorAttachmentCount = 1;
 
 	renderer->fauxBackbufferSurfaceFormat = presentationParameters->backBufferFormat;
 	renderer->fauxBackbufferMultisampleCount = XNAToVK_SampleCount(presentationParameters->multiSampleCount);
 
+	/* The multisample color is resolved into the image above by the
+	 * render pass itself, so there's no separate resolve step.
+	 */
+	if (renderer->fauxBackbufferMultisampleCount > VK_SAMPLE_COUNT_1_BIT)
+	{
+		if (
+			!CreateMultiSampleColorImage(
+				renderer,
+				presentationParameters->backBufferWidth,
+				presentationParameters->backBufferHeight,
+				renderer->fauxBackbufferMultisampleCount,
+				renderer->surfaceFormatMapping.formatColor,
+				renderer->surfaceFormatMapping.swizzle,
+				&renderer->fauxBackbufferMultiSampleColorImageData
+			)
+		) {
+			FNA3D_LogError(
+				"%s\n",
+				"Failed to create multisample color attachment image"
+			);
+
+			return 0;
+		}
+
+		renderer->fauxBackbufferColor.multiSampleTexture = &renderer->fauxBackbufferMultiSampleColorImageData;
+		renderer->fauxBackbufferColor.multiSampleCount = renderer->fauxBackbufferMultisampleCount;
+	}
+
 	/* create faux backbuffer depth stencil image */
 
 	renderer->fauxBackbufferDepthFormat = presentationParameters->depthStencilFormat;
@@ -7419,6 +9398,7 @@ static uint8_t CreateFauxBackbuffer(
 				renderer,
 				presentationParameters->backBufferWidth,
 				presentationParameters->backBufferHeight,
+				1,
 				XNAToVK_SampleCount(presentationParameters->multiSampleCount),
 				vulkanDepthStencilFormat,
 				IDENTITY_SWIZZLE,
@@ -7449,6 +9429,74 @@ static uint8_t CreateFauxBackbuffer(
 	return 1;
 }
 
+static uint8_t RecreateSwapChain(
+	FNAVulkanRenderer *renderer
+) {
+	FNA3D_PresentationParameters presentationParameters;
+	VkSwapchainKHR oldSwapChain = renderer->swapChain;
+	FNAVulkanImageData *oldSwapChainImages = renderer->swapChainImages;
+	uint32_t oldSwapChainImageCount = renderer->swapChainImageCount;
+	VkResult waitResult;
+
+	renderer->needNewSwapChain = 0;
+
+	waitResult = renderer->vkDeviceWaitIdle(renderer->logicalDevice);
+	if (waitResult != VK_SUCCESS)
+	{
+		LogVulkanResult("vkDeviceWaitIdle", waitResult);
+	}
+
+	/* Framebuffers may be holding on to the old swapchain views */
+	for (uint32_t i = 0; i < hmlenu(renderer->framebufferHashMap); i++)
+	{
+		renderer->vkDestroyFramebuffer(
+			renderer->logicalDevice,
+			renderer->framebufferHashMap[i].value,
+			NULL
+		);
+	}
+	hmfree(renderer->framebufferHashMap);
+	hmdefault(renderer->framebufferHashMap, NULL);
+
+	SDL_zero(presentationParameters);
+	presentationParameters.backBufferWidth = renderer->fauxBackbufferWidth;
+	presentationParameters.backBufferHeight = renderer->fauxBackbufferHeight;
+	presentationParameters.backBufferFormat = renderer->fauxBackbufferSurfaceFormat;
+	presentationParameters.presentationInterval = renderer->presentInterval;
+
+	if (!CreateSwapChain(renderer, &presentationParameters))
+	{
+		FNA3D_LogError("Failed to recreate swap chain");
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < oldSwapChainImageCount; i++)
+	{
+		renderer->vkDestroyImageView(
+			renderer->logicalDevice,
+			oldSwapChainImages[i].view,
+			NULL
+		);
+	}
+	SDL_free(oldSwapChainImages);
+
+	renderer->vkDestroySwapchainKHR(
+		renderer->logicalDevice,
+		oldSwapChain,
+		NULL
+	);
+
+	/* The surface may have changed size out from under us */
+	if (	!renderer->useFauxBackbuffer &&
+		(	renderer->swapChainExtent.width != renderer->fauxBackbufferWidth ||
+			renderer->swapChainExtent.height != renderer->fauxBackbufferHeight	)	)
+	{
+		return CreateFauxBackbufferColor(renderer);
+	}
+
+	return 1;
+}
+
 static uint8_t CreatePipelineCache(
 	FNAVulkanRenderer *renderer
 ) {
@@ -7474,6 +9522,11 @@ static uint8_t CreatePipelineCache(
 static uint8_t CreateMojoshaderContext(
 	FNAVulkanRenderer *renderer
 ) {
+	uint8_t result = 0;
+
+	renderer->mojoshaderContextLock = SDL_CreateMutex();
+	renderer->mojoshaderContext = NULL;
+	LockShaderContext(renderer);
 	renderer->mojoshaderContext = MOJOSHADER_vkCreateContext(
 		(MOJOSHADER_VkInstance*) &renderer->instance,
 		(MOJOSHADER_VkPhysicalDevice*) &renderer->physicalDevice,
@@ -7490,12 +9543,17 @@ static uint8_t CreateMojoshaderContext(
 	if (renderer->mojoshaderContext != NULL)
 	{
 		MOJOSHADER_vkMakeContextCurrent(renderer->mojoshaderContext);
-		return 1;
-	}
-	else
-	{
-		return 0;
+		ShaderCache_Init(
+			&renderer->shaderCache,
+			(MOJOSHADER_compileShaderFunc) MOJOSHADER_vkCompileShader,
+			(MOJOSHADER_shaderAddRefFunc) MOJOSHADER_vkShaderAddRef,
+			(MOJOSHADER_deleteShaderFunc) MOJOSHADER_vkDeleteShader
+		);
+		result = 1;
 	}
+	UnlockShaderContext(renderer);
+
+	return result;
 }
 
 static uint8_t CreateDescriptorPools(
@@ -7944,15 +10002,18 @@ static uint8_t CreateBarrierStorage(
 	return 1;
 }
 
-FNA3D_Device* VULKAN_CreateDevice(
+static FNA3D_Device* InternalCreateDevice(
 	FNA3D_PresentationParameters *presentationParameters,
-	uint8_t debugMode
+	uint8_t debugMode,
+	uint8_t headless
 ) {
 	FNAVulkanRenderer *renderer;
 	FNA3D_Device *result;
 
-	char const* deviceExtensionNames[] = { "VK_KHR_swapchain" };
-	uint32_t deviceExtensionCount = sizeof(deviceExtensionNames) / sizeof(deviceExtensionNames[0]);
+	/* Optional extensions are appended once we have a physical device */
+	char const* deviceExtensionNames[3] = { "VK_KHR_swapchain" };
+	uint32_t deviceExtensionCount = 1;
+	const char *frameLatencyHint;
 
 	/* Create the FNA3D_Device */
 	result = (FNA3D_Device*) SDL_malloc(sizeof(FNA3D_Device));
@@ -7963,10 +10024,16 @@ FNA3D_Device* VULKAN_CreateDevice(
 	SDL_zero(*renderer);
 
 	renderer->debugMode = debugMode;
+	renderer->headless = headless;
 	renderer->parentDevice = result;
 	result->driverData = (FNA3D_Renderer*) renderer;
 
-	if (SDL_WasInit(SDL_INIT_VIDEO) == 0)
+	if (headless)
+	{
+		/* No surface means no swapchain extension either */
+		deviceExtensionCount = 0;
+	}
+	else if (SDL_WasInit(SDL_INIT_VIDEO) == 0)
 	{
 		SDL_LogError(
 			SDL_LOG_CATEGORY_APPLICATION,
@@ -7978,7 +10045,7 @@ FNA3D_Device* VULKAN_CreateDevice(
 	}
 
 	/* load library so we can load vk functions dynamically */
-	if (SDL_Vulkan_LoadLibrary(NULL) == -1)
+	if (!headless && SDL_Vulkan_LoadLibrary(NULL) == -1)
 	{
 		SDL_LogError(
 			SDL_LOG_CATEGORY_APPLICATION,
@@ -7990,11 +10057,19 @@ FNA3D_Device* VULKAN_CreateDevice(
 		return NULL;
 	}
 
-	if (!LoadGlobalFunctions())
+	/* The global function pointers are shared by every device */
+	LockGlobalFunctions();
+	if (!LoadGlobalFunctions(headless))
 	{
+		if (headless && vulkanLibrary != NULL)
+		{
+			ReleaseVulkanLibrary();
+		}
+		SDL_UnlockMutex(globalFunctionsLock);
 		FNA3D_LogError("Failed to load Vulkan global functions");
 		return NULL;
 	}
+	SDL_UnlockMutex(globalFunctionsLock);
 
 	if (!CreateInstance(renderer, presentationParameters))
 	{
@@ -8002,7 +10077,7 @@ FNA3D_Device* VULKAN_CreateDevice(
 		return NULL;
 	}
 
-	if (!SDL_Vulkan_CreateSurface(
+	if (!headless && !SDL_Vulkan_CreateSurface(
 			presentationParameters->deviceWindowHandle,
 			renderer->instance,
 			&renderer->surface
@@ -8025,6 +10100,24 @@ FNA3D_Device* VULKAN_CreateDevice(
 		return NULL;
 	}
 
+	frameLatencyHint = SDL_GetHint("FNA3D_VULKAN_MAX_FRAME_LATENCY");
+	if (frameLatencyHint != NULL)
+	{
+		renderer->maxFrameLatency = SDL_max(SDL_atoi(frameLatencyHint), 0);
+	}
+
+#if defined(VK_KHR_present_id) && defined(VK_KHR_present_wait)
+	if (	!headless &&
+		renderer->maxFrameLatency > 0 &&
+		CheckPresentWaitSupport(renderer)	)
+	{
+		deviceExtensionNames[deviceExtensionCount++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+		deviceExtensionNames[deviceExtensionCount++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+		renderer->supportsPresentWait = 1;
+		FNA3D_LogInfo("Using VK_KHR_present_wait for frame pacing!");
+	}
+#endif
+
 	if (!CreateLogicalDevice(
 		renderer,
 		deviceExtensionNames,
@@ -8034,7 +10127,18 @@ FNA3D_Device* VULKAN_CreateDevice(
 		return NULL;
 	}
 
-	if (!CreateSwapChain(
+	if (headless)
+	{
+		/* The faux backbuffer stands in for the swapchain */
+		renderer->surfaceFormatMapping = XNAToVK_SurfaceFormat[
+			presentationParameters->backBufferFormat
+		];
+		renderer->swapChainFormat = renderer->surfaceFormatMapping.formatColor;
+		renderer->swapChainExtent.width = presentationParameters->backBufferWidth;
+		renderer->swapChainExtent.height = presentationParameters->backBufferHeight;
+		renderer->presentInterval = presentationParameters->presentationInterval;
+	}
+	else if (!CreateSwapChain(
 		renderer,
 		presentationParameters
 	)) {
@@ -8118,11 +10222,11 @@ FNA3D_Device* VULKAN_CreateDevice(
 	renderer->frameInProgress = 0;
 
 	/* initialize various render object caches */
-	hmdefault(renderer->pipelineHashMap, NULL);
+	PackedHashMap_Init(&renderer->pipelineHashMap, PIPELINE_KEY_WORDS);
 	hmdefault(renderer->pipelineLayoutHashMap, NULL);
 	hmdefault(renderer->renderPassHashMap, NULL);
 	hmdefault(renderer->framebufferHashMap, NULL);
-	hmdefault(renderer->samplerStateHashMap, NULL);
+	PackedHashMap_Init(&renderer->samplerStateHashMap, 2);
 
 	/* Initialize renderer members not covered by SDL_memset('\0') */
 	SDL_memset(renderer->multiSampleMask, -1, sizeof(renderer->multiSampleMask)); /* AKA 0xFFFFFFFF */
@@ -8154,11 +10258,26 @@ FNA3D_Device* VULKAN_CreateDevice(
 	return result;
 }
 
+FNA3D_Device* VULKAN_CreateDevice(
+	FNA3D_PresentationParameters *presentationParameters,
+	uint8_t debugMode
+) {
+	return InternalCreateDevice(presentationParameters, debugMode, 0);
+}
+
+FNA3D_Device* VULKAN_CreateHeadlessDevice(
+	FNA3D_PresentationParameters *presentationParameters,
+	uint8_t debugMode
+) {
+	return InternalCreateDevice(presentationParameters, debugMode, 1);
+}
+
 FNA3D_Driver VulkanDriver = {
 	"Vulkan",
 	VULKAN_PrepareWindowAttributes,
 	VULKAN_GetDrawableSize,
-	VULKAN_CreateDevice
+	VULKAN_CreateDevice,
+	VULKAN_CreateHeadlessDevice
 };
 
 #endif /* FNA_3D_DRIVER_VULKAN */
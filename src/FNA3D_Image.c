@@ -24,10 +24,20 @@
  *
  */
 
+#include "FNA3D.h"
 #include "FNA3D_Image.h"
 
 #include <SDL.h>
 
+/* SSE2 and NEON are baseline on x86_64 and ARM64, so no runtime check */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FNA3D_IMAGE_SSE2
+#include <emmintrin.h>
+#elif (defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)) && SDL_BYTEORDER == SDL_LIL_ENDIAN
+#define FNA3D_IMAGE_NEON
+#include <arm_neon.h>
+#endif
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-function"
 #ifndef __clang__
@@ -92,9 +102,47 @@
 #define STBI_FREE SDL_free
 #define STB_IMAGE_IMPLEMENTATION
 #ifdef __MINGW32__
-#define STBI_NO_THREAD_LOCALS /* FIXME: Port to SDL_TLS -flibit */
+/* MinGW's thread-locals need emutls, so stb_image's failure reason would be a
+ * global that FNA3D_Image_LoadBatch workers overwrite under each other. The
+ * vertical flip setting is global too, but it's only ever read. Route the
+ * failure reason through SDL_TLS instead, stb_image never knows the difference.
+ */
+#define STBI_NO_THREAD_LOCALS
+static SDL_SpinLock stbiFailureReasonLock = 0;
+static SDL_TLSID stbiFailureReasonTLS = 0;
+static const char *stbiFailureReasonFallback = NULL;
+static const char** FNA3D_INTERNAL_GetFailureReason(void)
+{
+	const char **result;
+
+	SDL_AtomicLock(&stbiFailureReasonLock);
+	if (stbiFailureReasonTLS == 0)
+	{
+		stbiFailureReasonTLS = SDL_TLSCreate();
+	}
+	SDL_AtomicUnlock(&stbiFailureReasonLock);
+
+	result = (const char**) SDL_TLSGet(stbiFailureReasonTLS);
+	if (result == NULL)
+	{
+		result = (const char**) SDL_malloc(sizeof(const char*));
+		if (	result == NULL ||
+			SDL_TLSSet(stbiFailureReasonTLS, result, SDL_free) < 0	)
+		{
+			/* Racy, but still better than nothing */
+			SDL_free(result);
+			return &stbiFailureReasonFallback;
+		}
+		*result = NULL;
+	}
+	return result;
+}
+#define stbi__g_failure_reason (*FNA3D_INTERNAL_GetFailureReason())
 #endif
 #include "stb_image.h"
+#ifdef __MINGW32__
+#undef stbi__g_failure_reason
+#endif
 
 #define MINIZ_NO_STDIO
 #define MINIZ_NO_TIME
@@ -136,278 +184,2376 @@ static unsigned char* dgibson_stbi_zlib_compress(
 
 /* Image Read API */
 
-uint8_t* FNA3D_Image_Load(
-	FNA3D_Image_ReadFunc readFunc,
-	FNA3D_Image_SkipFunc skipFunc,
-	FNA3D_Image_EOFFunc eofFunc,
-	void* context,
-	int32_t *w,
-	int32_t *h,
-	int32_t *len,
-	int32_t forceW,
-	int32_t forceH,
-	uint8_t zoom
+/* Exact round(c * a / 255), shared by the scalar and SIMD paths so that
+ * every path produces identical output.
+ */
+#define PREMULTIPLY(c, a) \
+	((((c) * (a) + 128) + (((c) * (a) + 128) >> 8)) >> 8)
+
+/* Copies count RGBA8 pixels from src to dst (which may be the same memory),
+ * either zeroing the color of fully transparent pixels or premultiplying the
+ * color by alpha. Doing this during the copy means we only touch each pixel
+ * once, and dst is only ever written to, which matters for mapped memory.
+ */
+static void FNA3D_INTERNAL_ProcessAlpha(
+	uint8_t *dst,
+	const uint8_t *src,
+	int32_t count,
+	uint8_t premultiply
 ) {
-	uint8_t *result;
-	uint8_t *pixels;
-	int32_t format;
-	float scale;
-	SDL_Rect crop;
-	uint8_t scaleWidth;
-	SDL_Surface *surface, *newSurface;
-	stbi_io_callbacks cb;
-	int32_t i;
+	int32_t i = 0;
+	uint8_t a;
 
-	cb.read = readFunc;
-	cb.skip = skipFunc;
-	cb.eof = eofFunc;
-	result = stbi_load_from_callbacks(
-		&cb,
-		context,
-		w,
-		h,
-		&format,
-		STBI_rgb_alpha
-	);
+#if defined(FNA3D_IMAGE_SSE2)
+	const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(128);
+	__m128i pixels, lo, hi, loAlpha, hiAlpha;
 
-	if (forceW != -1 && forceH != -1)
+	if (premultiply)
 	{
-		surface = SDL_CreateRGBSurfaceFrom(
-			result,
-			*w,
-			*h,
-			8 * 4,
-			(*w) * 4,
-			0x000000FF,
-			0x0000FF00,
-			0x00FF0000,
-			0xFF000000
-		);
-
-		if (zoom)
+		for (; i + 4 <= count; i += 4, src += 16, dst += 16)
 		{
-			scaleWidth = surface->w < surface->h;
+			pixels = _mm_loadu_si128((const __m128i*) src);
+
+			lo = _mm_unpacklo_epi8(pixels, zero);
+			hi = _mm_unpackhi_epi8(pixels, zero);
+			loAlpha = _mm_shufflehi_epi16(
+				_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)),
+				_MM_SHUFFLE(3, 3, 3, 3)
+			);
+			hiAlpha = _mm_shufflehi_epi16(
+				_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)),
+				_MM_SHUFFLE(3, 3, 3, 3)
+			);
+			lo = _mm_add_epi16(_mm_mullo_epi16(lo, loAlpha), round);
+			hi = _mm_add_epi16(_mm_mullo_epi16(hi, hiAlpha), round);
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+			hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+			/* The alpha lanes got multiplied too, put the originals back */
+			_mm_storeu_si128(
+				(__m128i*) dst,
+				_mm_or_si128(
+					_mm_andnot_si128(alphaMask, _mm_packus_epi16(lo, hi)),
+					_mm_and_si128(alphaMask, pixels)
+				)
+			);
 		}
-		else
+	}
+	else
+	{
+		for (; i + 4 <= count; i += 4, src += 16, dst += 16)
 		{
-			scaleWidth = surface->w > surface->h;
+			pixels = _mm_loadu_si128((const __m128i*) src);
+
+			/* Alpha is already 0, so the whole pixel can be zeroed */
+			_mm_storeu_si128(
+				(__m128i*) dst,
+				_mm_andnot_si128(
+					_mm_cmpeq_epi32(
+						_mm_and_si128(pixels, alphaMask),
+						zero
+					),
+					pixels
+				)
+			);
 		}
+	}
+#elif defined(FNA3D_IMAGE_NEON)
+	uint8x8x4_t rgba;
+	uint16x8_t product;
+	uint32x4_t pixels;
+	const uint16x8_t round = vdupq_n_u16(128);
 
-		if (scaleWidth)
+	if (premultiply)
+	{
+		for (; i + 8 <= count; i += 8, src += 32, dst += 32)
 		{
-			scale = forceW / (float) surface->w;
+			rgba = vld4_u8(src);
+
+			#define PREMULTIPLY_NEON(channel) \
+				product = vaddq_u16(vmull_u8(channel, rgba.val[3]), round); \
+				channel = vshrn_n_u16(vsraq_n_u16(product, product, 8), 8);
+			PREMULTIPLY_NEON(rgba.val[0])
+			PREMULTIPLY_NEON(rgba.val[1])
+			PREMULTIPLY_NEON(rgba.val[2])
+			#undef PREMULTIPLY_NEON
+
+			vst4_u8(dst, rgba);
 		}
-		else
+	}
+	else
+	{
+		for (; i + 4 <= count; i += 4, src += 16, dst += 16)
 		{
-			scale = forceH / (float) surface->h;
+			pixels = vld1q_u32((const uint32_t*) src);
+
+			/* Alpha is already 0, so the whole pixel can be zeroed */
+			vst1q_u32(
+				(uint32_t*) dst,
+				vbicq_u32(
+					pixels,
+					vceqq_u32(vshrq_n_u32(pixels, 24), vdupq_n_u32(0))
+				)
+			);
 		}
+	}
+#endif
 
-		if (zoom)
+	for (; i < count; i += 1, src += 4, dst += 4)
+	{
+		a = src[3];
+		if (premultiply)
 		{
-			*w = forceW;
-			*h = forceH;
-			if (scaleWidth)
-			{
-				crop.x = 0;
-				crop.y = (int) (surface->h / 2 - (forceH / scale) / 2);
-				crop.w = surface->w;
-				crop.h = (int) (forceH / scale);
-			}
-			else
-			{
-				crop.x = (int) (surface->w / 2 - (forceW / scale) / 2);
-				crop.y = 0;
-				crop.w = (int) (forceW / scale);
-				crop.h = surface->h;
-			}
+			dst[0] = PREMULTIPLY(src[0], a);
+			dst[1] = PREMULTIPLY(src[1], a);
+			dst[2] = PREMULTIPLY(src[2], a);
 		}
-		else
+		else if (a == 0)
 		{
-			*w = (int) (surface->w * scale);
-			*h = (int) (surface->h * scale);
-		}
-
-		/* Alloc surface, blit! */
-		newSurface = SDL_CreateRGBSurface(
-			0,
-			*w,
-			*h,
-			32,
-			0x000000FF,
-			0x0000FF00,
-			0x00FF0000,
-			0xFF000000
-		);
-		SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
-		if (zoom)
-		{
-			SDL_BlitScaled(
-				surface,
-				&crop,
-				newSurface,
-				NULL
-			);
+			dst[0] = 0;
+			dst[1] = 0;
+			dst[2] = 0;
 		}
 		else
 		{
-			SDL_BlitScaled(
-				surface,
-				NULL,
-				newSurface,
-				NULL
-			);
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
 		}
-		SDL_FreeSurface(surface);
-		SDL_free(result);
+		dst[3] = a;
+	}
+}
+
+#undef PREMULTIPLY
 
-		/* We're going to cheat and let the client take the memory! */
-		result = (uint8_t*) newSurface->pixels;
-		newSurface->flags |= SDL_PREALLOC;
-		SDL_FreeSurface(newSurface);
+static void FNA3D_INTERNAL_ScaleDimensions(
+	int32_t srcW,
+	int32_t srcH,
+	int32_t forceW,
+	int32_t forceH,
+	uint8_t zoom,
+	int32_t *w,
+	int32_t *h,
+	SDL_Rect *crop
+) {
+	float scale;
+	uint8_t scaleWidth;
+
+	if (zoom)
+	{
+		scaleWidth = srcW < srcH;
+	}
+	else
+	{
+		scaleWidth = srcW > srcH;
 	}
 
-	/* Ensure that the alpha pixels are... well, actual alpha.
-	 * You think this looks stupid, but be assured: Your paint program is
-	 * almost certainly even stupider.
-	 * -flibit
-	 */
-	pixels = result;
-	*len = (*w) * (*h) * 4;
-	for (i = 0; i < *len; i += 4, pixels += 4)
+	if (scaleWidth)
+	{
+		scale = forceW / (float) srcW;
+	}
+	else
+	{
+		scale = forceH / (float) srcH;
+	}
+
+	if (zoom)
 	{
-		if (pixels[3] == 0)
+		*w = forceW;
+		*h = forceH;
+		if (scaleWidth)
+		{
+			crop->x = 0;
+			crop->y = (int) (srcH / 2 - (forceH / scale) / 2);
+			crop->w = srcW;
+			crop->h = (int) (forceH / scale);
+		}
+		else
 		{
-			pixels[0] = 0;
-			pixels[1] = 0;
-			pixels[2] = 0;
+			crop->x = (int) (srcW / 2 - (forceW / scale) / 2);
+			crop->y = 0;
+			crop->w = (int) (forceW / scale);
+			crop->h = srcH;
 		}
 	}
+	else
+	{
+		*w = (int) (srcW * scale);
+		*h = (int) (srcH * scale);
+		crop->x = 0;
+		crop->y = 0;
+		crop->w = srcW;
+		crop->h = srcH;
+	}
 
-	return result;
+	/* Extreme aspect ratios can push the crop outside of the image */
+	crop->x = SDL_max(crop->x, 0);
+	crop->y = SDL_max(crop->y, 0);
+	crop->w = SDL_max(SDL_min(crop->w, srcW - crop->x), 1);
+	crop->h = SDL_max(SDL_min(crop->h, srcH - crop->y), 1);
+	*w = SDL_max(*w, 1);
+	*h = SDL_max(*h, 1);
 }
 
-void FNA3D_Image_Free(uint8_t *mem)
+/* Row Bands */
+
+#define FNA3D_IMAGE_MAX_BANDS 16
+
+typedef struct FNA3D_Image_Band
 {
-	SDL_free(mem);
-}
+	void* job;
+	int32_t start;
+	int32_t end;
+} FNA3D_Image_Band;
 
-/* Image Write API */
+/* Set on FNA3D_Image_LoadBatch workers, which are already one per core */
+static SDL_SpinLock batchWorkerLock = 0;
+static SDL_TLSID batchWorkerTLS = 0;
 
-void FNA3D_Image_SavePNG(
-	FNA3D_Image_WriteFunc writeFunc,
-	void* context,
-	int32_t srcW,
-	int32_t srcH,
-	int32_t dstW,
-	int32_t dstH,
-	uint8_t *data
+/* Splits rows into bands and runs func on each, one band per thread. The
+ * calling thread takes the first band, and any band whose thread could not
+ * be created is run inline instead.
+ */
+static void FNA3D_INTERNAL_RunBands(
+	SDL_ThreadFunction func,
+	void* job,
+	int32_t rows,
+	int32_t bandCount
 ) {
-	SDL_Surface *surface, *scaledSurface = NULL;
-	uint8_t *pixels;
-	uint8_t scale = (srcW != dstW) || (srcH != dstH);
+	FNA3D_Image_Band bands[FNA3D_IMAGE_MAX_BANDS];
+	SDL_Thread *threads[FNA3D_IMAGE_MAX_BANDS];
+	int32_t i;
 
-	/* Only blit to scale, the format is already correct */
-	if (scale)
+	if (batchWorkerTLS != 0 && SDL_TLSGet(batchWorkerTLS) != NULL)
 	{
-		surface = SDL_CreateRGBSurfaceFrom(
-			data,
-			srcW,
-			srcH,
-			8 * 4,
-			srcW * 4,
-			0x000000FF,
-			0x0000FF00,
-			0x00FF0000,
-			0xFF000000
-		);
-		scaledSurface = SDL_CreateRGBSurface(
-			0,
-			dstW,
-			dstH,
-			32,
-			0x000000FF,
-			0x0000FF00,
-			0x00FF0000,
-			0xFF000000
-		);
-		SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
-		SDL_BlitScaled(surface, NULL, scaledSurface, NULL);
-		SDL_FreeSurface(surface);
-		pixels = (uint8_t*) scaledSurface->pixels;
+		bandCount = 1;
 	}
-	else
+	bandCount = SDL_max(SDL_min(bandCount, FNA3D_IMAGE_MAX_BANDS), 1);
+	for (i = 0; i < bandCount; i += 1)
 	{
-		pixels = data;
+		bands[i].job = job;
+		bands[i].start = (rows * i) / bandCount;
+		bands[i].end = (rows * (i + 1)) / bandCount;
 	}
-
-	/* Write the image data, finally. */
-	stbi_write_png_to_func(
-		writeFunc,
-		context,
-		dstW,
-		dstH,
-		4,
-		pixels,
-		dstW * 4
-	);
-
-	/* Clean up. We out. */
-	if (scale)
+	for (i = 1; i < bandCount; i += 1)
+	{
+		threads[i] = SDL_CreateThread(func, "FNA3D Image", &bands[i]);
+		if (threads[i] == NULL)
+		{
+			func(&bands[i]);
+		}
+	}
+	func(&bands[0]);
+	for (i = 1; i < bandCount; i += 1)
 	{
-		SDL_FreeSurface(scaledSurface);
+		SDL_WaitThread(threads[i], NULL);
 	}
 }
 
-void FNA3D_Image_SaveJPG(
-	FNA3D_Image_WriteFunc writeFunc,
-	void* context,
-	int32_t srcW,
-	int32_t srcH,
-	int32_t dstW,
-	int32_t dstH,
-	uint8_t *data,
-	int32_t quality
-) {
-	/* Get an RGB24 surface at the specified width/height */
-	SDL_Surface *surface = SDL_CreateRGBSurfaceFrom(
-		data,
-		srcW,
-		srcH,
-		8 * 4,
-		srcW * 4,
-		0x000000FF,
-		0x0000FF00,
-		0x00FF0000,
-		0xFF000000
+/* Resampler */
+
+typedef enum FNA3D_Image_ResampleOutput
+{
+	FNA3D_IMAGE_OUTPUT_PLAIN,
+	FNA3D_IMAGE_OUTPUT_PREMULTIPLIED,
+	FNA3D_IMAGE_OUTPUT_UNPREMULTIPLY
+} FNA3D_Image_ResampleOutput;
+
+/* One RGBA pixel in float, so both passes can keep full precision */
+
+#if defined(FNA3D_IMAGE_SSE2)
+typedef __m128 Float4;
+
+static inline Float4 Float4_Zero(void)
+{
+	return _mm_setzero_ps();
+}
+
+static inline Float4 Float4_Set(float r, float g, float b, float a)
+{
+	return _mm_set_ps(a, b, g, r);
+}
+
+static inline Float4 Float4_Load(const float *mem)
+{
+	return _mm_loadu_ps(mem);
+}
+
+static inline void Float4_Store(float *mem, Float4 v)
+{
+	_mm_storeu_ps(mem, v);
+}
+
+static inline Float4 Float4_FromPixel(const uint8_t *pixel)
+{
+	int32_t packed;
+	const __m128i zero = _mm_setzero_si128();
+	SDL_memcpy(&packed, pixel, sizeof(packed));
+	return _mm_cvtepi32_ps(
+		_mm_unpacklo_epi16(
+			_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero),
+			zero
+		)
 	);
-	SDL_Surface *convertSurface = SDL_CreateRGBSurface(
-		0,
-		dstW,
-		dstH,
-		24,
-		0x000000FF,
-		0x0000FF00,
-		0x00FF0000,
-		0x00000000
+}
+
+static inline void Float4_ToPixel(uint8_t *pixel, Float4 v)
+{
+	/* The packs saturate, so this clamps to 0-255 for free */
+	__m128i i = _mm_cvtps_epi32(v);
+	int32_t packed;
+	i = _mm_packs_epi32(i, i);
+	i = _mm_packus_epi16(i, i);
+	packed = _mm_cvtsi128_si32(i);
+	SDL_memcpy(pixel, &packed, sizeof(packed));
+}
+
+static inline Float4 Float4_MulAdd(Float4 acc, Float4 v, float w)
+{
+	return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(w)));
+}
+
+static inline Float4 Float4_Mul(Float4 a, Float4 b)
+{
+	return _mm_mul_ps(a, b);
+}
+
+static inline Float4 Float4_Min(Float4 a, Float4 b)
+{
+	return _mm_min_ps(a, b);
+}
+
+static inline float Float4_Alpha(Float4 v)
+{
+	return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+}
+
+static inline Float4 Float4_SplatAlpha(Float4 v)
+{
+	return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+}
+#elif defined(FNA3D_IMAGE_NEON)
+typedef float32x4_t Float4;
+
+static inline Float4 Float4_Zero(void)
+{
+	return vdupq_n_f32(0.0f);
+}
+
+static inline Float4 Float4_Set(float r, float g, float b, float a)
+{
+	const float v[4] = { r, g, b, a };
+	return vld1q_f32(v);
+}
+
+static inline Float4 Float4_Load(const float *mem)
+{
+	return vld1q_f32(mem);
+}
+
+static inline void Float4_Store(float *mem, Float4 v)
+{
+	vst1q_f32(mem, v);
+}
+
+static inline Float4 Float4_FromPixel(const uint8_t *pixel)
+{
+	uint32_t packed;
+	SDL_memcpy(&packed, pixel, sizeof(packed));
+	return vcvtq_f32_u32(
+		vmovl_u16(
+			vget_low_u16(
+				vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(packed)))
+			)
+		)
 	);
-	SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
-	SDL_BlitScaled(surface, NULL, convertSurface, NULL);
-	SDL_FreeSurface(surface);
-	surface = convertSurface;
+}
 
-	/* Write the image, finally. */
-	stbi_write_jpg_to_func(
-		writeFunc,
-		context,
-		dstW,
-		dstH,
-		3,
-		surface->pixels,
-		quality
+static inline void Float4_ToPixel(uint8_t *pixel, Float4 v)
+{
+	uint16x4_t narrow;
+	uint32_t packed;
+	v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(255.0f));
+	narrow = vmovn_u32(vcvtq_u32_f32(vaddq_f32(v, vdupq_n_f32(0.5f))));
+	packed = vget_lane_u32(
+		vreinterpret_u32_u8(vmovn_u16(vcombine_u16(narrow, narrow))),
+		0
 	);
+	SDL_memcpy(pixel, &packed, sizeof(packed));
+}
 
-	/* Clean up. We out. */
-	SDL_FreeSurface(surface);
+static inline Float4 Float4_MulAdd(Float4 acc, Float4 v, float w)
+{
+	return vmlaq_n_f32(acc, v, w);
+}
+
+static inline Float4 Float4_Mul(Float4 a, Float4 b)
+{
+	return vmulq_f32(a, b);
+}
+
+static inline Float4 Float4_Min(Float4 a, Float4 b)
+{
+	return vminq_f32(a, b);
+}
+
+static inline float Float4_Alpha(Float4 v)
+{
+	return vgetq_lane_f32(v, 3);
+}
+
+static inline Float4 Float4_SplatAlpha(Float4 v)
+{
+	return vdupq_n_f32(vgetq_lane_f32(v, 3));
+}
+#else
+typedef struct Float4
+{
+	float v[4];
+} Float4;
+
+static inline Float4 Float4_Zero(void)
+{
+	Float4 result = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+	return result;
+}
+
+static inline Float4 Float4_Set(float r, float g, float b, float a)
+{
+	Float4 result = { { r, g, b, a } };
+	return result;
+}
+
+static inline Float4 Float4_Load(const float *mem)
+{
+	Float4 result;
+	SDL_memcpy(result.v, mem, sizeof(result.v));
+	return result;
+}
+
+static inline void Float4_Store(float *mem, Float4 v)
+{
+	SDL_memcpy(mem, v.v, sizeof(v.v));
+}
+
+static inline Float4 Float4_FromPixel(const uint8_t *pixel)
+{
+	Float4 result = { { pixel[0], pixel[1], pixel[2], pixel[3] } };
+	return result;
+}
+
+static inline void Float4_ToPixel(uint8_t *pixel, Float4 v)
+{
+	int32_t i;
+	for (i = 0; i < 4; i += 1)
+	{
+		pixel[i] = (uint8_t) (SDL_max(SDL_min(v.v[i], 255.0f), 0.0f) + 0.5f);
+	}
+}
+
+static inline Float4 Float4_MulAdd(Float4 acc, Float4 v, float w)
+{
+	int32_t i;
+	for (i = 0; i < 4; i += 1)
+	{
+		acc.v[i] += v.v[i] * w;
+	}
+	return acc;
+}
+
+static inline Float4 Float4_Mul(Float4 a, Float4 b)
+{
+	int32_t i;
+	for (i = 0; i < 4; i += 1)
+	{
+		a.v[i] *= b.v[i];
+	}
+	return a;
+}
+
+static inline Float4 Float4_Min(Float4 a, Float4 b)
+{
+	int32_t i;
+	for (i = 0; i < 4; i += 1)
+	{
+		a.v[i] = SDL_min(a.v[i], b.v[i]);
+	}
+	return a;
+}
+
+static inline float Float4_Alpha(Float4 v)
+{
+	return v.v[3];
+}
+
+static inline Float4 Float4_SplatAlpha(Float4 v)
+{
+	return Float4_Set(v.v[3], v.v[3], v.v[3], v.v[3]);
+}
+#endif
+
+/* For each destination texel along one axis, the run of source texels it
+ * reads from and how much each of them contributes.
+ */
+typedef struct FNA3D_Image_Contributors
+{
+	int32_t *first;
+	int32_t *count;
+	float *weights;
+	int32_t maxTaps;
+} FNA3D_Image_Contributors;
+
+typedef struct FNA3D_Image_Resampler
+{
+	const uint8_t *src;
+	int32_t srcPitch;
+	uint8_t *dst;
+	int32_t dstW;
+	int32_t dstPitch;
+	FNA3D_Image_ResampleOutput output;
+	FNA3D_Image_Contributors x;
+	FNA3D_Image_Contributors y;
+	SDL_atomic_t failed;
+} FNA3D_Image_Resampler;
+
+static float FNA3D_INTERNAL_FilterRadius(FNA3D_Image_Filter filter)
+{
+	switch (filter)
+	{
+	case FNA3D_IMAGE_FILTER_BOX:
+		return 0.5f;
+	case FNA3D_IMAGE_FILTER_LANCZOS:
+		return 3.0f;
+	default:
+		return 1.0f;
+	}
+}
+
+static float FNA3D_INTERNAL_FilterWeight(FNA3D_Image_Filter filter, float x)
+{
+	const float pi = 3.14159265358979f;
+	float px;
+
+	x = SDL_fabsf(x);
+	switch (filter)
+	{
+	case FNA3D_IMAGE_FILTER_BOX:
+		return (x <= 0.5f) ? 1.0f : 0.0f;
+	case FNA3D_IMAGE_FILTER_LANCZOS:
+		if (x < 0.00001f)
+		{
+			return 1.0f;
+		}
+		if (x >= 3.0f)
+		{
+			return 0.0f;
+		}
+		px = pi * x;
+		return (3.0f * SDL_sinf(px) * SDL_sinf(px / 3.0f)) / (px * px);
+	default:
+		return (x < 1.0f) ? (1.0f - x) : 0.0f;
+	}
+}
+
+static uint8_t FNA3D_INTERNAL_BuildContributors(
+	FNA3D_Image_Contributors *contributors,
+	int32_t srcLength,
+	int32_t dstLength,
+	FNA3D_Image_Filter filter
+) {
+	float scale = dstLength / (float) srcLength;
+	float filterScale = (scale < 1.0f) ? (1.0f / scale) : 1.0f;
+	float support = FNA3D_INTERNAL_FilterRadius(filter) * filterScale;
+	float center, total;
+	float *weights;
+	int32_t i, j, start, end;
+
+	/* When minifying, the filter is stretched to cover every source texel */
+	contributors->maxTaps = (int32_t) SDL_ceilf(support * 2.0f) + 2;
+	contributors->first = (int32_t*) SDL_malloc(sizeof(int32_t) * dstLength);
+	contributors->count = (int32_t*) SDL_malloc(sizeof(int32_t) * dstLength);
+	contributors->weights = (float*) SDL_malloc(
+		sizeof(float) * dstLength * contributors->maxTaps
+	);
+	if (	contributors->first == NULL ||
+		contributors->count == NULL ||
+		contributors->weights == NULL	)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < dstLength; i += 1)
+	{
+		center = (i + 0.5f) / scale;
+		start = SDL_max((int32_t) SDL_floorf(center - support), 0);
+		end = SDL_min((int32_t) SDL_ceilf(center + support), srcLength);
+		end = SDL_min(end, start + contributors->maxTaps);
+		weights = contributors->weights + (i * contributors->maxTaps);
+
+		total = 0.0f;
+		for (j = start; j < end; j += 1)
+		{
+			weights[j - start] = FNA3D_INTERNAL_FilterWeight(
+				filter,
+				(j + 0.5f - center) / filterScale
+			);
+			total += weights[j - start];
+		}
+
+		if (total == 0.0f)
+		{
+			/* Should not happen, but fall back to nearest if it does */
+			start = SDL_min((int32_t) center, srcLength - 1);
+			end = start + 1;
+			weights[0] = 1.0f;
+		}
+		else
+		{
+			/* Clipped edges would otherwise darken the border */
+			for (j = 0; j < end - start; j += 1)
+			{
+				weights[j] /= total;
+			}
+		}
+
+		contributors->first[i] = start;
+		contributors->count[i] = end - start;
+	}
+	return 1;
+}
+
+static void FNA3D_INTERNAL_FreeContributors(
+	FNA3D_Image_Contributors *contributors
+) {
+	SDL_free(contributors->first);
+	SDL_free(contributors->count);
+	SDL_free(contributors->weights);
+}
+
+static inline void FNA3D_INTERNAL_WritePixel(
+	uint8_t *pixel,
+	Float4 v,
+	FNA3D_Image_ResampleOutput output
+) {
+	float alpha, rounded, scale;
+
+	if (output == FNA3D_IMAGE_OUTPUT_PREMULTIPLIED)
+	{
+		/* Lanczos can overshoot, keep the color valid for its alpha */
+		v = Float4_Min(v, Float4_SplatAlpha(v));
+	}
+	else if (output == FNA3D_IMAGE_OUTPUT_UNPREMULTIPLY)
+	{
+		/* Decide on the alpha that actually gets written, and write
+		 * exactly that. Float4_ToPixel rounds halves to even on SSE2,
+		 * so 0.5 would otherwise come out invisible but not black.
+		 */
+		alpha = Float4_Alpha(v);
+		rounded = SDL_floorf(alpha + 0.5f);
+		if (rounded < 1.0f)
+		{
+			/* Same rule as FNA3D_Image_Load: invisible means black */
+			SDL_memset(pixel, '\0', 4);
+			return;
+		}
+		scale = 255.0f / alpha;
+		v = Float4_Mul(v, Float4_Set(scale, scale, scale, rounded / alpha));
+	}
+	Float4_ToPixel(pixel, v);
+}
+
+static int FNA3D_INTERNAL_ResampleBand(void* data)
+{
+	FNA3D_Image_Band *band = (FNA3D_Image_Band*) data;
+	FNA3D_Image_Resampler *resampler = (FNA3D_Image_Resampler*) band->job;
+	const int32_t rowLength = resampler->dstW * 4;
+	int32_t firstRow, lastRow, x, y, k, taps;
+	const uint8_t *pixel;
+	const float *weights, *column;
+	float *rows, *row;
+	uint8_t *dstRow;
+	Float4 acc;
+
+	/* Each band filters just the source rows it needs horizontally, so
+	 * the bands never have to wait on one another.
+	 */
+	firstRow = resampler->y.first[band->start];
+	lastRow = firstRow;
+	for (y = band->start; y < band->end; y += 1)
+	{
+		lastRow = SDL_max(
+			lastRow,
+			resampler->y.first[y] + resampler->y.count[y]
+		);
+	}
+	rows = (float*) SDL_malloc(
+		sizeof(float) * rowLength * (lastRow - firstRow)
+	);
+	if (rows == NULL)
+	{
+		SDL_AtomicSet(&resampler->failed, 1);
+		return 0;
+	}
+
+	/* Horizontal pass */
+	for (y = firstRow; y < lastRow; y += 1)
+	{
+		row = rows + ((y - firstRow) * rowLength);
+		for (x = 0; x < resampler->dstW; x += 1)
+		{
+			taps = resampler->x.count[x];
+			weights = resampler->x.weights + (x * resampler->x.maxTaps);
+			pixel = (
+				resampler->src +
+				(y * resampler->srcPitch) +
+				(resampler->x.first[x] * 4)
+			);
+
+			acc = Float4_Zero();
+			for (k = 0; k < taps; k += 1, pixel += 4)
+			{
+				acc = Float4_MulAdd(
+					acc,
+					Float4_FromPixel(pixel),
+					weights[k]
+				);
+			}
+			Float4_Store(row + (x * 4), acc);
+		}
+	}
+
+	/* Vertical pass */
+	for (y = band->start; y < band->end; y += 1)
+	{
+		taps = resampler->y.count[y];
+		weights = resampler->y.weights + (y * resampler->y.maxTaps);
+		row = rows + ((resampler->y.first[y] - firstRow) * rowLength);
+		dstRow = resampler->dst + (y * resampler->dstPitch);
+		for (x = 0; x < resampler->dstW; x += 1)
+		{
+			column = row + (x * 4);
+
+			acc = Float4_Zero();
+			for (k = 0; k < taps; k += 1, column += rowLength)
+			{
+				acc = Float4_MulAdd(
+					acc,
+					Float4_Load(column),
+					weights[k]
+				);
+			}
+			FNA3D_INTERNAL_WritePixel(
+				dstRow + (x * 4),
+				acc,
+				resampler->output
+			);
+		}
+	}
+
+	SDL_free(rows);
+	return 0;
+}
+
+static uint8_t FNA3D_INTERNAL_Resample(
+	const uint8_t *src,
+	int32_t srcW,
+	int32_t srcH,
+	int32_t srcPitch,
+	uint8_t *dst,
+	int32_t dstW,
+	int32_t dstH,
+	int32_t dstPitch,
+	FNA3D_Image_Filter filter,
+	FNA3D_Image_ResampleOutput output
+) {
+	FNA3D_Image_Resampler resampler;
+	int32_t bandCount = 1;
+	uint8_t built;
+
+	resampler.src = src;
+	resampler.srcPitch = srcPitch;
+	resampler.dst = dst;
+	resampler.dstW = dstW;
+	resampler.dstPitch = dstPitch;
+	resampler.output = output;
+	SDL_AtomicSet(&resampler.failed, 0);
+
+	/* Both always allocate, so both can always be freed */
+	built = FNA3D_INTERNAL_BuildContributors(&resampler.x, srcW, dstW, filter);
+	built &= FNA3D_INTERNAL_BuildContributors(&resampler.y, srcH, dstH, filter);
+	if (!built)
+	{
+		FNA3D_INTERNAL_FreeContributors(&resampler.x);
+		FNA3D_INTERNAL_FreeContributors(&resampler.y);
+		return 0;
+	}
+
+	/* Small images aren't worth the thread startup */
+	if (dstW * dstH >= 256 * 256)
+	{
+		bandCount = SDL_min(SDL_GetCPUCount(), dstH / 64);
+	}
+	FNA3D_INTERNAL_RunBands(
+		FNA3D_INTERNAL_ResampleBand,
+		&resampler,
+		dstH,
+		bandCount
+	);
+
+	FNA3D_INTERNAL_FreeContributors(&resampler.x);
+	FNA3D_INTERNAL_FreeContributors(&resampler.y);
+	return !SDL_AtomicGet(&resampler.failed);
+}
+
+uint8_t FNA3D_Image_Info(
+	FNA3D_Image_ReadFunc readFunc,
+	FNA3D_Image_SkipFunc skipFunc,
+	FNA3D_Image_EOFFunc eofFunc,
+	void* context,
+	int32_t *w,
+	int32_t *h,
+	int32_t forceW,
+	int32_t forceH,
+	uint8_t zoom
+) {
+	int32_t srcW, srcH, format;
+	SDL_Rect crop;
+	stbi_io_callbacks cb;
+
+	cb.read = readFunc;
+	cb.skip = skipFunc;
+	cb.eof = eofFunc;
+	if (!stbi_info_from_callbacks(&cb, context, &srcW, &srcH, &format))
+	{
+		return 0;
+	}
+
+	if (forceW != -1 && forceH != -1)
+	{
+		FNA3D_INTERNAL_ScaleDimensions(
+			srcW,
+			srcH,
+			forceW,
+			forceH,
+			zoom,
+			w,
+			h,
+			&crop
+		);
+	}
+	else
+	{
+		*w = srcW;
+		*h = srcH;
+	}
+	return 1;
+}
+
+uint8_t* FNA3D_Image_Load(
+	FNA3D_Image_ReadFunc readFunc,
+	FNA3D_Image_SkipFunc skipFunc,
+	FNA3D_Image_EOFFunc eofFunc,
+	void* context,
+	int32_t *w,
+	int32_t *h,
+	int32_t *len,
+	int32_t forceW,
+	int32_t forceH,
+	uint8_t zoom
+) {
+	uint8_t *result, *scaled;
+	int32_t srcW, srcH, format;
+	SDL_Rect crop;
+	stbi_io_callbacks cb;
+
+	cb.read = readFunc;
+	cb.skip = skipFunc;
+	cb.eof = eofFunc;
+	result = stbi_load_from_callbacks(
+		&cb,
+		context,
+		w,
+		h,
+		&format,
+		STBI_rgb_alpha
+	);
+	if (result == NULL)
+	{
+		*w = 0;
+		*h = 0;
+		*len = 0;
+		return NULL;
+	}
+
+	if (forceW != -1 && forceH != -1)
+	{
+		srcW = *w;
+		srcH = *h;
+		FNA3D_INTERNAL_ScaleDimensions(
+			srcW,
+			srcH,
+			forceW,
+			forceH,
+			zoom,
+			w,
+			h,
+			&crop
+		);
+
+		/* Filter in premultiplied space so that the invisible colors
+		 * don't bleed into the edges, then go back to straight alpha.
+		 * This also takes care of the alpha clearing below.
+		 */
+		FNA3D_INTERNAL_ProcessAlpha(result, result, srcW * srcH, 1);
+		scaled = (uint8_t*) SDL_malloc((*w) * (*h) * 4);
+		if (	scaled == NULL ||
+			!FNA3D_INTERNAL_Resample(
+				result + (crop.y * srcW * 4) + (crop.x * 4),
+				crop.w,
+				crop.h,
+				srcW * 4,
+				scaled,
+				*w,
+				*h,
+				(*w) * 4,
+				FNA3D_IMAGE_FILTER_BILINEAR,
+				FNA3D_IMAGE_OUTPUT_UNPREMULTIPLY
+			)	)
+		{
+			SDL_free(scaled);
+			SDL_free(result);
+			*w = 0;
+			*h = 0;
+			*len = 0;
+			return NULL;
+		}
+		SDL_free(result);
+
+		*len = (*w) * (*h) * 4;
+		return scaled;
+	}
+
+	/* Ensure that the alpha pixels are... well, actual alpha.
+	 * You think this looks stupid, but be assured: Your paint program is
+	 * almost certainly even stupider.
+	 * -flibit
+	 */
+	*len = (*w) * (*h) * 4;
+	FNA3D_INTERNAL_ProcessAlpha(result, result, (*w) * (*h), 0);
+
+	return result;
+}
+
+uint8_t FNA3D_Image_LoadInto(
+	FNA3D_Image_ReadFunc readFunc,
+	FNA3D_Image_SkipFunc skipFunc,
+	FNA3D_Image_EOFFunc eofFunc,
+	void* context,
+	int32_t *w,
+	int32_t *h,
+	int32_t forceW,
+	int32_t forceH,
+	uint8_t zoom,
+	uint8_t premultiply,
+	uint8_t *dst,
+	int32_t dstPitch,
+	int32_t dstLength
+) {
+	uint8_t *result;
+	int32_t srcW, srcH, format, row;
+	SDL_Rect crop;
+	stbi_io_callbacks cb;
+	uint8_t scale = (forceW != -1 && forceH != -1);
+
+	cb.read = readFunc;
+	cb.skip = skipFunc;
+	cb.eof = eofFunc;
+	result = stbi_load_from_callbacks(
+		&cb,
+		context,
+		&srcW,
+		&srcH,
+		&format,
+		STBI_rgb_alpha
+	);
+	if (result == NULL)
+	{
+		return 0;
+	}
+
+	if (scale)
+	{
+		FNA3D_INTERNAL_ScaleDimensions(
+			srcW,
+			srcH,
+			forceW,
+			forceH,
+			zoom,
+			w,
+			h,
+			&crop
+		);
+	}
+	else
+	{
+		*w = srcW;
+		*h = srcH;
+	}
+
+	/* The caller sized dst with FNA3D_Image_Info, make sure it still fits */
+	if (	(*w) * 4 > dstPitch ||
+		(int64_t) dstPitch * (*h - 1) + (*w) * 4 > dstLength	)
+	{
+		SDL_free(result);
+		return 0;
+	}
+
+	if (scale)
+	{
+		/* Filter in premultiplied space, see FNA3D_Image_Load */
+		FNA3D_INTERNAL_ProcessAlpha(result, result, srcW * srcH, 1);
+		if (!FNA3D_INTERNAL_Resample(
+			result + (crop.y * srcW * 4) + (crop.x * 4),
+			crop.w,
+			crop.h,
+			srcW * 4,
+			dst,
+			*w,
+			*h,
+			dstPitch,
+			FNA3D_IMAGE_FILTER_BILINEAR,
+			premultiply ?
+				FNA3D_IMAGE_OUTPUT_PREMULTIPLIED :
+				FNA3D_IMAGE_OUTPUT_UNPREMULTIPLY
+		)) {
+			SDL_free(result);
+			return 0;
+		}
+	}
+	else
+	{
+		for (row = 0; row < *h; row += 1)
+		{
+			FNA3D_INTERNAL_ProcessAlpha(
+				dst + (row * dstPitch),
+				result + (row * srcW * 4),
+				srcW,
+				premultiply
+			);
+		}
+	}
+
+	SDL_free(result);
+	return 1;
+}
+
+typedef struct FNA3D_Image_Batch
+{
+	FNA3D_Image_LoadRequest *requests;
+	int32_t count;
+	SDL_atomic_t next;
+	FNA3D_Image_LoadCallback callback;
+	void* userdata;
+} FNA3D_Image_Batch;
+
+static int FNA3D_INTERNAL_LoadBatchThread(void* data)
+{
+	FNA3D_Image_Batch *batch = (FNA3D_Image_Batch*) data;
+	FNA3D_Image_LoadRequest *request;
+	int32_t i;
+
+	/* stb_image keeps no shared decoder state, so each worker just grabs
+	 * the next request until there are none left. Every core already has a
+	 * worker, so the resampler shouldn't start threads of its own.
+	 */
+	SDL_TLSSet(batchWorkerTLS, batch, NULL);
+	while ((i = SDL_AtomicAdd(&batch->next, 1)) < batch->count)
+	{
+		request = &batch->requests[i];
+		request->pixels = FNA3D_Image_Load(
+			request->readFunc,
+			request->skipFunc,
+			request->eofFunc,
+			request->context,
+			&request->w,
+			&request->h,
+			&request->len,
+			request->forceW,
+			request->forceH,
+			request->zoom
+		);
+		if (batch->callback != NULL)
+		{
+			batch->callback(batch->userdata, request);
+		}
+	}
+	SDL_TLSSet(batchWorkerTLS, NULL, NULL);
+	return 0;
+}
+
+void FNA3D_Image_LoadBatch(
+	FNA3D_Image_LoadRequest *requests,
+	int32_t count,
+	int32_t threadCount,
+	FNA3D_Image_LoadCallback callback,
+	void* userdata
+) {
+	FNA3D_Image_Batch batch;
+	SDL_Thread **threads;
+	char threadName[32];
+	int32_t i;
+
+	if (count <= 0)
+	{
+		return;
+	}
+	if (threadCount <= 0)
+	{
+		threadCount = SDL_GetCPUCount();
+	}
+	threadCount = SDL_max(SDL_min(threadCount, count), 1);
+
+	batch.requests = requests;
+	batch.count = count;
+	SDL_AtomicSet(&batch.next, 0);
+	batch.callback = callback;
+	batch.userdata = userdata;
+
+	SDL_AtomicLock(&batchWorkerLock);
+	if (batchWorkerTLS == 0)
+	{
+		batchWorkerTLS = SDL_TLSCreate();
+	}
+	SDL_AtomicUnlock(&batchWorkerLock);
+
+	/* The calling thread is one of the workers */
+	threads = (SDL_Thread**) SDL_malloc(
+		sizeof(SDL_Thread*) * threadCount
+	);
+	if (threads == NULL)
+	{
+		/* No helpers, the calling thread decodes the whole batch */
+		FNA3D_INTERNAL_LoadBatchThread(&batch);
+		return;
+	}
+	for (i = 1; i < threadCount; i += 1)
+	{
+		SDL_snprintf(threadName, sizeof(threadName), "FNA3D Image %d", i);
+		threads[i] = SDL_CreateThread(
+			FNA3D_INTERNAL_LoadBatchThread,
+			threadName,
+			&batch
+		);
+	}
+	FNA3D_INTERNAL_LoadBatchThread(&batch);
+	for (i = 1; i < threadCount; i += 1)
+	{
+		/* If creation failed this is NULL, which is fine */
+		SDL_WaitThread(threads[i], NULL);
+	}
+	SDL_free(threads);
+}
+
+void FNA3D_Image_Free(uint8_t *mem)
+{
+	SDL_free(mem);
+}
+
+/* Image Mipmap API */
+
+int32_t FNA3D_Image_GenerateMipChain(
+	uint8_t *data,
+	int32_t dataLength,
+	int32_t w,
+	int32_t h,
+	int32_t levelCount,
+	FNA3D_Image_Filter filter
+) {
+	uint8_t *src = data;
+	int32_t srcW = w, srcH = h;
+	int32_t dstW, dstH, level;
+	int64_t offset = (int64_t) w * h * 4;
+
+	if (levelCount <= 0)
+	{
+		levelCount = INT32_MAX;
+	}
+
+	/* Each level is filtered from the one before it, which is both much
+	 * cheaper and what a GPU would do.
+	 */
+	for (level = 1; level < levelCount && (srcW > 1 || srcH > 1); level += 1)
+	{
+		dstW = SDL_max(srcW >> 1, 1);
+		dstH = SDL_max(srcH >> 1, 1);
+		if (offset + (dstW * dstH * 4) > dataLength)
+		{
+			break;
+		}
+
+		if (!FNA3D_INTERNAL_Resample(
+			src,
+			srcW,
+			srcH,
+			srcW * 4,
+			data + offset,
+			dstW,
+			dstH,
+			dstW * 4,
+			filter,
+			FNA3D_IMAGE_OUTPUT_PLAIN
+		)) {
+			break;
+		}
+
+		src = data + offset;
+		srcW = dstW;
+		srcH = dstH;
+		offset += dstW * dstH * 4;
+	}
+	return level;
+}
+
+/* Image Container API */
+
+#define DDS_MAGIC			0x20534444
+#define DDS_HEADERSIZE			128
+#define DDS_DX10HEADERSIZE		20
+#define DDSD_MIPMAPCOUNT		0x00020000
+#define DDPF_ALPHAPIXELS		0x00000001
+#define DDPF_ALPHA			0x00000002
+#define DDPF_FOURCC			0x00000004
+#define DDPF_RGB			0x00000040
+#define DDSCAPS2_CUBEMAP		0x00000200
+#define DDSCAPS2_CUBEMAP_ALLFACES	0x0000FC00
+#define DDSCAPS2_VOLUME			0x00200000
+#define DDS_DIMENSION_TEXTURE2D		3
+#define DDS_MISC_TEXTURECUBE		0x00000004
+
+#define KTX_HEADERSIZE			64
+#define KTX_ENDIANNESS			0x04030201
+
+/* Same as the largest texture any FNA3D driver will create */
+#define CONTAINER_MAX_DIMENSION		16384
+
+#define FOURCC(a, b, c, d) ( \
+	((uint32_t) (a)) | \
+	((uint32_t) (b) << 8) | \
+	((uint32_t) (c) << 16) | \
+	((uint32_t) (d) << 24) \
+)
+
+static const uint8_t KTX_Identifier[12] =
+{
+	0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+static inline uint32_t FNA3D_INTERNAL_ReadUInt32(const uint8_t *mem)
+{
+	uint32_t result;
+	SDL_memcpy(&result, mem, sizeof(result));
+	return SDL_SwapLE32(result);
+}
+
+static int64_t FNA3D_INTERNAL_LevelSize(
+	int32_t format,
+	int32_t width,
+	int32_t height
+) {
+	/* Headers are untrusted, these can't be allowed to wrap around */
+	int64_t w = width;
+	int64_t h = height;
+
+	switch (format)
+	{
+	case FNA3D_SURFACEFORMAT_DXT1:
+		return ((w + 3) / 4) * ((h + 3) / 4) * 8;
+	case FNA3D_SURFACEFORMAT_DXT3:
+	case FNA3D_SURFACEFORMAT_DXT5:
+		return ((w + 3) / 4) * ((h + 3) / 4) * 16;
+	case FNA3D_SURFACEFORMAT_BGR565:
+	case FNA3D_SURFACEFORMAT_BGRA5551:
+	case FNA3D_SURFACEFORMAT_BGRA4444:
+		return w * h * 2;
+	case FNA3D_SURFACEFORMAT_ALPHA8:
+		return w * h;
+	default:
+		return w * h * 4;
+	}
+}
+
+/* Levels past 1x1 don't exist, no matter what the header says */
+static int32_t FNA3D_INTERNAL_MaxLevelCount(int32_t width, int32_t height)
+{
+	int32_t size = SDL_max(width, height);
+	int32_t result = 1;
+	while (size > 1)
+	{
+		size >>= 1;
+		result += 1;
+	}
+	return result;
+}
+
+static int32_t FNA3D_INTERNAL_DDSFormat(const uint8_t *pixelFormat)
+{
+	uint32_t flags = FNA3D_INTERNAL_ReadUInt32(pixelFormat + 4);
+	uint32_t fourCC = FNA3D_INTERNAL_ReadUInt32(pixelFormat + 8);
+	uint32_t bitCount = FNA3D_INTERNAL_ReadUInt32(pixelFormat + 12);
+	uint32_t rMask = FNA3D_INTERNAL_ReadUInt32(pixelFormat + 16);
+	uint32_t aMask = FNA3D_INTERNAL_ReadUInt32(pixelFormat + 28);
+
+	if (flags & DDPF_FOURCC)
+	{
+		switch (fourCC)
+		{
+		case FOURCC('D', 'X', 'T', '1'):
+			return FNA3D_SURFACEFORMAT_DXT1;
+		case FOURCC('D', 'X', 'T', '3'):
+			return FNA3D_SURFACEFORMAT_DXT3;
+		case FOURCC('D', 'X', 'T', '5'):
+			return FNA3D_SURFACEFORMAT_DXT5;
+		default:
+			return -1;
+		}
+	}
+	if ((flags & DDPF_ALPHA) && bitCount == 8 && aMask == 0xFF)
+	{
+		return FNA3D_SURFACEFORMAT_ALPHA8;
+	}
+	if (flags & DDPF_RGB)
+	{
+		if (bitCount == 32 && (flags & DDPF_ALPHAPIXELS))
+		{
+			if (rMask == 0x000000FF && aMask == 0xFF000000)
+			{
+				return FNA3D_SURFACEFORMAT_COLOR;
+			}
+			if (rMask == 0x00FF0000 && aMask == 0xFF000000)
+			{
+				return FNA3D_SURFACEFORMAT_COLORBGRA_EXT;
+			}
+		}
+		else if (bitCount == 16)
+		{
+			if (rMask == 0xF800 && !(flags & DDPF_ALPHAPIXELS))
+			{
+				return FNA3D_SURFACEFORMAT_BGR565;
+			}
+			if (rMask == 0x7C00 && aMask == 0x8000)
+			{
+				return FNA3D_SURFACEFORMAT_BGRA5551;
+			}
+			if (rMask == 0x0F00 && aMask == 0xF000)
+			{
+				return FNA3D_SURFACEFORMAT_BGRA4444;
+			}
+		}
+	}
+	return -1;
+}
+
+static int32_t FNA3D_INTERNAL_DXGIFormat(uint32_t dxgiFormat)
+{
+	switch (dxgiFormat)
+	{
+	case 28: /* DXGI_FORMAT_R8G8B8A8_UNORM */
+	case 29: /* DXGI_FORMAT_R8G8B8A8_UNORM_SRGB */
+		return FNA3D_SURFACEFORMAT_COLOR;
+	case 65: /* DXGI_FORMAT_A8_UNORM */
+		return FNA3D_SURFACEFORMAT_ALPHA8;
+	case 71: /* DXGI_FORMAT_BC1_UNORM */
+	case 72: /* DXGI_FORMAT_BC1_UNORM_SRGB */
+		return FNA3D_SURFACEFORMAT_DXT1;
+	case 74: /* DXGI_FORMAT_BC2_UNORM */
+	case 75: /* DXGI_FORMAT_BC2_UNORM_SRGB */
+		return FNA3D_SURFACEFORMAT_DXT3;
+	case 77: /* DXGI_FORMAT_BC3_UNORM */
+	case 78: /* DXGI_FORMAT_BC3_UNORM_SRGB */
+		return FNA3D_SURFACEFORMAT_DXT5;
+	case 85: /* DXGI_FORMAT_B5G6R5_UNORM */
+		return FNA3D_SURFACEFORMAT_BGR565;
+	case 86: /* DXGI_FORMAT_B5G5R5A1_UNORM */
+		return FNA3D_SURFACEFORMAT_BGRA5551;
+	case 87: /* DXGI_FORMAT_B8G8R8A8_UNORM */
+	case 91: /* DXGI_FORMAT_B8G8R8A8_UNORM_SRGB */
+		return FNA3D_SURFACEFORMAT_COLORBGRA_EXT;
+	case 115: /* DXGI_FORMAT_B4G4R4A4_UNORM */
+		return FNA3D_SURFACEFORMAT_BGRA4444;
+	default:
+		return -1;
+	}
+}
+
+static int32_t FNA3D_INTERNAL_KTXFormat(
+	uint32_t glType,
+	uint32_t glFormat,
+	uint32_t glInternalFormat
+) {
+	if (glType == 0)
+	{
+		switch (glInternalFormat)
+		{
+		case 0x83F0: /* GL_COMPRESSED_RGB_S3TC_DXT1_EXT */
+		case 0x83F1: /* GL_COMPRESSED_RGBA_S3TC_DXT1_EXT */
+			return FNA3D_SURFACEFORMAT_DXT1;
+		case 0x83F2: /* GL_COMPRESSED_RGBA_S3TC_DXT3_EXT */
+			return FNA3D_SURFACEFORMAT_DXT3;
+		case 0x83F3: /* GL_COMPRESSED_RGBA_S3TC_DXT5_EXT */
+			return FNA3D_SURFACEFORMAT_DXT5;
+		default:
+			return -1;
+		}
+	}
+
+	/* Same pairs the OpenGL driver uploads each format with */
+	if (glType == 0x1401) /* GL_UNSIGNED_BYTE */
+	{
+		switch (glFormat)
+		{
+		case 0x1908: /* GL_RGBA */
+			return FNA3D_SURFACEFORMAT_COLOR;
+		case 0x80E1: /* GL_BGRA */
+			return FNA3D_SURFACEFORMAT_COLORBGRA_EXT;
+		case 0x1906: /* GL_ALPHA */
+			return FNA3D_SURFACEFORMAT_ALPHA8;
+		default:
+			return -1;
+		}
+	}
+	if (glType == 0x8363 && glFormat == 0x1907) /* 5_6_5, GL_RGB */
+	{
+		return FNA3D_SURFACEFORMAT_BGR565;
+	}
+	if (glType == 0x8366 && glFormat == 0x80E1) /* 1_5_5_5_REV, GL_BGRA */
+	{
+		return FNA3D_SURFACEFORMAT_BGRA5551;
+	}
+	if (glType == 0x8365 && glFormat == 0x80E1) /* 4_4_4_4_REV, GL_BGRA */
+	{
+		return FNA3D_SURFACEFORMAT_BGRA4444;
+	}
+	return -1;
+}
+
+/* Returns 0 if the level doesn't fit in what's left of the file */
+static uint8_t FNA3D_INTERNAL_SetLevel(
+	FNA3D_Image_Texture *texture,
+	int32_t face,
+	int32_t level,
+	uint8_t *data,
+	int32_t dataLength,
+	int64_t offset
+) {
+	FNA3D_Image_Level *result = &texture->levels[face][level];
+	int32_t width = SDL_max(texture->width >> level, 1);
+	int32_t height = SDL_max(texture->height >> level, 1);
+	int64_t size = FNA3D_INTERNAL_LevelSize(texture->format, width, height);
+
+	if (offset < 0 || offset > dataLength || size > dataLength - offset)
+	{
+		return 0;
+	}
+	result->data = data + offset;
+	result->dataLength = (int32_t) size;
+	result->width = width;
+	result->height = height;
+	return 1;
+}
+
+static uint8_t FNA3D_INTERNAL_CheckContainer(FNA3D_Image_Texture *texture)
+{
+	if (	texture->format == -1 ||
+		texture->width <= 0 ||
+		texture->height <= 0 ||
+		texture->width > CONTAINER_MAX_DIMENSION ||
+		texture->height > CONTAINER_MAX_DIMENSION	)
+	{
+		return 0;
+	}
+	texture->levelCount = SDL_min(
+		texture->levelCount,
+		FNA3D_INTERNAL_MaxLevelCount(texture->width, texture->height)
+	);
+	return 1;
+}
+
+uint8_t FNA3D_Image_LoadDDS(
+	uint8_t *data,
+	int32_t dataLength,
+	FNA3D_Image_Texture *texture
+) {
+	uint32_t flags, caps2, levelCount;
+	int64_t offset = DDS_HEADERSIZE;
+	int32_t face, level;
+
+	SDL_zerop(texture);
+	if (	dataLength < DDS_HEADERSIZE ||
+		FNA3D_INTERNAL_ReadUInt32(data) != DDS_MAGIC ||
+		FNA3D_INTERNAL_ReadUInt32(data + 4) != 124	)
+	{
+		return 0;
+	}
+
+	flags = FNA3D_INTERNAL_ReadUInt32(data + 8);
+	texture->height = (int32_t) FNA3D_INTERNAL_ReadUInt32(data + 12);
+	texture->width = (int32_t) FNA3D_INTERNAL_ReadUInt32(data + 16);
+	levelCount = FNA3D_INTERNAL_ReadUInt32(data + 28);
+	caps2 = FNA3D_INTERNAL_ReadUInt32(data + 112);
+
+	if (FNA3D_INTERNAL_ReadUInt32(data + 84) == FOURCC('D', 'X', '1', '0'))
+	{
+		offset += DDS_DX10HEADERSIZE;
+		if (	dataLength < offset ||
+			FNA3D_INTERNAL_ReadUInt32(data + 132) != DDS_DIMENSION_TEXTURE2D ||
+			FNA3D_INTERNAL_ReadUInt32(data + 140) != 1	)
+		{
+			return 0;
+		}
+		texture->format = FNA3D_INTERNAL_DXGIFormat(
+			FNA3D_INTERNAL_ReadUInt32(data + 128)
+		);
+		if (FNA3D_INTERNAL_ReadUInt32(data + 136) & DDS_MISC_TEXTURECUBE)
+		{
+			caps2 |= DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_ALLFACES;
+		}
+	}
+	else
+	{
+		texture->format = FNA3D_INTERNAL_DDSFormat(data + 76);
+	}
+
+	texture->faceCount = (caps2 & DDSCAPS2_CUBEMAP) ? 6 : 1;
+	if (flags & DDSD_MIPMAPCOUNT)
+	{
+		texture->levelCount = (int32_t) SDL_min(
+			SDL_max(levelCount, 1),
+			FNA3D_IMAGE_MAX_LEVELS
+		);
+	}
+	else
+	{
+		texture->levelCount = 1;
+	}
+
+	/* No volumes or partial cubes, XNA can't make those either */
+	if (	!FNA3D_INTERNAL_CheckContainer(texture) ||
+		(caps2 & DDSCAPS2_VOLUME) ||
+		(	(caps2 & DDSCAPS2_CUBEMAP) &&
+			(caps2 & DDSCAPS2_CUBEMAP_ALLFACES) != DDSCAPS2_CUBEMAP_ALLFACES	)	)
+	{
+		SDL_zerop(texture);
+		return 0;
+	}
+
+	/* Each face is stored with all of its levels before the next face */
+	for (face = 0; face < texture->faceCount; face += 1)
+	{
+		for (level = 0; level < texture->levelCount; level += 1)
+		{
+			if (!FNA3D_INTERNAL_SetLevel(
+				texture,
+				face,
+				level,
+				data,
+				dataLength,
+				offset
+			)) {
+				SDL_zerop(texture);
+				return 0;
+			}
+			offset += texture->levels[face][level].dataLength;
+		}
+	}
+	return 1;
+}
+
+uint8_t FNA3D_Image_LoadKTX(
+	uint8_t *data,
+	int32_t dataLength,
+	FNA3D_Image_Texture *texture
+) {
+	uint32_t depth, arrayCount, imageSize;
+	int64_t offset = KTX_HEADERSIZE;
+	int32_t face, level;
+
+	SDL_zerop(texture);
+	if (	dataLength < KTX_HEADERSIZE ||
+		SDL_memcmp(data, KTX_Identifier, sizeof(KTX_Identifier)) != 0 ||
+		FNA3D_INTERNAL_ReadUInt32(data + 12) != KTX_ENDIANNESS	)
+	{
+		/* Big endian files would need every texel swapped, not zero-copy */
+		return 0;
+	}
+
+	texture->format = FNA3D_INTERNAL_KTXFormat(
+		FNA3D_INTERNAL_ReadUInt32(data + 16),
+		FNA3D_INTERNAL_ReadUInt32(data + 24),
+		FNA3D_INTERNAL_ReadUInt32(data + 28)
+	);
+	texture->width = (int32_t) FNA3D_INTERNAL_ReadUInt32(data + 36);
+	texture->height = SDL_max((int32_t) FNA3D_INTERNAL_ReadUInt32(data + 40), 1);
+	depth = FNA3D_INTERNAL_ReadUInt32(data + 44);
+	arrayCount = FNA3D_INTERNAL_ReadUInt32(data + 48);
+	texture->faceCount = (int32_t) FNA3D_INTERNAL_ReadUInt32(data + 52);
+	texture->levelCount = SDL_max((int32_t) FNA3D_INTERNAL_ReadUInt32(data + 56), 1);
+	texture->levelCount = SDL_min(texture->levelCount, FNA3D_IMAGE_MAX_LEVELS);
+	offset += FNA3D_INTERNAL_ReadUInt32(data + 60);
+
+	if (	!FNA3D_INTERNAL_CheckContainer(texture) ||
+		depth > 1 ||
+		arrayCount > 0 ||
+		(texture->faceCount != 1 && texture->faceCount != 6)	)
+	{
+		SDL_zerop(texture);
+		return 0;
+	}
+
+	/* Levels come first here, each face padded to 4 bytes within them */
+	for (level = 0; level < texture->levelCount; level += 1)
+	{
+		if (offset + 4 > dataLength)
+		{
+			SDL_zerop(texture);
+			return 0;
+		}
+		imageSize = FNA3D_INTERNAL_ReadUInt32(data + offset);
+		offset += 4;
+
+		for (face = 0; face < texture->faceCount; face += 1)
+		{
+			/* Uploads need tight rows, but KTX pads them to 4 bytes.
+			 * For cube maps imageSize is per face, so this works for
+			 * both layouts.
+			 */
+			if (	!FNA3D_INTERNAL_SetLevel(
+					texture,
+					face,
+					level,
+					data,
+					dataLength,
+					offset
+				) ||
+				imageSize != (uint32_t) texture->levels[face][level].dataLength	)
+			{
+				SDL_zerop(texture);
+				return 0;
+			}
+			offset += ((int64_t) imageSize + 3) & ~3;
+		}
+	}
+	return 1;
+}
+
+#undef FOURCC
+
+/* Image Compression API */
+
+typedef struct FNA3D_Image_Compressor
+{
+	const uint8_t *src;
+	int32_t w;
+	int32_t h;
+	uint8_t *dst;
+	int32_t format;
+	int32_t blocksWide;
+} FNA3D_Image_Compressor;
+
+/* Picks the closest palette entry for each of the 16 texels, returning the
+ * packed 2-bit indices and writing the total squared error.
+ */
+static uint32_t FNA3D_INTERNAL_PickIndices(
+	const int16_t *r,
+	const int16_t *g,
+	const int16_t *b,
+	int16_t palette[4][3],
+	int32_t paletteCount,
+	int32_t *error
+) {
+	int32_t indices[16];
+	int32_t errors[16];
+	uint32_t result = 0;
+	int32_t i, k;
+
+#if defined(FNA3D_IMAGE_SSE2)
+	__m128i rs, gs, bs, dr, dg, db, lo, hi, mask;
+	__m128i bestLo, bestHi, indexLo, indexHi, index;
+	const __m128i zero = _mm_setzero_si128();
+
+	for (i = 0; i < 16; i += 8)
+	{
+		rs = _mm_loadu_si128((const __m128i*) (r + i));
+		gs = _mm_loadu_si128((const __m128i*) (g + i));
+		bs = _mm_loadu_si128((const __m128i*) (b + i));
+		bestLo = _mm_set1_epi32(INT32_MAX);
+		bestHi = bestLo;
+		indexLo = zero;
+		indexHi = zero;
+
+		for (k = 0; k < paletteCount; k += 1)
+		{
+			dr = _mm_sub_epi16(rs, _mm_set1_epi16(palette[k][0]));
+			dg = _mm_sub_epi16(gs, _mm_set1_epi16(palette[k][1]));
+			db = _mm_sub_epi16(bs, _mm_set1_epi16(palette[k][2]));
+
+			/* Interleaving lets madd square and sum in 32-bit */
+			lo = _mm_add_epi32(
+				_mm_madd_epi16(
+					_mm_unpacklo_epi16(dr, dg),
+					_mm_unpacklo_epi16(dr, dg)
+				),
+				_mm_madd_epi16(
+					_mm_unpacklo_epi16(db, zero),
+					_mm_unpacklo_epi16(db, zero)
+				)
+			);
+			hi = _mm_add_epi32(
+				_mm_madd_epi16(
+					_mm_unpackhi_epi16(dr, dg),
+					_mm_unpackhi_epi16(dr, dg)
+				),
+				_mm_madd_epi16(
+					_mm_unpackhi_epi16(db, zero),
+					_mm_unpackhi_epi16(db, zero)
+				)
+			);
+
+			index = _mm_set1_epi32(k);
+			mask = _mm_cmplt_epi32(lo, bestLo);
+			bestLo = _mm_or_si128(
+				_mm_and_si128(mask, lo),
+				_mm_andnot_si128(mask, bestLo)
+			);
+			indexLo = _mm_or_si128(
+				_mm_and_si128(mask, index),
+				_mm_andnot_si128(mask, indexLo)
+			);
+			mask = _mm_cmplt_epi32(hi, bestHi);
+			bestHi = _mm_or_si128(
+				_mm_and_si128(mask, hi),
+				_mm_andnot_si128(mask, bestHi)
+			);
+			indexHi = _mm_or_si128(
+				_mm_and_si128(mask, index),
+				_mm_andnot_si128(mask, indexHi)
+			);
+		}
+
+		_mm_storeu_si128((__m128i*) (indices + i), indexLo);
+		_mm_storeu_si128((__m128i*) (indices + i + 4), indexHi);
+		_mm_storeu_si128((__m128i*) (errors + i), bestLo);
+		_mm_storeu_si128((__m128i*) (errors + i + 4), bestHi);
+	}
+#elif defined(FNA3D_IMAGE_NEON)
+	int16x8_t rs, gs, bs, dr, dg, db;
+	int32x4_t lo, hi, bestLo, bestHi, indexLo, indexHi, index;
+	uint32x4_t mask;
+
+	for (i = 0; i < 16; i += 8)
+	{
+		rs = vld1q_s16(r + i);
+		gs = vld1q_s16(g + i);
+		bs = vld1q_s16(b + i);
+		bestLo = vdupq_n_s32(INT32_MAX);
+		bestHi = bestLo;
+		indexLo = vdupq_n_s32(0);
+		indexHi = indexLo;
+
+		for (k = 0; k < paletteCount; k += 1)
+		{
+			dr = vsubq_s16(rs, vdupq_n_s16(palette[k][0]));
+			dg = vsubq_s16(gs, vdupq_n_s16(palette[k][1]));
+			db = vsubq_s16(bs, vdupq_n_s16(palette[k][2]));
+
+			lo = vmull_s16(vget_low_s16(dr), vget_low_s16(dr));
+			lo = vmlal_s16(lo, vget_low_s16(dg), vget_low_s16(dg));
+			lo = vmlal_s16(lo, vget_low_s16(db), vget_low_s16(db));
+			hi = vmull_s16(vget_high_s16(dr), vget_high_s16(dr));
+			hi = vmlal_s16(hi, vget_high_s16(dg), vget_high_s16(dg));
+			hi = vmlal_s16(hi, vget_high_s16(db), vget_high_s16(db));
+
+			index = vdupq_n_s32(k);
+			mask = vcltq_s32(lo, bestLo);
+			bestLo = vbslq_s32(mask, lo, bestLo);
+			indexLo = vbslq_s32(mask, index, indexLo);
+			mask = vcltq_s32(hi, bestHi);
+			bestHi = vbslq_s32(mask, hi, bestHi);
+			indexHi = vbslq_s32(mask, index, indexHi);
+		}
+
+		vst1q_s32(indices + i, indexLo);
+		vst1q_s32(indices + i + 4, indexHi);
+		vst1q_s32(errors + i, bestLo);
+		vst1q_s32(errors + i + 4, bestHi);
+	}
+#else
+	int32_t dr, dg, db, distance;
+
+	for (i = 0; i < 16; i += 1)
+	{
+		errors[i] = INT32_MAX;
+		indices[i] = 0;
+		for (k = 0; k < paletteCount; k += 1)
+		{
+			dr = r[i] - palette[k][0];
+			dg = g[i] - palette[k][1];
+			db = b[i] - palette[k][2];
+			distance = (dr * dr) + (dg * dg) + (db * db);
+			if (distance < errors[i])
+			{
+				errors[i] = distance;
+				indices[i] = k;
+			}
+		}
+	}
+#endif
+
+	*error = 0;
+	for (i = 0; i < 16; i += 1)
+	{
+		result |= ((uint32_t) indices[i]) << (i * 2);
+		*error += errors[i];
+	}
+	return result;
+}
+
+static inline uint16_t FNA3D_INTERNAL_Quantize565(const float *color)
+{
+	int32_t r = (int32_t) (SDL_max(SDL_min(color[0], 255.0f), 0.0f) * (31.0f / 255.0f) + 0.5f);
+	int32_t g = (int32_t) (SDL_max(SDL_min(color[1], 255.0f), 0.0f) * (63.0f / 255.0f) + 0.5f);
+	int32_t b = (int32_t) (SDL_max(SDL_min(color[2], 255.0f), 0.0f) * (31.0f / 255.0f) + 0.5f);
+	return (uint16_t) ((r << 11) | (g << 5) | b);
+}
+
+static inline void FNA3D_INTERNAL_Expand565(uint16_t color, int16_t *rgb)
+{
+	int16_t r = (color >> 11) & 0x1F;
+	int16_t g = (color >> 5) & 0x3F;
+	int16_t b = color & 0x1F;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+static void FNA3D_INTERNAL_BuildPalette(
+	uint16_t color0,
+	uint16_t color1,
+	uint8_t threeColor,
+	int16_t palette[4][3]
+) {
+	int32_t i;
+
+	FNA3D_INTERNAL_Expand565(color0, palette[0]);
+	FNA3D_INTERNAL_Expand565(color1, palette[1]);
+	for (i = 0; i < 3; i += 1)
+	{
+		if (threeColor)
+		{
+			palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+			palette[3][i] = 0;
+		}
+		else
+		{
+			palette[2][i] = ((2 * palette[0][i]) + palette[1][i]) / 3;
+			palette[3][i] = (palette[0][i] + (2 * palette[1][i])) / 3;
+		}
+	}
+}
+
+/* Encodes the color half of a block. The endpoints start from the bounding
+ * box of the texels, flipped along the diagonal that best fits them and
+ * inset to cut down on error from outliers. They are then refined with a
+ * least squares fit to the indices that box gave us.
+ */
+static void FNA3D_INTERNAL_CompressColorBlock(
+	const uint8_t *block,
+	uint8_t *out,
+	uint8_t allowAlpha
+) {
+	int16_t r[16], g[16], b[16];
+	uint8_t transparent[16];
+	int32_t opaqueCount = 0;
+	uint8_t threeColor;
+	float minColor[3], maxColor[3], mid[3], inset, swap;
+	uint16_t swapColor;
+	float covariance[3] = { 0.0f, 0.0f, 0.0f };
+	float endpoint0[3], endpoint1[3];
+	float weights[4], alpha, beta, aa, bb, ab, det;
+	float ax[3], bx[3];
+	int16_t palette[4][3];
+	uint16_t color0, color1, bestColor0 = 0, bestColor1 = 0;
+	uint32_t indices, bestIndices = 0, index;
+	int32_t error, bestError = INT32_MAX;
+	int32_t i, c, reference, iteration;
+
+	for (c = 0; c < 3; c += 1)
+	{
+		minColor[c] = 255.0f;
+		maxColor[c] = 0.0f;
+	}
+	for (i = 0; i < 16; i += 1)
+	{
+		r[i] = block[(i * 4) + 0];
+		g[i] = block[(i * 4) + 1];
+		b[i] = block[(i * 4) + 2];
+		transparent[i] = allowAlpha && (block[(i * 4) + 3] < 128);
+		if (!transparent[i])
+		{
+			minColor[0] = SDL_min(minColor[0], r[i]);
+			minColor[1] = SDL_min(minColor[1], g[i]);
+			minColor[2] = SDL_min(minColor[2], b[i]);
+			maxColor[0] = SDL_max(maxColor[0], r[i]);
+			maxColor[1] = SDL_max(maxColor[1], g[i]);
+			maxColor[2] = SDL_max(maxColor[2], b[i]);
+			opaqueCount += 1;
+		}
+	}
+
+	/* Punch-through alpha needs the 3-color mode, where index 3 is clear */
+	threeColor = (opaqueCount < 16);
+	if (opaqueCount == 0)
+	{
+		SDL_memset(out, '\0', 4);
+		SDL_memset(out + 4, 0xFF, 4);
+		return;
+	}
+
+	for (c = 0; c < 3; c += 1)
+	{
+		mid[c] = (minColor[c] + maxColor[c]) * 0.5f;
+	}
+	for (i = 0; i < 16; i += 1)
+	{
+		if (!transparent[i])
+		{
+			covariance[0] += (r[i] - mid[0]) * (r[i] - mid[0]);
+			covariance[1] += (r[i] - mid[0]) * (g[i] - mid[1]);
+			covariance[2] += (r[i] - mid[0]) * (b[i] - mid[2]);
+		}
+	}
+
+	/* Red is the reference axis, unless it's flat */
+	reference = (covariance[0] > 0.0f) ? 0 : 1;
+	if (reference == 0)
+	{
+		for (c = 1; c < 3; c += 1)
+		{
+			if (covariance[c] < 0.0f)
+			{
+				swap = minColor[c];
+				minColor[c] = maxColor[c];
+				maxColor[c] = swap;
+			}
+		}
+	}
+	else
+	{
+		covariance[2] = 0.0f;
+		for (i = 0; i < 16; i += 1)
+		{
+			if (!transparent[i])
+			{
+				covariance[2] += (g[i] - mid[1]) * (b[i] - mid[2]);
+			}
+		}
+		if (covariance[2] < 0.0f)
+		{
+			swap = minColor[2];
+			minColor[2] = maxColor[2];
+			maxColor[2] = swap;
+		}
+	}
+
+	for (c = 0; c < 3; c += 1)
+	{
+		inset = (maxColor[c] - minColor[c]) / 16.0f;
+		endpoint0[c] = maxColor[c] - inset;
+		endpoint1[c] = minColor[c] + inset;
+	}
+
+	/* How much of endpoint0 each index uses */
+	weights[0] = 1.0f;
+	weights[1] = 0.0f;
+	weights[2] = threeColor ? 0.5f : (2.0f / 3.0f);
+	weights[3] = threeColor ? 0.0f : (1.0f / 3.0f);
+
+	for (iteration = 0; iteration < 2; iteration += 1)
+	{
+		color0 = FNA3D_INTERNAL_Quantize565(endpoint0);
+		color1 = FNA3D_INTERNAL_Quantize565(endpoint1);
+		FNA3D_INTERNAL_BuildPalette(color0, color1, threeColor, palette);
+		indices = FNA3D_INTERNAL_PickIndices(
+			r,
+			g,
+			b,
+			palette,
+			threeColor ? 3 : 4,
+			&error
+		);
+
+		if (threeColor)
+		{
+			/* Transparent texels don't count towards the error */
+			for (i = 0; i < 16; i += 1)
+			{
+				if (transparent[i])
+				{
+					index = (indices >> (i * 2)) & 3;
+					error -= (
+						(r[i] - palette[index][0]) * (r[i] - palette[index][0]) +
+						(g[i] - palette[index][1]) * (g[i] - palette[index][1]) +
+						(b[i] - palette[index][2]) * (b[i] - palette[index][2])
+					);
+					indices |= 3 << (i * 2);
+				}
+			}
+		}
+
+		if (error < bestError)
+		{
+			bestError = error;
+			bestColor0 = color0;
+			bestColor1 = color1;
+			bestIndices = indices;
+		}
+		if (error == 0)
+		{
+			break;
+		}
+
+		/* Solve for the endpoints that best fit these indices */
+		aa = bb = ab = 0.0f;
+		for (c = 0; c < 3; c += 1)
+		{
+			ax[c] = 0.0f;
+			bx[c] = 0.0f;
+		}
+		for (i = 0; i < 16; i += 1)
+		{
+			if (transparent[i])
+			{
+				continue;
+			}
+			alpha = weights[(indices >> (i * 2)) & 3];
+			beta = 1.0f - alpha;
+			aa += alpha * alpha;
+			bb += beta * beta;
+			ab += alpha * beta;
+			ax[0] += alpha * r[i];
+			ax[1] += alpha * g[i];
+			ax[2] += alpha * b[i];
+			bx[0] += beta * r[i];
+			bx[1] += beta * g[i];
+			bx[2] += beta * b[i];
+		}
+		det = (aa * bb) - (ab * ab);
+		if (SDL_fabsf(det) < 0.0001f)
+		{
+			break;
+		}
+		for (c = 0; c < 3; c += 1)
+		{
+			endpoint0[c] = ((ax[c] * bb) - (bx[c] * ab)) / det;
+			endpoint1[c] = ((bx[c] * aa) - (ax[c] * ab)) / det;
+		}
+	}
+
+	/* The endpoint order is what selects the mode, so fix it up */
+	if (threeColor)
+	{
+		if (bestColor0 > bestColor1)
+		{
+			swapColor = bestColor0;
+			bestColor0 = bestColor1;
+			bestColor1 = swapColor;
+
+			/* 0 <-> 1, the midpoint and transparent indices stay */
+			bestIndices ^= (~bestIndices >> 1) & 0x55555555;
+		}
+	}
+	else if (bestColor0 < bestColor1)
+	{
+		swapColor = bestColor0;
+		bestColor0 = bestColor1;
+		bestColor1 = swapColor;
+
+		/* 0 <-> 1, 2 <-> 3 */
+		bestIndices ^= 0x55555555;
+	}
+	else if (bestColor0 == bestColor1)
+	{
+		/* Would be 3-color mode, but only index 0 is needed anyway */
+		bestIndices = 0;
+	}
+
+	out[0] = bestColor0 & 0xFF;
+	out[1] = bestColor0 >> 8;
+	out[2] = bestColor1 & 0xFF;
+	out[3] = bestColor1 >> 8;
+	out[4] = bestIndices & 0xFF;
+	out[5] = (bestIndices >> 8) & 0xFF;
+	out[6] = (bestIndices >> 16) & 0xFF;
+	out[7] = bestIndices >> 24;
+}
+
+/* Encodes the alpha half of a DXT5 block using the 8-alpha mode */
+static void FNA3D_INTERNAL_CompressAlphaBlock(
+	const uint8_t *block,
+	uint8_t *out
+) {
+	uint8_t minAlpha = 255, maxAlpha = 0;
+	int32_t range, t, i;
+	uint64_t indices = 0;
+
+	for (i = 0; i < 16; i += 1)
+	{
+		minAlpha = SDL_min(minAlpha, block[(i * 4) + 3]);
+		maxAlpha = SDL_max(maxAlpha, block[(i * 4) + 3]);
+	}
+
+	out[0] = maxAlpha;
+	out[1] = minAlpha;
+	range = maxAlpha - minAlpha;
+	if (range > 0)
+	{
+		for (i = 0; i < 16; i += 1)
+		{
+			/* t steps from alpha1 (index 1) up to alpha0 (index 0) */
+			t = (((block[(i * 4) + 3] - minAlpha) * 7) + (range / 2)) / range;
+			if (t == 7)
+			{
+				t = 0;
+			}
+			else if (t == 0)
+			{
+				t = 1;
+			}
+			else
+			{
+				t = 8 - t;
+			}
+			indices |= ((uint64_t) t) << (i * 3);
+		}
+	}
+	for (i = 0; i < 6; i += 1)
+	{
+		out[2 + i] = (indices >> (i * 8)) & 0xFF;
+	}
+}
+
+static int FNA3D_INTERNAL_CompressBand(void* data)
+{
+	FNA3D_Image_Band *band = (FNA3D_Image_Band*) data;
+	FNA3D_Image_Compressor *compressor = (FNA3D_Image_Compressor*) band->job;
+	const int32_t blockSize = (compressor->format == FNA3D_SURFACEFORMAT_DXT1) ? 8 : 16;
+	uint8_t block[64];
+	uint8_t *out;
+	int32_t blockX, blockY, x, y, srcX;
+	int64_t srcY;
+
+	for (blockY = band->start; blockY < band->end; blockY += 1)
+	{
+		out = compressor->dst + (
+			(int64_t) blockY * compressor->blocksWide * blockSize
+		);
+		for (blockX = 0; blockX < compressor->blocksWide; blockX += 1)
+		{
+			/* Edge blocks repeat the last row/column */
+			for (y = 0; y < 4; y += 1)
+			{
+				srcY = SDL_min((blockY * 4) + y, compressor->h - 1);
+				for (x = 0; x < 4; x += 1)
+				{
+					srcX = SDL_min((blockX * 4) + x, compressor->w - 1);
+					SDL_memcpy(
+						block + (((y * 4) + x) * 4),
+						compressor->src + (((srcY * compressor->w) + srcX) * 4),
+						4
+					);
+				}
+			}
+
+			if (compressor->format == FNA3D_SURFACEFORMAT_DXT1)
+			{
+				FNA3D_INTERNAL_CompressColorBlock(block, out, 1);
+			}
+			else
+			{
+				FNA3D_INTERNAL_CompressAlphaBlock(block, out);
+				FNA3D_INTERNAL_CompressColorBlock(block, out + 8, 0);
+			}
+			out += blockSize;
+		}
+	}
+	return 0;
+}
+
+uint8_t FNA3D_Image_CompressDXT(
+	uint8_t *data,
+	int32_t w,
+	int32_t h,
+	int32_t format,
+	uint8_t *dst,
+	int32_t dstLength
+) {
+	FNA3D_Image_Compressor compressor;
+	int32_t blocksHigh, bandCount = 1;
+	int64_t required;
+
+	if (	(	format != FNA3D_SURFACEFORMAT_DXT1 &&
+			format != FNA3D_SURFACEFORMAT_DXT5	) ||
+		w <= 0 ||
+		h <= 0	)
+	{
+		return 0;
+	}
+
+	/* LevelSize works in int64, large w and h would wrap around in int32 */
+	required = FNA3D_INTERNAL_LevelSize(format, w, h);
+	if (required > dstLength)
+	{
+		return 0;
+	}
+
+	compressor.src = data;
+	compressor.w = w;
+	compressor.h = h;
+	compressor.dst = dst;
+	compressor.format = format;
+	compressor.blocksWide = (w + 3) / 4;
+	blocksHigh = (h + 3) / 4;
+
+	/* Blocks are independent, so rows of them can go to any thread */
+	if (compressor.blocksWide * blocksHigh >= 64 * 64)
+	{
+		bandCount = SDL_min(SDL_GetCPUCount(), blocksHigh / 8);
+	}
+	FNA3D_INTERNAL_RunBands(
+		FNA3D_INTERNAL_CompressBand,
+		&compressor,
+		blocksHigh,
+		bandCount
+	);
+	return 1;
+}
+
+/* Image Write API */
+
+void FNA3D_Image_SavePNG(
+	FNA3D_Image_WriteFunc writeFunc,
+	void* context,
+	int32_t srcW,
+	int32_t srcH,
+	int32_t dstW,
+	int32_t dstH,
+	uint8_t *data
+) {
+	uint8_t *pixels;
+	uint8_t scale = (srcW != dstW) || (srcH != dstH);
+
+	/* Only resample to scale, the format is already correct */
+	if (scale)
+	{
+		pixels = (uint8_t*) SDL_malloc(dstW * dstH * 4);
+		if (	pixels == NULL ||
+			!FNA3D_INTERNAL_Resample(
+				data,
+				srcW,
+				srcH,
+				srcW * 4,
+				pixels,
+				dstW,
+				dstH,
+				dstW * 4,
+				FNA3D_IMAGE_FILTER_LANCZOS,
+				FNA3D_IMAGE_OUTPUT_PLAIN
+			)	)
+		{
+			SDL_free(pixels);
+			return;
+		}
+	}
+	else
+	{
+		pixels = data;
+	}
+
+	/* Write the image data, finally. */
+	stbi_write_png_to_func(
+		writeFunc,
+		context,
+		dstW,
+		dstH,
+		4,
+		pixels,
+		dstW * 4
+	);
+
+	/* Clean up. We out. */
+	if (scale)
+	{
+		SDL_free(pixels);
+	}
+}
+
+void FNA3D_Image_SaveJPG(
+	FNA3D_Image_WriteFunc writeFunc,
+	void* context,
+	int32_t srcW,
+	int32_t srcH,
+	int32_t dstW,
+	int32_t dstH,
+	uint8_t *data,
+	int32_t quality
+) {
+	uint8_t *pixels;
+	uint8_t scale = (srcW != dstW) || (srcH != dstH);
+
+	/* Only resample to scale, stb_image_write skips the alpha for us */
+	if (scale)
+	{
+		pixels = (uint8_t*) SDL_malloc(dstW * dstH * 4);
+		if (	pixels == NULL ||
+			!FNA3D_INTERNAL_Resample(
+				data,
+				srcW,
+				srcH,
+				srcW * 4,
+				pixels,
+				dstW,
+				dstH,
+				dstW * 4,
+				FNA3D_IMAGE_FILTER_LANCZOS,
+				FNA3D_IMAGE_OUTPUT_PLAIN
+			)	)
+		{
+			SDL_free(pixels);
+			return;
+		}
+	}
+	else
+	{
+		pixels = data;
+	}
+
+	/* Write the image, finally. */
+	stbi_write_jpg_to_func(
+		writeFunc,
+		context,
+		dstW,
+		dstH,
+		4,
+		pixels,
+		quality
+	);
+
+	/* Clean up. We out. */
+	if (scale)
+	{
+		SDL_free(pixels);
+	}
 }
 
 /* vim: set noexpandtab shiftwidth=8 tabstop=8: */
@@ -61,6 +61,312 @@
 #define STB_DS_IMPLEMENTATION
 #include "stb_ds.h"
 
+/* Packed Hash Map */
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PACKEDHASHMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+#define GROUP_SIZE		16
+#define INITIAL_CAPACITY	64 /* Must be a power of two, >= GROUP_SIZE */
+#define TOMBSTONE		0x01 /* Removed; not empty, but never a match */
+
+static uint64_t PackedHashMap_Hash(
+	const uint64_t *key,
+	uint32_t keyWords
+) {
+	/* The keys are mostly packed bitfields, so mix them up a bit */
+	uint64_t result = 0;
+	uint32_t i;
+	for (i = 0; i < keyWords; i += 1)
+	{
+		result = (result ^ key[i]) * 0x9E3779B97F4A7C15ULL;
+	}
+	return result ^ (result >> 29);
+}
+
+static uint8_t PackedHashMap_Tag(uint64_t hash)
+{
+	/* High bit is always set, so 0 can mean "empty" and 1 "removed" */
+	return (uint8_t) (0x80 | (hash >> 57));
+}
+
+static uint32_t PackedHashMap_MatchGroup(
+	const uint8_t *group,
+	uint8_t tag
+) {
+#ifdef PACKEDHASHMAP_SSE2
+	__m128i tags = _mm_loadu_si128((const __m128i*) group);
+	return (uint32_t) _mm_movemask_epi8(
+		_mm_cmpeq_epi8(tags, _mm_set1_epi8((char) tag))
+	);
+#else
+	uint32_t result = 0;
+	int32_t i;
+	for (i = 0; i < GROUP_SIZE; i += 1)
+	{
+		result |= (uint32_t) (group[i] == tag) << i;
+	}
+	return result;
+#endif
+}
+
+static uint8_t PackedHashMap_KeysEqual(
+	const uint64_t *a,
+	const uint64_t *b,
+	uint32_t keyWords
+) {
+	uint32_t i;
+	for (i = 0; i < keyWords; i += 1)
+	{
+		if (a[i] != b[i])
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Returns the slot holding the key, or the empty slot it belongs in */
+static uint32_t PackedHashMap_FindSlot(
+	PackedHashMap *map,
+	const uint64_t *key,
+	uint64_t hash
+) {
+	uint8_t tag = PackedHashMap_Tag(hash);
+	uint32_t groupMask = (map->capacity / GROUP_SIZE) - 1;
+	uint32_t group = (uint32_t) hash & groupMask;
+	uint32_t base, slot, matches, empty;
+
+	/* The map is never full, so this always finds an empty slot */
+	while (1)
+	{
+		base = group * GROUP_SIZE;
+		matches = PackedHashMap_MatchGroup(&map->tags[base], tag);
+		slot = base;
+		while (matches != 0)
+		{
+			if (	(matches & 1) &&
+				PackedHashMap_KeysEqual(
+					&map->keys[slot * map->keyWords],
+					key,
+					map->keyWords
+				)	)
+			{
+				return slot;
+			}
+			matches >>= 1;
+			slot += 1;
+		}
+
+		empty = PackedHashMap_MatchGroup(&map->tags[base], 0);
+		if (empty != 0)
+		{
+			slot = base;
+			while (!(empty & 1))
+			{
+				empty >>= 1;
+				slot += 1;
+			}
+			return slot;
+		}
+
+		group = (group + 1) & groupMask;
+	}
+}
+
+static void PackedHashMap_Allocate(PackedHashMap *map, uint32_t capacity)
+{
+	map->capacity = capacity;
+	map->keys = (uint64_t*) SDL_malloc(
+		capacity * map->keyWords * sizeof(uint64_t)
+	);
+	map->values = (uint64_t*) SDL_malloc(capacity * sizeof(uint64_t));
+	map->tags = (uint8_t*) SDL_malloc(capacity);
+	SDL_memset(map->tags, '\0', capacity);
+	map->count = 0;
+	map->tombstones = 0;
+	map->lastHit = 0;
+}
+
+static void PackedHashMap_Grow(PackedHashMap *map)
+{
+	uint64_t *oldKeys = map->keys;
+	uint64_t *oldValues = map->values;
+	uint8_t *oldTags = map->tags;
+	uint32_t oldCapacity = map->capacity;
+	uint32_t newCapacity = oldCapacity;
+	uint32_t i;
+
+	/* If it's mostly tombstones that filled the map, rehash in place */
+	if ((map->count + 1) * 16 > oldCapacity * 7)
+	{
+		newCapacity *= 2;
+	}
+
+	PackedHashMap_Allocate(map, newCapacity);
+	for (i = 0; i < oldCapacity; i += 1)
+	{
+		if (oldTags[i] & 0x80)
+		{
+			PackedHashMap_PutHandle(
+				map,
+				&oldKeys[i * map->keyWords],
+				oldValues[i]
+			);
+		}
+	}
+
+	SDL_free(oldKeys);
+	SDL_free(oldValues);
+	SDL_free(oldTags);
+}
+
+void PackedHashMap_Init(PackedHashMap *map, uint32_t keyWords)
+{
+	map->keyWords = keyWords;
+	PackedHashMap_Allocate(map, INITIAL_CAPACITY);
+}
+
+void PackedHashMap_Free(PackedHashMap *map)
+{
+	SDL_free(map->keys);
+	SDL_free(map->values);
+	SDL_free(map->tags);
+	map->keys = NULL;
+	map->values = NULL;
+	map->tags = NULL;
+	map->capacity = 0;
+	map->count = 0;
+	map->tombstones = 0;
+	map->lastHit = 0;
+}
+
+uint64_t PackedHashMap_GetHandle(PackedHashMap *map, const uint64_t *key)
+{
+	uint32_t slot;
+
+	/* Same thing as last time? */
+	if (	(map->tags[map->lastHit] & 0x80) &&
+		PackedHashMap_KeysEqual(
+			&map->keys[map->lastHit * map->keyWords],
+			key,
+			map->keyWords
+		)	)
+	{
+		return map->values[map->lastHit];
+	}
+
+	slot = PackedHashMap_FindSlot(
+		map,
+		key,
+		PackedHashMap_Hash(key, map->keyWords)
+	);
+	if (map->tags[slot] == 0)
+	{
+		return 0;
+	}
+	map->lastHit = slot;
+	return map->values[slot];
+}
+
+void PackedHashMap_PutHandle(
+	PackedHashMap *map,
+	const uint64_t *key,
+	uint64_t value
+) {
+	uint64_t hash;
+	uint32_t slot;
+
+	/* Keep the load factor under 7/8 so probes stay short */
+	if ((map->count + map->tombstones + 1) * 8 > map->capacity * 7)
+	{
+		PackedHashMap_Grow(map);
+	}
+
+	hash = PackedHashMap_Hash(key, map->keyWords);
+	slot = PackedHashMap_FindSlot(map, key, hash);
+	if (map->tags[slot] == 0)
+	{
+		map->tags[slot] = PackedHashMap_Tag(hash);
+		SDL_memcpy(
+			&map->keys[slot * map->keyWords],
+			key,
+			map->keyWords * sizeof(uint64_t)
+		);
+		map->count += 1;
+	}
+	map->values[slot] = value;
+	map->lastHit = slot;
+}
+
+void PackedHashMap_Remove(PackedHashMap *map, const uint64_t *key)
+{
+	uint32_t slot = PackedHashMap_FindSlot(
+		map,
+		key,
+		PackedHashMap_Hash(key, map->keyWords)
+	);
+	if (map->tags[slot] == 0)
+	{
+		return;
+	}
+
+	/* Probes can't stop here, they may need to get past this slot */
+	map->tags[slot] = TOMBSTONE;
+	map->count -= 1;
+	map->tombstones += 1;
+}
+
+uint64_t PackedHashMap_GetStateHandle(PackedHashMap *map, StateHash key)
+{
+	uint64_t packed[2];
+	packed[0] = key.a;
+	packed[1] = key.b;
+	return PackedHashMap_GetHandle(map, packed);
+}
+
+void PackedHashMap_PutStateHandle(
+	PackedHashMap *map,
+	StateHash key,
+	uint64_t value
+) {
+	uint64_t packed[2];
+	packed[0] = key.a;
+	packed[1] = key.b;
+	PackedHashMap_PutHandle(map, packed, value);
+}
+
+void* PackedHashMap_Get(PackedHashMap *map, const uint64_t *key)
+{
+	return (void*) (size_t) PackedHashMap_GetHandle(map, key);
+}
+
+void PackedHashMap_Put(PackedHashMap *map, const uint64_t *key, void *value)
+{
+	PackedHashMap_PutHandle(map, key, (uint64_t) (size_t) value);
+}
+
+void* PackedHashMap_GetState(PackedHashMap *map, StateHash key)
+{
+	return (void*) (size_t) PackedHashMap_GetStateHandle(map, key);
+}
+
+void PackedHashMap_PutState(PackedHashMap *map, StateHash key, void *value)
+{
+	PackedHashMap_PutStateHandle(map, key, (uint64_t) (size_t) value);
+}
+
+void* PackedHashMap_Value(PackedHashMap *map, uint32_t slot)
+{
+	return (void*) (size_t) map->values[slot];
+}
+
+#undef GROUP_SIZE
+#undef INITIAL_CAPACITY
+#undef TOMBSTONE
+
 /* State Hashing */
 
 #define FLOAT_TO_UINT64(f) (uint64_t) *((uint32_t*) &f)
@@ -228,6 +534,371 @@ uint64_t GetVertexBufferBindingsHash(
 	return result;
 }
 
+uint64_t GetVertexDeclarationShaderFactor(
+	FNA3D_VertexDeclaration declaration
+) {
+	uint64_t result = HASH_FACTOR;
+	int32_t i;
+	for (i = 0; i < declaration.elementCount; i += 1)
+	{
+		result *= HASH_FACTOR;
+	}
+	return result;
+}
+
+uint64_t GetVertexDeclarationObjectsHash(
+	FNA3D_VertexBufferBinding *bindings,
+	FNA3D_VertexDeclarationObject **declarations,
+	int32_t numBindings,
+	void* vertexShader
+) {
+	uint64_t shader = (uint64_t) (size_t) vertexShader;
+	uint64_t result = shader;
+	int32_t i;
+	if (declarations == NULL)
+	{
+		return GetVertexBufferBindingsHash(
+			bindings,
+			numBindings,
+			vertexShader
+		);
+	}
+	for (i = 0; i < numBindings; i += 1)
+	{
+		result = result * HASH_FACTOR + (
+			(uint64_t) bindings[i].instanceFrequency
+		);
+		result = result * HASH_FACTOR + (
+			shader * declarations[i]->shaderFactor +
+			declarations[i]->hash
+		);
+	}
+	return result;
+}
+
 #undef HASH_FACTOR
 
+/* Shader Translation Cache */
+
+typedef struct ShaderCacheEntry
+{
+	uint8_t *key; /* Everything that went into the hash, for collisions */
+	size_t keyLength;
+	uint64_t packed[2];
+	void *shader;
+	int32_t users; /* References handed out, not counting the cache's own */
+} ShaderCacheEntry;
+
+/* Per thread, so devices of different drivers can compile at the same time */
+static SDL_SpinLock currentShaderCacheLock = 0;
+static SDL_TLSID currentShaderCache = 0;
+
+static inline ShaderCache* ShaderCache_GetCurrent(void)
+{
+	return (ShaderCache*) SDL_TLSGet(currentShaderCache);
+}
+
+static ShaderCacheEntry* ShaderCache_FindShader(
+	ShaderCache *cache,
+	void *shader
+) {
+	uint64_t key = (uint64_t) (size_t) shader;
+	return (ShaderCacheEntry*) PackedHashMap_Get(&cache->shaders, &key);
+}
+
+static uint64_t ShaderCache_Hash(const uint8_t *data, size_t length)
+{
+	/* FNV-1a, the key is mostly bytecode */
+	uint64_t result = 0xCBF29CE484222325ULL;
+	size_t i;
+	for (i = 0; i < length; i += 1)
+	{
+		result = (result ^ data[i]) * 0x00000100000001B3ULL;
+	}
+	return result;
+}
+
+static void ShaderCache_WriteUInt32(uint8_t **ptr, uint32_t val)
+{
+	SDL_memcpy(*ptr, &val, sizeof(val));
+	*ptr += sizeof(val);
+}
+
+static uint8_t* ShaderCache_BuildKey(
+	const char *mainfn,
+	const unsigned char *tokenbuf,
+	const unsigned int bufsize,
+	const MOJOSHADER_swizzle *swiz,
+	const unsigned int swizcount,
+	const MOJOSHADER_samplerMap *smap,
+	const unsigned int smapcount,
+	size_t *keyLength
+) {
+	uint8_t *result, *ptr;
+	size_t mainfnLength = (mainfn != NULL) ? SDL_strlen(mainfn) + 1 : 0;
+	unsigned int i;
+
+	/* mainfn, bytecode, then each swizzle and sampler map field by field */
+	*keyLength = (
+		sizeof(uint32_t) + mainfnLength +
+		sizeof(uint32_t) + bufsize +
+		sizeof(uint32_t) + (swizcount * (sizeof(int32_t) * 2 + 4)) +
+		sizeof(uint32_t) + (smapcount * (sizeof(int32_t) * 2))
+	);
+	result = (uint8_t*) SDL_malloc(*keyLength);
+	ptr = result;
+
+	ShaderCache_WriteUInt32(&ptr, (uint32_t) mainfnLength);
+	if (mainfnLength > 0)
+	{
+		SDL_memcpy(ptr, mainfn, mainfnLength);
+		ptr += mainfnLength;
+	}
+	ShaderCache_WriteUInt32(&ptr, bufsize);
+	SDL_memcpy(ptr, tokenbuf, bufsize);
+	ptr += bufsize;
+	ShaderCache_WriteUInt32(&ptr, swizcount);
+	for (i = 0; i < swizcount; i += 1)
+	{
+		ShaderCache_WriteUInt32(&ptr, swiz[i].usage);
+		ShaderCache_WriteUInt32(&ptr, swiz[i].index);
+		SDL_memcpy(ptr, swiz[i].swizzles, 4);
+		ptr += 4;
+	}
+	ShaderCache_WriteUInt32(&ptr, smapcount);
+	for (i = 0; i < smapcount; i += 1)
+	{
+		ShaderCache_WriteUInt32(&ptr, smap[i].index);
+		ShaderCache_WriteUInt32(&ptr, smap[i].type);
+	}
+
+	SDL_assert((size_t) (ptr - result) == *keyLength);
+	return result;
+}
+
+void ShaderCache_Init(
+	ShaderCache *cache,
+	MOJOSHADER_compileShaderFunc compileShader,
+	MOJOSHADER_shaderAddRefFunc shaderAddRef,
+	MOJOSHADER_deleteShaderFunc deleteShader
+) {
+	SDL_AtomicLock(&currentShaderCacheLock);
+	if (currentShaderCache == 0)
+	{
+		currentShaderCache = SDL_TLSCreate();
+	}
+	SDL_AtomicUnlock(&currentShaderCacheLock);
+
+	/* Key is the hash and the length of what was hashed */
+	PackedHashMap_Init(&cache->entries, 2);
+	PackedHashMap_Init(&cache->shaders, 1);
+	cache->compileShader = compileShader;
+	cache->shaderAddRef = shaderAddRef;
+	cache->deleteShader = deleteShader;
+}
+
+void ShaderCache_Free(ShaderCache *cache)
+{
+	ShaderCacheEntry *entry;
+	uint32_t i;
+
+	/* Effects still holding these keep them alive, refcounting handles it */
+	for (i = 0; i < cache->entries.capacity; i += 1)
+	{
+		if (!(cache->entries.tags[i] & 0x80))
+		{
+			continue;
+		}
+		entry = (ShaderCacheEntry*) PackedHashMap_Value(&cache->entries, i);
+		cache->deleteShader(entry->shader);
+		SDL_free(entry->key);
+		SDL_free(entry);
+	}
+	PackedHashMap_Free(&cache->entries);
+	PackedHashMap_Free(&cache->shaders);
+
+	if (ShaderCache_GetCurrent() == cache)
+	{
+		SDL_TLSSet(currentShaderCache, NULL, NULL);
+	}
+}
+
+void ShaderCache_MakeCurrent(ShaderCache *cache)
+{
+	SDL_TLSSet(currentShaderCache, cache, NULL);
+}
+
+void MOJOSHADERCALL ShaderCache_ShaderAddRef(void *shader)
+{
+	ShaderCache *cache = ShaderCache_GetCurrent();
+	ShaderCacheEntry *entry;
+
+	SDL_assert(cache != NULL);
+
+	entry = ShaderCache_FindShader(cache, shader);
+	if (entry != NULL)
+	{
+		entry->users += 1;
+	}
+	cache->shaderAddRef(shader);
+}
+
+void MOJOSHADERCALL ShaderCache_DeleteShader(void *shader)
+{
+	ShaderCache *cache = ShaderCache_GetCurrent();
+	ShaderCacheEntry *entry;
+	uint64_t key;
+
+	SDL_assert(cache != NULL);
+
+	entry = ShaderCache_FindShader(cache, shader);
+	cache->deleteShader(shader);
+	if (entry == NULL)
+	{
+		return;
+	}
+
+	/* Only the cache's own reference is left, so nobody can use it now */
+	entry->users -= 1;
+	if (entry->users == 0)
+	{
+		key = (uint64_t) (size_t) shader;
+		PackedHashMap_Remove(&cache->entries, entry->packed);
+		PackedHashMap_Remove(&cache->shaders, &key);
+		cache->deleteShader(shader);
+		SDL_free(entry->key);
+		SDL_free(entry);
+	}
+}
+
+void* MOJOSHADERCALL ShaderCache_CompileShader(
+	const char *mainfn,
+	const unsigned char *tokenbuf,
+	const unsigned int bufsize,
+	const MOJOSHADER_swizzle *swiz,
+	const unsigned int swizcount,
+	const MOJOSHADER_samplerMap *smap,
+	const unsigned int smapcount
+) {
+	ShaderCache *cache = ShaderCache_GetCurrent();
+	ShaderCacheEntry *entry;
+	uint8_t *key;
+	size_t keyLength;
+	uint64_t packed[2];
+	uint64_t shaderKey;
+	void *result;
+
+	SDL_assert(cache != NULL);
+
+	key = ShaderCache_BuildKey(
+		mainfn,
+		tokenbuf,
+		bufsize,
+		swiz,
+		swizcount,
+		smap,
+		smapcount,
+		&keyLength
+	);
+	packed[0] = ShaderCache_Hash(key, keyLength);
+	packed[1] = (uint64_t) keyLength;
+
+	entry = (ShaderCacheEntry*) PackedHashMap_Get(&cache->entries, packed);
+	if (entry != NULL)
+	{
+		if (SDL_memcmp(entry->key, key, keyLength) == 0)
+		{
+			SDL_free(key);
+			cache->shaderAddRef(entry->shader);
+			entry->users += 1;
+			return entry->shader;
+		}
+
+		/* Hash collision, just don't cache this one */
+		SDL_free(key);
+		return cache->compileShader(
+			mainfn,
+			tokenbuf,
+			bufsize,
+			swiz,
+			swizcount,
+			smap,
+			smapcount
+		);
+	}
+
+	result = cache->compileShader(
+		mainfn,
+		tokenbuf,
+		bufsize,
+		swiz,
+		swizcount,
+		smap,
+		smapcount
+	);
+	if (result == NULL)
+	{
+		/* Let the effect report the error, and try again next time */
+		SDL_free(key);
+		return NULL;
+	}
+
+	/* One reference for the effect, one for the cache */
+	cache->shaderAddRef(result);
+	entry = (ShaderCacheEntry*) SDL_malloc(sizeof(ShaderCacheEntry));
+	entry->key = key;
+	entry->keyLength = keyLength;
+	entry->packed[0] = packed[0];
+	entry->packed[1] = packed[1];
+	entry->shader = result;
+	entry->users = 1;
+	PackedHashMap_Put(&cache->entries, packed, entry);
+	shaderKey = (uint64_t) (size_t) result;
+	PackedHashMap_Put(&cache->shaders, &shaderKey, entry);
+	return result;
+}
+
+void* ShaderCache_LookupShader(
+	const char *mainfn,
+	const unsigned char *tokenbuf,
+	const unsigned int bufsize,
+	const MOJOSHADER_swizzle *swiz,
+	const unsigned int swizcount,
+	const MOJOSHADER_samplerMap *smap,
+	const unsigned int smapcount
+) {
+	ShaderCache *cache = ShaderCache_GetCurrent();
+	ShaderCacheEntry *entry;
+	uint8_t *key;
+	size_t keyLength;
+	uint64_t packed[2];
+
+	SDL_assert(cache != NULL);
+
+	key = ShaderCache_BuildKey(
+		mainfn,
+		tokenbuf,
+		bufsize,
+		swiz,
+		swizcount,
+		smap,
+		smapcount,
+		&keyLength
+	);
+	packed[0] = ShaderCache_Hash(key, keyLength);
+	packed[1] = (uint64_t) keyLength;
+
+	entry = (ShaderCacheEntry*) PackedHashMap_Get(&cache->entries, packed);
+	if (	entry == NULL ||
+		SDL_memcmp(entry->key, key, keyLength) != 0	)
+	{
+		SDL_free(key);
+		return NULL;
+	}
+	SDL_free(key);
+	cache->shaderAddRef(entry->shader);
+	entry->users += 1;
+	return entry->shader;
+}
+
 /* vim: set noexpandtab shiftwidth=8 tabstop=8: */
@@ -27,25 +27,69 @@
 #ifndef FNA3D_PIPELINECACHE_H
 #define FNA3D_PIPELINECACHE_H
 
+#include "mojoshader.h"
 #include "FNA3D.h"
 
+#include <SDL.h>
+
 typedef struct StateHash
 {
 	uint64_t a;
 	uint64_t b;
 } StateHash;
 
-typedef struct StateHashMap
+/* Open-addressing map for the per-draw state and pipeline caches.
+ *
+ * Keys are a fixed number of 64-bit words, set when the map is initialized.
+ * Callers pack their keys into words explicitly, so no struct padding ever
+ * ends up in a key. Each slot also has a one-byte tag (0 for empty, otherwise
+ * 7 bits of the key hash), and lookups scan 16 tags at a time before touching
+ * any keys. The last slot that was hit is checked first, since draws tend to
+ * reuse the same state over and over.
+ *
+ * The state caches never remove anything and only grow until the renderer is
+ * destroyed. Removed slots are tagged 1 rather than emptied so probes still
+ * get past them; live slots always have the tag's high bit set. To walk every
+ * value, loop over capacity, skip slots without the high bit and read the rest
+ * with PackedHashMap_Value.
+ *
+ * Values are 64 bits wide so that Vulkan's non-dispatchable handles, which
+ * are plain integers on 32-bit targets, fit without truncation. Pointers go
+ * through the plain Get/Put functions, handles through the Handle ones.
+ */
+typedef struct PackedHashMap
 {
-	StateHash key;
-	void* value;
-} StateHashMap;
+	uint64_t *keys;
+	uint64_t *values;
+	uint8_t *tags;
+	uint32_t keyWords;
+	uint32_t capacity;
+	uint32_t count;
+	uint32_t tombstones;
+	uint32_t lastHit;
+} PackedHashMap;
 
-typedef struct UInt64HashMap
-{
-	uint64_t key;
-	void* value;
-} UInt64HashMap;
+void PackedHashMap_Init(PackedHashMap *map, uint32_t keyWords);
+void PackedHashMap_Free(PackedHashMap *map);
+uint64_t PackedHashMap_GetHandle(PackedHashMap *map, const uint64_t *key);
+void PackedHashMap_PutHandle(
+	PackedHashMap *map,
+	const uint64_t *key,
+	uint64_t value
+);
+void PackedHashMap_Remove(PackedHashMap *map, const uint64_t *key);
+uint64_t PackedHashMap_GetStateHandle(PackedHashMap *map, StateHash key);
+void PackedHashMap_PutStateHandle(
+	PackedHashMap *map,
+	StateHash key,
+	uint64_t value
+);
+
+void* PackedHashMap_Get(PackedHashMap *map, const uint64_t *key);
+void PackedHashMap_Put(PackedHashMap *map, const uint64_t *key, void *value);
+void* PackedHashMap_GetState(PackedHashMap *map, StateHash key);
+void PackedHashMap_PutState(PackedHashMap *map, StateHash key, void *value);
+void* PackedHashMap_Value(PackedHashMap *map, uint32_t slot);
 
 StateHash GetBlendStateHash(FNA3D_BlendState blendState);
 StateHash GetDepthStencilStateHash(FNA3D_DepthStencilState dsState);
@@ -61,6 +105,88 @@ uint64_t GetVertexBufferBindingsHash(
 	void* vertexShader
 );
 
+/* Interned Vertex Declarations */
+
+/* The declaration hash is linear in its vertex shader seed, so it is split into
+ * a shader-independent hash and the factor the shader gets multiplied by.
+ * (shader * shaderFactor + hash) is exactly GetVertexDeclarationHash.
+ */
+struct FNA3D_VertexDeclarationObject
+{
+	FNA3D_VertexDeclaration declaration; /* Owns its elements */
+	uint64_t id;
+	uint64_t hash;
+	uint64_t shaderFactor;
+	SDL_atomic_t refcount;
+	struct FNA3D_VertexDeclarationObject *next;
+};
+
+uint64_t GetVertexDeclarationShaderFactor(
+	FNA3D_VertexDeclaration declaration
+);
+uint64_t GetVertexDeclarationObjectsHash(
+	FNA3D_VertexBufferBinding *bindings,
+	FNA3D_VertexDeclarationObject **declarations,
+	int32_t numBindings,
+	void* vertexShader
+);
+
+/* Shader Translation Cache */
+
+/* MojoShader translates every shader in an effect on its own, and effects tend
+ * to share shaders with each other (not to mention games that load the same
+ * effect more than once). This sits in front of the backend's compileShader,
+ * keyed by the bytecode and everything else that affects the translation, and
+ * hands out new references to shaders it has already seen. The cache keeps one
+ * reference of its own to each shader, and lets go of the shader once that is
+ * the only one left, so effects should use ShaderCache_ShaderAddRef and
+ * ShaderCache_DeleteShader as their shaderAddRef/deleteShader.
+ *
+ * The callbacks get no userdata, so the cache to use is made current on the
+ * calling thread around MOJOSHADER_compileEffect, cloneEffect and deleteEffect,
+ * with the shader context locked.
+ *
+ * ShaderCache_LookupShader only hands out shaders already in the cache, and
+ * never calls into the backend's compileShader. It returns NULL on a miss.
+ */
+typedef struct ShaderCache
+{
+	PackedHashMap entries;
+	PackedHashMap shaders; /* Shader pointer -> entry, for refcounting */
+	MOJOSHADER_compileShaderFunc compileShader;
+	MOJOSHADER_shaderAddRefFunc shaderAddRef;
+	MOJOSHADER_deleteShaderFunc deleteShader;
+} ShaderCache;
+
+void ShaderCache_Init(
+	ShaderCache *cache,
+	MOJOSHADER_compileShaderFunc compileShader,
+	MOJOSHADER_shaderAddRefFunc shaderAddRef,
+	MOJOSHADER_deleteShaderFunc deleteShader
+);
+void ShaderCache_Free(ShaderCache *cache);
+void ShaderCache_MakeCurrent(ShaderCache *cache);
+void MOJOSHADERCALL ShaderCache_ShaderAddRef(void *shader);
+void MOJOSHADERCALL ShaderCache_DeleteShader(void *shader);
+void* MOJOSHADERCALL ShaderCache_CompileShader(
+	const char *mainfn,
+	const unsigned char *tokenbuf,
+	const unsigned int bufsize,
+	const MOJOSHADER_swizzle *swiz,
+	const unsigned int swizcount,
+	const MOJOSHADER_samplerMap *smap,
+	const unsigned int smapcount
+);
+void* ShaderCache_LookupShader(
+	const char *mainfn,
+	const unsigned char *tokenbuf,
+	const unsigned int bufsize,
+	const MOJOSHADER_swizzle *swiz,
+	const unsigned int swizcount,
+	const MOJOSHADER_samplerMap *smap,
+	const unsigned int smapcount
+);
+
 #endif /* FNA3D_PIPELINECACHE_H */
 
 /* vim: set noexpandtab shiftwidth=8 tabstop=8: */